@@ -0,0 +1,228 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench/bench.h"
+
+static int compare_double(const void *a, const void *b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+
+  return (da > db) - (da < db);
+}
+
+void bench_init(struct bench_st *bench)
+{
+  const char *latency = getenv("BENCH_LATENCY_MS");
+  const char *throttle = getenv("BENCH_THROTTLE");
+  const char *alloc_stats = getenv("BENCH_ALLOC_STATS");
+
+  bench->alloc_stats = alloc_stats && !strcmp(alloc_stats, "1") &&
+                       !ms3_alloc_stats_enable();
+  ms3_library_init();
+  bench->mock = NULL;
+  bench->latency_ms = latency ? (uint32_t)strtoul(latency, NULL, 10) : 0;
+
+  if (getenv("S3KEY"))
+  {
+    bench->bucket = getenv("S3BUCKET");
+
+    if (!bench->bucket)
+    {
+      fprintf(stderr, "S3BUCKET is needed with S3KEY\n");
+      exit(77);
+    }
+
+    return;
+  }
+
+  bench->bucket = "bench";
+  bench->mock = s3mock_start();
+
+  if (!bench->mock)
+  {
+    fprintf(stderr, "Could not start the mock S3 server\n");
+    exit(77);
+  }
+
+  s3mock_set_latency(bench->mock, bench->latency_ms);
+
+  if (throttle)
+  {
+    s3mock_set_throttle(bench->mock, strtoull(throttle, NULL, 10));
+  }
+}
+
+void bench_deinit(struct bench_st *bench)
+{
+  if (bench->mock)
+  {
+    s3mock_stop(bench->mock);
+  }
+
+  ms3_library_deinit();
+}
+
+ms3_st *bench_connect(struct bench_st *bench)
+{
+  ms3_st *ms3;
+  const char *s3usehttp = getenv("S3USEHTTP");
+  const char *s3noverify = getenv("S3NOVERIFY");
+  const char *s3port = getenv("S3PORT");
+
+  if (bench->mock)
+  {
+    ms3 = s3mock_connect(bench->mock);
+  }
+  else
+  {
+    ms3 = ms3_init(getenv("S3KEY"), getenv("S3SECRET"),
+                   getenv("S3REGION"), getenv("S3HOST"));
+
+    if (ms3 && s3noverify && !strcmp(s3noverify, "1"))
+    {
+      ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+    }
+
+    if (ms3 && s3usehttp && !strcmp(s3usehttp, "1"))
+    {
+      ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+    }
+
+    if (ms3 && s3port)
+    {
+      int port = atoi(s3port);
+      ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+    }
+  }
+
+  if (!ms3)
+  {
+    fprintf(stderr, "Could not create a handle\n");
+    exit(1);
+  }
+
+  return ms3;
+}
+
+size_t bench_iterations(size_t default_iterations)
+{
+  const char *iterations = getenv("BENCH_ITERATIONS");
+
+  if (iterations && strtoull(iterations, NULL, 10) > 0)
+  {
+    return (size_t)strtoull(iterations, NULL, 10);
+  }
+
+  return default_iterations;
+}
+
+double bench_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static uint64_t allocation_count(struct bench_st *bench)
+{
+  ms3_alloc_stats_st total;
+
+  if (!bench->alloc_stats)
+  {
+    return 0;
+  }
+
+  ms3_alloc_stats(NULL, 0, &total);
+
+  return total.allocations;
+}
+
+void bench_start(struct bench_st *bench, struct bench_result_st *result)
+{
+  result->allocations_start = allocation_count(bench);
+  result->start = bench_now();
+}
+
+void bench_stop(struct bench_st *bench, struct bench_result_st *result)
+{
+  result->seconds = bench_now() - result->start;
+  result->allocations = allocation_count(bench) - result->allocations_start;
+}
+
+void bench_report(struct bench_st *bench, struct bench_result_st *result)
+{
+  printf("{\"benchmark\": \"%s\", \"service\": \"%s\", "
+         "\"injected_latency_ms\": %u, \"threads\": %zu, "
+         "\"object_size\": %zu, \"ops\": %zu, \"seconds\": %.6f, "
+         "\"ops_per_sec\": %.1f",
+         result->name, bench->mock ? "mock" : "s3", bench->latency_ms,
+         result->threads ? result->threads : 1, result->object_size,
+         result->ops, result->seconds,
+         result->seconds > 0 ? (double)result->ops / result->seconds : 0.0);
+
+  if (bench->alloc_stats && result->ops)
+  {
+    printf(", \"allocs_per_op\": %.2f",
+           (double)result->allocations / (double)result->ops);
+  }
+
+  if (result->bytes)
+  {
+    printf(", \"mb_per_sec\": %.2f",
+           result->seconds > 0 ?
+           (double)result->bytes / (1024.0 * 1024.0) / result->seconds : 0.0);
+  }
+
+  if (result->latencies && result->latency_count)
+  {
+    size_t count = result->latency_count;
+
+    qsort(result->latencies, count, sizeof(double), compare_double);
+    printf(", \"latency_us\": {\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+           "\"p99\": %.1f, \"max\": %.1f}",
+           result->latencies[0] * 1e6,
+           result->latencies[count / 2] * 1e6,
+           result->latencies[(count * 9) / 10] * 1e6,
+           result->latencies[(count * 99) / 100] * 1e6,
+           result->latencies[count - 1] * 1e6);
+  }
+
+  printf("}\n");
+  fflush(stdout);
+}
+
+void bench_check(uint8_t res, const char *what)
+{
+  if (res)
+  {
+    fprintf(stderr, "%s failed: %s\n", what, ms3_error(res));
+    exit(1);
+  }
+}
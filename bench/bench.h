@@ -0,0 +1,91 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+/* Shared code for the benchmarks. Each benchmark runs against the mock S3
+ * server from the test suite unless S3KEY etc. are set, in which case it
+ * runs against that service. Results are written to stdout as one JSON
+ * object per line.
+ *
+ * Environment variables:
+ *   BENCH_LATENCY_MS  latency the mock adds to every response (default 0)
+ *   BENCH_THROTTLE    mock bandwidth limit in bytes per second (default 0,
+ *                     unlimited)
+ *   BENCH_ITERATIONS  operations per measurement (default depends on the
+ *                     benchmark)
+ *   BENCH_OBJECT_SIZE object size for the large object benchmark
+ *   BENCH_ALLOC_STATS set to 1 to report library allocations per operation
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libmarias3/marias3.h>
+
+#include "tests/s3mock.h"
+
+struct bench_st
+{
+  s3mock_st *mock; // NULL when running against a real service
+  const char *bucket;
+  uint32_t latency_ms;
+  bool alloc_stats;
+};
+
+struct bench_result_st
+{
+  const char *name;
+  size_t ops;
+  size_t threads;
+  size_t object_size;
+  double start;
+  double seconds;
+  uint64_t allocations_start;
+  uint64_t allocations;
+  uint64_t bytes; // Payload bytes moved, 0 if not a throughput benchmark
+  double *latencies; // Seconds per operation, NULL if not recorded
+  size_t latency_count;
+};
+
+/* Starts the mock if needed, exits with 77 if it could not */
+void bench_init(struct bench_st *bench);
+
+void bench_deinit(struct bench_st *bench);
+
+/* A new handle for the service, each thread should use its own */
+ms3_st *bench_connect(struct bench_st *bench);
+
+size_t bench_iterations(size_t default_iterations);
+
+/* Monotonic clock in seconds */
+double bench_now(void);
+
+/* Start and stop the clock and allocation count of a measurement */
+void bench_start(struct bench_st *bench, struct bench_result_st *result);
+
+void bench_stop(struct bench_st *bench, struct bench_result_st *result);
+
+/* Prints the result as a JSON object on a single line */
+void bench_report(struct bench_st *bench, struct bench_result_st *result);
+
+/* Exits with an error message if res is not 0 */
+void bench_check(uint8_t res, const char *what);
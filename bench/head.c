@@ -0,0 +1,68 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/bench.h"
+
+/* HEAD request latency */
+
+int main(void)
+{
+  struct bench_st bench;
+  struct bench_result_st result;
+  ms3_st *ms3;
+  ms3_status_st status;
+  size_t iterations = bench_iterations(2000);
+  size_t op_it;
+  double *latencies = malloc(iterations * sizeof(double));
+
+  bench_init(&bench);
+  ms3 = bench_connect(&bench);
+  bench_check(ms3_put(ms3, bench.bucket, "bench/head", (const uint8_t *)"head",
+                      4), "PUT");
+
+  memset(&result, 0, sizeof(result));
+  result.name = "head";
+  result.ops = iterations;
+  result.object_size = 4;
+  result.latencies = latencies;
+  result.latency_count = iterations;
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    double op_start = bench_now();
+    bench_check(ms3_status(ms3, bench.bucket, "bench/head", &status), "HEAD");
+    latencies[op_it] = bench_now() - op_start;
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  ms3_delete(ms3, bench.bucket, "bench/head");
+  free(latencies);
+  ms3_deinit(ms3);
+  bench_deinit(&bench);
+  return 0;
+}
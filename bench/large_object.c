@@ -0,0 +1,124 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench/bench.h"
+
+/* Large object throughput in MB/s for PUT, GET and the file based calls */
+
+int main(void)
+{
+  struct bench_st bench;
+  struct bench_result_st result;
+  ms3_st *ms3;
+  size_t iterations = bench_iterations(5);
+  size_t object_size = 64 * 1024 * 1024;
+  size_t op_it;
+  const char *size_env = getenv("BENCH_OBJECT_SIZE");
+  uint8_t *object;
+  ms3_buffer_st get_buffer = { NULL, 0, 0 };
+  char filename[] = "/tmp/ms3_bench_XXXXXX";
+  int fd;
+
+  if (size_env && strtoull(size_env, NULL, 10) > 0)
+  {
+    object_size = (size_t)strtoull(size_env, NULL, 10);
+  }
+
+  object = malloc(object_size);
+  memset(object, 'l', object_size);
+  bench_init(&bench);
+  ms3 = bench_connect(&bench);
+
+  memset(&result, 0, sizeof(result));
+  result.ops = iterations;
+  result.object_size = object_size;
+  result.bytes = (uint64_t)iterations * object_size;
+
+  result.name = "put_large";
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    bench_check(ms3_put(ms3, bench.bucket, "bench/large", object, object_size),
+                "PUT");
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  result.name = "get_large";
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    bench_check(ms3_get_into(ms3, bench.bucket, "bench/large", &get_buffer),
+                "GET");
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+  ms3_buffer_free(ms3, &get_buffer);
+
+  fd = mkstemp(filename);
+
+  if (fd < 0 || write(fd, object, object_size) != (ssize_t)object_size)
+  {
+    fprintf(stderr, "Could not write %s\n", filename);
+    return 1;
+  }
+
+  result.name = "put_file_large";
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    bench_check(ms3_put_file(ms3, bench.bucket, "bench/large", fd, 0,
+                             object_size), "PUT from file");
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  result.name = "get_file_large";
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    bench_check(ms3_get_to_file(ms3, bench.bucket, "bench/large", filename),
+                "GET to file");
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  close(fd);
+  unlink(filename);
+  ms3_delete(ms3, bench.bucket, "bench/large");
+  free(object);
+  ms3_deinit(ms3);
+  bench_deinit(&bench);
+  return 0;
+}
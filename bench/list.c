@@ -0,0 +1,81 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/bench.h"
+
+/* Keys listed per second, across several pages of 1000 keys */
+
+#define KEY_COUNT 5000
+
+int main(void)
+{
+  struct bench_st bench;
+  struct bench_result_st result;
+  ms3_st *ms3;
+  ms3_list_st *list;
+  size_t iterations = bench_iterations(20);
+  size_t op_it;
+  size_t key_it;
+  char key[64];
+
+  bench_init(&bench);
+  ms3 = bench_connect(&bench);
+
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    snprintf(key, sizeof(key), "bench/list/%06zu", key_it);
+    bench_check(ms3_put(ms3, bench.bucket, key, (const uint8_t *)"l", 1),
+                "PUT");
+  }
+
+  memset(&result, 0, sizeof(result));
+  result.name = "list_keys";
+  result.ops = 0;
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    bench_check(ms3_list(ms3, bench.bucket, "bench/list/", &list), "LIST");
+
+    for (; list; list = list->next)
+    {
+      result.ops++;
+    }
+  }
+
+  // ops is keys here so ops_per_sec is keys per second
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    snprintf(key, sizeof(key), "bench/list/%06zu", key_it);
+    ms3_delete(ms3, bench.bucket, key);
+  }
+
+  ms3_deinit(ms3);
+  bench_deinit(&bench);
+  return 0;
+}
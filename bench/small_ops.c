@@ -0,0 +1,94 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/bench.h"
+
+/* Small object PUT and GET operations per second */
+
+#define OBJECT_SIZE 1024
+
+int main(void)
+{
+  struct bench_st bench;
+  struct bench_result_st result;
+  ms3_st *ms3;
+  size_t iterations = bench_iterations(2000);
+  size_t op_it;
+  double *latencies = malloc(iterations * sizeof(double));
+  uint8_t object[OBJECT_SIZE];
+  char key[64];
+
+  memset(object, 'b', sizeof(object));
+  bench_init(&bench);
+  ms3 = bench_connect(&bench);
+
+  memset(&result, 0, sizeof(result));
+  result.name = "put_small";
+  result.ops = iterations;
+  result.object_size = OBJECT_SIZE;
+  result.latencies = latencies;
+  result.latency_count = iterations;
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    double op_start = bench_now();
+    snprintf(key, sizeof(key), "bench/small/%zu", op_it % 100);
+    bench_check(ms3_put(ms3, bench.bucket, key, object, OBJECT_SIZE), "PUT");
+    latencies[op_it] = bench_now() - op_start;
+  }
+
+  bench_stop(&bench, &result);
+  result.bytes = (uint64_t)iterations * OBJECT_SIZE;
+  bench_report(&bench, &result);
+
+  result.name = "get_small";
+  bench_start(&bench, &result);
+
+  for (op_it = 0; op_it < iterations; op_it++)
+  {
+    double op_start = bench_now();
+    uint8_t *data;
+    size_t length;
+    snprintf(key, sizeof(key), "bench/small/%zu", op_it % 100);
+    bench_check(ms3_get(ms3, bench.bucket, key, &data, &length), "GET");
+    ms3_free(data);
+    latencies[op_it] = bench_now() - op_start;
+  }
+
+  bench_stop(&bench, &result);
+  bench_report(&bench, &result);
+
+  for (op_it = 0; op_it < 100 && op_it < iterations; op_it++)
+  {
+    snprintf(key, sizeof(key), "bench/small/%zu", op_it);
+    ms3_delete(ms3, bench.bucket, key);
+  }
+
+  free(latencies);
+  ms3_deinit(ms3);
+  bench_deinit(&bench);
+  return 0;
+}
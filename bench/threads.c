@@ -0,0 +1,112 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/bench.h"
+
+/* Small object GETs per second with 1 to 64 threads, one handle each */
+
+#define OBJECT_SIZE 1024
+#define MAX_THREADS 64
+
+struct thread_st
+{
+  struct bench_st *bench;
+  pthread_t thread;
+  size_t iterations;
+  uint8_t res;
+};
+
+static void *get_thread(void *arg)
+{
+  struct thread_st *thread = (struct thread_st *)arg;
+  ms3_st *ms3 = bench_connect(thread->bench);
+  size_t op_it;
+
+  for (op_it = 0; op_it < thread->iterations && !thread->res; op_it++)
+  {
+    uint8_t *data = NULL;
+    size_t length;
+    thread->res = ms3_get(ms3, thread->bench->bucket, "bench/threads", &data,
+                          &length);
+    ms3_free(data);
+  }
+
+  ms3_deinit(ms3);
+  return NULL;
+}
+
+int main(void)
+{
+  struct bench_st bench;
+  struct bench_result_st result;
+  struct thread_st threads[MAX_THREADS];
+  ms3_st *ms3;
+  size_t iterations = bench_iterations(200);
+  size_t thread_count;
+  size_t thread_it;
+  uint8_t object[OBJECT_SIZE];
+
+  memset(object, 't', sizeof(object));
+  bench_init(&bench);
+  ms3 = bench_connect(&bench);
+  bench_check(ms3_put(ms3, bench.bucket, "bench/threads", object, OBJECT_SIZE),
+              "PUT");
+
+  memset(&result, 0, sizeof(result));
+  result.name = "get_small_threads";
+  result.object_size = OBJECT_SIZE;
+
+  for (thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2)
+  {
+    bench_start(&bench, &result);
+
+    for (thread_it = 0; thread_it < thread_count; thread_it++)
+    {
+      threads[thread_it].bench = &bench;
+      threads[thread_it].iterations = iterations;
+      threads[thread_it].res = 0;
+      pthread_create(&threads[thread_it].thread, NULL, get_thread,
+                     &threads[thread_it]);
+    }
+
+    for (thread_it = 0; thread_it < thread_count; thread_it++)
+    {
+      pthread_join(threads[thread_it].thread, NULL);
+      bench_check(threads[thread_it].res, "GET");
+    }
+
+    bench_stop(&bench, &result);
+    result.threads = thread_count;
+    result.ops = thread_count * iterations;
+    result.bytes = (uint64_t)result.ops * OBJECT_SIZE;
+    bench_report(&bench, &result);
+  }
+
+  ms3_delete(ms3, bench.bucket, "bench/threads");
+  ms3_deinit(ms3);
+  bench_deinit(&bench);
+  return 0;
+}
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <curl/curl.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <libmarias3/visibility.h>
@@ -49,6 +50,70 @@ struct ms3_status_st
 
 typedef struct ms3_status_st ms3_status_st;
 
+struct ms3_header_st
+{
+  const char *name;
+  const char *value;
+};
+
+typedef struct ms3_header_st ms3_header_st;
+
+struct ms3_response_st
+{
+  long status; // HTTP status, 0 if there was no response
+  uint64_t content_length;
+  time_t last_modified;
+  const char *etag; // NULL if the header was not sent
+  const char *content_type;
+  const char *content_range;
+  const ms3_header_st *amz_headers; // Every x-amz-* header
+  size_t amz_header_count;
+};
+
+typedef struct ms3_response_st ms3_response_st;
+
+struct ms3_error_st
+{
+  uint8_t result; // MS3_ERR_* code of the failure
+  long status; // HTTP status, 0 if there was no response
+  const char *code; // S3 error code such as "NoSuchKey", NULL if none
+  const char *message; // NULL if there was no message
+  const char *request_id; // NULL if the server didn't send one
+  bool retryable; // Sending the same request again may work
+};
+
+typedef struct ms3_error_st ms3_error_st;
+
+struct ms3_delete_progress_st
+{
+  uint64_t listed;
+  uint64_t deleted;
+  uint64_t failed;
+};
+
+typedef struct ms3_delete_progress_st ms3_delete_progress_st;
+
+struct ms3_buffer_st
+{
+  uint8_t *data;
+  size_t length;
+  size_t alloced;
+};
+
+typedef struct ms3_buffer_st ms3_buffer_st;
+
+struct ms3_alloc_stats_st
+{
+  const char *file; // Source file of the call site, NULL for the total
+  unsigned int line;
+  uint64_t allocations;
+  uint64_t bytes;
+  uint64_t live_bytes;
+  uint64_t peak_live_bytes;
+};
+
+typedef struct ms3_alloc_stats_st ms3_alloc_stats_st;
+
 typedef void *(*ms3_malloc_callback)(size_t size);
 typedef void (*ms3_free_callback)(void *ptr);
 typedef void *(*ms3_realloc_callback)(void *ptr, size_t size);
@@ -61,6 +126,27 @@ typedef void *(*ms3_calloc_callback)(size_t nmemb, size_t size);
 typedef size_t (*ms3_read_callback)(void *buffer, size_t size,
                                     size_t nitems, void *userdata);
 
+/** The callback for ms3_delete_prefix(), called after each batch of keys */
+typedef void (*ms3_delete_progress_callback)(const ms3_delete_progress_st
+                                             *progress, void *userdata);
+
+struct ms3_credentials_st
+{
+  const char *key;
+  const char *secret;
+  const char *token; // Session token, NULL if there is none
+  time_t expiration; // 0 if the credentials don't expire
+};
+
+typedef struct ms3_credentials_st ms3_credentials_st;
+
+/** The callback for ms3_set_credential_provider(). It fills in the
+ * credentials and returns 0, or returns an error code. The strings are copied
+ * as soon as it returns. */
+typedef uint8_t (*ms3_credential_callback)(ms3_st *ms3,
+                                           ms3_credentials_st *credentials,
+                                           void *userdata);
+
 enum ms3_error_code_t
 {
   MS3_ERR_NONE,
@@ -77,6 +163,8 @@ enum ms3_error_code_t
   MS3_ERR_TOO_BIG,
   MS3_ERR_AUTH_ROLE,
   MS3_ERR_ENDPOINT,
+  MS3_ERR_FILE,
+  MS3_ERR_NOT_MODIFIED,
   MS3_ERR_MAX // Always the last error
 };
 
@@ -94,7 +182,17 @@ enum ms3_set_option_t
   MS3_OPT_PORT_NUMBER,
   MS3_OPT_CONNECT_TIMEOUT,
   MS3_OPT_TIMEOUT,
-  MS3_OPT_NO_CONTENT_TYPE
+  MS3_OPT_NO_CONTENT_TYPE,
+  MS3_OPT_BUFFER_POOL_SIZE,
+  MS3_OPT_PART_SIZE,
+  MS3_OPT_MAX_PARALLEL,
+  MS3_OPT_COPY_THRESHOLD,
+  MS3_OPT_STATUS_CACHE_SIZE,
+  MS3_OPT_STATUS_CACHE_TTL,
+  MS3_OPT_DISK_CACHE_DIR,
+  MS3_OPT_DISK_CACHE_SIZE,
+  MS3_OPT_CREDENTIAL_REFRESH_WINDOW,
+  MS3_OPT_IAM_ROLE_ARN
 };
 
 typedef enum ms3_set_option_t ms3_set_option_t;
@@ -110,6 +208,16 @@ uint8_t ms3_library_init_malloc(ms3_malloc_callback m,
                                 ms3_free_callback f, ms3_realloc_callback r,
                                 ms3_strdup_callback s, ms3_calloc_callback c);
 
+MS3_API
+uint8_t ms3_alloc_stats_enable(void);
+
+MS3_API
+size_t ms3_alloc_stats(ms3_alloc_stats_st *sites, size_t max_sites,
+                       ms3_alloc_stats_st *total);
+
+MS3_API
+void ms3_alloc_stats_reset(void);
+
 MS3_API
 ms3_st *ms3_init(const char *s3key, const char *s3secret,
                  const char *region,
@@ -123,6 +231,18 @@ uint8_t ms3_ec2_set_cred(ms3_st *ms3, const char *iam_role,
                      const char *s3key, const char *s3secret,
                      const char *token);
 
+MS3_API
+uint8_t ms3_set_credential_provider(ms3_st *ms3,
+                                    ms3_credential_callback provider,
+                                    void *userdata);
+
+MS3_API
+uint8_t ms3_init_imds_credentials(ms3_st *ms3, const char *endpoint);
+
+MS3_API
+uint8_t ms3_init_ecs_credentials(ms3_st *ms3, const char *uri,
+                                 const char *auth_token);
+
 MS3_API
 uint8_t ms3_set_option(ms3_st *ms3, ms3_set_option_t option, void *value);
 
@@ -152,10 +272,18 @@ void ms3_list_free(ms3_list_st *list);
 MS3_API
 void ms3_set_content_type(ms3_st *ms3, const char *content_type);
 
+MS3_API
+uint8_t ms3_set_headers(ms3_st *ms3, const ms3_header_st *headers,
+                        size_t count);
+
 MS3_API
 uint8_t ms3_put(ms3_st *ms3, const char *bucket, const char *key,
                 const uint8_t *data, size_t length);
 
+MS3_API
+uint8_t ms3_put_file(ms3_st *ms3, const char *bucket, const char *key,
+                     int fd, uint64_t offset, size_t length);
+
 MS3_API
 const char *ms3_get_content_type(ms3_st *ms3);
 
@@ -163,6 +291,35 @@ MS3_API
 uint8_t ms3_get(ms3_st *ms3, const char *bucket, const char *key,
                 uint8_t **data, size_t *length);
 
+MS3_API
+uint8_t ms3_get_into(ms3_st *ms3, const char *bucket, const char *key,
+                     ms3_buffer_st *buffer);
+
+MS3_API
+void ms3_buffer_free(ms3_st *ms3, ms3_buffer_st *buffer);
+
+MS3_API
+uint8_t ms3_get_if_changed(ms3_st *ms3, const char *bucket, const char *key,
+                           const char *etag, time_t modified_since,
+                           ms3_buffer_st *buffer);
+
+MS3_API
+const char *ms3_get_etag(ms3_st *ms3);
+
+MS3_API
+const ms3_response_st *ms3_last_response(ms3_st *ms3);
+
+MS3_API
+const ms3_error_st *ms3_last_error(ms3_st *ms3);
+
+MS3_API
+uint8_t ms3_get_to_fd(ms3_st *ms3, const char *bucket, const char *key,
+                      int fd);
+
+MS3_API
+uint8_t ms3_get_to_file(ms3_st *ms3, const char *bucket, const char *key,
+                        const char *filename);
+
 MS3_API
 uint8_t ms3_copy(ms3_st *ms3, const char *source_bucket, const char *source_key,
                  const char *dest_bucket, const char *dest_key);
@@ -177,10 +334,23 @@ void ms3_free(uint8_t *data);
 MS3_API
 uint8_t ms3_delete(ms3_st *ms3, const char *bucket, const char *key);
 
+MS3_API
+uint8_t ms3_delete_many(ms3_st *ms3, const char *bucket, const char **keys,
+                        size_t count, uint8_t *results);
+
+MS3_API
+uint8_t ms3_delete_prefix(ms3_st *ms3, const char *bucket, const char *prefix,
+                          ms3_delete_progress_callback callback, void *userdata,
+                          ms3_delete_progress_st *progress);
+
 MS3_API
 uint8_t ms3_status(ms3_st *ms3, const char *bucket, const char *key,
                    ms3_status_st *status);
 
+MS3_API
+uint8_t ms3_status_many(ms3_st *ms3, const char *bucket, const char **keys,
+                        size_t count, ms3_status_st *statuses, uint8_t *results);
+
 MS3_API
 uint8_t ms3_assume_role(ms3_st *ms3);
 
@@ -0,0 +1,304 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include "config.h"
+#include "common.h"
+
+#include <pthread.h>
+
+/* The statistics wrap whichever allocation callbacks are set, so they are
+ * called through the raw function pointers here and not the macros
+ */
+#undef ms3_cmalloc
+#undef ms3_ccalloc
+#undef ms3_crealloc
+#undef ms3_cstrdup
+#undef ms3_cfree
+
+#define ALLOC_STATS_SITES 1024
+
+/* Placed in front of every allocation, the union keeps the data after it
+ * aligned as malloc() would
+ */
+union alloc_header_st
+{
+  struct
+  {
+    size_t size;
+    uint32_t site;
+  } info;
+  long double align;
+};
+
+struct alloc_site_st
+{
+  const char *file;
+  unsigned int line;
+  uint64_t allocations;
+  uint64_t bytes;
+  uint64_t live_bytes;
+  uint64_t peak_live_bytes;
+};
+
+bool alloc_stats_enabled = false;
+static bool alloc_stats_locked = false;
+static pthread_mutex_t alloc_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct alloc_site_st alloc_sites[ALLOC_STATS_SITES];
+static size_t alloc_site_count = 0;
+static struct alloc_site_st alloc_total;
+
+// Caller holds the mutex
+static uint32_t site_index(const char *file, unsigned int line)
+{
+  uint32_t index = (uint32_t)(((uintptr_t)file >> 4) * 31 + line) %
+                   ALLOC_STATS_SITES;
+  uint32_t probe;
+
+  for (probe = 0; probe < ALLOC_STATS_SITES; probe++)
+  {
+    struct alloc_site_st *site = &alloc_sites[index];
+
+    if (!site->file)
+    {
+      site->file = file;
+      site->line = line;
+      alloc_site_count++;
+      return index;
+    }
+
+    if (site->file == file && site->line == line)
+    {
+      return index;
+    }
+
+    index = (index + 1) % ALLOC_STATS_SITES;
+  }
+
+  // Table full, the last slot collects everything else
+  return ALLOC_STATS_SITES - 1;
+}
+
+static void site_add(struct alloc_site_st *site, size_t size)
+{
+  site->allocations++;
+  site->bytes += size;
+  site->live_bytes += size;
+
+  if (site->live_bytes > site->peak_live_bytes)
+  {
+    site->peak_live_bytes = site->live_bytes;
+  }
+}
+
+static void record_alloc(union alloc_header_st *header, size_t size,
+                         const char *file, unsigned int line)
+{
+  pthread_mutex_lock(&alloc_stats_mutex);
+  header->info.size = size;
+  header->info.site = site_index(file, line);
+  site_add(&alloc_sites[header->info.site], size);
+  site_add(&alloc_total, size);
+  pthread_mutex_unlock(&alloc_stats_mutex);
+}
+
+static void record_free(union alloc_header_st *header)
+{
+  pthread_mutex_lock(&alloc_stats_mutex);
+  alloc_sites[header->info.site].live_bytes -= header->info.size;
+  alloc_total.live_bytes -= header->info.size;
+  pthread_mutex_unlock(&alloc_stats_mutex);
+}
+
+void *alloc_stats_malloc(size_t size, const char *file, unsigned int line)
+{
+  union alloc_header_st *header;
+
+  if (size > SIZE_MAX - sizeof(union alloc_header_st))
+  {
+    return NULL;
+  }
+
+  header = ms3_cmalloc(sizeof(union alloc_header_st) + size);
+
+  if (!header)
+  {
+    return NULL;
+  }
+
+  record_alloc(header, size, file, line);
+
+  return header + 1;
+}
+
+void *alloc_stats_calloc(size_t nmemb, size_t size, const char *file,
+                         unsigned int line)
+{
+  union alloc_header_st *header;
+
+  if (size && nmemb > (SIZE_MAX - sizeof(union alloc_header_st)) / size)
+  {
+    return NULL;
+  }
+
+  header = ms3_ccalloc(1, sizeof(union alloc_header_st) + nmemb * size);
+
+  if (!header)
+  {
+    return NULL;
+  }
+
+  record_alloc(header, nmemb * size, file, line);
+
+  return header + 1;
+}
+
+void *alloc_stats_realloc(void *ptr, size_t size, const char *file,
+                          unsigned int line)
+{
+  union alloc_header_st *header;
+
+  if (!ptr)
+  {
+    return alloc_stats_malloc(size, file, line);
+  }
+
+  if (size > SIZE_MAX - sizeof(union alloc_header_st))
+  {
+    return NULL;
+  }
+
+  header = (union alloc_header_st *)ptr - 1;
+  header = ms3_crealloc(header, sizeof(union alloc_header_st) + size);
+
+  if (!header)
+  {
+    return NULL;
+  }
+
+  // Moves the allocation from its old call site to this one
+  record_free(header);
+  record_alloc(header, size, file, line);
+
+  return header + 1;
+}
+
+char *alloc_stats_strdup(const char *str, const char *file, unsigned int line)
+{
+  size_t length = strlen(str) + 1;
+  char *copy = alloc_stats_malloc(length, file, line);
+
+  if (copy)
+  {
+    memcpy(copy, str, length);
+  }
+
+  return copy;
+}
+
+void alloc_stats_free(void *ptr)
+{
+  union alloc_header_st *header;
+
+  if (!ptr)
+  {
+    return;
+  }
+
+  header = (union alloc_header_st *)ptr - 1;
+  record_free(header);
+  ms3_cfree(header);
+}
+
+void alloc_stats_lock(void)
+{
+  alloc_stats_locked = true;
+}
+
+uint8_t ms3_alloc_stats_enable(void)
+{
+  // Allocations made without a header can't be freed with one
+  if (alloc_stats_locked)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  alloc_stats_enabled = true;
+
+  return 0;
+}
+
+static void copy_site(ms3_alloc_stats_st *stats, struct alloc_site_st *site)
+{
+  stats->file = site->file;
+  stats->line = site->line;
+  stats->allocations = site->allocations;
+  stats->bytes = site->bytes;
+  stats->live_bytes = site->live_bytes;
+  stats->peak_live_bytes = site->peak_live_bytes;
+}
+
+size_t ms3_alloc_stats(ms3_alloc_stats_st *sites, size_t max_sites,
+                       ms3_alloc_stats_st *total)
+{
+  size_t site_it;
+  size_t found = 0;
+  size_t count;
+
+  pthread_mutex_lock(&alloc_stats_mutex);
+
+  for (site_it = 0; site_it < ALLOC_STATS_SITES && found < max_sites && sites;
+       site_it++)
+  {
+    if (alloc_sites[site_it].file)
+    {
+      copy_site(&sites[found++], &alloc_sites[site_it]);
+    }
+  }
+
+  if (total)
+  {
+    copy_site(total, &alloc_total);
+  }
+
+  count = alloc_site_count;
+  pthread_mutex_unlock(&alloc_stats_mutex);
+
+  return count;
+}
+
+void ms3_alloc_stats_reset(void)
+{
+  size_t site_it;
+
+  pthread_mutex_lock(&alloc_stats_mutex);
+
+  // Memory still allocated stays live, everything else starts again
+  for (site_it = 0; site_it < ALLOC_STATS_SITES; site_it++)
+  {
+    alloc_sites[site_it].allocations = 0;
+    alloc_sites[site_it].bytes = 0;
+    alloc_sites[site_it].peak_live_bytes = alloc_sites[site_it].live_bytes;
+  }
+
+  alloc_total.allocations = 0;
+  alloc_total.bytes = 0;
+  alloc_total.peak_live_bytes = alloc_total.live_bytes;
+  pthread_mutex_unlock(&alloc_stats_mutex);
+}
@@ -22,35 +22,118 @@
 #include "sha256.h"
 
 #include <math.h>
+#include <pthread.h>
 
 const char *default_iam_domain = "iam.amazonaws.com";
 const char *default_sts_domain = "sts.amazonaws.com";
 const char *iam_request_region = "us-east-1";
 
-static void set_error(ms3_st *ms3, const char *error)
+/* Role ARNs which have been assumed, shared by every handle in the process.
+ * Keyed on the access key as well as the role name because the same name
+ * can exist in several accounts.
+ */
+struct role_arn_entry_st
 {
-  ms3_cfree(ms3->last_error);
+  char *key;
+  char *role;
+  char *arn;
+  struct role_arn_entry_st *next;
+};
+
+static struct role_arn_entry_st *role_arn_cache = NULL;
+static pthread_mutex_t role_arn_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+bool role_arn_cache_get(const char *key, const char *role, char *arn,
+                        size_t arn_size)
+{
+  struct role_arn_entry_st *entry;
+  bool found = false;
+
+  pthread_mutex_lock(&role_arn_mutex);
 
-  if (!error)
+  for (entry = role_arn_cache; entry; entry = entry->next)
   {
-    ms3->last_error = NULL;
-    return;
+    if (!strcmp(entry->key, key) && !strcmp(entry->role, role))
+    {
+      found = (size_t)snprintf(arn, arn_size, "%s", entry->arn) < arn_size;
+      break;
+    }
   }
 
-  ms3->last_error = ms3_cstrdup(error);
+  pthread_mutex_unlock(&role_arn_mutex);
+
+  return found;
 }
 
-static void set_error_nocopy(ms3_st *ms3, char *error)
+void role_arn_cache_put(const char *key, const char *role, const char *arn)
 {
-  ms3_cfree(ms3->last_error);
+  struct role_arn_entry_st *entry;
+  char *new_arn;
 
-  if (!error)
+  pthread_mutex_lock(&role_arn_mutex);
+
+  for (entry = role_arn_cache; entry; entry = entry->next)
+  {
+    if (!strcmp(entry->key, key) && !strcmp(entry->role, role))
+    {
+      break;
+    }
+  }
+
+  if (entry)
   {
-    ms3->last_error = NULL;
+    if (strcmp(entry->arn, arn) && (new_arn = ms3_cstrdup(arn)))
+    {
+      ms3_cfree(entry->arn);
+      entry->arn = new_arn;
+    }
+
+    pthread_mutex_unlock(&role_arn_mutex);
     return;
   }
 
-  ms3->last_error = error;
+  // Nothing is lost if this fails, the next handle looks the role up again
+  entry = ms3_cmalloc(sizeof(struct role_arn_entry_st));
+
+  if (entry)
+  {
+    entry->key = ms3_cstrdup(key);
+    entry->role = ms3_cstrdup(role);
+    entry->arn = ms3_cstrdup(arn);
+
+    if (entry->key && entry->role && entry->arn)
+    {
+      entry->next = role_arn_cache;
+      role_arn_cache = entry;
+    }
+    else
+    {
+      ms3_cfree(entry->key);
+      ms3_cfree(entry->role);
+      ms3_cfree(entry->arn);
+      ms3_cfree(entry);
+    }
+  }
+
+  pthread_mutex_unlock(&role_arn_mutex);
+}
+
+void role_arn_cache_clear(void)
+{
+  struct role_arn_entry_st *entry;
+
+  pthread_mutex_lock(&role_arn_mutex);
+
+  while ((entry = role_arn_cache))
+  {
+    role_arn_cache = entry->next;
+    ms3_cfree(entry->key);
+    ms3_cfree(entry->role);
+    ms3_cfree(entry->arn);
+    ms3_cfree(entry);
+  }
+
+  pthread_mutex_unlock(&role_arn_mutex);
 }
 
 static size_t header_callback(char *buffer, size_t size,
@@ -121,11 +204,14 @@ static size_t body_callback(void *buffer, size_t size,
 
 static uint8_t build_assume_role_request_uri(CURL *curl, const char *base_domain, const char *query, bool use_http)
 {
-  char uri_buffer[MAX_URI_LENGTH];
+  char uri_data[MAX_URI_LENGTH];
+  struct string_builder_st uri;
   const char *domain;
-  const char *http_protocol = "http";
-  const char *https_protocol = "https";
-  const char *protocol;
+
+  if (!query)
+  {
+      return MS3_ERR_PARAMETER;
+  }
 
   if (base_domain)
   {
@@ -136,173 +222,116 @@ static uint8_t build_assume_role_request_uri(CURL *curl, const char *base_domain
     domain = default_sts_domain;
   }
 
+  string_builder_init(&uri, uri_data, sizeof(uri_data));
+
   if (use_http)
   {
-    protocol = http_protocol;
+    string_builder_append(&uri, "http://", 7);
   }
   else
   {
-    protocol = https_protocol;
+    string_builder_append(&uri, "https://", 8);
   }
 
-  if (query)
+  string_builder_append_str(&uri, domain);
+  string_builder_append(&uri, "/?", 2);
+  string_builder_append_str(&uri, query);
+
+  if (uri.failed)
   {
-    if (snprintf(uri_buffer, MAX_URI_LENGTH, "%s://%s/?%s", protocol,
-             domain, query) >= MAX_URI_LENGTH)
-      return MS3_ERR_URI_TOO_LONG;
+    string_builder_free(&uri);
+    return MS3_ERR_OOM;
   }
-  else
+
+  ms3debug("URI: %s", uri.data);
+  curl_easy_setopt(curl, CURLOPT_URL, uri.data);
+  string_builder_free(&uri);
+  return 0;
+}
+
+// Adds name=value to a query, value is URL encoded
+static void query_append(CURL *curl, struct string_builder_st *query,
+                         const char *name, const char *value)
+{
+  char *encoded = curl_easy_escape(curl, value, (int)strlen(value));
+
+  if (!encoded)
   {
-      return MS3_ERR_PARAMETER;
+    query->failed = true;
+    return;
   }
 
-  ms3debug("URI: %s", uri_buffer);
-  curl_easy_setopt(curl, CURLOPT_URL, uri_buffer);
-  return 0;
+  if (query->length)
+  {
+    string_builder_append_char(query, '&');
+  }
+
+  string_builder_append_str(query, name);
+  string_builder_append_char(query, '=');
+  string_builder_append_str(query, encoded);
+  curl_free(encoded);
 }
 
-static char *generate_assume_role_query(CURL *curl, const char *action, size_t role_duration,
+static void generate_assume_role_query(CURL *curl, const char *action, size_t role_duration,
                             const char *version, const char *role_session_name, const char *role_arn,
-                            const char *continuation, char *query_buffer)
+                            const char *continuation, struct string_builder_st *query)
 {
-  size_t query_buffer_length = 0;
-  char *encoded;
-  query_buffer[0] = '\0';
-
   if (action)
   {
-    encoded = curl_easy_escape(curl, action, (int)strlen(action));
-    query_buffer_length = strlen(query_buffer);
-    if (query_buffer_length)
-    {
-      snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-               "&Action=%s", encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "Action=%s", encoded);
-    }
-    curl_free(encoded);
+    query_append(curl, query, "Action", action);
   }
   if (role_duration >= 900 && role_duration <= 43200)
   {
-    query_buffer_length = strlen(query_buffer);
-    if (query_buffer_length)
-    {
-      snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-               "&DurationSeconds=%zu", role_duration);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "DurationSeconds=%zu", role_duration);
-    }
+    char duration[24];
+
+    snprintf(duration, sizeof(duration), "%zu", role_duration);
+    query_append(curl, query, "DurationSeconds", duration);
   }
   if (continuation)
   {
-      encoded = curl_easy_escape(curl, continuation, (int)strlen(continuation));
-      query_buffer_length = strlen(query_buffer);
-      if (query_buffer_length)
-      {
-        snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-                 "&Marker=%s", encoded);
-      }
-      else
-      {
-        snprintf(query_buffer, 3072, "Marker=%s", encoded);
-      }
-      curl_free(encoded);
+    query_append(curl, query, "Marker", continuation);
   }
   if (role_arn)
   {
-    encoded = curl_easy_escape(curl, role_arn, (int)strlen(role_arn));
-    query_buffer_length = strlen(query_buffer);
-    if (query_buffer_length)
-    {
-      snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-               "&RoleArn=%s", encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "RoleArn=%s", encoded);
-    }
-    curl_free(encoded);
+    query_append(curl, query, "RoleArn", role_arn);
   }
   if (role_session_name)
   {
-    encoded = curl_easy_escape(curl, role_session_name, (int)strlen(role_session_name));
-    query_buffer_length = strlen(query_buffer);
-    if (query_buffer_length)
-    {
-      snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-               "&RoleSessionName=%s", encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "RoleSessionName=%s", encoded);
-    }
-    curl_free(encoded);
+    query_append(curl, query, "RoleSessionName", role_session_name);
   }
   if (version)
   {
-    encoded = curl_easy_escape(curl, version, (int)strlen(version));
-    query_buffer_length = strlen(query_buffer);
-    if (query_buffer_length)
-    {
-      snprintf(query_buffer + query_buffer_length, 3072 - query_buffer_length,
-               "&Version=%s", encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "Version=%s", encoded);
-    }
-    curl_free(encoded);
+    query_append(curl, query, "Version", version);
   }
-
-  return query_buffer;
 }
 
 
 static uint8_t generate_assume_role_request_hash(uri_method_t method, const char *query, char *post_hash,
-                                        struct curl_slist *headers, char *return_hash)
+                                        const struct signed_headers_st *headers, char *return_hash)
 {
-  char signing_data[3072];
-  size_t pos = 0;
+  char signing_buffer[MAX_URI_LENGTH];
+  struct string_builder_st signing_data;
   uint8_t sha256hash[32]; // SHA_256 binary length
-  uint8_t hash_pos = 0;
-  uint8_t i;
-  struct curl_slist *current_header = headers;
+  const char *line;
+  size_t length;
+  size_t name_length;
+  size_t header_it;
+
+  string_builder_init(&signing_data, signing_buffer, sizeof(signing_buffer));
 
   // Method first
   switch (method)
   {
     case MS3_GET:
     {
-      sprintf(signing_data, "GET\n");
-      pos += 4;
+      string_builder_append(&signing_data, "GET\n", 4);
       break;
     }
 
     case MS3_HEAD:
-    {
-      sprintf(signing_data, "HEAD\n");
-      pos += 5;
-      break;
-    }
-
     case MS3_PUT:
-    {
-      sprintf(signing_data, "PUT\n");
-      pos += 4;
-      break;
-    }
-
     case MS3_DELETE:
-    {
-      sprintf(signing_data, "DELETE\n");
-      pos += 7;
-      break;
-    }
-
+    case MS3_POST:
     default:
     {
       ms3debug("Bad method detected");
@@ -313,44 +342,42 @@ static uint8_t generate_assume_role_request_hash(uri_method_t method, const char
   // URL query (if exists)
   if (query)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "/\n%s\n", query);
-    pos += strlen(query) + 3;
-  }
-  else
-  {
-    sprintf(signing_data + pos, "\n");
-    pos++;
+    string_builder_append(&signing_data, "/\n", 2);
+    string_builder_append_str(&signing_data, query);
   }
 
-  do
+  string_builder_append_char(&signing_data, '\n');
+
+  for (header_it = 0; header_it < headers->count; header_it++)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "%s\n",
-             current_header->data);
-    pos += strlen(current_header->data) + 1;
+    line = signed_headers_get(headers, header_it, &length, &name_length);
+    string_builder_append(&signing_data, line, length);
+    string_builder_append_char(&signing_data, '\n');
   }
-  while ((current_header = current_header->next));
 
   // List if header names
   // The newline between headers and this is important
-  snprintf(signing_data + pos, sizeof(signing_data) - pos,
-             "\nhost;x-amz-content-sha256;x-amz-date\n");
-  pos += 38;
+  string_builder_append_char(&signing_data, '\n');
+  signed_headers_names(headers, &signing_data);
+  string_builder_append_char(&signing_data, '\n');
 
   // Hash of post data (can be hash of empty)
-  snprintf(signing_data + pos, sizeof(signing_data) - pos, "%.*s", 64, post_hash);
-  //pos+= 64;
-
-  // Hash all of the above
-  sha256((uint8_t *)signing_data, strlen(signing_data), (uint8_t *)sha256hash);
+  string_builder_append(&signing_data, post_hash, 64);
 
-  for (i = 0; i < 32; i++)
+  if (signing_data.failed)
   {
-    sprintf(return_hash + hash_pos, "%.2x", sha256hash[i]);
-    hash_pos += 2;
+    string_builder_free(&signing_data);
+    return MS3_ERR_OOM;
   }
 
-  ms3debug("Signature data: %s", signing_data);
+  // Hash all of the above
+  sha256((uint8_t *)signing_data.data, signing_data.length, sha256hash);
+
+  hex_encode(sha256hash, 32, return_hash);
+
+  ms3debug("Signature data: %s", signing_data.data);
   ms3debug("Signature: %.*s", 64, return_hash);
+  string_builder_free(&signing_data);
 
   return 0;
 }
@@ -367,23 +394,27 @@ build_assume_role_request_headers(CURL *curl, struct curl_slist **head,
   uint8_t ret = 0;
   time_t now;
   struct tm tmp_tm;
-  char headerbuf[3072];
+  char header_data[MAX_URI_LENGTH];
+  struct string_builder_st header;
+  char signed_data[MAX_URI_LENGTH];
+  struct signed_headers_st signed_headers;
   char secrethead[MAX_S3_SECRET_LENGTH + S3_SECRET_EXTRA_LENGTH];
   char date[9];
+  char date_time[17];
   char sha256hash[65];
   char post_hash[65];
   uint8_t tmp_hash[32];
   // Alternate between these two so hmac doesn't overwrite itself
   uint8_t hmac_hash[32];
   uint8_t hmac_hash2[32];
-  uint8_t hash_pos = 0;
   const char *domain;
   const char *type;
   struct curl_slist *headers = NULL;
-  uint8_t offset;
-  uint8_t i;
   struct curl_slist *current_header;
 
+  string_builder_init(&header, header_data, sizeof(header_data));
+  signed_headers_init(&signed_headers, signed_data, sizeof(signed_data));
+
   // Host header
   if (base_domain)
   {
@@ -403,47 +434,45 @@ build_assume_role_request_headers(CURL *curl, struct curl_slist **head,
       type = "sts";
   }
 
-  snprintf(headerbuf, sizeof(headerbuf), "host:%s", domain);
-
-  headers = curl_slist_append(headers, headerbuf);
-  *head = headers;
+  signed_headers_add(&signed_headers, "host", domain, strlen(domain));
 
   // Hash post data
   sha256(post_data->data, post_data->length, tmp_hash);
 
-  for (i = 0; i < 32; i++)
-  {
-    sprintf(post_hash + hash_pos, "%.2x", tmp_hash[i]);
-    hash_pos += 2;
-  }
-
-  snprintf(headerbuf, sizeof(headerbuf), "x-amz-content-sha256:%.*s", 64,
-           post_hash);
-  headers = curl_slist_append(headers, headerbuf);
+  hex_encode(tmp_hash, 32, post_hash);
+  signed_headers_add(&signed_headers, "x-amz-content-sha256", post_hash, 64);
 
   // Date/time header
   time(&now);
-  snprintf(headerbuf, sizeof(headerbuf), "x-amz-date:");
-  offset = strlen(headerbuf);
   gmtime_r(&now, &tmp_tm);
-  strftime(headerbuf + offset, sizeof(headerbuf) - offset, "%Y%m%dT%H%M%SZ",
-           &tmp_tm);
-  headers = curl_slist_append(headers, headerbuf);
+  strftime(date, sizeof(date), "%Y%m%d", &tmp_tm);
+  strftime(date_time, sizeof(date_time), "%Y%m%dT%H%M%SZ", &tmp_tm);
+  signed_headers_add(&signed_headers, "x-amz-date", date_time, 16);
+
+  // A header which didn't fit must not be signed
+  if (signed_headers.failed)
+  {
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
+    return MS3_ERR_OOM;
+  }
 
   // Builds the request hash
-  ret = generate_assume_role_request_hash(method, query, post_hash, headers, sha256hash);
+  ret = generate_assume_role_request_hash(method, query, post_hash,
+                                          &signed_headers, sha256hash);
 
   if (ret)
   {
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
     return ret;
   }
 
   // User signing key hash
   // Date hashed using AWS4:secret_key
   snprintf(secrethead, sizeof(secrethead), "AWS4%.*s", MAX_S3_SECRET_LENGTH, secret);
-  strftime(headerbuf, sizeof(headerbuf), "%Y%m%d", &tmp_tm);
-  hmac_sha256((uint8_t *)secrethead, strlen(secrethead), (uint8_t *)headerbuf,
-              strlen(headerbuf), hmac_hash);
+  hmac_sha256((uint8_t *)secrethead, strlen(secrethead), (uint8_t *)date, 8,
+              hmac_hash);
 
   // Region signed by above key
   hmac_sha256(hmac_hash, 32, (uint8_t *)region, strlen(region),
@@ -454,41 +483,58 @@ build_assume_role_request_headers(CURL *curl, struct curl_slist **head,
               hmac_hash);
 
   // Request version signed by above key (always "aws4_request")
-  sprintf(headerbuf, "aws4_request");
-  hmac_sha256(hmac_hash, 32, (uint8_t *)headerbuf, strlen(headerbuf),
+  hmac_sha256(hmac_hash, 32, (const uint8_t *)"aws4_request", 12,
               hmac_hash2);
 
   // Sign everything with the key
-  snprintf(headerbuf, sizeof(headerbuf), "AWS4-HMAC-SHA256\n");
-  offset = strlen(headerbuf);
-  strftime(headerbuf + offset, sizeof(headerbuf) - offset, "%Y%m%dT%H%M%SZ\n",
-           &tmp_tm);
-  offset = strlen(headerbuf);
-  strftime(date, 9, "%Y%m%d", &tmp_tm);
-  snprintf(headerbuf + offset, sizeof(headerbuf) - offset,
-           "%.*s/%s/%s/aws4_request\n%.*s", 8, date, region, type, 64, sha256hash);
-  ms3debug("Data to sign: %s", headerbuf);
-  hmac_sha256(hmac_hash2, 32, (uint8_t *)headerbuf, strlen(headerbuf),
+  string_builder_reset(&header);
+  string_builder_append(&header, "AWS4-HMAC-SHA256\n", 17);
+  string_builder_append(&header, date_time, 16);
+  string_builder_append_char(&header, '\n');
+  string_builder_append(&header, date, 8);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, region);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, type);
+  string_builder_append(&header, "/aws4_request\n", 14);
+  string_builder_append(&header, sha256hash, 64);
+  ms3debug("Data to sign: %s", header.data);
+  hmac_sha256(hmac_hash2, 32, (uint8_t *)header.data, header.length,
               hmac_hash);
 
-  hash_pos = 0;
-
-  for (i = 0; i < 32; i++)
-  {
-    sprintf(sha256hash + hash_pos, "%.2x", hmac_hash[i]);
-    hash_pos += 2;
-  }
+  hex_encode(hmac_hash, 32, sha256hash);
 
   // Make auth header
-    snprintf(headerbuf, sizeof(headerbuf),
-             "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s/%s/%s/aws4_request, SignedHeaders=host;x-amz-content-sha256;x-amz-date, Signature=%s",
-             key, date, region, type, sha256hash);
-
-  headers = curl_slist_append(headers, headerbuf);
+  string_builder_reset(&header);
+  string_builder_append_str(&header,
+                            "Authorization: AWS4-HMAC-SHA256 Credential=");
+  string_builder_append_str(&header, key);
+  string_builder_append_char(&header, '/');
+  string_builder_append(&header, date, 8);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, region);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, type);
+  string_builder_append(&header, "/aws4_request, SignedHeaders=", 29);
+  signed_headers_names(&signed_headers, &header);
+  string_builder_append(&header, ", Signature=", 12);
+  string_builder_append(&header, sha256hash, 64);
+
+  if (header.failed)
+  {
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
+    return MS3_ERR_OOM;
+  }
+
+  headers = signed_headers_emit(&signed_headers, NULL);
+  *head = headers;
+  headers = curl_slist_append(headers, header.data);
+  string_builder_free(&header);
+  signed_headers_free(&signed_headers);
 
   // Disable this header or PUT will barf with a 501
-  sprintf(headerbuf, "Transfer-Encoding:");
-  headers = curl_slist_append(headers, headerbuf);
+  headers = curl_slist_append(headers, "Transfer-Encoding:");
 
   current_header = headers;
 
@@ -512,13 +558,20 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
   uint8_t res = 0;
   struct memory_buffer_st mem;
   uri_method_t method;
-  char *query = NULL;
+  char query_data[MAX_URI_LENGTH];
+  struct string_builder_st query;
   struct put_buffer_st post_data;
   CURLcode curl_res;
   long response_code = 0;
   char* endpoint = NULL;
   const char* region = iam_request_region;
   char endpoint_type[8];
+  struct ms3_context_st *ctx = context_get(ms3);
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
 
   mem.data = NULL;
   mem.length = 0;
@@ -529,21 +582,24 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
   post_data.length = data_size;
   post_data.offset = 0;
 
-  curl = ms3->curl;
+  curl = ctx->curl;
 
-  if (!ms3->first_run)
+  if (!ctx->first_run)
   {
     curl_easy_reset(curl);
   }
   else
   {
-    ms3->first_run = false;
+    ctx->first_run = false;
   }
 
+  // Only needed until the request is signed
+  string_builder_init(&query, query_data, sizeof(query_data));
+
   if (cmd == MS3_CMD_ASSUME_ROLE)
   {
-      query = generate_assume_role_query(curl, "AssumeRole", ms3->role_session_duration, "2011-06-15", "libmariaS3",
-                                         ms3->iam_role_arn, continuation, ms3->query_buffer);
+      generate_assume_role_query(curl, "AssumeRole", ms3->role_session_duration, "2011-06-15", "libmariaS3",
+                                 ms3->iam_role_arn, continuation, &query);
       endpoint = ms3->sts_endpoint;
       region = ms3->sts_region;
       sprintf(endpoint_type, "sts");
@@ -551,23 +607,34 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
   }
   else if (cmd == MS3_CMD_LIST_ROLE)
   {
-      query = generate_assume_role_query(curl, "ListRoles", 0, "2010-05-08", NULL, NULL, continuation, ms3->query_buffer);
+      generate_assume_role_query(curl, "ListRoles", 0, "2010-05-08", NULL, NULL, continuation, &query);
       endpoint = ms3->iam_endpoint;
       sprintf(endpoint_type, "iam");
       method = MS3_GET;
   }
 
-  res = build_assume_role_request_uri(curl, endpoint, query, ms3->use_http);
+  if (query.failed)
+  {
+    res = MS3_ERR_OOM;
+  }
+  else
+  {
+    res = build_assume_role_request_uri(curl, endpoint,
+                                        query.length ? query.data : NULL,
+                                        ms3->use_http);
+  }
 
   if (res)
   {
+    string_builder_free(&query);
     return res;
   }
 
   res = build_assume_role_request_headers(curl, &headers, endpoint,
                                           endpoint_type, region,
-                                          ms3->s3key, ms3->s3secret, query,
+                                          ms3->s3key, ms3->s3secret, query.data,
                                           method, &post_data);
+  string_builder_free(&query);
 
   if (res)
   {
@@ -584,6 +651,7 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
   }
 
+  curl_easy_setopt(curl, CURLOPT_SHARE, ms3->curl_share);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, body_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&mem);
@@ -593,7 +661,10 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
   if (curl_res != CURLE_OK)
   {
     ms3debug("Curl error: %s", curl_easy_strerror(curl_res));
-    set_error(ms3, curl_easy_strerror(curl_res));
+    memset(&ctx->error, 0, sizeof(struct request_error_st));
+    request_error_set(&ctx->error, MS3_ERR_REQUEST_ERROR,
+                      curl_easy_strerror(curl_res),
+                      request_curl_retryable(curl_res));
     ms3_cfree(mem.data);
     curl_slist_free_all(headers);
 
@@ -605,41 +676,25 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
 
   if (response_code == 404)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_NOT_FOUND;
   }
   else if (response_code == 403)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_AUTH;
   }
   else if (response_code >= 400)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_SERVER;
   }
 
+  if (res)
+  {
+    // STS sends the request ID in the body
+    memset(&ctx->error, 0, sizeof(struct request_error_st));
+    request_error_response(&ctx->error, res, response_code, "",
+                           (const char *)mem.data, mem.length);
+  }
+
   switch (cmd)
    {
      case MS3_CMD_LIST_ROLE:
@@ -672,7 +727,27 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
          curl_slist_free_all(headers);
          return res;
        }
-       res = parse_assume_role_response((const char *)mem.data, mem.length, ms3->role_key, ms3->role_secret, ms3->role_session_token);
+       {
+         // Parsed aside so a bad response doesn't touch the credentials in use
+         char role_key[128];
+         char role_secret[1024];
+         // aws says theres no maximum length here.. 2048 might be overkill
+         char role_session_token[2048];
+         time_t expiration = 0;
+
+         role_key[0] = '\0';
+         role_secret[0] = '\0';
+         role_session_token[0] = '\0';
+         res = parse_assume_role_response((const char *)mem.data, mem.length,
+                                          role_key, role_secret,
+                                          role_session_token, &expiration);
+
+         if (!res)
+         {
+           res = credentials_set(ms3, role_key, role_secret,
+                                 role_session_token, expiration);
+         }
+       }
        ms3_cfree(mem.data);
        break;
      }
@@ -684,6 +759,14 @@ uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd,
      case MS3_CMD_DELETE:
      case MS3_CMD_HEAD:
      case MS3_CMD_COPY:
+     case MS3_CMD_GET_FILE:
+     case MS3_CMD_CREATE_MULTIPART:
+     case MS3_CMD_UPLOAD_PART:
+     case MS3_CMD_COMPLETE_MULTIPART:
+     case MS3_CMD_ABORT_MULTIPART:
+     case MS3_CMD_DELETE_MANY:
+     case MS3_CMD_LIST_PAGE:
+     case MS3_CMD_UPLOAD_PART_COPY:
      default:
      {
        ms3_cfree(mem.data);
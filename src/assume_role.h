@@ -19,4 +19,16 @@
 
 #pragma once
 
+#define MAX_ROLE_ARN_LENGTH 2048
+
 uint8_t execute_assume_role_request(ms3_st *ms3, command_t cmd, const uint8_t *data, size_t data_size, char *continuation);
+
+/* Process wide cache of role ARNs so that new handles don't page through
+ * ListRoles again. The key is the access key the role was assumed with.
+ */
+bool role_arn_cache_get(const char *key, const char *role, char *arn,
+                        size_t arn_size);
+
+void role_arn_cache_put(const char *key, const char *role, const char *arn);
+
+void role_arn_cache_clear(void);
@@ -0,0 +1,138 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+/* Free buffers are kept in a singly linked list per size class with the link
+ * stored in the first bytes of the free buffer itself, so the pool needs no
+ * allocations of its own.
+ */
+
+struct buffer_pool_node_st
+{
+  struct buffer_pool_node_st *next;
+};
+
+// Smallest class whose buffers are at least size bytes
+static uint8_t class_for_size(size_t size)
+{
+  uint8_t size_class = BUFFER_POOL_MIN_CLASS;
+
+  while (size_class < BUFFER_POOL_MIN_CLASS + BUFFER_POOL_CLASSES - 1 &&
+         ((size_t)1 << size_class) < size)
+  {
+    size_class++;
+  }
+
+  return size_class;
+}
+
+uint8_t *buffer_pool_get(struct ms3_buffer_pool_st *pool, size_t size,
+                         size_t *alloced)
+{
+  uint8_t size_class = class_for_size(size);
+  size_t class_size = (size_t)1 << size_class;
+  struct buffer_pool_node_st *node;
+
+  if (class_size < size)
+  {
+    // Bigger than the largest class, don't pool it
+    *alloced = size;
+    return ms3_cmalloc(size);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  node = pool->free_list[size_class - BUFFER_POOL_MIN_CLASS];
+
+  if (node)
+  {
+    pool->free_list[size_class - BUFFER_POOL_MIN_CLASS] = node->next;
+    pool->cached -= class_size;
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+  *alloced = class_size;
+
+  if (node)
+  {
+    return (uint8_t *)node;
+  }
+
+  return ms3_cmalloc(class_size);
+}
+
+void buffer_pool_put(struct ms3_buffer_pool_st *pool, uint8_t *data,
+                     size_t alloced)
+{
+  uint8_t size_class = BUFFER_POOL_MIN_CLASS;
+  struct buffer_pool_node_st *node;
+
+  if (!data)
+  {
+    return;
+  }
+
+  // A buffer can only serve the largest class that fits inside it
+  while (size_class < BUFFER_POOL_MIN_CLASS + BUFFER_POOL_CLASSES - 1 &&
+         ((size_t)1 << (size_class + 1)) <= alloced)
+  {
+    size_class++;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+
+  if (alloced < ((size_t)1 << BUFFER_POOL_MIN_CLASS) ||
+      pool->cached + ((size_t)1 << size_class) > pool->max_cached)
+  {
+    pthread_mutex_unlock(&pool->lock);
+    ms3_cfree(data);
+    return;
+  }
+
+  node = (struct buffer_pool_node_st *)data;
+  node->next = pool->free_list[size_class - BUFFER_POOL_MIN_CLASS];
+  pool->free_list[size_class - BUFFER_POOL_MIN_CLASS] = node;
+  pool->cached += (size_t)1 << size_class;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void buffer_pool_clear(struct ms3_buffer_pool_st *pool)
+{
+  uint8_t size_class;
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (size_class = 0; size_class < BUFFER_POOL_CLASSES; size_class++)
+  {
+    struct buffer_pool_node_st *node = pool->free_list[size_class];
+
+    while (node)
+    {
+      struct buffer_pool_node_st *next = node->next;
+      ms3_cfree(node);
+      node = next;
+    }
+
+    pool->free_list[size_class] = NULL;
+  }
+
+  pool->cached = 0;
+  pthread_mutex_unlock(&pool->lock);
+}
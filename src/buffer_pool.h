@@ -0,0 +1,46 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+#include "config.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Buffers are pooled in power of two size classes from 4KB to 2GB
+#define BUFFER_POOL_MIN_CLASS 12
+#define BUFFER_POOL_CLASSES 20
+
+// Safe to use from several threads, the lock is set up by ms3_init()
+struct ms3_buffer_pool_st
+{
+  pthread_mutex_t lock;
+  void *free_list[BUFFER_POOL_CLASSES];
+  size_t cached;
+  size_t max_cached; // 0 means the pool is disabled
+};
+
+uint8_t *buffer_pool_get(struct ms3_buffer_pool_st *pool, size_t size,
+                         size_t *alloced);
+
+void buffer_pool_put(struct ms3_buffer_pool_st *pool, uint8_t *data,
+                     size_t alloced);
+
+void buffer_pool_clear(struct ms3_buffer_pool_st *pool);
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sys/types.h>
 
 #include <curl/curl.h>
 
@@ -36,8 +37,19 @@
 #include "memory.h"
 #include "debug.h"
 #include "error.h"
+#include "buffer_pool.h"
+#include "string_builder.h"
+#include "signed_headers.h"
+#include "request.h"
+#include "status_cache.h"
+#include "disk_cache.h"
+#include "credentials.h"
+#include "instance_credentials.h"
+#include "context.h"
 #include "structs.h"
 #include "response.h"
-#include "request.h"
 #include "assume_role.h"
+#include "multipart.h"
+#include "delete.h"
+#include "status.h"
 
@@ -0,0 +1,263 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+
+static void share_lock(CURL *handle, curl_lock_data data,
+                       curl_lock_access access, void *userptr)
+{
+  ms3_st *ms3 = (ms3_st *) userptr;
+  (void) handle;
+  (void) access;
+
+  pthread_mutex_lock(&ms3->share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+  ms3_st *ms3 = (ms3_st *) userptr;
+  (void) handle;
+
+  pthread_mutex_unlock(&ms3->share_locks[data]);
+}
+
+/* The contexts of all the handles. The list is shared so an exiting thread
+ * can tell whether ms3_deinit() has taken its context without looking at the
+ * context or the handle, either may already be freed.
+ */
+static struct ms3_context_st *contexts = NULL;
+static pthread_mutex_t contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void context_free(struct ms3_context_st *ctx);
+
+// Runs when a thread which used the handle exits
+static void context_thread_exit(void *value)
+{
+  struct ms3_context_st *ctx = (struct ms3_context_st *) value;
+  struct ms3_context_st **pos;
+
+  pthread_mutex_lock(&contexts_lock);
+
+  // Otherwise ms3_deinit() detached it and frees it. The curl handle uses the
+  // handle's share, so ms3_deinit() is held up until it is freed.
+  for (pos = &contexts; *pos; pos = &(*pos)->next)
+  {
+    if (*pos == ctx)
+    {
+      *pos = ctx->next;
+      context_free(ctx);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&contexts_lock);
+}
+
+uint8_t context_init(ms3_st *ms3)
+{
+  int lock_it;
+
+  // Without a key contexts are found by thread ID instead
+  ms3->has_context_key = !pthread_key_create(&ms3->context_key,
+                                             context_thread_exit);
+  pthread_mutex_init(&ms3->credential_lock, NULL);
+  pthread_mutex_init(&ms3->refresh_lock, NULL);
+
+  for (lock_it = 0; lock_it < CURL_LOCK_DATA_LAST; lock_it++)
+  {
+    pthread_mutex_init(&ms3->share_locks[lock_it], NULL);
+  }
+
+  // Connections are not shared, curl doesn't support that across threads
+  ms3->curl_share = curl_share_init();
+
+  if (!ms3->curl_share)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  curl_share_setopt(ms3->curl_share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(ms3->curl_share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(ms3->curl_share, CURLSHOPT_USERDATA, (void *)ms3);
+  curl_share_setopt(ms3->curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(ms3->curl_share, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+
+  return 0;
+}
+
+static void context_free(struct ms3_context_st *ctx)
+{
+  parallel_free(ctx);
+
+  if (ctx->curl)
+  {
+    curl_easy_cleanup(ctx->curl);
+  }
+
+  list_container_free(&ctx->list_container);
+  ms3_cfree(ctx->response.amz_headers);
+  ms3_cfree(ctx->amz_headers);
+  ms3_cfree(ctx);
+}
+
+void context_deinit(ms3_st *ms3)
+{
+  struct ms3_context_st *detached = NULL;
+  struct ms3_context_st **pos;
+  struct ms3_context_st *ctx;
+  int lock_it;
+
+  // Threads exiting from now on leave their context to us
+  if (ms3->has_context_key)
+  {
+    pthread_key_delete(ms3->context_key);
+    ms3->has_context_key = false;
+  }
+
+  // A thread already exiting frees its own if it gets there first
+  pthread_mutex_lock(&contexts_lock);
+  pos = &contexts;
+
+  while (*pos)
+  {
+    ctx = *pos;
+
+    if (ctx->ms3 == ms3)
+    {
+      *pos = ctx->next;
+      ctx->next = detached;
+      detached = ctx;
+    }
+    else
+    {
+      pos = &ctx->next;
+    }
+  }
+
+  pthread_mutex_unlock(&contexts_lock);
+
+  while (detached)
+  {
+    ctx = detached;
+    detached = ctx->next;
+    context_free(ctx);
+  }
+
+  if (ms3->curl_share)
+  {
+    curl_share_cleanup(ms3->curl_share);
+    ms3->curl_share = NULL;
+  }
+
+  for (lock_it = 0; lock_it < CURL_LOCK_DATA_LAST; lock_it++)
+  {
+    pthread_mutex_destroy(&ms3->share_locks[lock_it]);
+  }
+
+  pthread_mutex_destroy(&ms3->refresh_lock);
+  pthread_mutex_destroy(&ms3->credential_lock);
+}
+
+static struct ms3_context_st *context_new(ms3_st *ms3, pthread_t thread)
+{
+  struct ms3_context_st *ctx = ms3_ccalloc(1, sizeof(struct ms3_context_st));
+
+  if (!ctx)
+  {
+    return NULL;
+  }
+
+  ctx->ms3 = ms3;
+  ctx->thread = thread;
+  ctx->first_run = true;
+  ctx->curl = curl_easy_init();
+
+  if (!ctx->curl)
+  {
+    context_free(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+struct ms3_context_st *context_get(ms3_st *ms3)
+{
+  pthread_t self = pthread_self();
+  struct ms3_context_st *ctx;
+
+  if (ms3->has_context_key)
+  {
+    ctx = (struct ms3_context_st *) pthread_getspecific(ms3->context_key);
+
+    if (ctx)
+    {
+      return ctx;
+    }
+
+    ctx = context_new(ms3, self);
+
+    if (!ctx)
+    {
+      return NULL;
+    }
+
+    if (pthread_setspecific(ms3->context_key, ctx))
+    {
+      context_free(ctx);
+      return NULL;
+    }
+
+    pthread_mutex_lock(&contexts_lock);
+    ctx->next = contexts;
+    contexts = ctx;
+    pthread_mutex_unlock(&contexts_lock);
+
+    return ctx;
+  }
+
+  pthread_mutex_lock(&contexts_lock);
+
+  for (ctx = contexts; ctx; ctx = ctx->next)
+  {
+    if (ctx->ms3 == ms3 && pthread_equal(ctx->thread, self))
+    {
+      break;
+    }
+  }
+
+  // A thread which exited leaves its context for the next with the same ID
+  if (!ctx)
+  {
+    ctx = context_new(ms3, self);
+
+    if (ctx)
+    {
+      ctx->next = contexts;
+      contexts = ctx;
+    }
+  }
+
+  pthread_mutex_unlock(&contexts_lock);
+
+  return ctx;
+}
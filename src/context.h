@@ -0,0 +1,44 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+
+struct ms3_context_st;
+
+/* A handle can be used by several threads at once once its options are set.
+ * Each thread gets its own curl handle and results, kept in a thread specific
+ * key and freed when the thread exits, while the DNS cache and TLS sessions
+ * are shared between them. If the process is out of keys the contexts are
+ * found by thread ID and kept until the handle is freed.
+ */
+
+// Sets up the locks and the curl share of a new handle
+uint8_t context_init(ms3_st *ms3);
+
+// Frees the contexts of all threads, none may still be using the handle
+void context_deinit(ms3_st *ms3);
+
+/* The context of the calling thread, created on first use. NULL if it
+ * could not be allocated.
+ */
+struct ms3_context_st *context_get(ms3_st *ms3);
@@ -0,0 +1,191 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+
+static void credentials_free(struct credentials_st *credentials)
+{
+  ms3_cfree(credentials->key);
+  ms3_cfree(credentials->secret);
+  ms3_cfree(credentials->token);
+  ms3_cfree(credentials);
+}
+
+uint8_t credentials_set(ms3_st *ms3, const char *key, const char *secret,
+                        const char *token, time_t expiration)
+{
+  struct credentials_st *credentials;
+  struct credentials_st *old;
+
+  credentials = ms3_ccalloc(1, sizeof(struct credentials_st));
+
+  if (!credentials)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  credentials->refs = 1; // The handle's own reference
+  credentials->key = ms3_cstrdup(key);
+  credentials->secret = ms3_cstrdup(secret);
+  credentials->token = token ? ms3_cstrdup(token) : NULL;
+
+  if (!credentials->key || !credentials->secret ||
+      (token && !credentials->token))
+  {
+    credentials_free(credentials);
+    return MS3_ERR_OOM;
+  }
+
+  pthread_mutex_lock(&ms3->credential_lock);
+  old = ms3->role_credentials;
+  ms3->role_credentials = credentials;
+  ms3->credential_expiration = expiration;
+  pthread_mutex_unlock(&ms3->credential_lock);
+  ms3->refresh_failed = 0;
+
+  credentials_release(ms3, old);
+  return 0;
+}
+
+struct credentials_st *credentials_get(ms3_st *ms3)
+{
+  struct credentials_st *credentials;
+
+  pthread_mutex_lock(&ms3->credential_lock);
+  credentials = ms3->role_credentials;
+
+  if (credentials)
+  {
+    credentials->refs++;
+  }
+
+  pthread_mutex_unlock(&ms3->credential_lock);
+  return credentials;
+}
+
+void credentials_release(ms3_st *ms3, struct credentials_st *credentials)
+{
+  bool last;
+
+  if (!credentials)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&ms3->credential_lock);
+  last = !--credentials->refs;
+  pthread_mutex_unlock(&ms3->credential_lock);
+
+  if (last)
+  {
+    credentials_free(credentials);
+  }
+}
+
+// When the current credentials expire, 0 if they are never refreshed
+static time_t credentials_expiration(ms3_st *ms3)
+{
+  time_t expiration;
+
+  pthread_mutex_lock(&ms3->credential_lock);
+  expiration = ms3->credential_provider ? ms3->credential_expiration : 0;
+  pthread_mutex_unlock(&ms3->credential_lock);
+
+  return expiration;
+}
+
+uint8_t credentials_refresh(ms3_st *ms3)
+{
+  time_t now = time(NULL);
+  time_t expiration = credentials_expiration(ms3);
+  uint8_t res;
+
+  if (!expiration || now + ms3->credential_refresh_window < expiration)
+  {
+    return 0;
+  }
+
+  /* One thread refreshes. While the current credentials are still valid the
+   * others carry on signing with them, they only wait for the refresh once
+   * the credentials have expired.
+   */
+  if (pthread_mutex_trylock(&ms3->refresh_lock))
+  {
+    if (now < expiration)
+    {
+      return 0;
+    }
+
+    pthread_mutex_lock(&ms3->refresh_lock);
+  }
+
+  expiration = credentials_expiration(ms3);
+
+  // After a failure the current credentials are used for a while before the
+  // next attempt, rather than every request trying again
+  if (!expiration || now + ms3->credential_refresh_window < expiration ||
+      (now < expiration && now < ms3->refresh_failed + REFRESH_RETRY_SECONDS))
+  {
+    pthread_mutex_unlock(&ms3->refresh_lock);
+    return 0;
+  }
+
+  ms3debug("Refreshing credentials expiring at %" PRId64, (int64_t)expiration);
+  res = ms3->credential_provider(ms3);
+
+  if (res && now < expiration)
+  {
+    ms3->refresh_failed = now;
+    pthread_mutex_unlock(&ms3->refresh_lock);
+    ms3debug("Credential refresh failed: %u, keeping current credentials", res);
+    return 0;
+  }
+
+  pthread_mutex_unlock(&ms3->refresh_lock);
+  return res;
+}
+
+uint8_t credentials_assume_role(ms3_st *ms3)
+{
+  return execute_assume_role_request(ms3, MS3_CMD_ASSUME_ROLE, NULL, 0, NULL);
+}
+
+uint8_t credentials_callback(ms3_st *ms3)
+{
+  ms3_credentials_st credentials;
+  uint8_t res;
+
+  memset(&credentials, 0, sizeof(credentials));
+  res = ms3->credential_callback(ms3, &credentials, ms3->credential_userdata);
+
+  if (res)
+  {
+    return res;
+  }
+
+  if (!credentials.key || !credentials.secret)
+  {
+    return MS3_ERR_AUTH;
+  }
+
+  return credentials_set(ms3, credentials.key, credentials.secret,
+                         credentials.token, credentials.expiration);
+}
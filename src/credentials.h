@@ -0,0 +1,75 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Seconds before expiry that temporary credentials are replaced
+#define CREDENTIAL_REFRESH_WINDOW_DEFAULT 300
+// Time between refreshes, so a failing endpoint isn't hammered
+#define REFRESH_RETRY_SECONDS 10
+
+/* A source of temporary credentials. It fetches a new set and stores them
+ * with credentials_set(), returning an MS3_ERR_* code on failure.
+ */
+typedef uint8_t (*credential_provider_fn)(ms3_st *ms3);
+
+/* A set of temporary credentials. Requests take a reference while they sign
+ * so that the lock isn't held for the signing, a replaced set is freed once
+ * the last request using it lets go.
+ */
+struct credentials_st
+{
+  size_t refs;
+  char *key;
+  char *secret;
+  char *token; // NULL if there isn't one
+};
+
+/* Replaces the signing credentials. The copies are made first so a failure
+ * leaves the current credentials in place. token can be NULL, expiration is
+ * 0 for credentials which don't expire.
+ */
+uint8_t credentials_set(ms3_st *ms3, const char *key, const char *secret,
+                        const char *token, time_t expiration);
+
+/* Returns a reference to the temporary credentials, or NULL when the keys
+ * given to ms3_init() are used
+ */
+struct credentials_st *credentials_get(ms3_st *ms3);
+
+// Drops a reference, NULL is ignored
+void credentials_release(ms3_st *ms3, struct credentials_st *credentials);
+
+/* Called before each request is signed. Asks the provider for new
+ * credentials once the current ones are within the refresh window of
+ * expiring. If that fails the current credentials are kept until they have
+ * actually expired.
+ */
+uint8_t credentials_refresh(ms3_st *ms3);
+
+// Providers
+
+uint8_t credentials_assume_role(ms3_st *ms3);
+
+uint8_t credentials_callback(ms3_st *ms3);
@@ -0,0 +1,550 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include "config.h"
+#include "common.h"
+
+/* Multi-object delete. Keys are sent to DeleteObjects in batches of up to
+ * MAX_DELETE_KEYS and the batches run in parallel.
+ */
+
+struct delete_job_st
+{
+  const char *bucket;
+  struct delete_batch_st *batches;
+};
+
+static size_t xml_escaped_length(const char *data)
+{
+  size_t length = 0;
+
+  for (; *data; data++)
+  {
+    switch (*data)
+    {
+      case '&':
+        length += 5;
+        break;
+
+      case '<':
+      case '>':
+        length += 4;
+        break;
+
+      case '"':
+      case '\'':
+        length += 6;
+        break;
+
+      default:
+        length++;
+    }
+  }
+
+  return length;
+}
+
+static char *xml_escape_append(char *out, const char *data)
+{
+  for (; *data; data++)
+  {
+    switch (*data)
+    {
+      case '&':
+        memcpy(out, "&amp;", 5);
+        out += 5;
+        break;
+
+      case '<':
+        memcpy(out, "&lt;", 4);
+        out += 4;
+        break;
+
+      case '>':
+        memcpy(out, "&gt;", 4);
+        out += 4;
+        break;
+
+      case '"':
+        memcpy(out, "&quot;", 6);
+        out += 6;
+        break;
+
+      case '\'':
+        memcpy(out, "&apos;", 6);
+        out += 6;
+        break;
+
+      default:
+        *out++ = *data;
+    }
+  }
+
+  return out;
+}
+
+// Quiet mode so that the response only lists the keys which failed
+static char *build_delete_body(struct delete_batch_st *batch, size_t *length)
+{
+  static const char *body_start = "<Delete><Quiet>true</Quiet>";
+  static const char *body_end = "</Delete>";
+  static const char *object_start = "<Object><Key>";
+  static const char *object_end = "</Key></Object>";
+  size_t body_size = strlen(body_start) + strlen(body_end) + 1;
+  size_t key_it;
+  char *body;
+  char *pos;
+
+  for (key_it = 0; key_it < batch->count; key_it++)
+  {
+    body_size += strlen(object_start) + strlen(object_end) +
+                 xml_escaped_length(batch->keys[key_it]);
+  }
+
+  body = ms3_cmalloc(body_size);
+
+  if (!body)
+  {
+    return NULL;
+  }
+
+  pos = body;
+  memcpy(pos, body_start, strlen(body_start));
+  pos += strlen(body_start);
+
+  for (key_it = 0; key_it < batch->count; key_it++)
+  {
+    memcpy(pos, object_start, strlen(object_start));
+    pos += strlen(object_start);
+    pos = xml_escape_append(pos, batch->keys[key_it]);
+    memcpy(pos, object_end, strlen(object_end));
+    pos += strlen(object_end);
+  }
+
+  memcpy(pos, body_end, strlen(body_end));
+  pos += strlen(body_end);
+  *pos = '\0';
+  *length = (size_t)(pos - body);
+
+  return body;
+}
+
+static uint8_t delete_request_init(struct request_st *request,
+                                   const char *bucket, struct delete_batch_st *batch)
+{
+  size_t body_length = 0;
+
+  batch->body = build_delete_body(batch, &body_length);
+
+  if (!batch->body)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  request_init(request, MS3_CMD_DELETE_MANY, bucket, NULL);
+  request->query = "delete=";
+  request->data = (uint8_t *)batch->body;
+  request->data_size = body_length;
+  request->ret_ptr = batch;
+
+  return 0;
+}
+
+static uint8_t delete_setup(ms3_st *ms3, size_t index,
+                            struct request_st *request, void *userdata)
+{
+  struct delete_job_st *job = (struct delete_job_st *)userdata;
+  (void) ms3;
+
+  return delete_request_init(request, job->bucket, &job->batches[index]);
+}
+
+static uint8_t delete_done(ms3_st *ms3, size_t index,
+                           struct request_st *request, uint8_t result, void *userdata)
+{
+  struct delete_job_st *job = (struct delete_job_st *)userdata;
+  struct delete_batch_st *batch = &job->batches[index];
+  (void) ms3;
+  (void) request;
+
+  // The whole batch failed
+  if (result)
+  {
+    memset(batch->results, result, batch->count);
+  }
+
+  ms3_cfree(batch->body);
+  batch->body = NULL;
+  batch->finished = true;
+
+  return result;
+}
+
+uint8_t delete_keys(ms3_st *ms3, const char *bucket, const char **keys,
+                    size_t count, uint8_t *results)
+{
+  uint8_t res;
+  size_t batch_count = (count + MAX_DELETE_KEYS - 1) / MAX_DELETE_KEYS;
+  size_t batch_it;
+  size_t key_it;
+  struct delete_job_st job;
+
+  job.bucket = bucket;
+  job.batches = ms3_ccalloc(batch_count, sizeof(struct delete_batch_st));
+
+  if (!job.batches)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  memset(results, MS3_ERR_NONE, count);
+
+  for (batch_it = 0; batch_it < batch_count; batch_it++)
+  {
+    struct delete_batch_st *batch = &job.batches[batch_it];
+    size_t start = batch_it * MAX_DELETE_KEYS;
+
+    batch->keys = keys + start;
+    batch->results = results + start;
+    batch->count = count - start;
+
+    if (batch->count > MAX_DELETE_KEYS)
+    {
+      batch->count = MAX_DELETE_KEYS;
+    }
+  }
+
+  res = execute_parallel(ms3, batch_count, delete_setup, delete_done, &job);
+
+  // Batches which were never sent, or failed in setup, are not deleted
+  for (batch_it = 0; batch_it < batch_count; batch_it++)
+  {
+    struct delete_batch_st *batch = &job.batches[batch_it];
+
+    if (!batch->finished)
+    {
+      memset(batch->results, res, batch->count);
+      ms3_cfree(batch->body);
+    }
+  }
+
+  ms3_cfree(job.batches);
+
+  if (res)
+  {
+    return res;
+  }
+
+  for (key_it = 0; key_it < count; key_it++)
+  {
+    if (results[key_it])
+    {
+      return results[key_it];
+    }
+  }
+
+  return 0;
+}
+
+/* Deleting a prefix runs the listing and the deletes on the same parallel
+ * runner. One slot lists the next page while the others delete the pages
+ * already listed, so the keys held in memory are bounded by the number of
+ * slots rather than by the size of the prefix.
+ */
+
+struct prefix_job_st
+{
+  const char *bucket;
+  const char *prefix;
+  char *continuation;
+  bool list_running;
+  bool list_done;
+  struct list_page_st *queue; // Listed pages waiting for a free slot
+  struct list_page_st *queue_tail;
+  size_t queued;
+  struct list_page_st *active; // Pages with a request in flight
+  uint8_t first_failure;
+  ms3_delete_progress_callback callback;
+  void *userdata;
+  ms3_delete_progress_st *progress;
+};
+
+static void list_page_free(struct list_page_st *page)
+{
+  list_container_free(&page->container);
+  ms3_cfree(page->continuation);
+  ms3_cfree(page->batch.keys);
+  ms3_cfree(page->batch.results);
+  ms3_cfree(page->batch.body);
+  ms3_cfree(page);
+}
+
+// Turns a listed page into a delete batch
+static uint8_t list_page_batch(struct list_page_st *page)
+{
+  ms3_list_st *list;
+  size_t count = 0;
+
+  for (list = page->container.start; list; list = list->next)
+  {
+    count++;
+  }
+
+  if (!count)
+  {
+    return 0;
+  }
+
+  page->batch.keys = ms3_cmalloc(count * sizeof(char *));
+  page->batch.results = ms3_ccalloc(count, 1);
+
+  if (!page->batch.keys || !page->batch.results)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  for (list = page->container.start; list; list = list->next)
+  {
+    page->batch.keys[page->batch.count++] = list->key;
+  }
+
+  return 0;
+}
+
+static void active_add(struct prefix_job_st *job, struct list_page_st *page)
+{
+  page->next = job->active;
+  job->active = page;
+}
+
+static void active_remove(struct prefix_job_st *job, struct list_page_st *page)
+{
+  struct list_page_st **it;
+
+  for (it = &job->active; *it; it = &(*it)->next)
+  {
+    if (*it == page)
+    {
+      *it = page->next;
+      page->next = NULL;
+      return;
+    }
+  }
+}
+
+static uint8_t prefix_setup(ms3_st *ms3, size_t index,
+                            struct request_st *request, void *userdata)
+{
+  struct prefix_job_st *job = (struct prefix_job_st *)userdata;
+  struct list_page_st *page;
+  (void) ms3;
+  (void) index;
+
+  // Keep the listing one page ahead of the deletes
+  if (!job->list_running && !job->list_done && job->queued < 1)
+  {
+    page = ms3_ccalloc(1, sizeof(struct list_page_st));
+
+    if (!page)
+    {
+      return MS3_ERR_OOM;
+    }
+
+    request_init(request, MS3_CMD_LIST_PAGE, job->bucket, NULL);
+    request->filter = job->prefix;
+    request->continuation = job->continuation;
+    request->ret_ptr = page;
+    job->list_running = true;
+    active_add(job, page);
+
+    return 0;
+  }
+
+  if (job->queue)
+  {
+    uint8_t res;
+
+    page = job->queue;
+    job->queue = page->next;
+    job->queued--;
+
+    if (!job->queue)
+    {
+      job->queue_tail = NULL;
+    }
+
+    res = delete_request_init(request, job->bucket, &page->batch);
+
+    if (res)
+    {
+      list_page_free(page);
+      return res;
+    }
+
+    active_add(job, page);
+    return 0;
+  }
+
+  if (job->list_done)
+  {
+    return PARALLEL_DONE;
+  }
+
+  return PARALLEL_WAIT;
+}
+
+static uint8_t prefix_list_done(struct prefix_job_st *job,
+                                struct list_page_st *page, uint8_t result)
+{
+  job->list_running = false;
+
+  if (!result)
+  {
+    result = list_page_batch(page);
+  }
+
+  if (result)
+  {
+    list_page_free(page);
+    return result;
+  }
+
+  ms3_cfree(job->continuation);
+  job->continuation = page->continuation;
+  page->continuation = NULL;
+
+  if (!job->continuation)
+  {
+    job->list_done = true;
+  }
+
+  if (!page->batch.count)
+  {
+    list_page_free(page);
+    return 0;
+  }
+
+  job->progress->listed += page->batch.count;
+  page->next = NULL;
+
+  if (job->queue_tail)
+  {
+    job->queue_tail->next = page;
+  }
+  else
+  {
+    job->queue = page;
+  }
+
+  job->queue_tail = page;
+  job->queued++;
+
+  return 0;
+}
+
+static uint8_t prefix_delete_done(struct prefix_job_st *job,
+                                  struct list_page_st *page, uint8_t result)
+{
+  size_t key_it;
+
+  for (key_it = 0; key_it < page->batch.count; key_it++)
+  {
+    uint8_t key_result = result ? result : page->batch.results[key_it];
+
+    if (key_result)
+    {
+      job->progress->failed++;
+
+      if (!job->first_failure)
+      {
+        job->first_failure = key_result;
+      }
+    }
+    else
+    {
+      job->progress->deleted++;
+    }
+  }
+
+  list_page_free(page);
+
+  if (job->callback)
+  {
+    job->callback(job->progress, job->userdata);
+  }
+
+  return result;
+}
+
+static uint8_t prefix_done(ms3_st *ms3, size_t index,
+                           struct request_st *request, uint8_t result, void *userdata)
+{
+  struct prefix_job_st *job = (struct prefix_job_st *)userdata;
+  struct list_page_st *page = (struct list_page_st *)request->ret_ptr;
+  (void) ms3;
+  (void) index;
+
+  active_remove(job, page);
+
+  if (request->cmd == MS3_CMD_LIST_PAGE)
+  {
+    return prefix_list_done(job, page, result);
+  }
+
+  return prefix_delete_done(job, page, result);
+}
+
+uint8_t delete_prefix(ms3_st *ms3, const char *bucket, const char *prefix,
+                      ms3_delete_progress_callback callback, void *userdata,
+                      ms3_delete_progress_st *progress)
+{
+  uint8_t res;
+  struct prefix_job_st job;
+
+  memset(&job, 0, sizeof(job));
+  memset(progress, 0, sizeof(ms3_delete_progress_st));
+  job.bucket = bucket;
+  job.prefix = prefix;
+  job.callback = callback;
+  job.userdata = userdata;
+  job.progress = progress;
+
+  res = execute_parallel(ms3, SIZE_MAX, prefix_setup, prefix_done, &job);
+
+  // Pages listed but never deleted after an error, or whose request failed
+  // to be set up
+  while (job.queue)
+  {
+    struct list_page_st *page = job.queue;
+    job.queue = page->next;
+    list_page_free(page);
+  }
+
+  while (job.active)
+  {
+    struct list_page_st *page = job.active;
+    job.active = page->next;
+    list_page_free(page);
+  }
+
+  ms3_cfree(job.continuation);
+
+  return res ? res : job.first_failure;
+}
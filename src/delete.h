@@ -0,0 +1,51 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* One DeleteObjects request of at most MAX_DELETE_KEYS keys */
+struct delete_batch_st
+{
+  const char **keys;
+  size_t count;
+  uint8_t *results; // One MS3_ERR_* code per key
+  char *body;
+  bool finished;
+};
+
+uint8_t delete_keys(ms3_st *ms3, const char *bucket, const char **keys,
+                    size_t count, uint8_t *results);
+
+/* One page of a listing, deleted as a single batch */
+struct list_page_st
+{
+  struct delete_batch_st batch; // First so the request's ret_ptr finds the page
+  struct ms3_list_container_st container;
+  char *continuation;
+  struct list_page_st *next;
+};
+
+uint8_t delete_prefix(ms3_st *ms3, const char *bucket, const char *prefix,
+                      ms3_delete_progress_callback callback, void *userdata,
+                      ms3_delete_progress_st *progress);
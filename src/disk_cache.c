@@ -0,0 +1,838 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+#include "sha256.h"
+#include "md5.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Each object is a file named by the SHA-256 of "bucket/key". The file
+ * starts with a header holding the full name, the ETag and an MD5 of the
+ * data which are all checked before the file is used. Files are written to
+ * a temporary name and renamed so a reader never sees a partial file.
+ *
+ * The files are indexed in a chained hash table on the file name, with
+ * every entry also on a list in order of use. The order is kept in the file
+ * modification times so it survives between handles. Files are read and
+ * written without the lock held, an entry in use is pinned so that removing
+ * it meanwhile only takes it out of the index and the last user frees it.
+ */
+
+#define DISK_CACHE_MAGIC "MS3CACH1"
+#define DISK_CACHE_SUFFIX ".ms3"
+// 64 hex digits plus the suffix
+#define DISK_CACHE_FILE_LENGTH 68
+
+struct disk_cache_header_st
+{
+  char magic[8];
+  uint64_t length;
+  uint8_t md5[MD5_MAC_LEN];
+  uint32_t name_length;
+  char etag[MAX_ETAG_LENGTH];
+  char content_type[128];
+};
+
+struct disk_cache_entry_st
+{
+  struct disk_cache_entry_st *hash_next;
+  struct disk_cache_entry_st *lru_prev;
+  struct disk_cache_entry_st *lru_next;
+  size_t size; // Of the whole file
+  time_t mtime; // Only used to order the entries when indexing
+  uint32_t hash;
+  size_t refs; // Readers using the entry
+  bool removed; // No longer indexed, freed by the last reader
+  char file[DISK_CACHE_FILE_LENGTH + 1];
+};
+
+static void lru_unlink(struct ms3_disk_cache_st *cache,
+                       struct disk_cache_entry_st *entry)
+{
+  if (entry->lru_prev)
+  {
+    entry->lru_prev->lru_next = entry->lru_next;
+  }
+  else
+  {
+    cache->lru_head = entry->lru_next;
+  }
+
+  if (entry->lru_next)
+  {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  }
+  else
+  {
+    cache->lru_tail = entry->lru_prev;
+  }
+}
+
+static void lru_push(struct ms3_disk_cache_st *cache,
+                     struct disk_cache_entry_st *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+
+  if (cache->lru_head)
+  {
+    cache->lru_head->lru_prev = entry;
+  }
+  else
+  {
+    cache->lru_tail = entry;
+  }
+
+  cache->lru_head = entry;
+}
+
+static char *cache_path(const struct ms3_disk_cache_st *cache,
+                        const char *file, const char *suffix)
+{
+  size_t length = strlen(cache->dir) + strlen(file) + strlen(suffix) + 2;
+  char *path = ms3_cmalloc(length);
+
+  if (path)
+  {
+    snprintf(path, length, "%s/%s%s", cache->dir, file, suffix);
+  }
+
+  return path;
+}
+
+// Builds "bucket/key" and the file name for it, the name must be freed
+static char *cache_name(const char *bucket, const char *key, char *file)
+{
+  static const char *hex = "0123456789abcdef";
+  size_t length = strlen(bucket) + strlen(key) + 2;
+  uint8_t hash[32];
+  char *name = ms3_cmalloc(length);
+  size_t pos;
+
+  if (!name)
+  {
+    return NULL;
+  }
+
+  snprintf(name, length, "%s/%s", bucket, key);
+  sha256((const uint8_t *)name, length - 1, hash);
+
+  for (pos = 0; pos < sizeof(hash); pos++)
+  {
+    file[pos * 2] = hex[hash[pos] >> 4];
+    file[pos * 2 + 1] = hex[hash[pos] & 0x0f];
+  }
+
+  memcpy(file + 64, DISK_CACHE_SUFFIX, sizeof(DISK_CACHE_SUFFIX));
+
+  return name;
+}
+
+// The file name is already a hash, the first 8 digits will do
+static uint32_t file_hash(const char *file)
+{
+  uint32_t hash = 0;
+  size_t pos;
+
+  for (pos = 0; pos < 8; pos++)
+  {
+    char digit = file[pos];
+
+    hash = (hash << 4) | (uint32_t)(digit <= '9' ? digit - '0' :
+                                    (digit | 0x20) - 'a' + 10);
+  }
+
+  return hash;
+}
+
+static struct disk_cache_entry_st *find_entry(struct ms3_disk_cache_st *cache,
+                                              const char *file)
+{
+  uint32_t hash = file_hash(file);
+  struct disk_cache_entry_st *entry;
+
+  if (!cache->table_size)
+  {
+    return NULL;
+  }
+
+  for (entry = cache->table[hash & (cache->table_size - 1)]; entry;
+       entry = entry->hash_next)
+  {
+    if (entry->hash == hash && !memcmp(entry->file, file, DISK_CACHE_FILE_LENGTH))
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+// Doubles the table, entries stay where they are if that fails
+static void table_grow(struct ms3_disk_cache_st *cache)
+{
+  size_t table_size = cache->table_size ? cache->table_size * 2 : 64;
+  struct disk_cache_entry_st **table =
+    ms3_ccalloc(table_size, sizeof(struct disk_cache_entry_st *));
+  struct disk_cache_entry_st *entry;
+
+  if (!table)
+  {
+    return;
+  }
+
+  for (entry = cache->lru_head; entry; entry = entry->lru_next)
+  {
+    struct disk_cache_entry_st **link = &table[entry->hash & (table_size - 1)];
+
+    entry->hash_next = *link;
+    *link = entry;
+  }
+
+  ms3_cfree(cache->table);
+  cache->table = table;
+  cache->table_size = table_size;
+}
+
+// Indexes an entry as the most recently used, false if there is no table
+static bool add_entry(struct ms3_disk_cache_st *cache,
+                      struct disk_cache_entry_st *entry)
+{
+  struct disk_cache_entry_st **link;
+
+  if (cache->count >= cache->table_size)
+  {
+    table_grow(cache);
+  }
+
+  if (!cache->table_size)
+  {
+    return false;
+  }
+
+  entry->hash = file_hash(entry->file);
+  entry->refs = 0;
+  entry->removed = false;
+  link = &cache->table[entry->hash & (cache->table_size - 1)];
+  entry->hash_next = *link;
+  *link = entry;
+  lru_push(cache, entry);
+  cache->size += entry->size;
+  cache->count++;
+
+  return true;
+}
+
+// Takes an entry out of the index, the file is left alone
+static void detach_entry(struct ms3_disk_cache_st *cache,
+                         struct disk_cache_entry_st *entry)
+{
+  struct disk_cache_entry_st **link =
+    &cache->table[entry->hash & (cache->table_size - 1)];
+
+  while (*link != entry)
+  {
+    link = &(*link)->hash_next;
+  }
+
+  *link = entry->hash_next;
+  lru_unlink(cache, entry);
+  cache->size -= entry->size;
+  cache->count--;
+
+  if (entry->refs)
+  {
+    entry->removed = true;
+  }
+  else
+  {
+    ms3_cfree(entry);
+  }
+}
+
+static void remove_entry(struct ms3_disk_cache_st *cache,
+                         struct disk_cache_entry_st *entry)
+{
+  char *path = cache_path(cache, entry->file, "");
+
+  if (path)
+  {
+    unlink(path);
+    ms3_cfree(path);
+  }
+
+  detach_entry(cache, entry);
+}
+
+static bool read_all(int fd, void *data, size_t length)
+{
+  uint8_t *pos = (uint8_t *)data;
+
+  while (length)
+  {
+    ssize_t bytes = read(fd, pos, length);
+
+    if (bytes < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (bytes <= 0)
+    {
+      return false;
+    }
+
+    pos += bytes;
+    length -= (size_t)bytes;
+  }
+
+  return true;
+}
+
+static bool write_all(int fd, const void *data, size_t length)
+{
+  const uint8_t *pos = (const uint8_t *)data;
+
+  while (length)
+  {
+    ssize_t bytes = write(fd, pos, length);
+
+    if (bytes < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (bytes <= 0)
+    {
+      return false;
+    }
+
+    pos += bytes;
+    length -= (size_t)bytes;
+  }
+
+  return true;
+}
+
+static int compare_mtime(const void *a, const void *b)
+{
+  const struct disk_cache_entry_st *entry_a =
+    *(const struct disk_cache_entry_st * const *)a;
+  const struct disk_cache_entry_st *entry_b =
+    *(const struct disk_cache_entry_st * const *)b;
+
+  if (entry_a->mtime != entry_b->mtime)
+  {
+    return entry_a->mtime < entry_b->mtime ? -1 : 1;
+  }
+
+  return strcmp(entry_a->file, entry_b->file);
+}
+
+static bool is_cache_file(const char *name)
+{
+  size_t pos;
+
+  if (strlen(name) != DISK_CACHE_FILE_LENGTH ||
+      strcmp(name + 64, DISK_CACHE_SUFFIX))
+  {
+    return false;
+  }
+
+  for (pos = 0; pos < 64; pos++)
+  {
+    if (!isxdigit((unsigned char)name[pos]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Checks a file against the name and a non-empty etag, reading the data
+ * into mem and checking its MD5 too
+ */
+static bool read_file(int fd, const char *name, const char *etag,
+                      struct disk_cache_header_st *header,
+                      struct memory_buffer_st *mem)
+{
+  struct stat file_stat;
+  uint8_t md5_data[MD5_MAC_LEN];
+  char *stored_name;
+  size_t name_length = strlen(name);
+  bool valid;
+
+  if (!read_all(fd, header, sizeof(struct disk_cache_header_st)) ||
+      memcmp(header->magic, DISK_CACHE_MAGIC, sizeof(header->magic)) ||
+      header->name_length != name_length ||
+      fstat(fd, &file_stat) ||
+      (uint64_t)file_stat.st_size != sizeof(struct disk_cache_header_st) +
+                                     name_length + header->length ||
+      header->etag[MAX_ETAG_LENGTH - 1] != '\0' ||
+      header->content_type[sizeof(header->content_type) - 1] != '\0' ||
+      (etag && etag[0] && strcmp(etag, header->etag)) ||
+      header->length >= SIZE_MAX)
+  {
+    return false;
+  }
+
+  stored_name = ms3_cmalloc(name_length);
+  valid = stored_name && read_all(fd, stored_name, name_length) &&
+          !memcmp(stored_name, name, name_length);
+  ms3_cfree(stored_name);
+
+  if (!valid)
+  {
+    return false;
+  }
+
+  mem->length = 0;
+
+  if (!memory_buffer_reserve_body(mem, (size_t)header->length) ||
+      !read_all(fd, mem->data, (size_t)header->length))
+  {
+    return false;
+  }
+
+  md5(mem->data, (size_t)header->length, md5_data);
+
+  return !memcmp(md5_data, header->md5, MD5_MAC_LEN);
+}
+
+/* The functions below take the cache lock and call these */
+
+static void cache_close(struct ms3_disk_cache_st *cache)
+{
+  struct disk_cache_entry_st *entry = cache->lru_head;
+
+  while (entry)
+  {
+    struct disk_cache_entry_st *next = entry->lru_next;
+    ms3_cfree(entry);
+    entry = next;
+  }
+
+  ms3_cfree(cache->dir);
+  ms3_cfree(cache->table);
+  cache->dir = NULL;
+  cache->table = NULL;
+  cache->table_size = 0;
+  cache->count = 0;
+  cache->size = 0;
+  cache->lru_head = NULL;
+  cache->lru_tail = NULL;
+}
+
+static void cache_trim(struct ms3_disk_cache_st *cache)
+{
+  while (cache->size > cache->max_size && cache->lru_tail)
+  {
+    remove_entry(cache, cache->lru_tail);
+  }
+}
+
+static uint8_t cache_open(struct ms3_disk_cache_st *cache, const char *dir)
+{
+  DIR *handle;
+  struct dirent *dirent;
+  struct disk_cache_entry_st **entries = NULL;
+  size_t entry_count = 0;
+  size_t entry_alloced = 0;
+  size_t entry_it;
+
+  cache_close(cache);
+
+  if (mkdir(dir, 0777) && errno != EEXIST)
+  {
+    ms3debug("Could not create %s: %s", dir, strerror(errno));
+    return MS3_ERR_FILE;
+  }
+
+  handle = opendir(dir);
+
+  if (!handle)
+  {
+    ms3debug("Could not open %s: %s", dir, strerror(errno));
+    return MS3_ERR_FILE;
+  }
+
+  cache->dir = ms3_cstrdup(dir);
+
+  if (!cache->dir)
+  {
+    closedir(handle);
+    return MS3_ERR_OOM;
+  }
+
+  while ((dirent = readdir(handle)))
+  {
+    struct stat file_stat;
+    struct disk_cache_entry_st *entry;
+
+    if (!is_cache_file(dirent->d_name) ||
+        fstatat(dirfd(handle), dirent->d_name, &file_stat, 0) ||
+        !S_ISREG(file_stat.st_mode))
+    {
+      continue;
+    }
+
+    if (entry_count == entry_alloced)
+    {
+      size_t new_alloced = entry_alloced ? entry_alloced * 2 : 64;
+      struct disk_cache_entry_st **new_entries =
+        ms3_crealloc(entries, new_alloced * sizeof(struct disk_cache_entry_st *));
+
+      if (!new_entries)
+      {
+        break;
+      }
+
+      entries = new_entries;
+      entry_alloced = new_alloced;
+    }
+
+    entry = ms3_cmalloc(sizeof(struct disk_cache_entry_st));
+
+    if (!entry)
+    {
+      break;
+    }
+
+    memcpy(entry->file, dirent->d_name, DISK_CACHE_FILE_LENGTH + 1);
+    entry->size = (size_t)file_stat.st_size;
+    entry->mtime = file_stat.st_mtime;
+    entries[entry_count++] = entry;
+  }
+
+  closedir(handle);
+
+  // Oldest first, so the most recently used ends up at the head
+  if (entry_count)
+  {
+    qsort(entries, entry_count, sizeof(struct disk_cache_entry_st *),
+          compare_mtime);
+  }
+
+  for (entry_it = 0; entry_it < entry_count; entry_it++)
+  {
+    if (!add_entry(cache, entries[entry_it]))
+    {
+      ms3_cfree(entries[entry_it]);
+    }
+  }
+
+  ms3_cfree(entries);
+  cache_trim(cache);
+
+  return 0;
+}
+
+static void cache_invalidate(struct ms3_disk_cache_st *cache,
+                             const char *bucket, const char *key)
+{
+  char file[DISK_CACHE_FILE_LENGTH + 1];
+  struct disk_cache_entry_st *entry;
+  char *name;
+  char *path;
+
+  if (!cache->dir || !bucket || !key)
+  {
+    return;
+  }
+
+  name = cache_name(bucket, key, file);
+
+  if (!name)
+  {
+    return;
+  }
+
+  ms3_cfree(name);
+  entry = find_entry(cache, file);
+
+  if (entry)
+  {
+    remove_entry(cache, entry);
+    return;
+  }
+
+  // Written by another handle since the directory was indexed
+  path = cache_path(cache, file, "");
+
+  if (path)
+  {
+    unlink(path);
+    ms3_cfree(path);
+  }
+}
+
+uint8_t disk_cache_open(struct ms3_disk_cache_st *cache, const char *dir)
+{
+  uint8_t ret;
+
+  pthread_mutex_lock(&cache->lock);
+  ret = cache_open(cache, dir);
+  pthread_mutex_unlock(&cache->lock);
+
+  return ret;
+}
+
+void disk_cache_close(struct ms3_disk_cache_st *cache)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache_close(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void disk_cache_trim(struct ms3_disk_cache_st *cache)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache_trim(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+bool disk_cache_read(struct ms3_disk_cache_st *cache, const char *bucket,
+                     const char *key, const char *etag, struct memory_buffer_st *mem,
+                     char *content_type, size_t content_type_size, char *etag_out)
+{
+  char file[DISK_CACHE_FILE_LENGTH + 1];
+  struct disk_cache_header_st header;
+  struct disk_cache_entry_st *entry = NULL;
+  char *name;
+  char *path = NULL;
+  bool valid = false;
+  int fd = -1;
+
+  name = cache_name(bucket, key, file);
+
+  if (!name)
+  {
+    return false;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  if (cache->dir)
+  {
+    entry = find_entry(cache, file);
+  }
+
+  if (entry)
+  {
+    entry->refs++;
+    path = cache_path(cache, file, "");
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (!entry)
+  {
+    ms3_cfree(name);
+    return false;
+  }
+
+  if (path)
+  {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    ms3_cfree(path);
+  }
+
+  if (fd >= 0)
+  {
+    valid = read_file(fd, name, etag, &header, mem);
+
+    // Keeps the order of use for the next time the directory is indexed
+    if (valid)
+    {
+      futimens(fd, NULL);
+    }
+    else
+    {
+      ms3debug("Dropping cached copy of %s/%s", bucket, key);
+    }
+
+    close(fd);
+  }
+
+  ms3_cfree(name);
+  pthread_mutex_lock(&cache->lock);
+  entry->refs--;
+
+  if (entry->removed)
+  {
+    if (!entry->refs)
+    {
+      ms3_cfree(entry);
+    }
+  }
+  else if (valid)
+  {
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+  }
+  else if (fd < 0)
+  {
+    // Removed behind our back
+    detach_entry(cache, entry);
+  }
+  else
+  {
+    remove_entry(cache, entry);
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (!valid)
+  {
+    return false;
+  }
+
+  mem->length = (size_t)header.length;
+  memory_buffer_terminate(mem);
+  snprintf(content_type, content_type_size, "%s", header.content_type);
+  memcpy(etag_out, header.etag, MAX_ETAG_LENGTH);
+
+  return true;
+}
+
+void disk_cache_write(struct ms3_disk_cache_st *cache, const char *bucket,
+                      const char *key, const char *etag, const char *content_type,
+                      const uint8_t *data, size_t length)
+{
+  char file[DISK_CACHE_FILE_LENGTH + 1];
+  struct disk_cache_header_st header;
+  struct disk_cache_entry_st *entry;
+  char *name;
+  char *path = NULL;
+  char *temp_path = NULL;
+  size_t name_length;
+  size_t file_size;
+  bool written = false;
+  int fd = -1;
+
+  name = cache_name(bucket, key, file);
+
+  if (!name)
+  {
+    return;
+  }
+
+  name_length = strlen(name);
+  file_size = sizeof(header) + name_length + length;
+  pthread_mutex_lock(&cache->lock);
+
+  if (cache->dir && file_size >= length && file_size <= cache->max_size)
+  {
+    path = cache_path(cache, file, "");
+    temp_path = cache_path(cache, file, ".XXXXXX");
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (path && temp_path)
+  {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISK_CACHE_MAGIC, sizeof(header.magic));
+    header.length = length;
+    md5(data, length, header.md5);
+    header.name_length = (uint32_t)name_length;
+    snprintf(header.etag, sizeof(header.etag), "%s", etag ? etag : "");
+    snprintf(header.content_type, sizeof(header.content_type), "%s",
+             content_type ? content_type : "");
+    fd = mkstemp(temp_path);
+  }
+
+  if (fd >= 0)
+  {
+    written = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, name, name_length) &&
+              write_all(fd, data, length);
+    written = !close(fd) && written && !rename(temp_path, path);
+
+    if (!written)
+    {
+      unlink(temp_path);
+    }
+  }
+
+  ms3_cfree(name);
+  ms3_cfree(temp_path);
+
+  if (!path)
+  {
+    return;
+  }
+
+  ms3_cfree(path);
+  pthread_mutex_lock(&cache->lock);
+  entry = cache->dir ? find_entry(cache, file) : NULL;
+
+  // Any older copy was replaced by the rename, or is now suspect
+  if (entry && written)
+  {
+    lru_unlink(cache, entry);
+    cache->size -= entry->size;
+    entry->size = file_size;
+    lru_push(cache, entry);
+    cache->size += file_size;
+  }
+  else if (entry)
+  {
+    remove_entry(cache, entry);
+  }
+  else if (written && cache->dir)
+  {
+    entry = ms3_cmalloc(sizeof(struct disk_cache_entry_st));
+
+    if (entry)
+    {
+      memcpy(entry->file, file, DISK_CACHE_FILE_LENGTH + 1);
+      entry->size = file_size;
+
+      if (!add_entry(cache, entry))
+      {
+        ms3_cfree(entry);
+      }
+    }
+  }
+
+  if (written)
+  {
+    cache_trim(cache);
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void disk_cache_invalidate(struct ms3_disk_cache_st *cache,
+                           const char *bucket, const char *key)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache_invalidate(cache, bucket, key);
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,75 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define DISK_CACHE_SIZE_DEFAULT ((size_t)1024 * 1024 * 1024)
+
+struct disk_cache_entry_st;
+struct memory_buffer_st;
+
+/* Whole objects kept in files in a local directory, read instead of sending
+ * a GET. The files survive the handle and are found again when the
+ * directory is next used, least recently used files are removed once the
+ * total size goes over max_size. Safe to use from several threads, the lock
+ * is set up by ms3_init().
+ */
+struct ms3_disk_cache_st
+{
+  pthread_mutex_t lock;
+  char *dir; // NULL means the cache is disabled
+  size_t max_size;
+  size_t size;
+  struct disk_cache_entry_st **table;
+  size_t table_size; // Power of two, grown with count
+  size_t count;
+  struct disk_cache_entry_st *lru_head; // Most recently used
+  struct disk_cache_entry_st *lru_tail;
+};
+
+// Creates the directory if needed and indexes the files already in it
+uint8_t disk_cache_open(struct ms3_disk_cache_st *cache, const char *dir);
+
+void disk_cache_close(struct ms3_disk_cache_st *cache);
+
+// Removes files until the cache fits in max_size
+void disk_cache_trim(struct ms3_disk_cache_st *cache);
+
+/* Reads an object into mem, returns false on a miss. A file which fails its
+ * checks or whose ETag differs from a non-empty etag is removed. The stored
+ * ETag is copied to etag_out, which is MAX_ETAG_LENGTH bytes.
+ */
+bool disk_cache_read(struct ms3_disk_cache_st *cache, const char *bucket,
+                     const char *key, const char *etag, struct memory_buffer_st *mem,
+                     char *content_type, size_t content_type_size, char *etag_out);
+
+// Stores an object, failures only mean it isn't cached
+void disk_cache_write(struct ms3_disk_cache_st *cache, const char *bucket,
+                      const char *key, const char *etag, const char *content_type,
+                      const uint8_t *data, size_t length);
+
+void disk_cache_invalidate(struct ms3_disk_cache_st *cache,
+                           const char *bucket, const char *key);
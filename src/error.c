@@ -37,5 +37,7 @@ const char *errmsgs[] =
   "S3 server error",
   "Data too big. Maximum data size is 4GB",
   "Error in role",
-  "Endpoint permanently moved"
+  "Endpoint permanently moved",
+  "Local file error",
+  "Not modified"
 };
@@ -0,0 +1,549 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+
+// The metadata services are local, don't hang around if there isn't one
+#define METADATA_CONNECT_TIMEOUT_MS 1000
+#define METADATA_TIMEOUT_MS 5000
+#define METADATA_MAX_RESPONSE 16384
+#define IMDS_TOKEN_TTL_SECONDS 21600
+
+struct credential_set_st
+{
+  char key[128];
+  char secret[1024];
+  char token[4096];
+  time_t expiration; // 0 until the first fetch
+};
+
+struct instance_credentials_st
+{
+  char *url;
+  char *auth_token; // Authorization header for the container endpoint
+  bool imds;
+  struct credential_set_st current;
+  bool refreshing;
+  bool thread_started; // Until it is joined
+  time_t last_refresh; // When the last background refresh was started
+  pthread_t thread;
+  struct instance_credentials_st *next;
+};
+
+struct metadata_response_st
+{
+  char data[METADATA_MAX_RESPONSE];
+  size_t length;
+};
+
+static struct instance_credentials_st *instance_sources = NULL;
+static pthread_mutex_t instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t metadata_body_callback(void *buffer, size_t size,
+                                     size_t nitems, void *userdata)
+{
+  size_t realsize = nitems * size;
+  struct metadata_response_st *response =
+    (struct metadata_response_st *)userdata;
+
+  // Credentials are small, anything this big isn't them
+  if (response->length + realsize >= METADATA_MAX_RESPONSE)
+  {
+    ms3debug("Metadata response too large");
+    return 0;
+  }
+
+  memcpy(response->data + response->length, buffer, realsize);
+  response->length += realsize;
+  response->data[response->length] = '\0';
+
+  return realsize;
+}
+
+/* Uses its own curl handle so it can run on the refresh thread */
+static uint8_t metadata_request(const char *url, bool put,
+                                struct curl_slist *headers,
+                                struct metadata_response_st *response)
+{
+  CURL *curl = curl_easy_init();
+  CURLcode curl_res;
+  long response_code = 0;
+
+  if (!curl)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  response->length = 0;
+  response->data[0] = '\0';
+  ms3debug("Metadata URI: %s", url);
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+
+  if (put)
+  {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+  }
+
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_NOPROXY, "*");
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                   (long)METADATA_CONNECT_TIMEOUT_MS);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)METADATA_TIMEOUT_MS);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, metadata_body_callback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
+  curl_res = curl_easy_perform(curl);
+
+  if (curl_res == CURLE_OK)
+  {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+  }
+
+  curl_easy_cleanup(curl);
+
+  if (curl_res != CURLE_OK)
+  {
+    ms3debug("Metadata curl error: %s", curl_easy_strerror(curl_res));
+    return MS3_ERR_REQUEST_ERROR;
+  }
+
+  ms3debug("Metadata response code: %ld", response_code);
+
+  if (response_code == 404)
+  {
+    return MS3_ERR_NOT_FOUND;
+  }
+
+  if (response_code == 401 || response_code == 403)
+  {
+    return MS3_ERR_AUTH;
+  }
+
+  if (response_code >= 400)
+  {
+    return MS3_ERR_SERVER;
+  }
+
+  return 0;
+}
+
+/* Copies a string member of the JSON credentials document. The documents are
+ * flat so searching for the quoted name is enough.
+ */
+static bool json_string(const char *json, const char *name, char *out,
+                        size_t out_size)
+{
+  char pattern[64];
+  const char *pos;
+  size_t length = 0;
+
+  snprintf(pattern, sizeof(pattern), "\"%s\"", name);
+  pos = strstr(json, pattern);
+
+  if (!pos)
+  {
+    return false;
+  }
+
+  pos += strlen(pattern);
+
+  while (isspace((unsigned char)*pos))
+  {
+    pos++;
+  }
+
+  if (*pos++ != ':')
+  {
+    return false;
+  }
+
+  while (isspace((unsigned char)*pos))
+  {
+    pos++;
+  }
+
+  if (*pos++ != '"')
+  {
+    return false;
+  }
+
+  while (*pos && *pos != '"')
+  {
+    if (*pos == '\\' && pos[1])
+    {
+      pos++;
+    }
+
+    if (length + 1 >= out_size)
+    {
+      return false;
+    }
+
+    out[length++] = *pos++;
+  }
+
+  out[length] = '\0';
+
+  return *pos == '"';
+}
+
+static uint8_t parse_credentials(const char *json,
+                                 struct credential_set_st *credentials)
+{
+  char value[64];
+  struct tm ttmp = {0};
+
+  // IMDS says whether it worked, the container endpoint doesn't
+  if (json_string(json, "Code", value, sizeof(value)) &&
+      strcmp(value, "Success"))
+  {
+    ms3debug("Metadata credentials code: %s", value);
+    return MS3_ERR_AUTH;
+  }
+
+  if (!json_string(json, "AccessKeyId", credentials->key,
+                   sizeof(credentials->key)) ||
+      !json_string(json, "SecretAccessKey", credentials->secret,
+                   sizeof(credentials->secret)) ||
+      !json_string(json, "Expiration", value, sizeof(value)))
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  if (!json_string(json, "Token", credentials->token,
+                   sizeof(credentials->token)))
+  {
+    credentials->token[0] = '\0';
+  }
+
+  // Date/time, format: 2019-03-15T16:58:54Z
+  if (!strptime(value, "%Y-%m-%dT%H:%M:%S", &ttmp))
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  credentials->expiration = timegm(&ttmp);
+
+  return 0;
+}
+
+static uint8_t imds_fetch(struct instance_credentials_st *source,
+                          struct metadata_response_st *response)
+{
+  struct curl_slist *headers = NULL;
+  char url[1024];
+  char header[256];
+  char role[256];
+  uint8_t res;
+
+  // IMDSv2, a session token first
+  snprintf(url, sizeof(url), "http://%s/latest/api/token", source->url);
+  snprintf(header, sizeof(header), "X-aws-ec2-metadata-token-ttl-seconds: %d",
+           IMDS_TOKEN_TTL_SECONDS);
+  headers = curl_slist_append(headers, header);
+  res = metadata_request(url, true, headers, response);
+  curl_slist_free_all(headers);
+
+  if (res)
+  {
+    return res;
+  }
+
+  if ((size_t)snprintf(header, sizeof(header), "X-aws-ec2-metadata-token: %.*s",
+                       (int)strcspn(response->data, "\r\n"), response->data) >=
+      sizeof(header))
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  headers = curl_slist_append(NULL, header);
+
+  // Then the name of the instance role, then its credentials
+  snprintf(url, sizeof(url), "http://%s/latest/meta-data/iam/security-credentials/",
+           source->url);
+  res = metadata_request(url, false, headers, response);
+
+  if (!res)
+  {
+    size_t role_length = strcspn(response->data, "\r\n");
+
+    if (!role_length || role_length >= sizeof(role))
+    {
+      res = MS3_ERR_RESPONSE_PARSE;
+    }
+    else
+    {
+      memcpy(role, response->data, role_length);
+      role[role_length] = '\0';
+      snprintf(url, sizeof(url),
+               "http://%s/latest/meta-data/iam/security-credentials/%s",
+               source->url, role);
+      res = metadata_request(url, false, headers, response);
+    }
+  }
+
+  curl_slist_free_all(headers);
+
+  return res;
+}
+
+static uint8_t ecs_fetch(struct instance_credentials_st *source,
+                         struct metadata_response_st *response)
+{
+  struct curl_slist *headers = NULL;
+  uint8_t res;
+
+  if (source->auth_token)
+  {
+    char header[2048];
+
+    if ((size_t)snprintf(header, sizeof(header), "Authorization: %s",
+                         source->auth_token) >= sizeof(header))
+    {
+      return MS3_ERR_PARAMETER;
+    }
+
+    headers = curl_slist_append(headers, header);
+  }
+
+  res = metadata_request(source->url, false, headers, response);
+  curl_slist_free_all(headers);
+
+  return res;
+}
+
+static uint8_t fetch_credentials(struct instance_credentials_st *source,
+                                 struct credential_set_st *credentials)
+{
+  struct metadata_response_st *response =
+    ms3_cmalloc(sizeof(struct metadata_response_st));
+  uint8_t res;
+
+  if (!response)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  if (source->imds)
+  {
+    res = imds_fetch(source, response);
+  }
+  else
+  {
+    res = ecs_fetch(source, response);
+  }
+
+  if (!res)
+  {
+    res = parse_credentials(response->data, credentials);
+  }
+
+  ms3_cfree(response);
+
+  return res;
+}
+
+static void *refresh_thread(void *arg)
+{
+  struct instance_credentials_st *source = (struct instance_credentials_st *)arg;
+  struct credential_set_st credentials;
+  uint8_t res;
+
+  res = fetch_credentials(source, &credentials);
+
+  pthread_mutex_lock(&instance_mutex);
+
+  if (!res)
+  {
+    source->current = credentials;
+  }
+  else
+  {
+    // The current set is used until it expires, the next request retries
+    ms3debug("Background credential refresh failed: %u", res);
+  }
+
+  source->refreshing = false;
+  pthread_mutex_unlock(&instance_mutex);
+
+  return NULL;
+}
+
+uint8_t instance_credentials_get(const char *url, const char *auth_token,
+                                 bool imds,
+                                 struct instance_credentials_st **credentials)
+{
+  struct instance_credentials_st *source;
+  uint8_t res = 0;
+
+  pthread_mutex_lock(&instance_mutex);
+
+  for (source = instance_sources; source; source = source->next)
+  {
+    if (source->imds == imds && !strcmp(source->url, url) &&
+        (source->auth_token && auth_token ?
+         !strcmp(source->auth_token, auth_token) :
+         source->auth_token == auth_token))
+    {
+      break;
+    }
+  }
+
+  if (!source)
+  {
+    source = ms3_ccalloc(1, sizeof(struct instance_credentials_st));
+
+    if (source)
+    {
+      source->imds = imds;
+      source->url = ms3_cstrdup(url);
+      source->auth_token = auth_token ? ms3_cstrdup(auth_token) : NULL;
+
+      if (!source->url || (auth_token && !source->auth_token))
+      {
+        ms3_cfree(source->url);
+        ms3_cfree(source->auth_token);
+        ms3_cfree(source);
+        source = NULL;
+      }
+      else
+      {
+        source->next = instance_sources;
+        instance_sources = source;
+      }
+    }
+  }
+
+  if (!source)
+  {
+    res = MS3_ERR_OOM;
+  }
+
+  pthread_mutex_unlock(&instance_mutex);
+
+  *credentials = source;
+
+  return res;
+}
+
+uint8_t credentials_instance(ms3_st *ms3)
+{
+  struct instance_credentials_st *source = ms3->instance_credentials;
+  struct credential_set_st *current;
+  time_t now = time(NULL);
+  pthread_t finished;
+  bool join = false;
+  uint8_t res;
+
+  // Too big for the stack of an application thread
+  current = ms3_cmalloc(sizeof(struct credential_set_st));
+
+  if (!current)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  pthread_mutex_lock(&instance_mutex);
+  *current = source->current;
+
+  if (current->expiration > now &&
+      current->expiration <= now + ms3->credential_refresh_window &&
+      !source->refreshing && now >= source->last_refresh + REFRESH_RETRY_SECONDS)
+  {
+    // The last thread is done with the source, it is joined after unlocking
+    if (source->thread_started)
+    {
+      finished = source->thread;
+      join = true;
+    }
+
+    // Still valid, the next set is fetched without holding anyone up
+    source->last_refresh = now;
+    source->refreshing = !pthread_create(&source->thread, NULL, refresh_thread,
+                                         source);
+    source->thread_started = source->refreshing;
+  }
+
+  pthread_mutex_unlock(&instance_mutex);
+
+  if (join)
+  {
+    pthread_join(finished, NULL);
+  }
+
+  if (current->expiration <= now)
+  {
+    // Nothing usable, this has to wait. Handles racing here each fetch a
+    // complete set, the one which lasts longest is kept.
+    res = fetch_credentials(source, current);
+
+    if (res)
+    {
+      ms3_cfree(current);
+      return res;
+    }
+
+    pthread_mutex_lock(&instance_mutex);
+
+    if (current->expiration > source->current.expiration)
+    {
+      source->current = *current;
+    }
+
+    pthread_mutex_unlock(&instance_mutex);
+  }
+
+  res = credentials_set(ms3, current->key, current->secret,
+                        current->token[0] ? current->token : NULL,
+                        current->expiration);
+  ms3_cfree(current);
+
+  return res;
+}
+
+void instance_credentials_clear(void)
+{
+  struct instance_credentials_st *source;
+
+  pthread_mutex_lock(&instance_mutex);
+  source = instance_sources;
+  instance_sources = NULL;
+  pthread_mutex_unlock(&instance_mutex);
+
+  while (source)
+  {
+    struct instance_credentials_st *next = source->next;
+
+    if (source->thread_started)
+    {
+      pthread_join(source->thread, NULL);
+    }
+
+    ms3_cfree(source->url);
+    ms3_cfree(source->auth_token);
+    ms3_cfree(source);
+    source = next;
+  }
+}
@@ -0,0 +1,51 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IMDS_ENDPOINT_DEFAULT "169.254.169.254"
+#define ECS_ENDPOINT_DEFAULT "169.254.170.2"
+
+struct instance_credentials_st;
+
+/* Credentials from the EC2 instance metadata service (IMDSv2) or the ECS
+ * container endpoint. They are held once per process for each source so
+ * handles using the same source share them. Once they are within the refresh
+ * window of expiring a thread fetches the next set while the current one is
+ * still used, the fetch only blocks when there are none which are valid.
+ */
+
+/* Finds or adds the shared credentials for a source, by URL and token. For
+ * IMDS url is the metadata host, otherwise it is the full URL of the
+ * container endpoint.
+ * Nothing is fetched until the provider is first called.
+ */
+uint8_t instance_credentials_get(const char *url, const char *auth_token,
+                                 bool imds,
+                                 struct instance_credentials_st **credentials);
+
+// The provider, uses ms3->instance_credentials
+uint8_t credentials_instance(ms3_st *ms3);
+
+// Waits for any refresh threads and frees everything
+void instance_credentials_clear(void);
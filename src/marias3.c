@@ -24,6 +24,12 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdint.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 ms3_malloc_callback ms3_cmalloc = (ms3_malloc_callback)malloc;
 ms3_free_callback ms3_cfree = (ms3_free_callback)free;
@@ -96,6 +102,7 @@ uint8_t ms3_library_init_malloc(ms3_malloc_callback m,
     return MS3_ERR_PARAMETER;
   }
 
+  alloc_stats_lock();
   ms3_cmalloc = m;
   ms3_cfree = f;
   ms3_crealloc = r;
@@ -125,10 +132,12 @@ uint8_t ms3_library_init_malloc(ms3_malloc_callback m,
 
 void ms3_library_init(void)
 {
+  alloc_stats_lock();
+
   if (curl_needs_openssl_locking())
   {
     int i;
-    mutex_buf = malloc(openssl_num_locks() * sizeof(pthread_mutex_t));
+    mutex_buf = ms3_cmalloc(openssl_num_locks() * sizeof(pthread_mutex_t));
     if(mutex_buf)
     {
       for(i = 0; i < openssl_num_locks(); i++)
@@ -152,6 +161,8 @@ void ms3_library_deinit(void)
     ms3_cfree(mutex_buf);
     mutex_buf = NULL;
   }
+  role_arn_cache_clear();
+  instance_credentials_clear();
   curl_global_cleanup();
 }
 
@@ -166,6 +177,7 @@ ms3_st *ms3_init(const char *s3key, const char *s3secret,
     return NULL;
   }
 
+  alloc_stats_lock();
   ms3 = ms3_cmalloc(sizeof(ms3_st));
 
   ms3->s3key = ms3_cstrdup(s3key);
@@ -203,37 +215,49 @@ ms3_st *ms3_init(const char *s3key, const char *s3secret,
 
   ms3->buffer_chunk_size = READ_BUFFER_DEFAULT_SIZE;
 
-  ms3->curl = curl_easy_init();
-  ms3->last_error = NULL;
   ms3->use_http = false;
   ms3->no_content_type = false;
+  ms3->content_type_out = NULL;
+  ms3->headers_out = NULL;
+  ms3->header_out_count = 0;
   ms3->disable_verification = false;
-  ms3->first_run = true;
-  ms3->path_buffer = ms3_cmalloc(sizeof(char) * 1024);
-  ms3->query_buffer = ms3_cmalloc(sizeof(char) * 3072);
-  ms3->list_container.pool = NULL;
-  ms3->list_container.next = NULL;
-  ms3->list_container.start = NULL;
-  ms3->list_container.pool_list = NULL;
-  ms3->list_container.pool_free = 0;
+  memset(&ms3->buffer_pool, 0, sizeof(struct ms3_buffer_pool_st));
+  pthread_mutex_init(&ms3->buffer_pool.lock, NULL);
+  memset(&ms3->status_cache, 0, sizeof(struct ms3_status_cache_st));
+  pthread_mutex_init(&ms3->status_cache.lock, NULL);
+  ms3->status_cache.ttl_ms = STATUS_CACHE_TTL_DEFAULT_MS;
+  memset(&ms3->disk_cache, 0, sizeof(struct ms3_disk_cache_st));
+  pthread_mutex_init(&ms3->disk_cache.lock, NULL);
+  ms3->disk_cache.max_size = DISK_CACHE_SIZE_DEFAULT;
+  ms3->part_size = PART_SIZE_DEFAULT;
+  ms3->max_parallel = MAX_PARALLEL_DEFAULT;
+  ms3->copy_threshold = (size_t)(MAX_COPY_SIZE < SIZE_MAX ? MAX_COPY_SIZE :
+                                  SIZE_MAX);
   ms3->read_cb= 0;
   ms3->user_data= 0;
   ms3->connect_timeout_ms = 0;
   ms3->timeout_ms = 0;
 
   ms3->iam_role = NULL;
-  ms3->role_key = NULL;
-  ms3->role_secret = NULL;
-  ms3->role_session_token = NULL;
+  ms3->role_credentials = NULL;
   ms3->iam_endpoint = NULL;
   ms3->sts_endpoint = NULL;
   ms3->sts_region = NULL;
   ms3->iam_role_arn = NULL;
-
-#ifdef HAVE_NEW_CURL_API
-  ms3->content_type_in = NULL;
-#endif
-  ms3->content_type_out = NULL;
+  ms3->credential_provider = NULL;
+  ms3->credential_callback = NULL;
+  ms3->credential_userdata = NULL;
+  ms3->credential_expiration = 0;
+  ms3->refresh_failed = 0;
+  ms3->credential_refresh_window = CREDENTIAL_REFRESH_WINDOW_DEFAULT;
+  ms3->instance_credentials = NULL;
+
+  // The per-thread state is created when each thread first uses the handle
+  if (context_init(ms3))
+  {
+    ms3_deinit(ms3);
+    return NULL;
+  }
 
   return ms3;
 }
@@ -268,17 +292,16 @@ uint8_t ms3_init_assume_role(ms3_st *ms3, const char *iam_role, const char *sts_
 
   ms3->iam_endpoint = ms3_cstrdup("iam.amazonaws.com");
 
-  ms3->iam_role_arn = ms3_cmalloc(sizeof(char) * 2048);
-  ms3->iam_role_arn[0] = '\0';
-  ms3->role_key = ms3_cmalloc(sizeof(char) * 128);
-  ms3->role_key[0] = '\0';
-  ms3->role_secret = ms3_cmalloc(sizeof(char) * 1024);
-  ms3->role_secret[0] = '\0';
-  // aws says theres no maximum length here.. 2048 might be overkill
-  ms3->role_session_token = ms3_cmalloc(sizeof(char) * 2048);
-  ms3->role_session_token[0] = '\0';
+  // Unless it was given with MS3_OPT_IAM_ROLE_ARN
+  if (!ms3->iam_role_arn)
+  {
+    ms3->iam_role_arn = ms3_cmalloc(sizeof(char) * MAX_ROLE_ARN_LENGTH);
+    ms3->iam_role_arn[0] = '\0';
+  }
   // 0 will uses the default and not set a value in the request
   ms3->role_session_duration = 0;
+  // The role is assumed again before the credentials expire
+  ms3->credential_provider = credentials_assume_role;
 
   ret = ms3_assume_role(ms3);
 
@@ -295,38 +318,153 @@ uint8_t ms3_ec2_set_cred(ms3_st *ms3, const char *iam_role,
   {
       return MS3_ERR_PARAMETER;
   }
+  ms3_cfree(ms3->iam_role);
   ms3->iam_role = ms3_cstrdup(iam_role);
-  ms3->role_key = ms3_cstrdup(s3key);
-  ms3->role_secret = ms3_cstrdup(s3secret);
-  ms3->role_session_token = ms3_cstrdup(token);
+  ms3->credential_provider = NULL;
+  ret = credentials_set(ms3, s3key, s3secret, token, 0);
 
   return ret;
 }
 
-static void list_free(ms3_st *ms3)
+static uint8_t use_instance_credentials(ms3_st *ms3,
+                                       struct instance_credentials_st *source)
+{
+  struct instance_credentials_st *previous = ms3->instance_credentials;
+  uint8_t res;
+
+  // The first handle for a source waits for the credentials, others share
+  ms3->instance_credentials = source;
+  res = credentials_instance(ms3);
+
+  if (res)
+  {
+    ms3->instance_credentials = previous;
+    return res;
+  }
+
+  ms3->credential_provider = credentials_instance;
+
+  return 0;
+}
+
+uint8_t ms3_init_imds_credentials(ms3_st *ms3, const char *endpoint)
+{
+  struct instance_credentials_st *source;
+  uint8_t res;
+
+  if (!ms3)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  if (!endpoint || !strlen(endpoint))
+  {
+    endpoint = IMDS_ENDPOINT_DEFAULT;
+  }
+
+  res = instance_credentials_get(endpoint, NULL, true, &source);
+
+  if (res)
+  {
+    return res;
+  }
+
+  return use_instance_credentials(ms3, source);
+}
+
+uint8_t ms3_init_ecs_credentials(ms3_st *ms3, const char *uri,
+                                 const char *auth_token)
+{
+  struct instance_credentials_st *source;
+  char url[MAX_URI_LENGTH];
+  uint8_t res;
+
+  if (!ms3)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  // Where the ECS agent says the credentials are
+  if (!uri || !strlen(uri))
+  {
+    const char *relative = getenv("AWS_CONTAINER_CREDENTIALS_RELATIVE_URI");
+
+    if (relative)
+    {
+      if ((size_t)snprintf(url, sizeof(url), "http://%s%s", ECS_ENDPOINT_DEFAULT,
+                           relative) >= sizeof(url))
+      {
+        return MS3_ERR_URI_TOO_LONG;
+      }
+
+      uri = url;
+    }
+    else
+    {
+      uri = getenv("AWS_CONTAINER_CREDENTIALS_FULL_URI");
+    }
+
+    if (!uri)
+    {
+      return MS3_ERR_PARAMETER;
+    }
+  }
+
+  if (!auth_token)
+  {
+    auth_token = getenv("AWS_CONTAINER_AUTHORIZATION_TOKEN");
+  }
+
+  res = instance_credentials_get(uri, auth_token, false, &source);
+
+  if (res)
+  {
+    return res;
+  }
+
+  return use_instance_credentials(ms3, source);
+}
+
+uint8_t ms3_set_credential_provider(ms3_st *ms3,
+                                    ms3_credential_callback provider,
+                                    void *userdata)
 {
-  ms3_list_st *list = ms3->list_container.start;
-  struct ms3_pool_alloc_list_st *plist = NULL, *next = NULL;
-  while (list)
+  uint8_t res;
+  struct credentials_st *credentials;
+
+  if (!ms3)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  if (!provider)
   {
-    ms3_cfree(list->key);
-    list = list->next;
+    // Back to signing with the keys given to ms3_init()
+    ms3->credential_provider = NULL;
+    ms3->credential_callback = NULL;
+    ms3->credential_userdata = NULL;
+    pthread_mutex_lock(&ms3->credential_lock);
+    ms3->credential_expiration = 0;
+    credentials = ms3->role_credentials;
+    ms3->role_credentials = NULL;
+    pthread_mutex_unlock(&ms3->credential_lock);
+    credentials_release(ms3, credentials);
+    return 0;
   }
-  plist = ms3->list_container.pool_list;
-  while (plist)
+
+  ms3->credential_callback = provider;
+  ms3->credential_userdata = userdata;
+  res = credentials_callback(ms3);
+
+  if (!res)
   {
-    next = plist->prev;
-    ms3_cfree(plist->pool);
-    ms3_cfree(plist);
-    plist = next;
+    ms3->credential_provider = credentials_callback;
   }
-  ms3->list_container.pool = NULL;
-  ms3->list_container.next = NULL;
-  ms3->list_container.start = NULL;
-  ms3->list_container.pool_list = NULL;
-  ms3->list_container.pool_free = 0;
+
+  return res;
 }
 
+
 void ms3_deinit(ms3_st *ms3)
 {
   if (!ms3)
@@ -340,29 +478,54 @@ void ms3_deinit(ms3_st *ms3)
   ms3_cfree(ms3->region);
   ms3_cfree(ms3->base_domain);
   ms3_cfree(ms3->iam_role);
-  ms3_cfree(ms3->role_key);
-  ms3_cfree(ms3->role_secret);
-  ms3_cfree(ms3->role_session_token);
+  credentials_release(ms3, ms3->role_credentials);
   ms3_cfree(ms3->iam_endpoint);
   ms3_cfree(ms3->sts_endpoint);
   ms3_cfree(ms3->sts_region);
   ms3_cfree(ms3->iam_role_arn);
-  curl_easy_cleanup(ms3->curl);
-  ms3_cfree(ms3->last_error);
-  ms3_cfree(ms3->path_buffer);
-  ms3_cfree(ms3->query_buffer);
-  list_free(ms3);
+  context_deinit(ms3);
+  buffer_pool_clear(&ms3->buffer_pool);
+  pthread_mutex_destroy(&ms3->buffer_pool.lock);
+  status_cache_clear(&ms3->status_cache);
+  pthread_mutex_destroy(&ms3->status_cache.lock);
+  disk_cache_close(&ms3->disk_cache);
+  pthread_mutex_destroy(&ms3->disk_cache.lock);
   ms3_cfree(ms3);
 }
 
 const char *ms3_server_error(ms3_st *ms3)
 {
-  if (!ms3)
+  struct ms3_context_st *ctx;
+
+  if (!ms3 || !(ctx = context_get(ms3)) || !ctx->error.message[0])
+  {
+    return NULL;
+  }
+
+  return ctx->error.message;
+}
+
+const ms3_error_st *ms3_last_error(ms3_st *ms3)
+{
+  struct ms3_context_st *ctx;
+  struct request_error_st *error;
+  ms3_error_st *last;
+
+  if (!ms3 || !(ctx = context_get(ms3)) || !ctx->error.result)
   {
     return NULL;
   }
 
-  return ms3->last_error;
+  error = &ctx->error;
+  last = &ctx->last_error;
+  last->result = error->result;
+  last->status = error->status;
+  last->code = error->code[0] ? error->code : NULL;
+  last->message = error->message[0] ? error->message : NULL;
+  last->request_id = error->request_id[0] ? error->request_id : NULL;
+  last->retryable = error->retryable;
+
+  return last;
 }
 
 void ms3_debug(int debug_state)
@@ -392,17 +555,25 @@ uint8_t ms3_list_dir(ms3_st *ms3, const char *bucket, const char *prefix,
                      ms3_list_st **list)
 {
   uint8_t res = 0;
+  struct ms3_context_st *ctx;
 
   if (!ms3 || !bucket || !list)
   {
     return MS3_ERR_PARAMETER;
   }
 
-  list_free(ms3);
+  ctx = context_get(ms3);
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  list_container_free(&ctx->list_container);
   res = execute_request(ms3, MS3_CMD_LIST, bucket, NULL, NULL, NULL, prefix, NULL,
                         0, NULL,
                         NULL);
-  *list = ms3->list_container.start;
+  *list = ctx->list_container.start;
   return res;
 }
 
@@ -410,18 +581,26 @@ uint8_t ms3_list(ms3_st *ms3, const char *bucket, const char *prefix,
                  ms3_list_st **list)
 {
   uint8_t res = 0;
+  struct ms3_context_st *ctx;
 
   if (!ms3 || !bucket || !list)
   {
     return MS3_ERR_PARAMETER;
   }
 
-  list_free(ms3);
+  ctx = context_get(ms3);
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  list_container_free(&ctx->list_container);
   res = execute_request(ms3, MS3_CMD_LIST_RECURSIVE, bucket, NULL, NULL, NULL,
                         prefix, NULL,
                         0, NULL,
                         NULL);
-  *list = ms3->list_container.start;
+  *list = ctx->list_container.start;
   return res;
 }
 
@@ -453,6 +632,210 @@ uint8_t ms3_put(ms3_st *ms3, const char *bucket, const char *key,
   return res;
 }
 
+static uint8_t put_file_range(ms3_st *ms3, const char *bucket,
+                              const char *key, const uint8_t *data, int fd, off_t offset, size_t length)
+{
+  uint8_t res;
+  struct multipart_st multipart;
+
+  if (length <= ms3->part_size)
+  {
+    struct request_st request;
+    struct upload_source_st source;
+
+    request_init(&request, MS3_CMD_PUT, bucket, key);
+
+    if (data)
+    {
+      request.data = data;
+      request.data_size = length;
+    }
+    else
+    {
+      source.fd = fd;
+      source.offset = offset;
+      source.length = length;
+      request.upload = &source;
+    }
+
+    return request_execute(ms3, &request);
+  }
+
+  res = multipart_create(ms3, &multipart, bucket, key, length, NULL, NULL, 0);
+
+  if (res)
+  {
+    return res;
+  }
+
+  res = multipart_upload_file(ms3, &multipart, data, fd, offset, length);
+
+  if (!res)
+  {
+    res = multipart_complete(ms3, &multipart);
+  }
+
+  if (res)
+  {
+    multipart_abort(ms3, &multipart);
+  }
+
+  multipart_free(&multipart);
+
+  return res;
+}
+
+uint8_t ms3_put_file(ms3_st *ms3, const char *bucket, const char *key,
+                     int fd, uint64_t offset, size_t length)
+{
+  uint8_t res;
+  struct stat file_stat;
+  uint8_t *map = MAP_FAILED;
+  size_t map_length = 0;
+  off_t map_offset;
+
+  if (!ms3 || !bucket || !key || key[0] == '\0' || fd < 0)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  if (length == 0)
+  {
+    return MS3_ERR_NO_DATA;
+  }
+
+  if (offset > (uint64_t)INT64_MAX - length || fstat(fd, &file_stat))
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  // Parts may be read more than once or out of order so the file must seek
+  if (lseek(fd, 0, SEEK_CUR) < 0)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  if (S_ISREG(file_stat.st_mode))
+  {
+    if (offset + length > (uint64_t)file_stat.st_size)
+    {
+      return MS3_ERR_PARAMETER;
+    }
+
+    // The mapping has to start on a page boundary
+    map_offset = (off_t)offset & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+    map_length = length + (size_t)((off_t)offset - map_offset);
+    map = mmap(NULL, map_length, PROT_READ, MAP_SHARED, fd, map_offset);
+
+    if (map != MAP_FAILED)
+    {
+      madvise(map, map_length, MADV_SEQUENTIAL);
+    }
+  }
+
+  // Anything that can't be mapped is read in windows as it is sent
+  if (map != MAP_FAILED)
+  {
+    res = put_file_range(ms3, bucket, key, map + (map_length - length), fd,
+                         (off_t)offset, length);
+    munmap(map, map_length);
+  }
+  else
+  {
+    res = put_file_range(ms3, bucket, key, NULL, fd, (off_t)offset, length);
+  }
+
+  return res;
+}
+
+/* GETs an object into a buffer, reading it from the disk cache instead if
+ * there is a copy. The copy is used as it is when the status cache has the
+ * same ETag, otherwise only after a conditional GET finds it unchanged.
+ */
+static uint8_t get_object(ms3_st *ms3, const char *bucket, const char *key,
+                          struct memory_buffer_st *buf)
+{
+  uint8_t res = 0;
+  struct request_st request;
+  struct ms3_context_st *ctx = context_get(ms3);
+  char etag[MAX_ETAG_LENGTH];
+  char content_type[sizeof(ctx->content_type_in)];
+  size_t length = 0;
+  bool cached = false;
+  bool sent = false;
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  request_init(&request, MS3_CMD_GET, bucket, key);
+  request.ret_ptr = buf;
+
+  if (ms3->disk_cache.dir)
+  {
+    bool found = true;
+    struct head_response_st head;
+
+    head.etag[0] = '\0';
+
+    if (status_cache_get(&ms3->status_cache, bucket, key, &found, &head) &&
+        !found)
+    {
+      disk_cache_invalidate(&ms3->disk_cache, bucket, key);
+    }
+    else if (disk_cache_read(&ms3->disk_cache, bucket, key, head.etag, buf,
+                             content_type, sizeof(content_type), etag) &&
+             (head.etag[0] || etag[0]))
+    {
+      length = buf->length;
+      cached = true;
+
+      // A 304 has no body, so leaves the copy in the buffer alone
+      if (!head.etag[0])
+      {
+        request.if_none_match = etag;
+        res = request_execute(ms3, &request);
+        sent = true;
+        cached = res == MS3_ERR_NOT_MODIFIED;
+      }
+    }
+  }
+
+  if (cached)
+  {
+    // Looks like the response the copy came from
+    buf->length = length;
+    ms3_cfree(ctx->response.amz_headers);
+    memset(&ctx->response, 0, sizeof(struct response_st));
+    ctx->response.status = 200;
+    ctx->response.content_length = length;
+    memcpy(ctx->response.etag, etag, MAX_ETAG_LENGTH);
+    memcpy(ctx->etag_in, etag, MAX_ETAG_LENGTH);
+    snprintf(ctx->response.content_type, sizeof(ctx->response.content_type),
+             "%s", content_type);
+    memcpy(ctx->content_type_in, content_type, sizeof(content_type));
+    return 0;
+  }
+
+  if (!sent)
+  {
+    res = request_execute(ms3, &request);
+  }
+
+  if (!res && ms3->disk_cache.dir)
+  {
+    disk_cache_write(&ms3->disk_cache, bucket, key, request.response.etag,
+                     ctx->content_type_in, buf->data, buf->length);
+  }
+  else if (res == MS3_ERR_NOT_FOUND && ms3->disk_cache.dir)
+  {
+    disk_cache_invalidate(&ms3->disk_cache, bucket, key);
+  }
+
+  return res;
+}
+
 uint8_t ms3_get(ms3_st *ms3, const char *bucket, const char *key,
                 uint8_t **data, size_t *length)
 {
@@ -461,6 +844,9 @@ uint8_t ms3_get(ms3_st *ms3, const char *bucket, const char *key,
 
   buf.data = NULL;
   buf.length = 0;
+  buf.alloced = 0;
+  buf.pool = NULL;
+  buf.terminate = true;
 
   if (!ms3 || !bucket || !key || key[0] == '\0')
   {
@@ -471,10 +857,25 @@ uint8_t ms3_get(ms3_st *ms3, const char *bucket, const char *key,
     return MS3_ERR_PARAMETER;
   }
 
-  res = execute_request(ms3, MS3_CMD_GET, bucket, key, NULL, NULL, NULL, NULL, 0,
-                        NULL, &buf);
+  // No buffer means the body goes to the read callback, which isn't cached
+  if (ms3->read_cb)
+  {
+    res = execute_request(ms3, MS3_CMD_GET, bucket, key, NULL, NULL, NULL, NULL,
+                          0, NULL, NULL);
+  }
+  else
+  {
+    res = get_object(ms3, bucket, key, &buf);
+  }
+
   if (!ms3->read_cb)
   {
+    if (res)
+    {
+      ms3_cfree(buf.data);
+      buf.data = NULL;
+    }
+
     *data = buf.data;
     *length = buf.length;
   }
@@ -482,74 +883,563 @@ uint8_t ms3_get(ms3_st *ms3, const char *bucket, const char *key,
   return res;
 }
 
-uint8_t ms3_copy(ms3_st *ms3, const char *source_bucket, const char *source_key,
-                 const char *dest_bucket, const char *dest_key)
+uint8_t ms3_get_into(ms3_st *ms3, const char *bucket, const char *key,
+                     ms3_buffer_st *buffer)
 {
   uint8_t res = 0;
+  struct memory_buffer_st buf;
 
-  if (!ms3 || !source_bucket || !source_key || !dest_bucket || !dest_key)
+  if (!ms3 || !bucket || !key || key[0] == '\0' || !buffer)
   {
     return MS3_ERR_PARAMETER;
   }
 
-  res = execute_request(ms3, MS3_CMD_COPY, dest_bucket, dest_key, source_bucket,
-                        source_key, NULL, NULL, 0, NULL, NULL);
+  buf.data = buffer->data;
+  buf.length = 0;
+  buf.alloced = buffer->data ? buffer->alloced : 0;
+  buf.pool = ms3->buffer_pool.max_cached ? &ms3->buffer_pool : NULL;
+  buf.terminate = false;
+
+  res = get_object(ms3, bucket, key, &buf);
+
+  buffer->data = buf.data;
+  buffer->length = buf.length;
+  buffer->alloced = buf.alloced;
+
   return res;
 }
 
-uint8_t ms3_move(ms3_st *ms3, const char *source_bucket, const char *source_key,
-                 const char *dest_bucket, const char *dest_key)
+uint8_t ms3_get_if_changed(ms3_st *ms3, const char *bucket, const char *key,
+                           const char *etag, time_t modified_since,
+                           ms3_buffer_st *buffer)
 {
   uint8_t res = 0;
+  struct request_st request;
+  struct memory_buffer_st buf;
 
-  if (!ms3 || !source_bucket || !source_key || !dest_bucket || !dest_key)
+  if (!ms3 || !bucket || !key || key[0] == '\0' || !buffer ||
+      (etag && strlen(etag) >= MAX_ETAG_LENGTH) || modified_since < 0)
   {
     return MS3_ERR_PARAMETER;
   }
 
-  res = ms3_copy(ms3, source_bucket, source_key, dest_bucket, dest_key);
-
-  if (res)
+  buf.data = buffer->data;
+  buf.length = 0;
+  buf.alloced = buffer->data ? buffer->alloced : 0;
+  buf.pool = ms3->buffer_pool.max_cached ? &ms3->buffer_pool : NULL;
+  buf.terminate = false;
+
+  // Revalidation has to ask the server, a new body still fills the disk cache
+  request_init(&request, MS3_CMD_GET, bucket, key);
+  request.if_none_match = etag && etag[0] ? etag : NULL;
+  request.if_modified_since = modified_since;
+  request.ret_ptr = &buf;
+  res = request_execute(ms3, &request);
+
+  if (!res && ms3->disk_cache.dir)
   {
-    return res;
+    disk_cache_write(&ms3->disk_cache, bucket, key, request.response.etag,
+                     ms3_get_content_type(ms3), buf.data, buf.length);
   }
 
-  res = ms3_delete(ms3, source_bucket, source_key);
+  buffer->data = buf.data;
+  buffer->length = buf.length;
+  buffer->alloced = buf.alloced;
 
   return res;
 }
 
-uint8_t ms3_delete(ms3_st *ms3, const char *bucket, const char *key)
+const char *ms3_get_etag(ms3_st *ms3)
 {
-  uint8_t res;
+  struct ms3_context_st *ctx;
 
-  if (!ms3 || !bucket || !key)
+  if (!ms3 || !(ctx = context_get(ms3)) || !ctx->etag_in[0])
   {
-    return MS3_ERR_PARAMETER;
+    return NULL;
   }
 
-  res = execute_request(ms3, MS3_CMD_DELETE, bucket, key, NULL, NULL, NULL, NULL,
-                        0, NULL,
-                        NULL);
-  return res;
+  return ctx->etag_in;
 }
 
-uint8_t ms3_status(ms3_st *ms3, const char *bucket, const char *key,
-                   ms3_status_st *status)
+const ms3_response_st *ms3_last_response(ms3_st *ms3)
 {
-  uint8_t res;
+  ms3_response_st *last;
+  struct response_st *response;
+  const char *pos;
+  size_t header_it;
+  struct ms3_context_st *ctx;
 
-  if (!ms3 || !bucket || !key || !status)
+  if (!ms3 || !(ctx = context_get(ms3)))
+  {
+    return NULL;
+  }
+
+  last = &ctx->last_response;
+  response = &ctx->response;
+
+  if (response->amz_count > ctx->amz_headers_alloced)
+  {
+    ms3_header_st *headers = ms3_crealloc(ctx->amz_headers,
+                                          response->amz_count * sizeof(ms3_header_st));
+
+    if (!headers)
+    {
+      return NULL;
+    }
+
+    ctx->amz_headers = headers;
+    ctx->amz_headers_alloced = response->amz_count;
+  }
+
+  pos = response->amz_headers;
+
+  for (header_it = 0; header_it < response->amz_count; header_it++)
+  {
+    ctx->amz_headers[header_it].name = pos;
+    pos += strlen(pos) + 1;
+    ctx->amz_headers[header_it].value = pos;
+    pos += strlen(pos) + 1;
+  }
+
+  last->status = response->status;
+  last->content_length = response->content_length;
+  last->last_modified = response->last_modified;
+  last->etag = response->etag[0] ? response->etag : NULL;
+  last->content_type = response->content_type[0] ? response->content_type : NULL;
+  last->content_range = response->content_range[0] ? response->content_range :
+                        NULL;
+  last->amz_headers = response->amz_count ? ctx->amz_headers : NULL;
+  last->amz_header_count = response->amz_count;
+
+  return last;
+}
+
+uint8_t ms3_get_to_fd(ms3_st *ms3, const char *bucket, const char *key,
+                      int fd)
+{
+  uint8_t res = 0;
+  struct file_buffer_st file;
+
+  if (!ms3 || !bucket || !key || key[0] == '\0' || fd < 0)
   {
     return MS3_ERR_PARAMETER;
   }
 
+  file.fd = fd;
+  // Pipes and sockets can't seek, they are written to sequentially
+  file.base = lseek(fd, 0, SEEK_CUR);
+  file.length = 0;
+  file.status = 0;
+  file.write_errno = 0;
+  file.error.data = NULL;
+  file.error.length = 0;
+  file.error.alloced = 0;
+  file.error.buffer_chunk_size = ms3->buffer_chunk_size;
+  file.error.pool = NULL;
+  file.error.terminate = true;
+
+  res = execute_request(ms3, MS3_CMD_GET_FILE, bucket, key, NULL, NULL, NULL,
+                        NULL, 0, NULL, &file);
+
+  // pwrite() doesn't move the offset, leave it after the data like write()
+  if (file.base >= 0)
+  {
+    lseek(fd, file.base + (off_t)file.length, SEEK_SET);
+  }
+
+  return res;
+}
+
+/* The object is downloaded into a temporary file next to the target, which
+ * is only renamed over it once the whole object is there. A failed GET
+ * leaves an existing file alone.
+ */
+uint8_t ms3_get_to_file(ms3_st *ms3, const char *bucket, const char *key,
+                        const char *filename)
+{
+  uint8_t res = 0;
+  int fd;
+  size_t length;
+  char *temp_name;
+  struct stat existing;
+  mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+  if (!ms3 || !bucket || !key || key[0] == '\0' || !filename)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  length = strlen(filename);
+  temp_name = ms3_cmalloc(length + 8);
+
+  if (!temp_name)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  memcpy(temp_name, filename, length);
+  memcpy(temp_name + length, ".XXXXXX", 8);
+  fd = mkstemp(temp_name);
+
+  if (fd < 0)
+  {
+    ms3debug("Could not create a file next to %s: %s", filename,
+             strerror(errno));
+    ms3_cfree(temp_name);
+    return MS3_ERR_FILE;
+  }
+
+  // Replacing a file keeps its permissions
+  if (!stat(filename, &existing))
+  {
+    mode = existing.st_mode & 07777;
+  }
+
+  if (fchmod(fd, mode))
+  {
+    ms3debug("Could not set the mode of %s: %s", temp_name, strerror(errno));
+  }
+
+  res = ms3_get_to_fd(ms3, bucket, key, fd);
+
+  if (close(fd) && !res)
+  {
+    res = MS3_ERR_FILE;
+  }
+
+  if (!res && rename(temp_name, filename))
+  {
+    ms3debug("Could not rename %s to %s: %s", temp_name, filename,
+             strerror(errno));
+    res = MS3_ERR_FILE;
+  }
+
+  // Don't leave a partial object behind
+  if (res)
+  {
+    unlink(temp_name);
+  }
+
+  ms3_cfree(temp_name);
+  return res;
+}
+
+void ms3_buffer_free(ms3_st *ms3, ms3_buffer_st *buffer)
+{
+  if (!buffer)
+  {
+    return;
+  }
+
+  if (ms3 && ms3->buffer_pool.max_cached)
+  {
+    buffer_pool_put(&ms3->buffer_pool, buffer->data, buffer->alloced);
+  }
+  else
+  {
+    ms3_cfree(buffer->data);
+  }
+
+  buffer->data = NULL;
+  buffer->length = 0;
+  buffer->alloced = 0;
+}
+
+/* Copies in parallel parts with multipart copy. A single copy keeps the
+ * content type and user metadata of the source, so they are taken from the
+ * HEAD of the source, which must be the last request made, and given to the
+ * upload along with the headers set on the handle.
+ */
+static uint8_t copy_multipart(ms3_st *ms3, const struct head_response_st *head,
+                              const char *source_bucket, const char *source_key,
+                              const char *dest_bucket, const char *dest_key)
+{
+  uint8_t res;
+  struct multipart_st multipart;
+  struct ms3_context_st *ctx = context_get(ms3);
+  ms3_header_st *headers;
+  char *amz_headers;
+  const char *pos;
+  size_t header_count = 0;
+  size_t header_it;
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  // The next request replaces the response headers, so they are copied
+  headers = ms3_ccalloc(ctx->response.amz_count + ms3->header_out_count + 1,
+                        sizeof(ms3_header_st));
+  amz_headers = ms3_cmalloc(ctx->response.amz_length + 1);
+
+  if (!headers || !amz_headers)
+  {
+    ms3_cfree(headers);
+    ms3_cfree(amz_headers);
+    return MS3_ERR_OOM;
+  }
+
+  if (ctx->response.amz_length)
+  {
+    memcpy(amz_headers, ctx->response.amz_headers, ctx->response.amz_length);
+  }
+
+  pos = amz_headers;
+
+  for (header_it = 0; header_it < ctx->response.amz_count; header_it++)
+  {
+    const char *name = pos;
+    const char *value = name + strlen(name) + 1;
+
+    pos = value + strlen(value) + 1;
+
+    if (!strncasecmp(name, "x-amz-meta-", 11))
+    {
+      headers[header_count].name = name;
+      headers[header_count].value = value;
+      header_count++;
+    }
+  }
+
+  // Later headers win, so the application's replace the source's
+  for (header_it = 0; header_it < ms3->header_out_count; header_it++)
+  {
+    headers[header_count++] = ms3->headers_out[header_it];
+  }
+
+  res = multipart_create(ms3, &multipart, dest_bucket, dest_key,
+                         head->status.length,
+                         head->content_type[0] ? head->content_type : NULL,
+                         headers, header_count);
+  ms3_cfree(headers);
+  ms3_cfree(amz_headers);
+
+  if (res)
+  {
+    return res;
+  }
+
+  res = multipart_copy(ms3, &multipart, source_bucket, source_key,
+                       head->status.length);
+
+  if (!res)
+  {
+    res = multipart_complete(ms3, &multipart);
+  }
+
+  if (res)
+  {
+    multipart_abort(ms3, &multipart);
+  }
+
+  multipart_free(&multipart);
+
+  return res;
+}
+
+/* S3 copies at most 5GB in one request. The size of the source is checked
+ * first as servers word their refusals differently, if at all.
+ */
+uint8_t ms3_copy(ms3_st *ms3, const char *source_bucket, const char *source_key,
+                 const char *dest_bucket, const char *dest_key)
+{
+  uint8_t res = 0;
+  struct request_st request;
+  struct head_response_st head;
+
+  if (!ms3 || !source_bucket || !source_key || !dest_bucket || !dest_key)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  memset(&head, 0, sizeof(head));
+  request_init(&request, MS3_CMD_HEAD, source_bucket, source_key);
+  request.ret_ptr = &head;
+  res = request_execute(ms3, &request);
+
+  if (res)
+  {
+    return res;
+  }
+
+  if (head.status.length <= ms3->copy_threshold)
+  {
+    return execute_request(ms3, MS3_CMD_COPY, dest_bucket, dest_key,
+                           source_bucket, source_key, NULL, NULL, 0, NULL, NULL);
+  }
+
+  return copy_multipart(ms3, &head, source_bucket, source_key, dest_bucket,
+                        dest_key);
+}
+
+uint8_t ms3_move(ms3_st *ms3, const char *source_bucket, const char *source_key,
+                 const char *dest_bucket, const char *dest_key)
+{
+  uint8_t res = 0;
+
+  if (!ms3 || !source_bucket || !source_key || !dest_bucket || !dest_key)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  res = ms3_copy(ms3, source_bucket, source_key, dest_bucket, dest_key);
+
+  if (res)
+  {
+    return res;
+  }
+
+  res = ms3_delete(ms3, source_bucket, source_key);
+
+  return res;
+}
+
+uint8_t ms3_delete(ms3_st *ms3, const char *bucket, const char *key)
+{
+  uint8_t res;
+
+  if (!ms3 || !bucket || !key)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  res = execute_request(ms3, MS3_CMD_DELETE, bucket, key, NULL, NULL, NULL, NULL,
+                        0, NULL,
+                        NULL);
+  return res;
+}
+
+uint8_t ms3_delete_many(ms3_st *ms3, const char *bucket, const char **keys,
+                        size_t count, uint8_t *results)
+{
+  uint8_t res;
+  uint8_t *key_results = results;
+  size_t key_it;
+
+  if (!ms3 || !bucket || (count && !keys))
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  for (key_it = 0; key_it < count; key_it++)
+  {
+    if (!keys[key_it] || !keys[key_it][0])
+    {
+      return MS3_ERR_PARAMETER;
+    }
+  }
+
+  if (!count)
+  {
+    return 0;
+  }
+
+  if (!key_results)
+  {
+    key_results = ms3_cmalloc(count);
+
+    if (!key_results)
+    {
+      return MS3_ERR_OOM;
+    }
+  }
+
+  res = delete_keys(ms3, bucket, keys, count, key_results);
+
+  if (key_results != results)
+  {
+    ms3_cfree(key_results);
+  }
+
+  return res;
+}
+
+uint8_t ms3_delete_prefix(ms3_st *ms3, const char *bucket, const char *prefix,
+                          ms3_delete_progress_callback callback, void *userdata,
+                          ms3_delete_progress_st *progress)
+{
+  ms3_delete_progress_st local_progress;
+
+  // An empty prefix is the whole bucket, but NULL is more likely a mistake
+  if (!ms3 || !bucket || !prefix)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  return delete_prefix(ms3, bucket, prefix, callback, userdata,
+                       progress ? progress : &local_progress);
+}
+
+uint8_t ms3_status(ms3_st *ms3, const char *bucket, const char *key,
+                   ms3_status_st *status)
+{
+  uint8_t res;
+  bool found;
+  struct head_response_st response;
+  uint64_t generation;
+
+  if (!ms3 || !bucket || !key || !status)
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  if (status_cache_get(&ms3->status_cache, bucket, key, &found, &response))
+  {
+    if (!found)
+    {
+      return MS3_ERR_NOT_FOUND;
+    }
+
+    *status = response.status;
+    return 0;
+  }
+
+  memset(&response, 0, sizeof(response));
+  generation = status_cache_generation(&ms3->status_cache);
   res = execute_request(ms3, MS3_CMD_HEAD, bucket, key, NULL, NULL, NULL, NULL, 0,
                         NULL,
-                        status);
+                        &response);
+
+  if (!res)
+  {
+    *status = response.status;
+    status_cache_put(&ms3->status_cache, bucket, key, &response, generation);
+  }
+  else if (res == MS3_ERR_NOT_FOUND)
+  {
+    status_cache_put(&ms3->status_cache, bucket, key, NULL, generation);
+  }
+
   return res;
 }
 
+uint8_t ms3_status_many(ms3_st *ms3, const char *bucket, const char **keys,
+                        size_t count, ms3_status_st *statuses, uint8_t *results)
+{
+  size_t key_it;
+
+  if (!ms3 || !bucket || (count && (!keys || !statuses || !results)))
+  {
+    return MS3_ERR_PARAMETER;
+  }
+
+  for (key_it = 0; key_it < count; key_it++)
+  {
+    if (!keys[key_it] || !keys[key_it][0])
+    {
+      return MS3_ERR_PARAMETER;
+    }
+  }
+
+  if (!count)
+  {
+    return 0;
+  }
+
+  return status_keys(ms3, bucket, keys, count, statuses, results);
+}
+
 void ms3_list_free(ms3_list_st *list)
 {
   // Deprecated
@@ -608,6 +1498,175 @@ uint8_t ms3_set_option(ms3_st *ms3, ms3_set_option_t option, void *value)
       break;
     }
 
+    case MS3_OPT_BUFFER_POOL_SIZE:
+    {
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->buffer_pool.max_cached = *(size_t *)value;
+
+      // Shrinking (or disabling) the pool drops everything it holds
+      if (ms3->buffer_pool.cached > ms3->buffer_pool.max_cached)
+      {
+        buffer_pool_clear(&ms3->buffer_pool);
+      }
+
+      break;
+    }
+
+    case MS3_OPT_PART_SIZE:
+    {
+      size_t part_size;
+
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      part_size = *(size_t *)value;
+
+      // S3 refuses smaller parts apart from the last
+      if (part_size < MIN_PART_SIZE)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->part_size = part_size;
+      break;
+    }
+
+    case MS3_OPT_MAX_PARALLEL:
+    {
+      size_t max_parallel;
+
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      max_parallel = *(size_t *)value;
+
+      if (max_parallel < 1)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->max_parallel = max_parallel;
+      break;
+    }
+
+    case MS3_OPT_COPY_THRESHOLD:
+    {
+      size_t copy_threshold;
+
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      copy_threshold = *(size_t *)value;
+
+      // Anything bigger can't be copied in one request
+      if (copy_threshold < 1 || copy_threshold > MAX_COPY_SIZE)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->copy_threshold = copy_threshold;
+      break;
+    }
+
+    case MS3_OPT_STATUS_CACHE_SIZE:
+    {
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      // The table is sized for the limit, so it is rebuilt on the next use
+      status_cache_clear(&ms3->status_cache);
+      ms3->status_cache.max_entries = *(size_t *)value;
+      break;
+    }
+
+    case MS3_OPT_STATUS_CACHE_TTL:
+    {
+      float ttl;
+
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ttl = *(float *)value;
+
+      if (ttl < 0 || ttl >= UINT32_MAX / 1000)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->status_cache.ttl_ms = ttl * 1000;
+      break;
+    }
+
+    case MS3_OPT_DISK_CACHE_DIR:
+    {
+      // NULL turns the cache off, the files are left for next time
+      if (!value)
+      {
+        disk_cache_close(&ms3->disk_cache);
+        break;
+      }
+
+      return disk_cache_open(&ms3->disk_cache, (const char *)value);
+    }
+
+    case MS3_OPT_DISK_CACHE_SIZE:
+    {
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->disk_cache.max_size = *(size_t *)value;
+      disk_cache_trim(&ms3->disk_cache);
+      break;
+    }
+
+    case MS3_OPT_IAM_ROLE_ARN:
+    {
+      if (!value || strlen((const char *)value) >= MAX_ROLE_ARN_LENGTH)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      if (!ms3->iam_role_arn)
+      {
+        ms3->iam_role_arn = ms3_cmalloc(sizeof(char) * MAX_ROLE_ARN_LENGTH);
+
+        if (!ms3->iam_role_arn)
+        {
+          return MS3_ERR_OOM;
+        }
+      }
+
+      strcpy(ms3->iam_role_arn, (const char *)value);
+      break;
+    }
+
+    case MS3_OPT_CREDENTIAL_REFRESH_WINDOW:
+    {
+      if (!value)
+      {
+        return MS3_ERR_PARAMETER;
+      }
+
+      ms3->credential_refresh_window = (time_t)(*(size_t *)value);
+      break;
+    }
+
     case MS3_OPT_FORCE_LIST_VERSION:
     {
       uint8_t list_version;
@@ -727,7 +1786,9 @@ uint8_t ms3_assume_role(ms3_st *ms3)
       return MS3_ERR_PARAMETER;
     }
 
-    if (!strstr(ms3->iam_role_arn, ms3->iam_role))
+    if (!strstr(ms3->iam_role_arn, ms3->iam_role) &&
+        !role_arn_cache_get(ms3->s3key, ms3->iam_role, ms3->iam_role_arn,
+                            MAX_ROLE_ARN_LENGTH))
     {
         ms3debug("Lookup IAM role ARN");
         res = execute_assume_role_request(ms3, MS3_CMD_LIST_ROLE, NULL, 0, NULL);
@@ -740,6 +1801,12 @@ uint8_t ms3_assume_role(ms3_st *ms3)
     ms3debug("Assume IAM role");
     res = execute_assume_role_request(ms3, MS3_CMD_ASSUME_ROLE, NULL, 0, NULL);
 
+    // Only an ARN which worked is shared with other handles
+    if (!res)
+    {
+      role_arn_cache_put(ms3->s3key, ms3->iam_role, ms3->iam_role_arn);
+    }
+
     return res;
 }
 
@@ -753,11 +1820,58 @@ void ms3_set_content_type(ms3_st *ms3, const char *content_type)
     ms3->content_type_out = content_type;
 }
 
+// The library sets these itself
+static const char *reserved_headers[] =
+{
+  "x-amz-content-sha256",
+  "x-amz-copy-source",
+  "x-amz-copy-source-range",
+  "x-amz-date",
+  "x-amz-security-token",
+  NULL
+};
+
+uint8_t ms3_set_headers(ms3_st *ms3, const ms3_header_st *headers,
+                        size_t count)
+{
+    size_t header_it;
+
+    if (!ms3 || (count && !headers))
+    {
+        return MS3_ERR_PARAMETER;
+    }
+
+    for (header_it = 0; header_it < count; header_it++)
+    {
+        const char *name = headers[header_it].name;
+        size_t reserved_it;
+
+        if (!name || !headers[header_it].value || strncasecmp(name, "x-amz-", 6))
+        {
+            return MS3_ERR_PARAMETER;
+        }
+
+        for (reserved_it = 0; reserved_headers[reserved_it]; reserved_it++)
+        {
+            if (!strcasecmp(name, reserved_headers[reserved_it]))
+            {
+                return MS3_ERR_PARAMETER;
+            }
+        }
+    }
+
+    ms3->headers_out = count ? headers : NULL;
+    ms3->header_out_count = count;
+    return 0;
+}
+
 const char *ms3_get_content_type(ms3_st *ms3)
 {
-    if (!ms3)
+    struct ms3_context_st *ctx;
+
+    if (!ms3 || !(ctx = context_get(ms3)))
     {
         return NULL;
     }
-    return ms3->content_type_in;
+    return ctx->content_type_in;
 }
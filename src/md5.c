@@ -0,0 +1,196 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "md5.h"
+
+#include <string.h>
+
+// Per round shift amounts
+static const uint8_t md5_shift[64] =
+{
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+// floor(abs(sin(i + 1)) * 2^32)
+static const uint32_t md5_k[64] =
+{
+  0xd76aa478UL, 0xe8c7b756UL, 0x242070dbUL, 0xc1bdceeeUL, 0xf57c0fafUL,
+  0x4787c62aUL, 0xa8304613UL, 0xfd469501UL, 0x698098d8UL, 0x8b44f7afUL,
+  0xffff5bb1UL, 0x895cd7beUL, 0x6b901122UL, 0xfd987193UL, 0xa679438eUL,
+  0x49b40821UL, 0xf61e2562UL, 0xc040b340UL, 0x265e5a51UL, 0xe9b6c7aaUL,
+  0xd62f105dUL, 0x02441453UL, 0xd8a1e681UL, 0xe7d3fbc8UL, 0x21e1cde6UL,
+  0xc33707d6UL, 0xf4d50d87UL, 0x455a14edUL, 0xa9e3e905UL, 0xfcefa3f8UL,
+  0x676f02d9UL, 0x8d2a4c8aUL, 0xfffa3942UL, 0x8771f681UL, 0x6d9d6122UL,
+  0xfde5380cUL, 0xa4beea44UL, 0x4bdecfa9UL, 0xf6bb4b60UL, 0xbebfbc70UL,
+  0x289b7ec6UL, 0xeaa127faUL, 0xd4ef3085UL, 0x04881d05UL, 0xd9d4d039UL,
+  0xe6db99e5UL, 0x1fa27cf8UL, 0xc4ac5665UL, 0xf4292244UL, 0x432aff97UL,
+  0xab9423a7UL, 0xfc93a039UL, 0x655b59c3UL, 0x8f0ccc92UL, 0xffeff47dUL,
+  0x85845dd1UL, 0x6fa87e4fUL, 0xfe2ce6e0UL, 0xa3014314UL, 0x4e0811a1UL,
+  0xf7537e82UL, 0xbd3af235UL, 0x2ad7d2bbUL, 0xeb86d391UL
+};
+
+static inline uint32_t md5_get_le32(const uint8_t *a)
+{
+  return ((uint32_t) a[3] << 24) | ((uint32_t) a[2] << 16) |
+         ((uint32_t) a[1] << 8) | a[0];
+}
+
+static inline void md5_put_le32(uint8_t *a, uint32_t val)
+{
+  a[0] = val & 0xff;
+  a[1] = (val >> 8) & 0xff;
+  a[2] = (val >> 16) & 0xff;
+  a[3] = (val >> 24) & 0xff;
+}
+
+static void md5_compress(struct md5_state *md, const uint8_t *buf)
+{
+  uint32_t w[16];
+  uint32_t a = md->state[0];
+  uint32_t b = md->state[1];
+  uint32_t c = md->state[2];
+  uint32_t d = md->state[3];
+  int i;
+
+  for (i = 0; i < 16; i++)
+  {
+    w[i] = md5_get_le32(buf + (4 * i));
+  }
+
+  for (i = 0; i < 64; i++)
+  {
+    uint32_t f;
+    int g;
+
+    if (i < 16)
+    {
+      f = d ^ (b & (c ^ d));
+      g = i;
+    }
+    else if (i < 32)
+    {
+      f = c ^ (d & (b ^ c));
+      g = (5 * i + 1) & 15;
+    }
+    else if (i < 48)
+    {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) & 15;
+    }
+    else
+    {
+      f = c ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+
+    f += a + md5_k[i] + w[g];
+    a = d;
+    d = c;
+    c = b;
+    b += (f << md5_shift[i]) | (f >> (32 - md5_shift[i]));
+  }
+
+  md->state[0] += a;
+  md->state[1] += b;
+  md->state[2] += c;
+  md->state[3] += d;
+}
+
+void md5_init(struct md5_state *md)
+{
+  md->length = 0;
+  md->curlen = 0;
+  md->state[0] = 0x67452301UL;
+  md->state[1] = 0xefcdab89UL;
+  md->state[2] = 0x98badcfeUL;
+  md->state[3] = 0x10325476UL;
+}
+
+void md5_process(struct md5_state *md, const uint8_t *in, size_t inlen)
+{
+  md->length += (uint64_t) inlen * 8;
+
+  while (inlen > 0)
+  {
+    size_t n;
+
+    if (md->curlen == 0 && inlen >= MD5_BLOCK_SIZE)
+    {
+      md5_compress(md, in);
+      in += MD5_BLOCK_SIZE;
+      inlen -= MD5_BLOCK_SIZE;
+      continue;
+    }
+
+    n = MD5_BLOCK_SIZE - md->curlen;
+
+    if (n > inlen)
+    {
+      n = inlen;
+    }
+
+    memcpy(md->buf + md->curlen, in, n);
+    md->curlen += (uint32_t) n;
+    in += n;
+    inlen -= n;
+
+    if (md->curlen == MD5_BLOCK_SIZE)
+    {
+      md5_compress(md, md->buf);
+      md->curlen = 0;
+    }
+  }
+}
+
+void md5_done(struct md5_state *md, uint8_t *out)
+{
+  int i;
+
+  md->buf[md->curlen++] = 0x80;
+
+  // No room left for the length, pad out this block and use another
+  if (md->curlen > MD5_BLOCK_SIZE - 8)
+  {
+    memset(md->buf + md->curlen, 0, MD5_BLOCK_SIZE - md->curlen);
+    md5_compress(md, md->buf);
+    md->curlen = 0;
+  }
+
+  memset(md->buf + md->curlen, 0, MD5_BLOCK_SIZE - 8 - md->curlen);
+  md5_put_le32(md->buf + MD5_BLOCK_SIZE - 8, (uint32_t) md->length);
+  md5_put_le32(md->buf + MD5_BLOCK_SIZE - 4, (uint32_t)(md->length >> 32));
+  md5_compress(md, md->buf);
+
+  for (i = 0; i < 4; i++)
+  {
+    md5_put_le32(out + (4 * i), md->state[i]);
+  }
+}
+
+void md5(const uint8_t *addr, size_t len, uint8_t *mac)
+{
+  struct md5_state ctx;
+
+  md5_init(&ctx);
+  md5_process(&ctx, addr, len);
+  md5_done(&ctx, mac);
+}
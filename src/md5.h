@@ -0,0 +1,44 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+/* MD5 (RFC 1321). Only used where S3 insists on a Content-MD5 header, it
+ * plays no part in request signing.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MD5_MAC_LEN 16
+#define MD5_BLOCK_SIZE 64
+
+struct md5_state
+{
+  uint64_t length;
+  uint32_t state[4];
+  uint32_t curlen;
+  uint8_t buf[MD5_BLOCK_SIZE];
+};
+
+void md5_init(struct md5_state *md);
+void md5_process(struct md5_state *md, const uint8_t *in, size_t inlen);
+void md5_done(struct md5_state *md, uint8_t *out);
+
+void md5(const uint8_t *addr, size_t len, uint8_t *mac);
@@ -24,3 +24,31 @@ extern ms3_free_callback ms3_cfree;
 extern ms3_realloc_callback ms3_crealloc;
 extern ms3_strdup_callback ms3_cstrdup;
 extern ms3_calloc_callback ms3_ccalloc;
+
+/* With allocation statistics enabled (ms3_alloc_stats_enable()) every
+ * allocation carries a small header and is recorded against the file and
+ * line it was made from. Otherwise the callbacks above are called directly.
+ */
+extern bool alloc_stats_enabled;
+
+void *alloc_stats_malloc(size_t size, const char *file, unsigned int line);
+void *alloc_stats_calloc(size_t nmemb, size_t size, const char *file,
+                         unsigned int line);
+void *alloc_stats_realloc(void *ptr, size_t size, const char *file,
+                          unsigned int line);
+char *alloc_stats_strdup(const char *str, const char *file, unsigned int line);
+void alloc_stats_free(void *ptr);
+
+// Called by the functions that may allocate, stats can't be enabled after
+void alloc_stats_lock(void);
+
+#define ms3_cmalloc(size) (alloc_stats_enabled ? \
+  alloc_stats_malloc((size), __FILE__, __LINE__) : ms3_cmalloc(size))
+#define ms3_ccalloc(nmemb, size) (alloc_stats_enabled ? \
+  alloc_stats_calloc((nmemb), (size), __FILE__, __LINE__) : ms3_ccalloc((nmemb), (size)))
+#define ms3_crealloc(ptr, size) (alloc_stats_enabled ? \
+  alloc_stats_realloc((ptr), (size), __FILE__, __LINE__) : ms3_crealloc((ptr), (size)))
+#define ms3_cstrdup(str) (alloc_stats_enabled ? \
+  alloc_stats_strdup((str), __FILE__, __LINE__) : ms3_cstrdup(str))
+#define ms3_cfree(ptr) (alloc_stats_enabled ? \
+  alloc_stats_free(ptr) : ms3_cfree(ptr))
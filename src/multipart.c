@@ -0,0 +1,538 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include "config.h"
+#include "common.h"
+
+#include <pthread.h>
+
+/* Multipart uploads. The parts are independent requests so they are sent
+ * in parallel, the ETag of each is kept for the completion request. Parts
+ * are either sent from memory or a file, or copied server side from ranges
+ * of another object.
+ */
+
+struct part_upload_st
+{
+  struct multipart_st *multipart;
+  const uint8_t *data; // NULL when the parts are read from fd
+  struct upload_source_st *sources;
+  int fd;
+  off_t offset;
+  size_t length;
+  size_t window_size;
+  struct part_hasher_st *hasher;
+  size_t in_flight; // Parts set up and not yet done
+};
+
+/* The payload hash of every part has to be known before the part is sent.
+ * Instead of hashing each part when a slot becomes free, a thread hashes the
+ * parts in order ahead of the uploads so hashing a part overlaps with sending
+ * the ones before it. It runs at most a few parts ahead so the data it reads
+ * is still cached when it is sent. The data is still read twice, once here
+ * and once as it is sent.
+ */
+struct part_hasher_st
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct part_upload_st *upload;
+  char (*hashes)[65];
+  size_t hashed; // Parts with a hash ready
+  size_t wanted; // Parts set up for sending so far
+  size_t lookahead;
+  uint8_t error;
+  bool stop;
+};
+
+static void part_range(struct part_upload_st *upload, size_t index,
+                       size_t *start, size_t *part_length)
+{
+  *start = index * upload->multipart->part_size;
+  *part_length = upload->multipart->part_size;
+
+  if (*part_length > upload->length - *start)
+  {
+    *part_length = upload->length - *start;
+  }
+}
+
+static void *part_hasher_thread(void *arg)
+{
+  struct part_hasher_st *hasher = (struct part_hasher_st *)arg;
+  struct part_upload_st *upload = hasher->upload;
+  size_t part_it;
+
+  for (part_it = 0; part_it < upload->multipart->part_count; part_it++)
+  {
+    uint8_t res = 0;
+    size_t start;
+    size_t part_length;
+
+    pthread_mutex_lock(&hasher->lock);
+
+    while (!hasher->stop && part_it >= hasher->wanted + hasher->lookahead)
+    {
+      pthread_cond_wait(&hasher->cond, &hasher->lock);
+    }
+
+    if (hasher->stop)
+    {
+      pthread_mutex_unlock(&hasher->lock);
+      break;
+    }
+
+    pthread_mutex_unlock(&hasher->lock);
+
+    part_range(upload, part_it, &start, &part_length);
+
+    if (upload->data)
+    {
+      payload_hash_data(upload->data + start, part_length,
+                        hasher->hashes[part_it]);
+    }
+    else
+    {
+      struct upload_source_st source;
+      source.fd = upload->fd;
+      source.offset = upload->offset + (off_t)start;
+      source.length = part_length;
+      res = payload_hash_file(&source, upload->window_size,
+                              hasher->hashes[part_it]);
+    }
+
+    pthread_mutex_lock(&hasher->lock);
+
+    if (res)
+    {
+      hasher->error = res;
+    }
+    else
+    {
+      hasher->hashed = part_it + 1;
+    }
+
+    pthread_cond_broadcast(&hasher->cond);
+    pthread_mutex_unlock(&hasher->lock);
+
+    if (res)
+    {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static bool part_hasher_start(struct part_hasher_st *hasher,
+                              struct part_upload_st *upload, size_t max_parallel)
+{
+  memset(hasher, 0, sizeof(struct part_hasher_st));
+  hasher->upload = upload;
+  hasher->lookahead = max_parallel + 1;
+  hasher->hashes = ms3_cmalloc(upload->multipart->part_count * 65);
+
+  if (!hasher->hashes)
+  {
+    return false;
+  }
+
+  pthread_mutex_init(&hasher->lock, NULL);
+  pthread_cond_init(&hasher->cond, NULL);
+
+  if (pthread_create(&hasher->thread, NULL, part_hasher_thread, hasher))
+  {
+    pthread_cond_destroy(&hasher->cond);
+    pthread_mutex_destroy(&hasher->lock);
+    ms3_cfree(hasher->hashes);
+    return false;
+  }
+
+  return true;
+}
+
+/* Gets the hash of a part. If it isn't ready yet this waits for it, or with
+ * wait false returns PARALLEL_WAIT so the parts in flight carry on.
+ */
+static uint8_t part_hasher_get(struct part_hasher_st *hasher, size_t index,
+                               bool wait, const char **hash)
+{
+  uint8_t res;
+
+  pthread_mutex_lock(&hasher->lock);
+  hasher->wanted = index + 1;
+  pthread_cond_broadcast(&hasher->cond);
+
+  if (!wait && hasher->hashed <= index && !hasher->error)
+  {
+    pthread_mutex_unlock(&hasher->lock);
+    return PARALLEL_WAIT;
+  }
+
+  while (hasher->hashed <= index && !hasher->error)
+  {
+    pthread_cond_wait(&hasher->cond, &hasher->lock);
+  }
+
+  res = hasher->hashed > index ? 0 : hasher->error;
+  pthread_mutex_unlock(&hasher->lock);
+  *hash = hasher->hashes[index];
+
+  return res;
+}
+
+static void part_hasher_stop(struct part_hasher_st *hasher)
+{
+  pthread_mutex_lock(&hasher->lock);
+  hasher->stop = true;
+  pthread_cond_broadcast(&hasher->cond);
+  pthread_mutex_unlock(&hasher->lock);
+  pthread_join(hasher->thread, NULL);
+  pthread_cond_destroy(&hasher->cond);
+  pthread_mutex_destroy(&hasher->lock);
+  ms3_cfree(hasher->hashes);
+}
+
+uint8_t multipart_create(ms3_st *ms3, struct multipart_st *multipart,
+                         const char *bucket, const char *key, size_t length,
+                         const char *content_type,
+                         const ms3_header_st *headers, size_t header_count)
+{
+  uint8_t res;
+  char *upload_id = NULL;
+  char *encoded;
+  struct request_st request;
+
+  memset(multipart, 0, sizeof(struct multipart_st));
+  multipart->bucket = bucket;
+  multipart->key = key;
+  multipart->part_size = ms3->part_size;
+
+  // S3 allows at most 10000 parts, use bigger ones if needed
+  if (length / multipart->part_size >= MAX_PART_COUNT)
+  {
+    multipart->part_size = (length + MAX_PART_COUNT - 1) / MAX_PART_COUNT;
+  }
+
+  multipart->part_count = (length + multipart->part_size - 1) /
+                          multipart->part_size;
+  multipart->etags = ms3_ccalloc(multipart->part_count, MAX_ETAG_LENGTH);
+
+  if (!multipart->etags)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  request_init(&request, MS3_CMD_CREATE_MULTIPART, bucket, key);
+  request.query = "uploads=";
+  request.content_type = content_type;
+  request.extra_headers = headers;
+  request.extra_header_count = header_count;
+  request.ret_ptr = &upload_id;
+  res = request_execute(ms3, &request);
+
+  if (res)
+  {
+    multipart_free(multipart);
+    return res;
+  }
+
+  // The thread's context exists once a request has been made
+  encoded = curl_easy_escape(context_get(ms3)->curl, upload_id,
+                             (int)strlen(upload_id));
+  ms3_cfree(upload_id);
+
+  if (!encoded)
+  {
+    multipart_free(multipart);
+    return MS3_ERR_OOM;
+  }
+
+  multipart->upload_id = ms3_cstrdup(encoded);
+  curl_free(encoded);
+  // "partNumber=10000&uploadId=" and the ID
+  multipart->query_size = strlen(multipart->upload_id) + 32;
+  multipart->query = ms3_cmalloc(multipart->query_size);
+
+  if (!multipart->upload_id || !multipart->query)
+  {
+    multipart_abort(ms3, multipart);
+    multipart_free(multipart);
+    return MS3_ERR_OOM;
+  }
+
+  ms3debug("Multipart upload of %zu parts: %s", multipart->part_count,
+           multipart->upload_id);
+
+  return 0;
+}
+
+static uint8_t part_setup(ms3_st *ms3, size_t index, struct request_st *request,
+                          void *userdata)
+{
+  struct part_upload_st *upload = (struct part_upload_st *)userdata;
+  struct multipart_st *multipart = upload->multipart;
+  size_t start;
+  size_t part_length;
+  const char *payload_hash = NULL;
+  (void) ms3;
+
+  // Blocking the loop would stall the parts in flight, with none there is
+  // nothing else to do
+  if (upload->hasher)
+  {
+    uint8_t res = part_hasher_get(upload->hasher, index, !upload->in_flight,
+                                  &payload_hash);
+
+    if (res)
+    {
+      return res;
+    }
+  }
+
+  part_range(upload, index, &start, &part_length);
+
+  // Parameters are in canonical order, partNumber before uploadId
+  snprintf(multipart->query, multipart->query_size, "partNumber=%zu&uploadId=%s",
+           index + 1, multipart->upload_id);
+  multipart->etags[index][0] = '\0';
+
+  request_init(request, MS3_CMD_UPLOAD_PART, multipart->bucket,
+               multipart->key);
+  request->query = multipart->query;
+  request->ret_ptr = multipart->etags[index];
+  request->payload_hash = payload_hash;
+  upload->in_flight++;
+
+  if (upload->data)
+  {
+    request->data = upload->data + start;
+    request->data_size = part_length;
+  }
+  else
+  {
+    struct upload_source_st *source = &upload->sources[index];
+    source->fd = upload->fd;
+    source->offset = upload->offset + (off_t)start;
+    source->length = part_length;
+    request->upload = source;
+  }
+
+  return 0;
+}
+
+static uint8_t part_done(ms3_st *ms3, size_t index, struct request_st *request,
+                         uint8_t result, void *userdata)
+{
+  struct part_upload_st *upload = (struct part_upload_st *)userdata;
+  (void) ms3;
+  (void) index;
+  (void) request;
+
+  upload->in_flight--;
+  return result;
+}
+
+uint8_t multipart_upload_file(ms3_st *ms3, struct multipart_st *multipart,
+                              const uint8_t *data, int fd, off_t offset, size_t length)
+{
+  uint8_t res;
+  struct part_upload_st upload;
+  struct part_hasher_st hasher;
+
+  upload.multipart = multipart;
+  upload.data = data;
+  upload.sources = NULL;
+  upload.fd = fd;
+  upload.offset = offset;
+  upload.length = length;
+  upload.window_size = ms3->buffer_chunk_size;
+  upload.hasher = NULL;
+  upload.in_flight = 0;
+
+  if (!data)
+  {
+    upload.sources = ms3_ccalloc(multipart->part_count,
+                                 sizeof(struct upload_source_st));
+
+    if (!upload.sources)
+    {
+      return MS3_ERR_OOM;
+    }
+  }
+
+  // Without the thread each part is hashed as it is set up
+  if (part_hasher_start(&hasher, &upload, ms3->max_parallel))
+  {
+    upload.hasher = &hasher;
+  }
+
+  res = execute_parallel(ms3, multipart->part_count, part_setup, part_done,
+                         &upload);
+
+  if (upload.hasher)
+  {
+    part_hasher_stop(&hasher);
+  }
+
+  ms3_cfree(upload.sources);
+
+  return res;
+}
+
+struct part_copy_st
+{
+  struct multipart_st *multipart;
+  const char *source_bucket;
+  const char *source_key;
+  size_t length;
+  char range[64]; // Only needed until the request is set up
+};
+
+static uint8_t part_copy_setup(ms3_st *ms3, size_t index,
+                               struct request_st *request, void *userdata)
+{
+  struct part_copy_st *copy = (struct part_copy_st *)userdata;
+  struct multipart_st *multipart = copy->multipart;
+  size_t start = index * multipart->part_size;
+  size_t part_length = multipart->part_size;
+  (void) ms3;
+
+  if (part_length > copy->length - start)
+  {
+    part_length = copy->length - start;
+  }
+
+  snprintf(multipart->query, multipart->query_size, "partNumber=%zu&uploadId=%s",
+           index + 1, multipart->upload_id);
+  snprintf(copy->range, sizeof(copy->range), "bytes=%zu-%zu", start,
+           start + part_length - 1);
+  multipart->etags[index][0] = '\0';
+
+  request_init(request, MS3_CMD_UPLOAD_PART_COPY, multipart->bucket,
+               multipart->key);
+  request->query = multipart->query;
+  request->source_bucket = copy->source_bucket;
+  request->source_object = copy->source_key;
+  request->copy_range = copy->range;
+  request->ret_ptr = multipart->etags[index];
+
+  return 0;
+}
+
+uint8_t multipart_copy(ms3_st *ms3, struct multipart_st *multipart,
+                       const char *source_bucket, const char *source_key, size_t length)
+{
+  struct part_copy_st copy;
+
+  copy.multipart = multipart;
+  copy.source_bucket = source_bucket;
+  copy.source_key = source_key;
+  copy.length = length;
+
+  return execute_parallel(ms3, multipart->part_count, part_copy_setup, NULL,
+                          &copy);
+}
+
+uint8_t multipart_complete(ms3_st *ms3, struct multipart_st *multipart)
+{
+  uint8_t res;
+  size_t part_it;
+  size_t body_size;
+  size_t pos;
+  char *body;
+  struct request_st request;
+  static const char *body_start = "<CompleteMultipartUpload>";
+  static const char *body_end = "</CompleteMultipartUpload>";
+
+  // Each part is <Part><PartNumber>N</PartNumber><ETag>...</ETag></Part>
+  body_size = strlen(body_start) + strlen(body_end) + 1 +
+              multipart->part_count * (64 + MAX_ETAG_LENGTH);
+  body = ms3_cmalloc(body_size);
+
+  if (!body)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  pos = (size_t)snprintf(body, body_size, "%s", body_start);
+
+  for (part_it = 0; part_it < multipart->part_count; part_it++)
+  {
+    pos += (size_t)snprintf(body + pos, body_size - pos,
+                            "<Part><PartNumber>%zu</PartNumber><ETag>%s</ETag></Part>",
+                            part_it + 1, multipart->etags[part_it]);
+  }
+
+  pos += (size_t)snprintf(body + pos, body_size - pos, "%s", body_end);
+
+  snprintf(multipart->query, multipart->query_size, "uploadId=%s",
+           multipart->upload_id);
+  request_init(&request, MS3_CMD_COMPLETE_MULTIPART, multipart->bucket,
+               multipart->key);
+  request.query = multipart->query;
+  request.data = (uint8_t *)body;
+  request.data_size = pos;
+  res = request_execute(ms3, &request);
+  ms3_cfree(body);
+
+  return res;
+}
+
+void multipart_abort(ms3_st *ms3, struct multipart_st *multipart)
+{
+  uint8_t res;
+  struct request_error_st last_error;
+  struct request_st request;
+  struct ms3_context_st *ctx = context_get(ms3);
+
+  if (!multipart->upload_id || !multipart->query || !ctx)
+  {
+    return;
+  }
+
+  // Keep the error of whatever made us abort
+  last_error = ctx->error;
+
+  snprintf(multipart->query, multipart->query_size, "uploadId=%s",
+           multipart->upload_id);
+  request_init(&request, MS3_CMD_ABORT_MULTIPART, multipart->bucket,
+               multipart->key);
+  request.query = multipart->query;
+  res = request_execute(ms3, &request);
+
+  if (res)
+  {
+    ms3debug("Abort of multipart upload failed: %s", ms3_error(res));
+  }
+
+  ctx->error = last_error;
+}
+
+void multipart_free(struct multipart_st *multipart)
+{
+  ms3_cfree(multipart->upload_id);
+  ms3_cfree(multipart->query);
+  ms3_cfree(multipart->etags);
+  multipart->upload_id = NULL;
+  multipart->query = NULL;
+  multipart->etags = NULL;
+}
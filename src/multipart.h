@@ -0,0 +1,61 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* State of a multipart upload between CreateMultipartUpload and
+ * CompleteMultipartUpload / AbortMultipartUpload
+ */
+struct multipart_st
+{
+  const char *bucket;
+  const char *key;
+  char *upload_id; // URI encoded, ready for the query string
+  char *query; // Scratch space for the query of the part being set up
+  size_t query_size;
+  size_t part_size;
+  size_t part_count;
+  char (*etags)[MAX_ETAG_LENGTH];
+};
+
+/* content_type and headers replace the ones set on the handle if not NULL,
+ * such as those of the source of a copy
+ */
+uint8_t multipart_create(ms3_st *ms3, struct multipart_st *multipart,
+                         const char *bucket, const char *key, size_t length,
+                         const char *content_type,
+                         const ms3_header_st *headers, size_t header_count);
+
+uint8_t multipart_upload_file(ms3_st *ms3, struct multipart_st *multipart,
+                              const uint8_t *data, int fd, off_t offset, size_t length);
+
+uint8_t multipart_copy(ms3_st *ms3, struct multipart_st *multipart,
+                       const char *source_bucket, const char *source_key, size_t length);
+
+uint8_t multipart_complete(ms3_st *ms3, struct multipart_st *multipart);
+
+void multipart_abort(ms3_st *ms3, struct multipart_st *multipart);
+
+void multipart_free(struct multipart_st *multipart);
@@ -21,50 +21,109 @@
 #include "common.h"
 #include "debug.h"
 #include "sha256.h"
+#include "sha256_i.h"
+#include "md5.h"
 
 #include <curl/curl.h>
 #include <curl/easy.h>
-#include <math.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 const char *default_domain = "s3.amazonaws.com";
 
-static void set_error(ms3_st *ms3, const char *error)
+/* Whether a failed request is worth sending again, for throttling, timeouts
+ * and failures on the server side
+ */
+static bool error_retryable(long status, const char *code)
 {
-  ms3_cfree(ms3->last_error);
+  static const char *codes[] = { "RequestTimeout", "SlowDown", "Throttling",
+                                 "ThrottlingException", "RequestTimeTooSkewed",
+                                 "InternalError", "ServiceUnavailable" };
+  size_t code_it;
 
-  if (!error)
+  if (status >= 500 || status == 429)
   {
-    ms3->last_error = NULL;
-    return;
+    return true;
+  }
+
+  for (code_it = 0; code_it < sizeof(codes) / sizeof(codes[0]); code_it++)
+  {
+    if (!strcmp(code, codes[code_it]))
+    {
+      return true;
+    }
   }
 
-  ms3->last_error = ms3_cstrdup(error);
+  return false;
+}
+
+bool request_curl_retryable(CURLcode curl_res)
+{
+  return curl_res == CURLE_COULDNT_RESOLVE_HOST ||
+         curl_res == CURLE_COULDNT_CONNECT ||
+         curl_res == CURLE_OPERATION_TIMEDOUT ||
+         curl_res == CURLE_SEND_ERROR ||
+         curl_res == CURLE_RECV_ERROR ||
+         curl_res == CURLE_GOT_NOTHING ||
+         curl_res == CURLE_PARTIAL_FILE;
+}
+
+void request_error_set(struct request_error_st *error, uint8_t result,
+                       const char *message, bool retryable)
+{
+  error->result = result;
+  error->retryable = retryable;
+  snprintf(error->message, sizeof(error->message), "%s",
+           message ? message : "");
 }
 
-static void set_error_nocopy(ms3_st *ms3, char *error)
+// Completes an error once the code and message have been filled in
+static void error_complete(struct request_error_st *error, uint8_t result,
+                           long status, const char *request_id)
 {
-  ms3_cfree(ms3->last_error);
+  error->result = result;
+  error->status = status;
+  error->retryable = error_retryable(status, error->code);
 
-  if (!error)
+  // The header is used over any ID in the body
+  if (request_id[0])
   {
-    ms3->last_error = NULL;
-    return;
+    memcpy(error->request_id, request_id, sizeof(error->request_id));
+  }
+
+  if (error->message[0])
+  {
+    ms3debug("Response message: %s", error->message);
   }
+}
+
+void request_error_response(struct request_error_st *error, uint8_t result,
+                            long status, const char *request_id,
+                            const char *data, size_t length)
+{
+  parse_error_response(data, length, error);
+  error_complete(error, result, status, request_id);
+}
 
-  ms3->last_error = error;
+// A failure replaces the thread's last error, success leaves it alone
+static void error_publish(struct ms3_context_st *ctx,
+                          const struct request_error_st *error)
+{
+  if (error->result)
+  {
+    ctx->error = *error;
+  }
 }
 
 static uint8_t build_request_uri(CURL *curl, const char *base_domain,
                                  const char *bucket, const char *object, const char *query, bool use_http,
                                  uint8_t protocol_version)
 {
-  char uri_buffer[MAX_URI_LENGTH];
+  char uri_data[MAX_URI_LENGTH];
+  struct string_builder_st uri;
   const char *domain;
-  const uint8_t path_parts = 10; // "https://" + "." + "/"
-  const char *http_protocol = "http";
-  const char *https_protocol = "https";
-  const char *protocol;
 
   if (base_domain)
   {
@@ -75,247 +134,235 @@ static uint8_t build_request_uri(CURL *curl, const char *base_domain,
     domain = default_domain;
   }
 
+  string_builder_init(&uri, uri_data, sizeof(uri_data));
+
   if (use_http)
   {
-    protocol = http_protocol;
+    string_builder_append(&uri, "http://", 7);
   }
   else
   {
-    protocol = https_protocol;
+    string_builder_append(&uri, "https://", 8);
   }
 
-  if (query)
+  if (protocol_version == 1)
   {
-    if (path_parts + strlen(domain) + strlen(bucket) + strlen(object) + strlen(
-          query) >= MAX_URI_LENGTH - 1)
-    {
-      return MS3_ERR_URI_TOO_LONG;
-    }
-
-    if (protocol_version == 1)
-    {
-      snprintf(uri_buffer, MAX_URI_LENGTH - 1, "%s://%s/%s%s?%s", protocol,
-               domain, bucket,
-               object, query);
-    }
-    else
-    {
-      snprintf(uri_buffer, MAX_URI_LENGTH - 1, "%s://%s.%s%s?%s", protocol,
-               bucket, domain,
-               object, query);
-    }
+    string_builder_append_str(&uri, domain);
+    string_builder_append_char(&uri, '/');
+    string_builder_append_str(&uri, bucket);
   }
   else
   {
-    if (path_parts + strlen(domain) + strlen(bucket) + strlen(
-          object) >= MAX_URI_LENGTH - 1)
-    {
-      return MS3_ERR_URI_TOO_LONG;
-    }
+    string_builder_append_str(&uri, bucket);
+    string_builder_append_char(&uri, '.');
+    string_builder_append_str(&uri, domain);
+  }
 
-    if (protocol_version == 1)
-    {
-      snprintf(uri_buffer, MAX_URI_LENGTH - 1, "%s://%s/%s%s", protocol,
-               domain,
-               bucket,
-               object);
-    }
-    else
-    {
-      snprintf(uri_buffer, MAX_URI_LENGTH - 1, "%s://%s.%s%s", protocol,
-               bucket, domain,
-               object);
-    }
+  string_builder_append_str(&uri, object);
+
+  if (query)
+  {
+    string_builder_append_char(&uri, '?');
+    string_builder_append_str(&uri, query);
+  }
+
+  if (uri.failed)
+  {
+    string_builder_free(&uri);
+    return MS3_ERR_OOM;
   }
 
-  ms3debug("URI: %s", uri_buffer);
-  curl_easy_setopt(curl, CURLOPT_URL, uri_buffer);
+  ms3debug("URI: %s", uri.data);
+  // curl keeps its own copy
+  curl_easy_setopt(curl, CURLOPT_URL, uri.data);
+  string_builder_free(&uri);
   return 0;
 }
 
 /* Handles object name to path conversion.
  * Must always start with a '/' even if object is empty.
  * Object should be urlencoded. Unfortunately curl also urlencodes slashes.
- * So this breaks up on slashes and reassembles the encoded parts.
- * Not very efficient but works until we write a custom encoder.
+ * So this breaks up on slashes and reassembles the encoded parts, empty parts
+ * are dropped.
  */
 
-static char *generate_path(CURL *curl, const char *object, char *path_buffer)
+static void generate_path(CURL *curl, const char *object,
+                          struct string_builder_st *path)
 {
-  char *tok_ptr = NULL;
-  char *save_ptr = NULL;
-  char *out_ptr = path_buffer;
-  char *path;
+  const char *part = object;
+
+  while (part && *part)
+  {
+    const char *end = strchr(part, '/');
+    size_t part_length = end ? (size_t)(end - part) : strlen(part);
+
+    if (part_length)
+    {
+      char *encoded = curl_easy_escape(curl, part, (int)part_length);
+
+      if (!encoded)
+      {
+        path->failed = true;
+        return;
+      }
 
-  // Keep scanbuild happy
-  path_buffer[0] = '\0';
+      string_builder_append_char(path, '/');
+      string_builder_append_str(path, encoded);
+      curl_free(encoded);
+    }
+
+    part = end ? end + 1 : NULL;
+  }
 
-  if (!object)
+  if (!path->length)
   {
-    sprintf(path_buffer, "/");
-    return path_buffer;
+    string_builder_append_char(path, '/');
   }
+}
 
-  path = ms3_cstrdup(object); // Because strtok_r is destructive
+// Adds name=value to a query, value is URL encoded when encode is set
+static void query_append(CURL *curl, struct string_builder_st *query,
+                         const char *name, const char *value, bool encode)
+{
+  if (query->length)
+  {
+    string_builder_append_char(query, '&');
+  }
 
-  tok_ptr = strtok_r((char *)path, "/", &save_ptr);
+  string_builder_append_str(query, name);
+  string_builder_append_char(query, '=');
 
-  while (tok_ptr != NULL)
+  if (encode)
   {
-    char *encoded = curl_easy_escape(curl, tok_ptr, (int)strlen(tok_ptr));
-    snprintf(out_ptr, 1024 - (out_ptr - path_buffer), "/%s", encoded);
-    out_ptr += strlen(encoded) + 1;
+    char *encoded = curl_easy_escape(curl, value, (int)strlen(value));
+
+    if (!encoded)
+    {
+      query->failed = true;
+      return;
+    }
+
+    string_builder_append_str(query, encoded);
     curl_free(encoded);
-    tok_ptr = strtok_r(NULL, "/", &save_ptr);
   }
-
-  if (path_buffer[0] != '/')
+  else
   {
-    sprintf(path_buffer, "/");
+    string_builder_append_str(query, value);
   }
-
-  ms3_cfree(path);
-  return path_buffer;
 }
 
-
-/* At a later date we need to make this accept multi-param/values to support
- * pagination
+/* Parameters are added in sorted order because the query is signed as it is
+ * sent.
  */
 
-static char *generate_query(CURL *curl, const char *value,
-                            const char *continuation, uint8_t list_version, bool use_delimiter,
-                            char *query_buffer)
+static void generate_query(CURL *curl, const char *value,
+                           const char *continuation, uint8_t list_version, bool use_delimiter,
+                           struct string_builder_st *query)
 {
-  char *encoded;
-  query_buffer[0] = '\0';
+  if (list_version == 2 && continuation)
+  {
+    query_append(curl, query, "continuation-token", continuation, true);
+  }
 
   if (use_delimiter)
   {
-    snprintf(query_buffer, 3072, "delimiter=%%2F");
+    query_append(curl, query, "delimiter", "%2F", false);
   }
 
   if (list_version == 2)
   {
-    if (continuation)
-    {
-      encoded = curl_easy_escape(curl, continuation, (int)strlen(continuation));
-
-      if (strlen(query_buffer))
-      {
-        snprintf(query_buffer + strlen(query_buffer), 3072 - strlen(query_buffer),
-                 "&continuation-token=%s&list-type=2", encoded);
-      }
-      else
-      {
-        snprintf(query_buffer, 3072, "continuation-token=%s&list-type=2", encoded);
-      }
-
-      curl_free(encoded);
-    }
-    else
-    {
-      if (strlen(query_buffer))
-      {
-        snprintf(query_buffer + strlen(query_buffer), 3072 - strlen(query_buffer),
-                 "&list-type=2");
-      }
-      else
-      {
-        sprintf(query_buffer, "list-type=2");
-      }
-    }
+    query_append(curl, query, "list-type", "2", false);
   }
   else if (continuation)
   {
     // Continuation is really marker here
-    encoded = curl_easy_escape(curl, continuation, (int)strlen(continuation));
-
-    if (strlen(query_buffer))
-    {
-      snprintf(query_buffer + strlen(query_buffer), 3072 - strlen(query_buffer),
-               "&marker=%s",
-               encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "marker=%s", encoded);
-    }
-
-    curl_free(encoded);
+    query_append(curl, query, "marker", continuation, true);
   }
 
   if (value)
   {
-    encoded = curl_easy_escape(curl, value, (int)strlen(value));
+    query_append(curl, query, "prefix", value, true);
+  }
+}
 
-    if (strlen(query_buffer))
-    {
-      snprintf(query_buffer + strlen(query_buffer), 3072 - strlen(query_buffer),
-               "&prefix=%s",
-               encoded);
-    }
-    else
-    {
-      snprintf(query_buffer, 3072, "prefix=%s",
-               encoded);
-    }
 
-    curl_free(encoded);
-  }
+/* Adds a piece of the canonical request to its hash. The request itself is
+ * only put together when debugging.
+ */
+static void canonical_append(struct sha256_state *state,
+                             struct string_builder_st *debug,
+                             const char *data, size_t length)
+{
+  sha256_process(state, (const unsigned char *)data, length);
 
-  return query_buffer;
+  if (debug)
+  {
+    string_builder_append(debug, data, length);
+  }
 }
 
-
 /*
 <HTTPMethod>\n
 <CanonicalURI>\n
 <CanonicalQueryString>\n
 <CanonicalHeaders>\n
-<SignedHeaders>\n - host;x-amz-content-sha256;x-amz-date
+<SignedHeaders>\n - the names of the headers, separated by ';'
 <HashedPayload> - empty if no POST data
 */
-static uint8_t generate_request_hash(uri_method_t method, const char *path,
-                                     const char *bucket,
-                                     const char *query, char *post_hash, struct curl_slist *headers, bool has_source, bool has_token,
-                                     char *return_hash)
+uint8_t generate_request_hash(uri_method_t method, const char *path,
+                              const char *bucket,
+                              const char *query, const char *post_hash,
+                              const struct signed_headers_st *headers,
+                              char *return_hash)
 {
-  char signing_data[3072];
-  size_t pos = 0;
+  struct sha256_state state;
+  struct string_builder_st debug_data;
+  struct string_builder_st *debug = NULL;
+  char debug_buffer[1024];
   uint8_t sha256hash[32]; // SHA_256 binary length
-  uint8_t hash_pos = 0;
-  uint8_t i;
-  struct curl_slist *current_header = headers;
+  const char *line;
+  size_t length;
+  size_t name_length;
+  size_t header_it;
+
+  if (ms3debug_get())
+  {
+    string_builder_init(&debug_data, debug_buffer, sizeof(debug_buffer));
+    debug = &debug_data;
+  }
+
+  sha256_init(&state);
 
   // Method first
   switch (method)
   {
     case MS3_GET:
     {
-      sprintf(signing_data, "GET\n");
-      pos += 4;
+      canonical_append(&state, debug, "GET\n", 4);
       break;
     }
 
     case MS3_HEAD:
     {
-      sprintf(signing_data, "HEAD\n");
-      pos += 5;
+      canonical_append(&state, debug, "HEAD\n", 5);
       break;
     }
 
     case MS3_PUT:
     {
-      sprintf(signing_data, "PUT\n");
-      pos += 4;
+      canonical_append(&state, debug, "PUT\n", 4);
       break;
     }
 
     case MS3_DELETE:
     {
-      sprintf(signing_data, "DELETE\n");
-      pos += 7;
+      canonical_append(&state, debug, "DELETE\n", 7);
+      break;
+    }
+
+    case MS3_POST:
+    {
+      canonical_append(&state, debug, "POST\n", 5);
       break;
     }
 
@@ -329,109 +376,91 @@ static uint8_t generate_request_hash(uri_method_t method, const char *path,
   // URL path
   if (bucket)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "/%s%s\n", bucket,
-             path);
-    pos += strlen(path) + strlen(bucket) + 2;
-  }
-  else
-  {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "%s\n", path);
-    pos += strlen(path) + 1;
+    canonical_append(&state, debug, "/", 1);
+    canonical_append(&state, debug, bucket, strlen(bucket));
   }
 
+  canonical_append(&state, debug, path, strlen(path));
+  canonical_append(&state, debug, "\n", 1);
+
   // URL query (if exists)
   if (query)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "%s\n", query);
-    pos += strlen(query) + 1;
-  }
-  else
-  {
-    sprintf(signing_data + pos, "\n");
-    pos++;
+    canonical_append(&state, debug, query, strlen(query));
   }
 
-  do
+  canonical_append(&state, debug, "\n", 1);
+
+  for (header_it = 0; header_it < headers->count; header_it++)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos, "%s\n",
-             current_header->data);
-    pos += strlen(current_header->data) + 1;
+    line = signed_headers_get(headers, header_it, &length, &name_length);
+    canonical_append(&state, debug, line, length);
+    canonical_append(&state, debug, "\n", 1);
   }
-  while ((current_header = current_header->next));
 
   // List if header names
   // The newline between headers and this is important
-  if (has_source && has_token)
-  {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos,
-             "\nhost;x-amz-content-sha256;x-amz-copy-source;x-amz-date;x-amz-security-token\n");
-    pos += 77;
-  }
-  else if (has_source)
-  {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos,
-             "\nhost;x-amz-content-sha256;x-amz-copy-source;x-amz-date\n");
-    pos += 56;
-  }
-  else if (has_token)
-  {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos,
-             "\nhost;x-amz-content-sha256;x-amz-date;x-amz-security-token\n");
-    pos += 59;
-  }
-  else
+  canonical_append(&state, debug, "\n", 1);
+
+  for (header_it = 0; header_it < headers->count; header_it++)
   {
-    snprintf(signing_data + pos, sizeof(signing_data) - pos,
-             "\nhost;x-amz-content-sha256;x-amz-date\n");
-    pos += 38;
+    line = signed_headers_get(headers, header_it, &length, &name_length);
+
+    if (header_it)
+    {
+      canonical_append(&state, debug, ";", 1);
+    }
+
+    canonical_append(&state, debug, line, name_length);
   }
 
+  canonical_append(&state, debug, "\n", 1);
+
   // Hash of post data (can be hash of empty)
-  snprintf(signing_data + pos, sizeof(signing_data) - pos, "%.*s", 64, post_hash);
-  //pos+= 64;
-  ms3debug("Signature data1: %s", signing_data);
+  canonical_append(&state, debug, post_hash, 64);
 
-  // Hash all of the above
-  sha256((uint8_t *)signing_data, strlen(signing_data), (uint8_t *)sha256hash);
+  sha256_done(&state, sha256hash);
+  hex_encode(sha256hash, 32, return_hash);
 
-  for (i = 0; i < 32; i++)
+  if (debug)
   {
-    sprintf(return_hash + hash_pos, "%.2x", sha256hash[i]);
-    hash_pos += 2;
+    ms3debug("Signature data: %s", debug->data);
+    string_builder_free(debug);
   }
 
-  ms3debug("Signature data: %s", signing_data);
   ms3debug("Signature: %.*s", 64, return_hash);
 
   return 0;
 }
 
-static uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
-                                     const char *base_domain, const char *region, const char *key,
-                                     const char *secret, const char *object, const char *query,
-                                     uri_method_t method, const char *bucket, const char *source_bucket,
-                                     const char *source_key, struct put_buffer_st *post_data,
-                                     uint8_t protocol_version, const char *session_token)
+uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
+                              const char *base_domain, const char *region, const char *key,
+                              const char *secret, const char *object, const char *query,
+                              uri_method_t method, const char *bucket, const char *source_bucket,
+                              const char *source_key, const char *copy_range, const char *post_hash, size_t content_length,
+                              uint8_t protocol_version, const char *session_token,
+                              const ms3_header_st *extra_headers, size_t extra_header_count)
 {
   uint8_t ret = 0;
   time_t now;
   struct tm tmp_tm;
-  char headerbuf[3072];
+  char header_data[MAX_URI_LENGTH];
+  struct string_builder_st header;
+  char signed_data[MAX_URI_LENGTH];
+  struct signed_headers_st signed_headers;
   char secrethead[MAX_S3_SECRET_LENGTH + S3_SECRET_EXTRA_LENGTH];
   char date[9];
+  char date_time[17];
   char sha256hash[65];
-  char post_hash[65];
-  uint8_t tmp_hash[32];
   // Alternate between these two so hmac doesn't overwrite itself
   uint8_t hmac_hash[32];
   uint8_t hmac_hash2[32];
-  uint8_t hash_pos = 0;
   const char *domain;
   struct curl_slist *headers = NULL;
-  uint8_t offset;
-  uint8_t i;
-  bool has_source = false;
-  bool has_token = false;
+  size_t header_it;
+
+  string_builder_init(&header, header_data, sizeof(header_data));
+  signed_headers_init(&signed_headers, signed_data, sizeof(signed_data));
 
   // Host header
   if (base_domain)
@@ -445,27 +474,13 @@ static uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
 
   if (protocol_version == 2)
   {
-    snprintf(headerbuf, sizeof(headerbuf), "host:%s.%s", bucket, domain);
-  }
-  else
-  {
-    snprintf(headerbuf, sizeof(headerbuf), "host:%s", domain);
-  }
-  headers = curl_slist_append(headers, headerbuf);
-  *head = headers;
-
-  // Hash post data
-  sha256(post_data->data, post_data->length, tmp_hash);
-
-  for (i = 0; i < 32; i++)
-  {
-    sprintf(post_hash + hash_pos, "%.2x", tmp_hash[i]);
-    hash_pos += 2;
+    string_builder_append_str(&header, bucket);
+    string_builder_append_char(&header, '.');
   }
 
-  snprintf(headerbuf, sizeof(headerbuf), "x-amz-content-sha256:%.*s", 64,
-           post_hash);
-  headers = curl_slist_append(headers, headerbuf);
+  string_builder_append_str(&header, domain);
+  signed_headers_add(&signed_headers, "host", header.data, header.length);
+  signed_headers_add(&signed_headers, "x-amz-content-sha256", post_hash, 64);
 
   if (source_bucket)
   {
@@ -473,132 +488,152 @@ static uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
     char *key_escape;
     bucket_escape = curl_easy_escape(curl, source_bucket, (int)strlen(source_bucket));
     key_escape = curl_easy_escape(curl, source_key, (int)strlen(source_key));
-    snprintf(headerbuf, sizeof(headerbuf), "x-amz-copy-source:/%s/%s",
-             bucket_escape, key_escape);
-    headers = curl_slist_append(headers, headerbuf);
-    ms3_cfree(bucket_escape);
-    ms3_cfree(key_escape);
+
+    if (!bucket_escape || !key_escape)
+    {
+      curl_free(bucket_escape);
+      curl_free(key_escape);
+      string_builder_free(&header);
+      signed_headers_free(&signed_headers);
+      return MS3_ERR_OOM;
+    }
+
+    string_builder_reset(&header);
+    string_builder_append_char(&header, '/');
+    string_builder_append_str(&header, bucket_escape);
+    string_builder_append_char(&header, '/');
+    string_builder_append_str(&header, key_escape);
+    signed_headers_add(&signed_headers, "x-amz-copy-source", header.data,
+                       header.length);
+    curl_free(bucket_escape);
+    curl_free(key_escape);
+
+    if (copy_range)
+    {
+      signed_headers_add(&signed_headers, "x-amz-copy-source-range",
+                         copy_range, strlen(copy_range));
+    }
   }
 
   // Date/time header
   time(&now);
-  snprintf(headerbuf, sizeof(headerbuf), "x-amz-date:");
-  offset = strlen(headerbuf);
   gmtime_r(&now, &tmp_tm);
-  strftime(headerbuf + offset, sizeof(headerbuf) - offset, "%Y%m%dT%H%M%SZ",
-           &tmp_tm);
-  headers = curl_slist_append(headers, headerbuf);
+  strftime(date, sizeof(date), "%Y%m%d", &tmp_tm);
+  strftime(date_time, sizeof(date_time), "%Y%m%dT%H%M%SZ", &tmp_tm);
+  signed_headers_add(&signed_headers, "x-amz-date", date_time, 16);
 
   // Temp Credentials Security Token
   if (session_token)
   {
-    snprintf(headerbuf, sizeof(headerbuf), "x-amz-security-token:%s",session_token);
-    headers = curl_slist_append(headers, headerbuf);
-    has_token = true;
+    signed_headers_add(&signed_headers, "x-amz-security-token", session_token,
+                       strlen(session_token));
   }
 
-  if (source_bucket)
+  // Such as metadata, storage class or checksums given by the application
+  for (header_it = 0; header_it < extra_header_count; header_it++)
+  {
+    signed_headers_add(&signed_headers, extra_headers[header_it].name,
+                       extra_headers[header_it].value,
+                       strlen(extra_headers[header_it].value));
+  }
+
+  // A header which didn't fit must not be signed
+  if (header.failed || signed_headers.failed)
   {
-    has_source = true;
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
+    return MS3_ERR_OOM;
   }
 
   // Builds the request hash
   if (protocol_version == 1)
   {
-    ret = generate_request_hash(method, object, bucket, query, post_hash, headers,
-                                has_source, has_token,
-                                sha256hash);
+    ret = generate_request_hash(method, object, bucket, query, post_hash,
+                                &signed_headers, sha256hash);
   }
   else
   {
-    ret = generate_request_hash(method, object, NULL, query, post_hash, headers,
-                                has_source, has_token,
-                                sha256hash);
+    ret = generate_request_hash(method, object, NULL, query, post_hash,
+                                &signed_headers, sha256hash);
   }
 
   if (ret)
   {
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
     return ret;
   }
 
   // User signing key hash
   // Date hashed using AWS4:secret_key
   snprintf(secrethead, sizeof(secrethead), "AWS4%.*s", MAX_S3_SECRET_LENGTH, secret);
-  strftime(headerbuf, sizeof(headerbuf), "%Y%m%d", &tmp_tm);
-  hmac_sha256((uint8_t *)secrethead, strlen(secrethead), (uint8_t *)headerbuf,
-              strlen(headerbuf), hmac_hash);
+  hmac_sha256((uint8_t *)secrethead, strlen(secrethead), (uint8_t *)date, 8,
+              hmac_hash);
 
   // Region signed by above key
   hmac_sha256(hmac_hash, 32, (uint8_t *)region, strlen(region),
               hmac_hash2);
 
   // Service signed by above key (s3 always)
-  sprintf(headerbuf, "s3");
-  hmac_sha256(hmac_hash2, 32, (uint8_t *)headerbuf, strlen(headerbuf),
-              hmac_hash);
+  hmac_sha256(hmac_hash2, 32, (const uint8_t *)"s3", 2, hmac_hash);
 
   // Request version signed by above key (always "aws4_request")
-  sprintf(headerbuf, "aws4_request");
-  hmac_sha256(hmac_hash, 32, (uint8_t *)headerbuf, strlen(headerbuf),
+  hmac_sha256(hmac_hash, 32, (const uint8_t *)"aws4_request", 12,
               hmac_hash2);
 
   // Sign everything with the key
-  snprintf(headerbuf, sizeof(headerbuf), "AWS4-HMAC-SHA256\n");
-  offset = strlen(headerbuf);
-  strftime(headerbuf + offset, sizeof(headerbuf) - offset, "%Y%m%dT%H%M%SZ\n",
-           &tmp_tm);
-  offset = strlen(headerbuf);
-  strftime(date, 9, "%Y%m%d", &tmp_tm);
-  snprintf(headerbuf + offset, sizeof(headerbuf) - offset,
-           "%.*s/%s/s3/aws4_request\n%.*s", 8, date, region, 64, sha256hash);
-  ms3debug("Data to sign: %s", headerbuf);
-  hmac_sha256(hmac_hash2, 32, (uint8_t *)headerbuf, strlen(headerbuf),
+  string_builder_reset(&header);
+  string_builder_append(&header, "AWS4-HMAC-SHA256\n", 17);
+  string_builder_append(&header, date_time, 16);
+  string_builder_append_char(&header, '\n');
+  string_builder_append(&header, date, 8);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, region);
+  string_builder_append(&header, "/s3/aws4_request\n", 17);
+  string_builder_append(&header, sha256hash, 64);
+  ms3debug("Data to sign: %s", header.data);
+  hmac_sha256(hmac_hash2, 32, (uint8_t *)header.data, header.length,
               hmac_hash);
 
-  hash_pos = 0;
-
-  for (i = 0; i < 32; i++)
-  {
-    sprintf(sha256hash + hash_pos, "%.2x", hmac_hash[i]);
-    hash_pos += 2;
-  }
+  hex_encode(hmac_hash, 32, sha256hash);
 
   // Make auth header
-  if (source_bucket && session_token)
-  {
-    snprintf(headerbuf, sizeof(headerbuf),
-             "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s/%s/s3/aws4_request, SignedHeaders=host;x-amz-content-sha256;x-amz-copy-source;x-amz-date;x-amz-security-token;x-amz-copy-source, Signature=%s",
-             key, date, region, sha256hash);
-  }
-  else if (source_bucket)
-  {
-    snprintf(headerbuf, sizeof(headerbuf),
-             "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s/%s/s3/aws4_request, SignedHeaders=host;x-amz-content-sha256;x-amz-copy-source;x-amz-date, Signature=%s",
-             key, date, region, sha256hash);
-  }
-  else if (session_token)
-  {
-    snprintf(headerbuf, sizeof(headerbuf),
-             "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s/%s/s3/aws4_request, SignedHeaders=host;x-amz-content-sha256;x-amz-date;x-amz-security-token, Signature=%s",
-             key, date, region, sha256hash);
-  }
-  else
-  {
-    snprintf(headerbuf, sizeof(headerbuf),
-             "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s/%s/s3/aws4_request, SignedHeaders=host;x-amz-content-sha256;x-amz-date, Signature=%s",
-             key, date, region, sha256hash);
-  }
-
-  headers = curl_slist_append(headers, headerbuf);
+  string_builder_reset(&header);
+  string_builder_append_str(&header,
+                            "Authorization: AWS4-HMAC-SHA256 Credential=");
+  string_builder_append_str(&header, key);
+  string_builder_append_char(&header, '/');
+  string_builder_append(&header, date, 8);
+  string_builder_append_char(&header, '/');
+  string_builder_append_str(&header, region);
+  string_builder_append(&header, "/s3/aws4_request, SignedHeaders=", 32);
+  signed_headers_names(&signed_headers, &header);
+  string_builder_append(&header, ", Signature=", 12);
+  string_builder_append(&header, sha256hash, 64);
+
+  if (header.failed)
+  {
+    string_builder_free(&header);
+    signed_headers_free(&signed_headers);
+    return MS3_ERR_OOM;
+  }
+
+  headers = signed_headers_emit(&signed_headers, NULL);
+  *head = headers;
+  headers = curl_slist_append(headers, header.data);
+  string_builder_free(&header);
+  signed_headers_free(&signed_headers);
 
   // Disable this header or PUT will barf with a 501
-  sprintf(headerbuf, "Transfer-Encoding:");
-  headers = curl_slist_append(headers, headerbuf);
+  headers = curl_slist_append(headers, "Transfer-Encoding:");
 
   if ((method == MS3_PUT) && !source_bucket)
   {
-    snprintf(headerbuf, sizeof(headerbuf), "Content-Length:%zu", post_data->length);
-    headers = curl_slist_append(headers, headerbuf);
+    char content_length_header[48];
+
+    snprintf(content_length_header, sizeof(content_length_header),
+             "Content-Length:%zu", content_length);
+    headers = curl_slist_append(headers, content_length_header);
   }
 
   if (ms3debug_get())
@@ -638,6 +673,12 @@ static uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
       break;
     }
 
+    case MS3_POST:
+    {
+      // The body given with CURLOPT_POSTFIELDS makes this a POST
+      break;
+    }
+
     default:
       ms3debug("Bad method detected");
       return MS3_ERR_IMPOSSIBLE;
@@ -645,182 +686,700 @@ static uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
 
   return 0;
 }
-static size_t head_header_callback(char *buffer, size_t size,
-                                   size_t nitems, void *userdata)
+/* Copies the trimmed value of a header line that starts with the name and
+ * colon, which are name_length bytes. Values that don't fit are skipped.
+ */
+static void copy_header_value(const char *buffer, size_t realsize,
+                              size_t name_length, char *out, size_t out_size)
 {
-  ms3debug("%.*s\n", (int)(nitems * size), buffer);
+  const char *start = buffer + name_length;
+  size_t length = realsize - name_length;
 
-  if (userdata)
+  while (length && isspace((unsigned char)*start))
   {
-    // HEAD request
-    if (!strncasecmp(buffer, "Last-Modified", 13))
-    {
-      ms3_status_st *status = (ms3_status_st *) userdata;
-      // Date/time, format: Fri, 15 Mar 2019 16:58:54 GMT
-      struct tm ttmp = {0};
-      strptime(buffer + 15, "%a, %d %b %Y %H:%M:%S %Z", &ttmp);
-      status->created = mktime(&ttmp);
-    }
-    else if (!strncasecmp(buffer, "Content-Length", 14))
-    {
-      ms3_status_st *status = (ms3_status_st *) userdata;
-      // Length
-      status->length = strtoull(buffer + 16, NULL, 10);
-    }
+    start++;
+    length--;
   }
 
-  return nitems * size;
-}
-
-static size_t get_header_callback(char *buffer, size_t size,
-                                  size_t nitems, void *userdata)
-{
-  ms3debug("%.*s\n", (int)(nitems * size), buffer);
-
-  if (userdata)
+  while (length && isspace((unsigned char)start[length - 1]))
   {
-    if (!strncasecmp(buffer, "Content-Type", 12))
-    {
-      size_t i;
-      ms3_st *ms3 = (ms3_st *) userdata;
-      snprintf(ms3->content_type_in, 127, "%s", (char*)buffer + 14);
-      for (i = 0; i < strlen(ms3->content_type_in); i++)
-      {
-        if (isspace( (unsigned char) ms3->content_type_in[i] ))
-          break;
-      }
-      ms3->content_type_in[i] = '\0';
-    }
+    length--;
   }
 
-  return nitems * size;
+  if (length < out_size)
+  {
+    memcpy(out, start, length);
+    out[length] = '\0';
+  }
 }
 
-static size_t body_callback(void *buffer, size_t size,
-                            size_t nitems, void *userdata)
+/* Grows a response buffer so it can hold at least size bytes. Used up front
+ * when the server tells us the Content-Length so that the body is received
+ * into a single allocation.
+ */
+bool memory_buffer_reserve(struct memory_buffer_st *mem, size_t size)
 {
   uint8_t *ptr;
-  size_t realsize = nitems * size;
 
-  struct memory_buffer_st *mem = (struct memory_buffer_st *)userdata;
+  if (size <= mem->alloced)
+  {
+    return true;
+  }
 
-  if (realsize + mem->length >= mem->alloced)
+  if (mem->pool)
   {
-    size_t additional_size = mem->buffer_chunk_size;
+    size_t alloced;
 
-    if (realsize >= mem->buffer_chunk_size)
+    ptr = buffer_pool_get(mem->pool, size, &alloced);
+
+    if (!ptr)
     {
-      additional_size = (ceil((double)realsize / (double)mem->buffer_chunk_size) + 1)
-                        * mem->buffer_chunk_size;
+      return false;
     }
 
-    ptr = (uint8_t *)ms3_crealloc(mem->data, mem->alloced + additional_size);
-
-    if (!ptr)
+    if (mem->length)
     {
-      ms3debug("Curl response OOM");
-      return 0;
+      memcpy(ptr, mem->data, mem->length);
     }
 
-    mem->alloced += additional_size;
+    buffer_pool_put(mem->pool, mem->data, mem->alloced);
     mem->data = ptr;
+    mem->alloced = alloced;
+    return true;
   }
 
-  memcpy(&(mem->data[mem->length]), buffer, realsize);
-  mem->length += realsize;
-  mem->data[mem->length] = '\0';
+  ptr = (uint8_t *)ms3_crealloc(mem->data, size);
 
-  ms3debug("Read %zu bytes, buffer %zu bytes", realsize, mem->length);
-//  ms3debug("Data: %s", (char*)buffer);
-  return nitems * size;
+  if (!ptr)
+  {
+    return false;
+  }
+
+  mem->data = ptr;
+  mem->alloced = size;
+  return true;
 }
 
-uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
-                        const char *object, const char *source_bucket, const char *source_object,
-                        const char *filter, const uint8_t *data, size_t data_size,
-                        char *continuation,
-                        void *ret_ptr)
+bool memory_buffer_reserve_body(struct memory_buffer_st *mem, size_t length)
 {
-  CURL *curl = NULL;
-  struct curl_slist *headers = NULL;
-  uint8_t res = 0;
-  struct memory_buffer_st mem;
-  uri_method_t method;
-  char *path = NULL;
-  char *query = NULL;
-  struct put_buffer_st post_data;
-  CURLcode curl_res;
-  long response_code = 0;
-
-  mem.data = NULL;
-  mem.length = 0;
-  mem.alloced = 1;
-  mem.buffer_chunk_size = ms3->buffer_chunk_size;
-
-  post_data.data = (uint8_t *) data;
-  post_data.length = data_size;
-  post_data.offset = 0;
-
-  curl = ms3->curl;
+  return memory_buffer_reserve(mem, mem->terminate ? length + 1 : length);
+}
 
-  if (!ms3->first_run)
+void memory_buffer_terminate(struct memory_buffer_st *mem)
+{
+  if (mem->terminate)
   {
-    curl_easy_reset(curl);
+    mem->data[mem->length] = '\0';
   }
-  else
+}
+
+/* Frees a response buffer, unless it belongs to the caller in which case it is
+ * handed back empty so it can be reused.
+ */
+static void memory_buffer_release(struct memory_buffer_st *mem,
+                                  struct memory_buffer_st *owner)
+{
+  if (!owner)
   {
-    ms3->first_run = false;
+    ms3_cfree(mem->data);
+    return;
   }
 
-  path = generate_path(curl, object, ms3->path_buffer);
+  owner->data = mem->data;
+  owner->length = 0;
+  owner->alloced = mem->alloced;
+}
 
-  if (cmd == MS3_CMD_LIST_RECURSIVE)
-  {
-    query = generate_query(curl, filter, continuation, ms3->list_version, false,
-                           ms3->query_buffer);
-  }
-  else if (cmd == MS3_CMD_LIST)
-  {
-    query = generate_query(curl, filter, continuation, ms3->list_version, true,
-                           ms3->query_buffer);
-  }
+// Clears a response for reuse, keeping the allocation for x-amz-* headers
+static void response_reset(struct response_st *response)
+{
+  char *amz_headers = response->amz_headers;
+  size_t amz_alloced = response->amz_alloced;
 
-  res = build_request_uri(curl, ms3->base_domain, bucket, path, query,
-                          ms3->use_http, ms3->protocol_version);
+  memset(response, 0, sizeof(struct response_st));
+  response->amz_headers = amz_headers;
+  response->amz_alloced = amz_alloced;
+}
 
-  if (res)
+// Value of a "Name: value" header line if it has the given name, else NULL
+static const char *header_value(const char *buffer, size_t realsize,
+                                const char *name, size_t name_length)
+{
+  if (realsize <= name_length || buffer[name_length] != ':' ||
+      strncasecmp(buffer, name, name_length))
   {
-    return res;
+    return NULL;
   }
 
-  switch (cmd)
+  return buffer + name_length + 1;
+}
+
+static void response_add_amz_header(struct response_st *response,
+                                    const char *buffer, size_t realsize)
+{
+  const char *colon = memchr(buffer, ':', realsize);
+  size_t name_length;
+  size_t value_length;
+  const char *value;
+  size_t needed;
+
+  if (!colon)
+  {
+    return;
+  }
+
+  name_length = (size_t)(colon - buffer);
+  value = colon + 1;
+  value_length = realsize - name_length - 1;
+
+  while (value_length && isspace((unsigned char)*value))
+  {
+    value++;
+    value_length--;
+  }
+
+  while (value_length && isspace((unsigned char)value[value_length - 1]))
+  {
+    value_length--;
+  }
+
+  needed = response->amz_length + name_length + value_length + 2;
+
+  if (needed > response->amz_alloced)
+  {
+    size_t new_alloced = response->amz_alloced ? response->amz_alloced * 2 : 256;
+    char *headers;
+
+    while (new_alloced < needed)
+    {
+      new_alloced *= 2;
+    }
+
+    headers = ms3_crealloc(response->amz_headers, new_alloced);
+
+    // Only the metadata is lost, the request itself is fine
+    if (!headers)
+    {
+      return;
+    }
+
+    response->amz_headers = headers;
+    response->amz_alloced = new_alloced;
+  }
+
+  // Stored as "name\0value\0" pairs
+  memcpy(response->amz_headers + response->amz_length, buffer, name_length);
+  response->amz_length += name_length;
+  response->amz_headers[response->amz_length++] = '\0';
+  memcpy(response->amz_headers + response->amz_length, value, value_length);
+  response->amz_length += value_length;
+  response->amz_headers[response->amz_length++] = '\0';
+  response->amz_count++;
+}
+
+/* Every header line of every request goes through here once. The common
+ * headers are kept in the request's response, then anything the command
+ * needs before the body arrives is done.
+ */
+static size_t header_callback(char *buffer, size_t size,
+                              size_t nitems, void *userdata)
+{
+  size_t realsize = nitems * size;
+  struct request_st *req = (struct request_st *) userdata;
+  struct response_st *response = &req->response;
+  const char *value;
+
+  if (realsize > 5 && !strncmp(buffer, "HTTP/", 5))
+  {
+    // Status line, there is one per response when redirects are followed or
+    // after a 100 Continue, only the last response is kept
+    const char *code = memchr(buffer, ' ', realsize);
+    size_t length = realsize;
+
+    while (length && (buffer[length - 1] == '\r' || buffer[length - 1] == '\n'))
+    {
+      length--;
+    }
+
+    ms3debug("Status: %.*s", (int)length, buffer);
+
+    response_reset(response);
+    response->status = code ? strtol(code + 1, NULL, 10) : 0;
+
+    if (req->get_file)
+    {
+      req->get_file->status = response->status;
+    }
+  }
+  else if (header_value(buffer, realsize, "ETag", 4))
+  {
+    copy_header_value(buffer, realsize, 5, response->etag,
+                      sizeof(response->etag));
+  }
+  else if (header_value(buffer, realsize, "Content-Type", 12))
+  {
+    copy_header_value(buffer, realsize, 13, response->content_type,
+                      sizeof(response->content_type));
+  }
+  else if (header_value(buffer, realsize, "Content-Range", 13))
+  {
+    copy_header_value(buffer, realsize, 14, response->content_range,
+                      sizeof(response->content_range));
+  }
+  else if ((value = header_value(buffer, realsize, "Last-Modified", 13)))
+  {
+    // Date/time, format: Fri, 15 Mar 2019 16:58:54 GMT
+    struct tm ttmp = {0};
+
+    while (isspace((unsigned char)*value))
+    {
+      value++;
+    }
+
+    strptime(value, "%a, %d %b %Y %H:%M:%S %Z", &ttmp);
+    response->last_modified = timegm(&ttmp);
+  }
+  else if ((value = header_value(buffer, realsize, "Content-Length", 14)))
+  {
+    response->content_length = strtoull(value, NULL, 10);
+
+    if (req->get_buffer)
+    {
+      // Allocate the whole body in one go
+      if (!memory_buffer_reserve_body(&req->mem,
+                                      (size_t)response->content_length))
+      {
+        ms3debug("Curl response OOM");
+        return 0;
+      }
+    }
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    else if (req->get_file)
+    {
+      struct file_buffer_st *file = req->get_file;
+
+      // Reserve the blocks up front so the file is not fragmented. This is
+      // only a hint, the size isn't changed and failure doesn't matter.
+      if (file->status >= 200 && file->status < 300 && file->base >= 0 &&
+          response->content_length)
+      {
+        (void) fallocate(file->fd, FALLOC_FL_KEEP_SIZE, file->base,
+                         (off_t) response->content_length);
+      }
+    }
+#endif
+  }
+  else if (realsize > 6 && !strncasecmp(buffer, "x-amz-", 6))
+  {
+    if (header_value(buffer, realsize, "x-amz-request-id", 16))
+    {
+      copy_header_value(buffer, realsize, 17, response->request_id,
+                        sizeof(response->request_id));
+    }
+
+    response_add_amz_header(response, buffer, realsize);
+  }
+
+  return realsize;
+}
+
+static size_t body_callback(void *buffer, size_t size,
+                            size_t nitems, void *userdata)
+{
+  size_t realsize = nitems * size;
+
+  struct memory_buffer_st *mem = (struct memory_buffer_st *)userdata;
+
+  if (realsize + mem->length + (mem->terminate ? 1 : 0) > mem->alloced)
+  {
+    // Length unknown (or wrong), grow geometrically to keep copies linear
+    size_t new_size = mem->alloced * 2;
+
+    if (new_size < mem->buffer_chunk_size)
+    {
+      new_size = mem->buffer_chunk_size;
+    }
+
+    if (new_size <= realsize + mem->length)
+    {
+      new_size = realsize + mem->length + 1;
+    }
+
+    if (!memory_buffer_reserve(mem, new_size))
+    {
+      ms3debug("Curl response OOM");
+      return 0;
+    }
+  }
+
+  memcpy(&(mem->data[mem->length]), buffer, realsize);
+  mem->length += realsize;
+  memory_buffer_terminate(mem);
+
+  ms3debug("Read %zu bytes, buffer %zu bytes", realsize, mem->length);
+//  ms3debug("Data: %s", (char*)buffer);
+  return nitems * size;
+}
+
+/* Writes the body straight to the file at the right offset so that only the
+ * current chunk from curl is ever held in memory.
+ */
+static size_t file_body_callback(void *buffer, size_t size,
+                                 size_t nitems, void *userdata)
+{
+  size_t realsize = nitems * size;
+  size_t remaining = realsize;
+  const uint8_t *ptr = (const uint8_t *)buffer;
+  struct file_buffer_st *file = (struct file_buffer_st *)userdata;
+
+  // Error responses are kept in memory for the error message
+  if (file->status < 200 || file->status >= 300)
+  {
+    return body_callback(buffer, size, nitems, &file->error);
+  }
+
+  while (remaining)
+  {
+    ssize_t written;
+
+    if (file->base >= 0)
+    {
+      written = pwrite(file->fd, ptr, remaining,
+                       file->base + (off_t)file->length);
+    }
+    else
+    {
+      written = write(file->fd, ptr, remaining);
+    }
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      file->write_errno = errno;
+      ms3debug("File write error: %s", strerror(errno));
+      return 0;
+    }
+
+    ptr += written;
+    remaining -= (size_t)written;
+    file->length += (size_t)written;
+  }
+
+  return realsize;
+}
+
+static size_t upload_read_callback(char *buffer, size_t size, size_t nitems,
+                                   void *userdata)
+{
+  struct upload_source_st *upload = (struct upload_source_st *)userdata;
+  size_t wanted = size * nitems;
+  ssize_t got;
+
+  if (wanted > upload->length - upload->position)
+  {
+    wanted = upload->length - upload->position;
+  }
+
+  if (!wanted)
+  {
+    return 0;
+  }
+
+  do
+  {
+    got = pread(upload->fd, buffer, wanted,
+                upload->offset + (off_t)upload->position);
+  }
+  while (got < 0 && errno == EINTR);
+
+  if (got <= 0)
+  {
+    // A short file is an error too, the length has already been sent
+    upload->read_errno = got ? errno : EIO;
+    ms3debug("File read error: %s", strerror(upload->read_errno));
+    return CURL_READFUNC_ABORT;
+  }
+
+  upload->position += (size_t)got;
+  return (size_t)got;
+}
+
+// Curl rewinds the body if it has to send it again
+static int upload_seek_callback(void *userdata, curl_off_t offset, int origin)
+{
+  struct upload_source_st *upload = (struct upload_source_st *)userdata;
+
+  if (origin != SEEK_SET || offset < 0 || (size_t)offset > upload->length)
+  {
+    return CURL_SEEKFUNC_CANTSEEK;
+  }
+
+  upload->position = (size_t)offset;
+  return CURL_SEEKFUNC_OK;
+}
+
+static void base64_encode(const uint8_t *data, size_t length, char *out)
+{
+  static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t pos;
+
+  for (pos = 0; pos + 2 < length; pos += 3)
+  {
+    *out++ = alphabet[data[pos] >> 2];
+    *out++ = alphabet[((data[pos] & 0x03) << 4) | (data[pos + 1] >> 4)];
+    *out++ = alphabet[((data[pos + 1] & 0x0f) << 2) | (data[pos + 2] >> 6)];
+    *out++ = alphabet[data[pos + 2] & 0x3f];
+  }
+
+  if (pos < length)
+  {
+    *out++ = alphabet[data[pos] >> 2];
+
+    if (pos + 1 < length)
+    {
+      *out++ = alphabet[((data[pos] & 0x03) << 4) | (data[pos + 1] >> 4)];
+      *out++ = alphabet[(data[pos + 1] & 0x0f) << 2];
+    }
+    else
+    {
+      *out++ = alphabet[(data[pos] & 0x03) << 4];
+      *out++ = '=';
+    }
+
+    *out++ = '=';
+  }
+
+  *out = '\0';
+}
+
+/* The SHA-256 of the body goes into the signature so the whole body has to be
+ * read before the request can be sent. File bodies are read in windows.
+ */
+uint8_t payload_hash_file(const struct upload_source_st *upload,
+                          size_t window_size, char *post_hash)
+{
+  uint8_t hash[32];
+  struct sha256_state state;
+  size_t done = 0;
+  uint8_t *window;
+
+  if (window_size > upload->length)
+  {
+    window_size = upload->length ? upload->length : 1;
+  }
+
+  window = ms3_cmalloc(window_size);
+
+  if (!window)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  sha256_init(&state);
+
+  while (done < upload->length)
+  {
+    size_t wanted = upload->length - done;
+    ssize_t got;
+
+    if (wanted > window_size)
+    {
+      wanted = window_size;
+    }
+
+    got = pread(upload->fd, window, wanted, upload->offset + (off_t)done);
+
+    if (got < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (got <= 0)
+    {
+      ms3debug("File read error: %s", got ? strerror(errno) : "short file");
+      ms3_cfree(window);
+      return MS3_ERR_FILE;
+    }
+
+    sha256_process(&state, window, (unsigned long)got);
+    done += (size_t)got;
+  }
+
+  sha256_done(&state, hash);
+  ms3_cfree(window);
+  hex_encode(hash, 32, post_hash);
+
+  return 0;
+}
+
+void payload_hash_data(const uint8_t *data, size_t length, char *post_hash)
+{
+  uint8_t hash[32];
+
+  sha256(data, length, hash);
+  hex_encode(hash, 32, post_hash);
+}
+
+static uint8_t hash_payload(ms3_st *ms3, struct request_st *req,
+                            char *post_hash)
+{
+  if (req->payload_hash)
+  {
+    snprintf(post_hash, 65, "%.*s", 64, req->payload_hash);
+    return 0;
+  }
+
+  if (req->upload)
+  {
+    return payload_hash_file(req->upload, ms3->buffer_chunk_size, post_hash);
+  }
+
+  payload_hash_data(req->data, req->data_size, post_hash);
+
+  return 0;
+}
+
+// RFC 7231 date, without strftime() so the locale can't change the names
+static void format_http_date(time_t when, char *out, size_t length)
+{
+  static const char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+                                };
+  struct tm tm_when;
+
+  gmtime_r(&when, &tm_when);
+  snprintf(out, length, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+           days[tm_when.tm_wday], tm_when.tm_mday, months[tm_when.tm_mon],
+           tm_when.tm_year + 1900, tm_when.tm_hour, tm_when.tm_min,
+           tm_when.tm_sec);
+}
+
+void request_init(struct request_st *request, command_t command,
+                  const char *bucket, const char *object)
+{
+  memset(request, 0, sizeof(struct request_st));
+  request->cmd = command;
+  request->bucket = bucket;
+  request->object = object;
+}
+
+/* Builds everything for a request on the given curl handle, ready to be
+ * performed
+ */
+static uint8_t request_setup(ms3_st *ms3, struct ms3_context_st *ctx,
+                              struct request_st *req, CURL *curl)
+{
+  uint8_t res = 0;
+  uri_method_t method;
+  char path_data[MAX_URI_LENGTH];
+  char query_data[MAX_URI_LENGTH];
+  struct string_builder_st path;
+  struct string_builder_st list_query;
+  const char *query = req->query;
+  const ms3_header_st *extra_headers = NULL;
+  size_t extra_header_count = 0;
+  struct credentials_st *credentials;
+  char post_hash[65];
+  struct memory_buffer_st *mem = &req->mem;
+
+  req->curl = curl;
+  req->headers = NULL;
+  memset(&req->error, 0, sizeof(struct request_error_st));
+  req->get_buffer = NULL;
+  req->get_file = NULL;
+  mem->data = NULL;
+  mem->length = 0;
+  mem->alloced = 0;
+  mem->buffer_chunk_size = ms3->buffer_chunk_size;
+  mem->pool = NULL;
+  mem->terminate = true;
+
+  curl_easy_setopt(curl, CURLOPT_SHARE, ms3->curl_share);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, req);
+
+  switch (req->cmd)
   {
     case MS3_CMD_COPY:
     case MS3_CMD_PUT:
+    case MS3_CMD_UPLOAD_PART:
+    case MS3_CMD_UPLOAD_PART_COPY:
       method = MS3_PUT;
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, (char *)data);
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data_size);
+
+      if (req->upload)
+      {
+        req->upload->position = 0;
+        req->upload->read_errno = 0;
+        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, upload_read_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, req->upload);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, upload_seek_callback);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, req->upload);
+        curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE,
+                         (curl_off_t)req->upload->length);
+      }
+      else
+      {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, (char *)req->data);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                         (curl_off_t)req->data_size);
+      }
+
+      break;
+
+    case MS3_CMD_CREATE_MULTIPART:
+    case MS3_CMD_COMPLETE_MULTIPART:
+    case MS3_CMD_DELETE_MANY:
+      method = MS3_POST;
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS,
+                       req->data ? (char *)req->data : "");
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                       (curl_off_t)req->data_size);
       break;
 
     case MS3_CMD_DELETE:
+    case MS3_CMD_ABORT_MULTIPART:
       method = MS3_DELETE;
       break;
 
     case MS3_CMD_HEAD:
       method = MS3_HEAD;
-      curl_easy_setopt(curl, CURLOPT_HEADERDATA, ret_ptr);
-      curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, head_header_callback);
       break;
 
     case MS3_CMD_GET:
-      ms3->content_type_in[0] = '\0';
-      curl_easy_setopt(curl, CURLOPT_HEADERDATA, ms3);
-      curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, get_header_callback);
+      ctx->content_type_in[0] = '\0';
+      ctx->etag_in[0] = '\0';
+
+      // Receive into the caller's buffer if it already has one, without a
+      // buffer the read callback streams the body
+      if (req->ret_ptr)
+      {
+        req->get_buffer = (struct memory_buffer_st *) req->ret_ptr;
+        mem->data = req->get_buffer->data;
+        mem->alloced = req->get_buffer->alloced;
+        mem->pool = req->get_buffer->pool;
+        mem->terminate = req->get_buffer->terminate;
+      }
+
+      method = MS3_GET;
+      break;
+
+    case MS3_CMD_GET_FILE:
+      ctx->content_type_in[0] = '\0';
+      ctx->etag_in[0] = '\0';
+      req->get_file = (struct file_buffer_st *) req->ret_ptr;
       method = MS3_GET;
       break;
 
     case MS3_CMD_LIST:
     case MS3_CMD_LIST_RECURSIVE:
+    case MS3_CMD_LIST_PAGE:
     case MS3_CMD_LIST_ROLE:
       method = MS3_GET;
       break;
@@ -828,145 +1387,350 @@ uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
     case MS3_CMD_ASSUME_ROLE:
     default:
       ms3debug("Bad cmd detected");
-      ms3_cfree(mem.data);
 
       return MS3_ERR_IMPOSSIBLE;
   }
 
-  if (ms3->iam_role)
+  res = hash_payload(ms3, req, post_hash);
+
+  if (res)
+  {
+    memory_buffer_release(mem, req->get_buffer);
+    return res;
+  }
+
+  // The application's headers go with the requests which create objects
+  if (req->extra_headers)
+  {
+    extra_headers = req->extra_headers;
+    extra_header_count = req->extra_header_count;
+  }
+  else if (req->cmd == MS3_CMD_PUT || req->cmd == MS3_CMD_COPY ||
+           req->cmd == MS3_CMD_CREATE_MULTIPART)
+  {
+    extra_headers = ms3->headers_out;
+    extra_header_count = ms3->header_out_count;
+  }
+
+  // Only needed until the request is signed
+  string_builder_init(&path, path_data, sizeof(path_data));
+  string_builder_init(&list_query, query_data, sizeof(query_data));
+  generate_path(curl, req->object, &path);
+
+  if (req->cmd == MS3_CMD_LIST_RECURSIVE || req->cmd == MS3_CMD_LIST_PAGE)
+  {
+    generate_query(curl, req->filter, req->continuation, ms3->list_version,
+                   false, &list_query);
+    query = list_query.length ? list_query.data : NULL;
+  }
+  else if (req->cmd == MS3_CMD_LIST)
+  {
+    generate_query(curl, req->filter, req->continuation, ms3->list_version,
+                   true, &list_query);
+    query = list_query.length ? list_query.data : NULL;
+  }
+
+  if (path.failed || list_query.failed)
   {
-      ms3debug("Using assumed role: %s",ms3->iam_role);
-      res = build_request_headers(curl, &headers, ms3->base_domain, ms3->region,
-                                  ms3->role_key, ms3->role_secret, path, query, method, bucket, source_bucket,
-                                  source_object, &post_data, ms3->protocol_version, ms3->role_session_token);
+    res = MS3_ERR_OOM;
   }
   else
   {
-      res = build_request_headers(curl, &headers, ms3->base_domain, ms3->region,
-                                  ms3->s3key, ms3->s3secret, path, query, method, bucket, source_bucket,
-                                  source_object, &post_data, ms3->protocol_version, NULL);
+    res = build_request_uri(curl, ms3->base_domain, req->bucket, path.data,
+                            query, ms3->use_http, ms3->protocol_version);
   }
+
   if (res)
   {
-    ms3_cfree(mem.data);
-    curl_slist_free_all(headers);
+    string_builder_free(&path);
+    string_builder_free(&list_query);
+    memory_buffer_release(mem, req->get_buffer);
+    return res;
+  }
+
+  // Signed without holding the lock, a refresh can't free these underneath us
+  credentials = credentials_get(ms3);
+
+  if (credentials)
+  {
+      ms3debug("Using temporary credentials, role: %s",
+               ms3->iam_role ? ms3->iam_role : "none");
+      res = build_request_headers(curl, &req->headers, ms3->base_domain, ms3->region,
+                                  credentials->key, credentials->secret, path.data, query, method, req->bucket,
+                                  req->source_bucket, req->source_object, req->copy_range, post_hash,
+                                  req->upload ? req->upload->length : req->data_size,
+                                  ms3->protocol_version, credentials->token,
+                                  extra_headers, extra_header_count);
+  }
+  else
+  {
+      res = build_request_headers(curl, &req->headers, ms3->base_domain, ms3->region,
+                                  ms3->s3key, ms3->s3secret, path.data, query, method, req->bucket,
+                                  req->source_bucket, req->source_object, req->copy_range, post_hash,
+                                  req->upload ? req->upload->length : req->data_size,
+                                  ms3->protocol_version, NULL,
+                                  extra_headers, extra_header_count);
+  }
+
+  credentials_release(ms3, credentials);
+  string_builder_free(&path);
+  string_builder_free(&list_query);
+
+  if (res)
+  {
+    memory_buffer_release(mem, req->get_buffer);
+    curl_slist_free_all(req->headers);
+    req->headers = NULL;
 
     return res;
   }
 
-  if ((method == MS3_PUT) && ms3->content_type_out)
+  // A multipart upload takes its type when it is created
+  if ((method == MS3_PUT || req->cmd == MS3_CMD_CREATE_MULTIPART) &&
+      (req->content_type || ms3->content_type_out))
   {
     // Mime type maxmum is 128 bytes
     char content_type[196];
-    snprintf(content_type, 195, "Content-Type: %s", ms3->content_type_out);
-    headers = curl_slist_append(headers, content_type);
+    snprintf(content_type, 195, "Content-Type: %s",
+             req->content_type ? req->content_type : ms3->content_type_out);
+    req->headers = curl_slist_append(req->headers, content_type);
   }
   else if (ms3->no_content_type)
   {
-    headers = curl_slist_append(headers, "Content-Type:");
+    req->headers = curl_slist_append(req->headers, "Content-Type:");
   }
 
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  // Conditions don't need to be signed
+  if (req->if_none_match)
+  {
+    char if_none_match[MAX_ETAG_LENGTH + 16];
+
+    snprintf(if_none_match, sizeof(if_none_match), "If-None-Match: %s",
+             req->if_none_match);
+    req->headers = curl_slist_append(req->headers, if_none_match);
+  }
+
+  if (req->if_modified_since)
+  {
+    char if_modified_since[64];
+
+    snprintf(if_modified_since, sizeof(if_modified_since),
+             "If-Modified-Since: ");
+    format_http_date(req->if_modified_since, if_modified_since + 19,
+                     sizeof(if_modified_since) - 19);
+    req->headers = curl_slist_append(req->headers, if_modified_since);
+  }
+
+  if (req->cmd == MS3_CMD_DELETE_MANY)
+  {
+    // DeleteObjects is refused without it, it isn't part of the signature
+    uint8_t digest[MD5_MAC_LEN];
+    char content_md5[48];
+
+    md5(req->data, req->data_size, digest);
+    snprintf(content_md5, sizeof(content_md5), "Content-MD5: ");
+    base64_encode(digest, MD5_MAC_LEN, content_md5 + 13);
+    req->headers = curl_slist_append(req->headers, content_md5);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->headers);
+
+  if (ms3->disable_verification)
+  {
+    ms3debug("Disabling SSL verification");
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+  }
+
+  if (ms3->port)
+    curl_easy_setopt(curl, CURLOPT_PORT, (long)ms3->port);
+
+  if (ms3->connect_timeout_ms != 0)
+  {
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, ms3->connect_timeout_ms);
+  }
+
+  if (ms3->timeout_ms != 0)
+  {
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, ms3->timeout_ms);
+  }
+
+  if (!req->ret_ptr && req->cmd == MS3_CMD_GET)
+  {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ms3->read_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, ms3->user_data);
+  }
+  else if (req->get_file)
+  {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, file_body_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)req->get_file);
+  }
+  else
+  {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, body_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)mem);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, ms3->buffer_chunk_size);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+  curl_easy_setopt(curl, CURLOPT_VERBOSE, ms3debug_get());
+
+  return 0;
+}
+
+/* Drops anything a request may have changed from the caches. This is done
+ * even when the request failed as the object could still have been changed.
+ */
+static void request_invalidate_caches(ms3_st *ms3, struct request_st *req)
+{
+  struct ms3_status_cache_st *cache = &ms3->status_cache;
+
+  if (!cache->max_entries && !ms3->disk_cache.dir)
+  {
+    return;
+  }
+
+  if (req->cmd == MS3_CMD_PUT || req->cmd == MS3_CMD_DELETE ||
+      req->cmd == MS3_CMD_COPY || req->cmd == MS3_CMD_COMPLETE_MULTIPART)
+  {
+    status_cache_invalidate(cache, req->bucket, req->object);
+    disk_cache_invalidate(&ms3->disk_cache, req->bucket, req->object);
+  }
+  else if (req->cmd == MS3_CMD_DELETE_MANY)
+  {
+    struct delete_batch_st *batch = (struct delete_batch_st *)req->ret_ptr;
+    size_t key_it;
+
+    for (key_it = 0; key_it < batch->count; key_it++)
+    {
+      status_cache_invalidate(cache, req->bucket, batch->keys[key_it]);
+      disk_cache_invalidate(&ms3->disk_cache, req->bucket, batch->keys[key_it]);
+    }
+  }
+}
+
+/* Turns the outcome of a performed request into a result code and processes
+ * the response body
+ */
+static uint8_t request_finish(ms3_st *ms3, struct ms3_context_st *ctx,
+                              struct request_st *req, CURLcode curl_res)
+{
+  uint8_t res = 0;
+  long response_code = 0;
+  struct memory_buffer_st mem = req->mem;
+  command_t cmd = req->cmd;
 
-  if (ms3->disable_verification)
-  {
-    ms3debug("Disabling SSL verification");
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-  }
+  request_invalidate_caches(ms3, req);
 
-  if (ms3->port)
-    curl_easy_setopt(curl, CURLOPT_PORT, (long)ms3->port);
+  // The handle keeps the headers of the last response for ms3_last_response()
+  ms3_cfree(ctx->response.amz_headers);
+  ctx->response = req->response;
+  req->response.amz_headers = NULL;
+  req->response.amz_alloced = 0;
 
-  if (ms3->connect_timeout_ms != 0)
+  if (req->get_file)
   {
-    curl_easy_setopt(ms3->curl, CURLOPT_CONNECTTIMEOUT_MS, ms3->connect_timeout_ms);
+    // Any error response body was buffered separately
+    mem = req->get_file->error;
   }
 
-  if (ms3->timeout_ms != 0)
+  if (req->get_file && req->get_file->write_errno)
   {
-    curl_easy_setopt(ms3->curl, CURLOPT_TIMEOUT_MS, ms3->timeout_ms);
-  }
+    request_error_set(&req->error, MS3_ERR_FILE,
+                      strerror(req->get_file->write_errno), false);
+    error_publish(ctx, &req->error);
+    ms3_cfree(mem.data);
+    curl_slist_free_all(req->headers);
 
-  if (ms3->read_cb && cmd == MS3_CMD_GET)
-  {
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ms3->read_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, ms3->user_data);
+    return MS3_ERR_FILE;
   }
-  else
+
+  if (req->upload && req->upload->read_errno)
   {
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, body_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&mem);
-  }
+    request_error_set(&req->error, MS3_ERR_FILE,
+                      strerror(req->upload->read_errno), false);
+    error_publish(ctx, &req->error);
+    ms3_cfree(mem.data);
+    curl_slist_free_all(req->headers);
 
-  curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, ms3->buffer_chunk_size);
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-  curl_easy_setopt(curl, CURLOPT_VERBOSE, ms3debug_get());
-  curl_res = curl_easy_perform(curl);
+    return MS3_ERR_FILE;
+  }
 
   if (curl_res != CURLE_OK)
   {
     ms3debug("Curl error: %s", curl_easy_strerror(curl_res));
-    set_error(ms3, curl_easy_strerror(curl_res));
-    ms3_cfree(mem.data);
-    curl_slist_free_all(headers);
+    request_error_set(&req->error, MS3_ERR_REQUEST_ERROR,
+                      curl_easy_strerror(curl_res),
+                      request_curl_retryable(curl_res));
+    error_publish(ctx, &req->error);
+    memory_buffer_release(&mem, req->get_buffer);
+    curl_slist_free_all(req->headers);
 
     return MS3_ERR_REQUEST_ERROR;
   }
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+  curl_easy_getinfo(req->curl, CURLINFO_RESPONSE_CODE, &response_code);
   ms3debug("Response code: %ld", response_code);
 
   if (response_code == 301)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_ENDPOINT;
   }
   if (response_code == 404)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_NOT_FOUND;
   }
   else if (response_code == 403)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
-
-    if (message)
-    {
-      ms3debug("Response message: %s", message);
-    }
-
-    set_error_nocopy(ms3, message);
     res = MS3_ERR_AUTH;
   }
+  else if (response_code == 304)
+  {
+    res = MS3_ERR_NOT_MODIFIED;
+  }
   else if (response_code >= 400)
   {
-    char *message = parse_error_message((char *)mem.data, mem.length);
+    res = MS3_ERR_SERVER;
+    pthread_mutex_lock(&ms3->credential_lock);
 
-    if (message)
+    if (ms3->role_credentials)
     {
-      ms3debug("Response message: %s", message);
+      res = MS3_ERR_AUTH_ROLE;
     }
 
-    set_error_nocopy(ms3, message);
-    res = MS3_ERR_SERVER;
-    if (ms3->iam_role)
+    pthread_mutex_unlock(&ms3->credential_lock);
+  }
+
+  if (res && res != MS3_ERR_NOT_MODIFIED)
+  {
+    request_error_response(&req->error, res, response_code,
+                           req->response.request_id,
+                           (const char *)mem.data, mem.length);
+  }
+
+  if (cmd == MS3_CMD_GET || cmd == MS3_CMD_GET_FILE)
+  {
+    size_t pos;
+
+    // Only the media type, anything after a space is dropped
+    for (pos = 0; req->response.content_type[pos] &&
+         !isspace((unsigned char)req->response.content_type[pos]); pos++)
     {
-      res = MS3_ERR_AUTH_ROLE;
+      ctx->content_type_in[pos] = req->response.content_type[pos];
     }
+
+    ctx->content_type_in[pos] = '\0';
+    // A 304 has the ETag too
+    memcpy(ctx->etag_in, req->response.etag, MAX_ETAG_LENGTH);
+  }
+  else if (cmd == MS3_CMD_HEAD && req->ret_ptr && !res)
+  {
+    struct head_response_st *head = (struct head_response_st *) req->ret_ptr;
+
+    head->status.length = (size_t)req->response.content_length;
+    head->status.created = req->response.last_modified;
+    memcpy(head->etag, req->response.etag, MAX_ETAG_LENGTH);
+    memcpy(head->content_type, req->response.content_type,
+           sizeof(head->content_type));
   }
 
   switch (cmd)
@@ -975,19 +1739,14 @@ uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
     case MS3_CMD_LIST:
     {
       char *cont = NULL;
-      parse_list_response((const char *)mem.data, mem.length, &ms3->list_container, ms3->list_version,
-                          &cont);
+      parse_list_response((const char *)mem.data, mem.length, &ctx->list_container, ms3->list_version,
+                          false, &cont);
 
       if (cont)
       {
-        res = execute_request(ms3, cmd, bucket, object, source_bucket, source_object,
-                              filter, data, data_size, cont,
-                              NULL);
-        if (res)
-        {
-          return res;
-        }
-
+        struct request_st next = *req;
+        next.continuation = cont;
+        res = request_execute(ms3, &next);
         ms3_cfree(cont);
       }
 
@@ -997,6 +1756,10 @@ uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
 
     case MS3_CMD_COPY:
     case MS3_CMD_PUT:
+    case MS3_CMD_DELETE:
+    case MS3_CMD_HEAD:
+    case MS3_CMD_GET_FILE:
+    case MS3_CMD_ABORT_MULTIPART:
     {
       ms3_cfree(mem.data);
       break;
@@ -1004,29 +1767,118 @@ uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
 
     case MS3_CMD_GET:
     {
-      struct memory_buffer_st *buf = (struct memory_buffer_st *) ret_ptr;
+      // The buffer always goes back to the caller, even on error
+      if (req->get_buffer)
+      {
+        req->get_buffer->data = mem.data;
+        req->get_buffer->length = res ? 0 : mem.length;
+        req->get_buffer->alloced = mem.alloced;
+      }
 
-      if (res)
+      break;
+    }
+
+    case MS3_CMD_CREATE_MULTIPART:
+    {
+      if (!res)
       {
-        ms3_cfree(mem.data);
+        res = parse_upload_id_response((const char *)mem.data, mem.length,
+                                       (char **) req->ret_ptr);
       }
-      else
+
+      ms3_cfree(mem.data);
+      break;
+    }
+
+    case MS3_CMD_UPLOAD_PART_COPY:
+    {
+      // The ETag is in the body, which can also hold an error
+      if (!res)
       {
-        buf->data = mem.data;
-        buf->length = mem.length;
+        if (parse_error_response((const char *)mem.data, mem.length,
+                                 &req->error))
+        {
+          res = MS3_ERR_SERVER;
+          error_complete(&req->error, res, response_code,
+                         req->response.request_id);
+        }
+        else
+        {
+          res = parse_copy_part_response((const char *)mem.data, mem.length,
+                                         (char *) req->ret_ptr);
+        }
       }
 
+      ms3_cfree(mem.data);
       break;
     }
 
-    case MS3_CMD_DELETE:
+    case MS3_CMD_UPLOAD_PART:
     {
+      char *etag = (char *) req->ret_ptr;
+
+      // The part's ETag is needed to complete the upload
+      memcpy(etag, req->response.etag, MAX_ETAG_LENGTH);
+
+      if (!res && !etag[0])
+      {
+        ms3debug("No ETag for uploaded part");
+        res = MS3_ERR_RESPONSE_PARSE;
+      }
+
       ms3_cfree(mem.data);
       break;
     }
 
-    case MS3_CMD_HEAD:
+    case MS3_CMD_COMPLETE_MULTIPART:
+    {
+      // Failures can be reported in the body of a 200 response
+      if (!res && parse_error_response((const char *)mem.data, mem.length,
+                                       &req->error))
+      {
+        res = MS3_ERR_SERVER;
+        error_complete(&req->error, res, response_code,
+                       req->response.request_id);
+      }
+
+      ms3_cfree(mem.data);
+      break;
+    }
+
+    case MS3_CMD_LIST_PAGE:
+    {
+      // A single page, the caller asks for the next one when it wants it
+      struct list_page_st *page = (struct list_page_st *) req->ret_ptr;
+
+      if (!res)
+      {
+        res = parse_list_response((const char *)mem.data, mem.length,
+                                  &page->container, ms3->list_version, true, &page->continuation);
+      }
+
+      ms3_cfree(mem.data);
+      break;
+    }
+
+    case MS3_CMD_DELETE_MANY:
     {
+      struct delete_batch_st *batch = (struct delete_batch_st *) req->ret_ptr;
+
+      // Per key failures are in the body of a 200 response
+      if (!res)
+      {
+        res = parse_delete_response((const char *)mem.data, mem.length,
+                                    batch->keys, batch->count, batch->results,
+                                    &req->error);
+
+        // The call worked, the first key which failed is still reported
+        if (req->error.result)
+        {
+          error_complete(&req->error, req->error.result, response_code,
+                         req->response.request_id);
+        }
+      }
+
       ms3_cfree(mem.data);
       break;
     }
@@ -1041,7 +1893,279 @@ uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
     }
   }
 
-  curl_slist_free_all(headers);
+  error_publish(ctx, &req->error);
+  curl_slist_free_all(req->headers);
+  req->headers = NULL;
+
+  return res;
+}
+
+uint8_t request_execute(ms3_st *ms3, struct request_st *request)
+{
+  uint8_t res;
+  CURLcode curl_res;
+  CURL *curl;
+  struct ms3_context_st *ctx = context_get(ms3);
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  curl = ctx->curl;
+
+  // Before the handle is set up, a refresh may use it
+  res = credentials_refresh(ms3);
+
+  if (res)
+  {
+    return res;
+  }
+
+  if (!ctx->first_run)
+  {
+    curl_easy_reset(curl);
+  }
+  else
+  {
+    ctx->first_run = false;
+  }
+
+  res = request_setup(ms3, ctx, request, curl);
+
+  if (res)
+  {
+    return res;
+  }
+
+  curl_res = curl_easy_perform(curl);
+
+  return request_finish(ms3, ctx, request, curl_res);
+}
+
+uint8_t execute_request(ms3_st *ms3, command_t cmd, const char *bucket,
+                        const char *object, const char *source_bucket, const char *source_object,
+                        const char *filter, const uint8_t *data, size_t data_size,
+                        char *continuation,
+                        void *ret_ptr)
+{
+  struct request_st request;
+
+  request_init(&request, cmd, bucket, object);
+  request.source_bucket = source_bucket;
+  request.source_object = source_object;
+  request.filter = filter;
+  request.data = data;
+  request.data_size = data_size;
+  request.continuation = continuation;
+  request.ret_ptr = ret_ptr;
+
+  return request_execute(ms3, &request);
+}
+
+/* Parallel requests use a curl multi handle with a pool of easy handles which
+ * are kept in the thread's context between calls so that connections are
+ * reused.
+ */
+static uint8_t parallel_slots_init(ms3_st *ms3, struct ms3_context_st *ctx)
+{
+  size_t slot_it;
+  struct parallel_slot_st *slots;
+
+  if (!ctx->curl_multi)
+  {
+    ctx->curl_multi = curl_multi_init();
+
+    if (!ctx->curl_multi)
+    {
+      return MS3_ERR_OOM;
+    }
+  }
+
+  if (ctx->parallel_slot_count >= ms3->max_parallel)
+  {
+    return 0;
+  }
+
+  slots = ms3_crealloc(ctx->parallel_slots,
+                       sizeof(struct parallel_slot_st) * ms3->max_parallel);
+
+  if (!slots)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  ctx->parallel_slots = slots;
+
+  for (slot_it = ctx->parallel_slot_count; slot_it < ms3->max_parallel;
+       slot_it++)
+  {
+    slots[slot_it].curl = curl_easy_init();
+    slots[slot_it].busy = false;
+
+    if (!slots[slot_it].curl)
+    {
+      return MS3_ERR_OOM;
+    }
+
+    ctx->parallel_slot_count++;
+  }
+
+  return 0;
+}
+
+void parallel_free(struct ms3_context_st *ctx)
+{
+  size_t slot_it;
+
+  for (slot_it = 0; slot_it < ctx->parallel_slot_count; slot_it++)
+  {
+    curl_easy_cleanup(ctx->parallel_slots[slot_it].curl);
+  }
+
+  ms3_cfree(ctx->parallel_slots);
+  ctx->parallel_slots = NULL;
+  ctx->parallel_slot_count = 0;
+
+  if (ctx->curl_multi)
+  {
+    curl_multi_cleanup(ctx->curl_multi);
+    ctx->curl_multi = NULL;
+  }
+}
+
+/* Runs count requests with at most max_parallel of them in flight at once.
+ * Requests are only set up when a slot is free so the memory needed is
+ * bounded by max_parallel, not count. The first error stops any new requests
+ * from being started and is returned once those in flight have finished.
+ * count can be SIZE_MAX when setup decides when to stop with PARALLEL_DONE,
+ * setup must not return PARALLEL_WAIT when nothing is in flight.
+ */
+uint8_t execute_parallel(ms3_st *ms3, size_t count,
+                         request_setup_callback setup, request_done_callback done, void *userdata)
+{
+  uint8_t res = 0;
+  size_t next_index = 0;
+  size_t running = 0;
+  size_t slot_it;
+  size_t slot_count;
+  struct ms3_context_st *ctx = context_get(ms3);
+
+  if (!ctx)
+  {
+    return MS3_ERR_OOM;
+  }
+
+  res = parallel_slots_init(ms3, ctx);
+
+  if (res)
+  {
+    return res;
+  }
+
+  slot_count = ms3->max_parallel;
+
+  while ((next_index < count && !res) || running)
+  {
+    int still_running = 0;
+    int messages = 0;
+    int wait_ms = 1000;
+    CURLMsg *msg;
+
+    // Start new requests in any free slots
+    for (slot_it = 0; slot_it < slot_count && next_index < count && !res;
+         slot_it++)
+    {
+      struct parallel_slot_st *slot = &ctx->parallel_slots[slot_it];
+
+      if (slot->busy)
+      {
+        continue;
+      }
+
+      curl_easy_reset(slot->curl);
+      slot->index = next_index;
+      res = setup(ms3, slot->index, &slot->request, userdata);
+
+      if (res == PARALLEL_WAIT)
+      {
+        // What it waits for may not be a request, so check back soon
+        res = 0;
+        wait_ms = PARALLEL_WAIT_POLL_MS;
+        break;
+      }
+
+      if (res == PARALLEL_DONE)
+      {
+        res = 0;
+        count = next_index;
+        break;
+      }
+
+      next_index++;
+
+      if (!res)
+      {
+        res = credentials_refresh(ms3);
+      }
+
+      if (!res)
+      {
+        res = request_setup(ms3, ctx, &slot->request, slot->curl);
+      }
+
+      if (res)
+      {
+        break;
+      }
+
+      curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, (void *)slot);
+      curl_multi_add_handle(ctx->curl_multi, slot->curl);
+      slot->busy = true;
+      running++;
+    }
+
+    if (!running)
+    {
+      break;
+    }
+
+    curl_multi_perform(ctx->curl_multi, &still_running);
+
+    while ((msg = curl_multi_info_read(ctx->curl_multi, &messages)))
+    {
+      struct parallel_slot_st *slot = NULL;
+      uint8_t request_res;
+
+      if (msg->msg != CURLMSG_DONE)
+      {
+        continue;
+      }
+
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&slot);
+      curl_multi_remove_handle(ctx->curl_multi, msg->easy_handle);
+      request_res = request_finish(ms3, ctx, &slot->request, msg->data.result);
+
+      if (done)
+      {
+        request_res = done(ms3, slot->index, &slot->request, request_res,
+                           userdata);
+      }
+
+      if (request_res && !res)
+      {
+        res = request_res;
+      }
+
+      slot->busy = false;
+      running--;
+    }
+
+    if (running && still_running)
+    {
+      curl_multi_wait(ctx->curl_multi, NULL, 0, wait_ms, NULL);
+    }
+  }
 
   return res;
 }
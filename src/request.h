@@ -20,23 +20,36 @@
 #pragma once
 
 #include "config.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-// Maxmum S3 file size is 1024 bytes so for protection we make the maximum
-// URI length this
+// Maxmum S3 key size is 1024 bytes so this much stack is used for building
+// paths, queries and URIs, anything longer moves to the heap
 #define MAX_URI_LENGTH 1024
 #define MAX_S3_SECRET_LENGTH 128
 #define S3_SECRET_EXTRA_LENGTH 5
 
 #define READ_BUFFER_DEFAULT_SIZE 1024*1024
 
+#define PART_SIZE_DEFAULT 8*1024*1024
+#define MAX_PARALLEL_DEFAULT 4
+// S3 limits for multipart uploads
+#define MIN_PART_SIZE (5 * 1024 * 1024)
+#define MAX_PART_COUNT 10000
+#define MAX_ETAG_LENGTH 128
+// S3 limit for DeleteObjects
+#define MAX_DELETE_KEYS 1000
+// Largest object S3 copies in a single request
+#define MAX_COPY_SIZE ((uint64_t)5 * 1024 * 1024 * 1024)
+
 enum uri_method_t
 {
   MS3_GET,
   MS3_HEAD,
   MS3_PUT,
-  MS3_DELETE
+  MS3_DELETE,
+  MS3_POST
 };
 
 typedef enum uri_method_t uri_method_t;
@@ -51,12 +64,103 @@ enum command_t
   MS3_CMD_HEAD,
   MS3_CMD_COPY,
   MS3_CMD_LIST_ROLE,
-  MS3_CMD_ASSUME_ROLE
+  MS3_CMD_ASSUME_ROLE,
+  MS3_CMD_GET_FILE,
+  MS3_CMD_CREATE_MULTIPART,
+  MS3_CMD_UPLOAD_PART,
+  MS3_CMD_COMPLETE_MULTIPART,
+  MS3_CMD_ABORT_MULTIPART,
+  MS3_CMD_DELETE_MANY,
+  MS3_CMD_LIST_PAGE,
+  MS3_CMD_UPLOAD_PART_COPY
 };
 
 typedef enum command_t command_t;
 
 struct ms3_st;
+struct request_st;
+struct upload_source_st;
+struct memory_buffer_st;
+struct ms3_context_st;
+struct signed_headers_st;
+
+/* Callbacks for execute_parallel(). setup fills in the request for a given
+ * index, done is called with the result once that request has finished.
+ * When the requests aren't known up front setup can return PARALLEL_WAIT if
+ * it has nothing to start yet, it is then called again after at most
+ * PARALLEL_WAIT_POLL_MS, or PARALLEL_DONE once there is nothing left at all.
+ */
+#define PARALLEL_WAIT 0xfe
+#define PARALLEL_DONE 0xff
+#define PARALLEL_WAIT_POLL_MS 10
+
+typedef uint8_t (*request_setup_callback)(ms3_st *ms3, size_t index,
+                                          struct request_st *request, void *userdata);
+typedef uint8_t (*request_done_callback)(ms3_st *ms3, size_t index,
+                                         struct request_st *request, uint8_t result, void *userdata);
+
+void request_init(struct request_st *request, command_t command,
+                  const char *bucket, const char *object);
+
+uint8_t request_execute(ms3_st *ms3, struct request_st *request);
+
+uint8_t execute_parallel(ms3_st *ms3, size_t count,
+                         request_setup_callback setup, request_done_callback done, void *userdata);
+
+struct request_error_st;
+
+// Records a failure without a response, such as a curl or file error
+void request_error_set(struct request_error_st *error, uint8_t result,
+                       const char *message, bool retryable);
+
+/* Records a failure response with the code and message from its body.
+ * request_id is the one from the response headers, if any.
+ */
+void request_error_response(struct request_error_st *error, uint8_t result,
+                            long status, const char *request_id,
+                            const char *data, size_t length);
+
+// Whether a curl error is worth retrying, such as a timeout
+bool request_curl_retryable(CURLcode curl_res);
+
+// Frees the curl handles a thread used for parallel requests
+void parallel_free(struct ms3_context_st *ctx);
+
+/* The hex SHA-256 of the canonical request which is signed, return_hash is
+ * 65 bytes
+ */
+uint8_t generate_request_hash(uri_method_t method, const char *path,
+                              const char *bucket,
+                              const char *query, const char *post_hash,
+                              const struct signed_headers_st *headers,
+                              char *return_hash);
+
+// Adds the signed headers of a request, including the Authorization header
+uint8_t build_request_headers(CURL *curl, struct curl_slist **head,
+                              const char *base_domain, const char *region, const char *key,
+                              const char *secret, const char *object, const char *query,
+                              uri_method_t method, const char *bucket, const char *source_bucket,
+                              const char *source_key, const char *copy_range, const char *post_hash, size_t content_length,
+                              uint8_t protocol_version, const char *session_token,
+                              const ms3_header_st *extra_headers, size_t extra_header_count);
+
+// Hex SHA-256 of a request body for the signature, post_hash is 65 bytes
+uint8_t payload_hash_file(const struct upload_source_st *upload,
+                          size_t window_size, char *post_hash);
+
+void payload_hash_data(const uint8_t *data, size_t length, char *post_hash);
+
+// Grows a response buffer so it can hold at least size bytes
+bool memory_buffer_reserve(struct memory_buffer_st *mem, size_t size);
+
+/* Grows a response buffer for a body of length bytes, and a byte more if it
+ * is NUL terminated. A caller's buffer gets just the body, so a power of two
+ * body stays in its pool size class.
+ */
+bool memory_buffer_reserve_body(struct memory_buffer_st *mem, size_t length);
+
+// NUL terminates the data if the buffer is terminated
+void memory_buffer_terminate(struct memory_buffer_st *mem);
 
 uint8_t execute_request(ms3_st *ms3, command_t command, const char *bucket,
                         const char *object, const char *source_bucket, const char *source_object,
@@ -22,25 +22,81 @@
 
 #include "xml.h"
 
-char *parse_error_message(const char *data, size_t length)
+// Copies an XML string with the predefined entities decoded
+static char *xml_unescape_copy(struct xml_string *content)
+{
+  size_t length = xml_string_length(content);
+  char *out = ms3_cmalloc(length + 1);
+  char *in_ptr;
+  char *out_ptr;
+  size_t entity_it;
+  static const char *entities[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;"};
+  static const char replacements[] = {'&', '<', '>', '"', '\''};
+
+  if (!out)
+  {
+    return NULL;
+  }
+
+  xml_string_copy(content, (uint8_t*)out, length);
+
+  for (in_ptr = out_ptr = out; *in_ptr;)
+  {
+    bool replaced = false;
+
+    if (*in_ptr == '&')
+    {
+      for (entity_it = 0; entity_it < 5; entity_it++)
+      {
+        size_t entity_length = strlen(entities[entity_it]);
+
+        if (!strncmp(in_ptr, entities[entity_it], entity_length))
+        {
+          *out_ptr++ = replacements[entity_it];
+          in_ptr += entity_length;
+          replaced = true;
+          break;
+        }
+      }
+    }
+
+    if (!replaced)
+    {
+      *out_ptr++ = *in_ptr++;
+    }
+  }
+
+  *out_ptr = '\0';
+  return out;
+}
+
+// Copies an XML string into a fixed size buffer, truncating it to fit
+static void xml_copy_to(struct xml_node *node, char *out, size_t out_size)
+{
+  xml_string_copy(xml_node_content(node), (uint8_t *)out, out_size - 1);
+}
+
+bool parse_error_response(const char *data, size_t length,
+                          struct request_error_st *error)
 {
   struct xml_document *doc = NULL;
   struct xml_node *node = NULL;
   struct xml_node *child = NULL;
   struct xml_node *root = NULL;
+  bool found = false;
 
   uint64_t node_it = 0;
 
   if (!data || !length)
   {
-    return NULL;
+    return false;
   }
 
   doc = xml_parse_document((uint8_t*)data, length);
 
   if (!doc)
   {
-    return NULL;
+    return false;
   }
 
   root = xml_document_root(doc);
@@ -58,21 +114,21 @@ char *parse_error_message(const char *data, size_t length)
     child = root;
   }
 
-  if (!node)
-  {
-    xml_document_free(doc, false);
-    return NULL;
-  }
-
   while(node)
   {
     if (!xml_node_name_cmp(node, "Message"))
     {
-      struct xml_string *content = xml_node_content(node);
-      uint8_t *message = ms3_cmalloc(xml_string_length(content) + 1);
-      xml_string_copy(content, message, xml_string_length(content));
-      xml_document_free(doc, false);
-      return (char *)message;
+      xml_copy_to(node, error->message, sizeof(error->message));
+      found = true;
+    }
+    else if (!xml_node_name_cmp(node, "Code"))
+    {
+      xml_copy_to(node, error->code, sizeof(error->code));
+      found = true;
+    }
+    else if (!xml_node_name_cmp(node, "RequestId") && !error->request_id[0])
+    {
+      xml_copy_to(node, error->request_id, sizeof(error->request_id));
     }
 
     node_it++;
@@ -80,7 +136,7 @@ char *parse_error_message(const char *data, size_t length)
   }
 
   xml_document_free(doc, false);
-  return NULL;
+  return found;
 }
 
 static ms3_list_st *get_next_list_ptr(struct ms3_list_container_st *container)
@@ -128,8 +184,32 @@ static ms3_list_st *get_next_list_ptr(struct ms3_list_container_st *container)
   return ret;
 }
 
+void list_container_free(struct ms3_list_container_st *list_container)
+{
+  ms3_list_st *list = list_container->start;
+  struct ms3_pool_alloc_list_st *plist = NULL, *next = NULL;
+  while (list)
+  {
+    ms3_cfree(list->key);
+    list = list->next;
+  }
+  plist = list_container->pool_list;
+  while (plist)
+  {
+    next = plist->prev;
+    ms3_cfree(plist->pool);
+    ms3_cfree(plist);
+    plist = next;
+  }
+  list_container->pool = NULL;
+  list_container->next = NULL;
+  list_container->start = NULL;
+  list_container->pool_list = NULL;
+  list_container->pool_free = 0;
+}
+
 uint8_t parse_list_response(const char *data, size_t length, struct ms3_list_container_st *list_container,
-                            uint8_t list_version,
+                            uint8_t list_version, bool keep_markers,
                             char **continuation)
 {
   struct xml_document *doc;
@@ -212,13 +292,18 @@ uint8_t parse_list_response(const char *data, size_t length, struct ms3_list_con
       {
         if (!xml_node_name_cmp(child, "Key"))
         {
-          struct xml_string *content = xml_node_content(child);
-          filename = ms3_cmalloc(xml_string_length(content) + 1);
-          xml_string_copy(content, (uint8_t*)filename, xml_string_length(content));
+          filename = xml_unescape_copy(xml_node_content(child));
+
+          if (!filename)
+          {
+            xml_document_free(doc, false);
+            return MS3_ERR_OOM;
+          }
 
           ms3debug("Filename: %s", filename);
 
-          if (filename[strlen((const char *)filename) - 1] == '/')
+          if (!keep_markers && filename[0] &&
+              filename[strlen((const char *)filename) - 1] == '/')
           {
             skip = true;
             ms3_cfree(filename);
@@ -293,9 +378,13 @@ uint8_t parse_list_response(const char *data, size_t length, struct ms3_list_con
 
       if (!xml_node_name_cmp(child, "Prefix"))
       {
-        struct xml_string *content = xml_node_content(child);
-        filename = ms3_cmalloc(xml_string_length(content) + 1);
-        xml_string_copy(content, (uint8_t*)filename, xml_string_length(content));
+        filename = xml_unescape_copy(xml_node_content(child));
+
+        if (!filename)
+        {
+          xml_document_free(doc, false);
+          return MS3_ERR_OOM;
+        }
 
         ms3debug("Filename: %s", filename);
         nextptr = get_next_list_ptr(list_container);
@@ -416,7 +505,7 @@ uint8_t parse_role_list_response(const char *data, size_t length, char *role_nam
     return MS3_ERR_NOT_FOUND;
 }
 
-uint8_t parse_assume_role_response(const char *data, size_t length, char *assume_role_key, char *assume_role_secret, char *assume_role_token)
+uint8_t parse_assume_role_response(const char *data, size_t length, char *assume_role_key, char *assume_role_secret, char *assume_role_token, time_t *expiration)
 {
     struct xml_document *doc;
     struct xml_node *root;
@@ -498,6 +587,26 @@ uint8_t parse_assume_role_response(const char *data, size_t length, char *assume
             }
             xml_string_copy(content, (uint8_t*)assume_role_token, content_length);
 
+            continue;
+          }
+          if (!xml_node_name_cmp(credentials, "Expiration"))
+          {
+            // Date/time, format: 2019-03-15T16:58:54Z
+            struct xml_string *content = xml_node_content(credentials);
+            size_t content_length = xml_string_length(content);
+            char date[64];
+            struct tm ttmp = {0};
+
+            if (content_length >= sizeof(date))
+            {
+              ms3debug("Expiration error length = %zu", content_length);
+              xml_document_free(doc, false);
+              return MS3_ERR_AUTH_ROLE;
+            }
+            xml_string_copy(content, (uint8_t*)date, content_length);
+            strptime(date, "%Y-%m-%dT%H:%M:%S", &ttmp);
+            *expiration = timegm(&ttmp);
+
             continue;
           }
         }
@@ -510,3 +619,236 @@ uint8_t parse_assume_role_response(const char *data, size_t length, char *assume
 
     return MS3_ERR_NONE;
 }
+
+uint8_t parse_upload_id_response(const char *data, size_t length, char **upload_id)
+{
+  struct xml_document *doc;
+  struct xml_node *root;
+  struct xml_node *child;
+  uint64_t node_it = 0;
+
+  *upload_id = NULL;
+
+  if (!data || !length)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  doc = xml_parse_document((uint8_t*)data, length);
+
+  if (!doc)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  root = xml_document_root(doc);
+  // First node is InitiateMultipartUploadResult
+  while ((child = xml_node_child(root, node_it++)))
+  {
+    if (!xml_node_name_cmp(child, "UploadId"))
+    {
+      struct xml_string *content = xml_node_content(child);
+      size_t content_length = xml_string_length(content);
+
+      *upload_id = ms3_ccalloc(content_length + 1, 1);
+
+      if (!*upload_id)
+      {
+        xml_document_free(doc, false);
+        return MS3_ERR_OOM;
+      }
+
+      xml_string_copy(content, (uint8_t*)*upload_id, content_length);
+      break;
+    }
+  }
+
+  xml_document_free(doc, false);
+
+  if (!*upload_id || !(*upload_id)[0])
+  {
+    ms3_cfree(*upload_id);
+    *upload_id = NULL;
+    ms3debug("No UploadId in response");
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  return MS3_ERR_NONE;
+}
+
+static uint8_t delete_error_code(const char *code)
+{
+  if (!code)
+  {
+    return MS3_ERR_SERVER;
+  }
+
+  if (!strcmp(code, "AccessDenied"))
+  {
+    return MS3_ERR_AUTH;
+  }
+
+  if (!strcmp(code, "NoSuchKey") || !strcmp(code, "NoSuchBucket"))
+  {
+    return MS3_ERR_NOT_FOUND;
+  }
+
+  return MS3_ERR_SERVER;
+}
+
+/* Errors come back in the order the keys were sent so the search for each
+ * key starts just after the previous one.
+ */
+static size_t delete_key_index(const char **keys, size_t key_count,
+                               const char *key, size_t hint)
+{
+  size_t key_it;
+
+  for (key_it = 0; key_it < key_count; key_it++)
+  {
+    size_t index = (hint + key_it) % key_count;
+
+    if (!strcmp(keys[index], key))
+    {
+      return index;
+    }
+  }
+
+  return key_count;
+}
+
+uint8_t parse_delete_response(const char *data, size_t length,
+                              const char **keys, size_t key_count, uint8_t *results,
+                              struct request_error_st *error)
+{
+  struct xml_document *doc;
+  struct xml_node *root;
+  struct xml_node *child;
+  uint64_t node_it = 0;
+  size_t hint = 0;
+
+  if (!data || !length)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  doc = xml_parse_document((uint8_t*)data, length);
+
+  if (!doc)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  root = xml_document_root(doc);
+  // First node is DeleteResult, in quiet mode it only lists the failures
+  while ((child = xml_node_child(root, node_it++)))
+  {
+    struct xml_node *field;
+    uint64_t field_it = 0;
+    char *key = NULL;
+    char *code = NULL;
+    char *text = NULL;
+    size_t index;
+
+    if (xml_node_name_cmp(child, "Error"))
+    {
+      continue;
+    }
+
+    while ((field = xml_node_child(child, field_it++)))
+    {
+      if (!xml_node_name_cmp(field, "Key"))
+      {
+        key = xml_unescape_copy(xml_node_content(field));
+      }
+      else if (!xml_node_name_cmp(field, "Code"))
+      {
+        code = xml_unescape_copy(xml_node_content(field));
+      }
+      else if (!xml_node_name_cmp(field, "Message"))
+      {
+        text = xml_unescape_copy(xml_node_content(field));
+      }
+    }
+
+    index = key ? delete_key_index(keys, key_count, key, hint) : key_count;
+
+    if (index < key_count)
+    {
+      results[index] = delete_error_code(code);
+      hint = index + 1;
+
+      // The first failure is the one reported
+      if (!error->result)
+      {
+        error->result = results[index];
+        snprintf(error->code, sizeof(error->code), "%s", code ? code : "");
+        snprintf(error->message, sizeof(error->message), "%s: %s", key,
+                 text ? text : "");
+      }
+    }
+    else
+    {
+      ms3debug("Delete error for unknown key: %s", key ? key : "");
+    }
+
+    ms3_cfree(key);
+    ms3_cfree(code);
+    ms3_cfree(text);
+  }
+
+  xml_document_free(doc, false);
+
+  return MS3_ERR_NONE;
+}
+
+uint8_t parse_copy_part_response(const char *data, size_t length, char *etag)
+{
+  struct xml_document *doc;
+  struct xml_node *root;
+  struct xml_node *child;
+  uint64_t node_it = 0;
+
+  etag[0] = '\0';
+
+  if (!data || !length)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  doc = xml_parse_document((uint8_t*)data, length);
+
+  if (!doc)
+  {
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  root = xml_document_root(doc);
+  // First node is CopyPartResult
+  while ((child = xml_node_child(root, node_it++)))
+  {
+    if (!xml_node_name_cmp(child, "ETag"))
+    {
+      // S3 escapes the quotes around the ETag
+      char *content = xml_unescape_copy(xml_node_content(child));
+
+      if (content && strlen(content) < MAX_ETAG_LENGTH)
+      {
+        strcpy(etag, content);
+      }
+
+      ms3_cfree(content);
+      break;
+    }
+  }
+
+  xml_document_free(doc, false);
+
+  if (!etag[0])
+  {
+    ms3debug("No ETag in copy part response");
+    return MS3_ERR_RESPONSE_PARSE;
+  }
+
+  return MS3_ERR_NONE;
+}
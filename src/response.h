@@ -20,13 +20,33 @@
 #pragma once
 
 #include "config.h"
+#include <stdbool.h>
 #include <stdint.h>
 
-char *parse_error_message(const char *data, size_t length);
+struct request_error_st;
+
+/* Fills in the code, message and request ID of an error response body.
+ * Returns false if the body doesn't hold an error.
+ */
+bool parse_error_response(const char *data, size_t length,
+                          struct request_error_st *error);
+
+void list_container_free(struct ms3_list_container_st *list_container);
 
 uint8_t parse_list_response(const char *data, size_t length,
-                            struct ms3_list_container_st *list_container, uint8_t list_version, char **continuation);
+                            struct ms3_list_container_st *list_container, uint8_t list_version,
+                            bool keep_markers, char **continuation);
 
 uint8_t parse_role_list_response(const char *data, size_t length, char *role_name, char* arn, char **continuation);
 
-uint8_t parse_assume_role_response(const char *data, size_t length, char *assume_role_key, char *assume_role_secret, char *assume_role_token);
+uint8_t parse_assume_role_response(const char *data, size_t length, char *assume_role_key, char *assume_role_secret, char *assume_role_token, time_t *expiration);
+
+uint8_t parse_upload_id_response(const char *data, size_t length, char **upload_id);
+
+// The first per-key failure is recorded in error
+uint8_t parse_delete_response(const char *data, size_t length,
+                              const char **keys, size_t key_count, uint8_t *results,
+                              struct request_error_st *error);
+
+// etag must hold MAX_ETAG_LENGTH bytes
+uint8_t parse_copy_part_response(const char *data, size_t length, char *etag);
@@ -0,0 +1,242 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+
+void signed_headers_init(struct signed_headers_st *set, char *buffer,
+                         size_t size)
+{
+  string_builder_init(&set->data, buffer, size);
+  set->headers = set->inline_headers;
+  set->count = 0;
+  set->alloced = SIGNED_HEADERS_INLINE;
+  set->failed = false;
+}
+
+// Orders header names the way SignedHeaders has to list them
+static int name_compare(const struct signed_headers_st *set,
+                        const struct signed_header_st *header,
+                        const char *name, size_t name_length)
+{
+  size_t length = header->name_length < name_length ? header->name_length :
+                  name_length;
+  int res = memcmp(set->data.data + header->offset, name, length);
+
+  if (res)
+  {
+    return res;
+  }
+
+  if (header->name_length == name_length)
+  {
+    return 0;
+  }
+
+  return header->name_length < name_length ? -1 : 1;
+}
+
+static bool signed_headers_reserve(struct signed_headers_st *set)
+{
+  struct signed_header_st *headers;
+  size_t new_alloced = set->alloced * 2;
+
+  if (set->count < set->alloced)
+  {
+    return true;
+  }
+
+  if (set->headers == set->inline_headers)
+  {
+    headers = ms3_cmalloc(sizeof(struct signed_header_st) * new_alloced);
+
+    if (headers)
+    {
+      memcpy(headers, set->inline_headers,
+             sizeof(struct signed_header_st) * set->count);
+    }
+  }
+  else
+  {
+    headers = ms3_crealloc(set->headers,
+                           sizeof(struct signed_header_st) * new_alloced);
+  }
+
+  if (!headers)
+  {
+    return false;
+  }
+
+  set->headers = headers;
+  set->alloced = new_alloced;
+  return true;
+}
+
+void signed_headers_add(struct signed_headers_st *set, const char *name,
+                        const char *value, size_t value_length)
+{
+  struct signed_header_st header;
+  size_t name_length = strlen(name);
+  size_t pos;
+  size_t insert;
+  bool space = false;
+
+  if (set->failed)
+  {
+    return;
+  }
+
+  header.offset = set->data.length;
+  header.name_length = name_length;
+
+  for (pos = 0; pos < name_length; pos++)
+  {
+    char c = name[pos];
+
+    if (c >= 'A' && c <= 'Z')
+    {
+      c = (char)(c - 'A' + 'a');
+    }
+
+    string_builder_append_char(&set->data, c);
+  }
+
+  string_builder_append_char(&set->data, ':');
+
+  // Spaces at the ends are dropped and runs of them become one
+  for (pos = 0; pos < value_length; pos++)
+  {
+    if (value[pos] == ' ' || value[pos] == '\t')
+    {
+      space = true;
+      continue;
+    }
+
+    if (space && set->data.length > header.offset + name_length + 1)
+    {
+      string_builder_append_char(&set->data, ' ');
+    }
+
+    space = false;
+    string_builder_append_char(&set->data, value[pos]);
+  }
+
+  header.length = set->data.length - header.offset;
+  // Each line is NUL terminated so that it can be handed to curl
+  string_builder_append_char(&set->data, '\0');
+
+  if (set->data.failed || !signed_headers_reserve(set))
+  {
+    set->failed = true;
+    return;
+  }
+
+  // Insertion keeps the list sorted, there are only ever a few headers
+  for (insert = set->count; insert > 0; insert--)
+  {
+    int res = name_compare(set, &set->headers[insert - 1],
+                           set->data.data + header.offset, name_length);
+
+    if (res == 0)
+    {
+      set->headers[insert - 1] = header;
+      return;
+    }
+
+    if (res < 0)
+    {
+      break;
+    }
+  }
+
+  memmove(&set->headers[insert + 1], &set->headers[insert],
+          sizeof(struct signed_header_st) * (set->count - insert));
+  set->headers[insert] = header;
+  set->count++;
+}
+
+const char *signed_headers_get(const struct signed_headers_st *set,
+                               size_t index, size_t *length,
+                               size_t *name_length)
+{
+  const struct signed_header_st *header = &set->headers[index];
+
+  *length = header->length;
+  *name_length = header->name_length;
+  return set->data.data + header->offset;
+}
+
+void signed_headers_names(const struct signed_headers_st *set,
+                          struct string_builder_st *out)
+{
+  size_t header_it;
+
+  for (header_it = 0; header_it < set->count; header_it++)
+  {
+    const struct signed_header_st *header = &set->headers[header_it];
+
+    if (header_it)
+    {
+      string_builder_append_char(out, ';');
+    }
+
+    string_builder_append(out, set->data.data + header->offset,
+                          header->name_length);
+  }
+}
+
+struct curl_slist *signed_headers_emit(struct signed_headers_st *set,
+                                       struct curl_slist *list)
+{
+  size_t header_it;
+
+  for (header_it = 0; header_it < set->count; header_it++)
+  {
+    const struct signed_header_st *header = &set->headers[header_it];
+    char *line = set->data.data + header->offset;
+
+    // curl removes "name:" headers, "name;" sends them empty
+    if (header->length == header->name_length + 1)
+    {
+      line[header->name_length] = ';';
+      list = curl_slist_append(list, line);
+      line[header->name_length] = ':';
+    }
+    else
+    {
+      list = curl_slist_append(list, line);
+    }
+  }
+
+  return list;
+}
+
+void signed_headers_free(struct signed_headers_st *set)
+{
+  if (set->headers != set->inline_headers)
+  {
+    ms3_cfree(set->headers);
+  }
+
+  string_builder_free(&set->data);
+  set->headers = set->inline_headers;
+  set->count = 0;
+  set->alloced = SIGNED_HEADERS_INLINE;
+}
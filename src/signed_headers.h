@@ -0,0 +1,79 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+#include "string_builder.h"
+
+// Room for this many headers before the list moves to the heap
+#define SIGNED_HEADERS_INLINE 16
+
+// A header line "name:value" stored in the collection's data
+struct signed_header_st
+{
+  size_t offset;
+  size_t name_length;
+  size_t length;
+};
+
+/* The headers of a request which are covered by its signature. They are kept
+ * in canonical form, lower case names and values with the surrounding and
+ * repeated spaces removed, sorted by name. The lines can then be hashed,
+ * listed in SignedHeaders and sent as they are. A header added twice keeps
+ * the last value. Like the string builder, failed is set when memory runs
+ * out and any further headers are dropped.
+ */
+struct signed_headers_st
+{
+  struct string_builder_st data;
+  struct signed_header_st *headers;
+  struct signed_header_st inline_headers[SIGNED_HEADERS_INLINE];
+  size_t count;
+  size_t alloced;
+  bool failed;
+};
+
+// The data starts in a buffer given by the caller, usually on the stack
+void signed_headers_init(struct signed_headers_st *set, char *buffer,
+                         size_t size);
+
+void signed_headers_add(struct signed_headers_st *set, const char *name,
+                        const char *value, size_t value_length);
+
+// Returns the line of the header at index, name_length is its name part
+const char *signed_headers_get(const struct signed_headers_st *set,
+                               size_t index, size_t *length,
+                               size_t *name_length);
+
+// Appends the names separated by ';' as used for SignedHeaders
+void signed_headers_names(const struct signed_headers_st *set,
+                          struct string_builder_st *out);
+
+// Adds every header to a curl header list
+struct curl_slist *signed_headers_emit(struct signed_headers_st *set,
+                                       struct curl_slist *list);
+
+void signed_headers_free(struct signed_headers_st *set);
@@ -0,0 +1,142 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include "config.h"
+#include "common.h"
+
+/* Batch HEAD. Each key is a separate request, up to MS3_OPT_MAX_PARALLEL are
+ * in flight at once over the handle's parallel connections. Keys in the
+ * status cache are answered without a request.
+ */
+
+struct status_job_st
+{
+  const char *bucket;
+  const char **keys;
+  ms3_status_st *statuses;
+  uint8_t *results;
+  size_t *pending; // Index of each key that needs a request
+  struct head_response_st *responses; // One per pending key
+  uint64_t generation; // Of the status cache before the requests
+};
+
+static uint8_t status_setup(ms3_st *ms3, size_t index,
+                            struct request_st *request, void *userdata)
+{
+  struct status_job_st *job = (struct status_job_st *)userdata;
+  (void) ms3;
+
+  request_init(request, MS3_CMD_HEAD, job->bucket,
+               job->keys[job->pending[index]]);
+  request->ret_ptr = &job->responses[index];
+
+  return 0;
+}
+
+static uint8_t status_done(ms3_st *ms3, size_t index,
+                           struct request_st *request, uint8_t result, void *userdata)
+{
+  struct status_job_st *job = (struct status_job_st *)userdata;
+  size_t key_index = job->pending[index];
+  (void) request;
+
+  job->results[key_index] = result;
+
+  if (!result)
+  {
+    job->statuses[key_index] = job->responses[index].status;
+    status_cache_put(&ms3->status_cache, job->bucket, job->keys[key_index],
+                     &job->responses[index], job->generation);
+  }
+  else if (result == MS3_ERR_NOT_FOUND)
+  {
+    status_cache_put(&ms3->status_cache, job->bucket, job->keys[key_index],
+                     NULL, job->generation);
+    // A missing key is an answer, anything else stops the remaining requests
+    return 0;
+  }
+
+  return result;
+}
+
+uint8_t status_keys(ms3_st *ms3, const char *bucket, const char **keys,
+                    size_t count, ms3_status_st *statuses, uint8_t *results)
+{
+  uint8_t res;
+  size_t key_it;
+  size_t pending_count = 0;
+  struct status_job_st job;
+
+  job.bucket = bucket;
+  job.keys = keys;
+  job.statuses = statuses;
+  job.results = results;
+  job.generation = status_cache_generation(&ms3->status_cache);
+  job.pending = ms3_cmalloc(count * sizeof(size_t));
+  job.responses = ms3_ccalloc(count, sizeof(struct head_response_st));
+
+  if (!job.pending || !job.responses)
+  {
+    ms3_cfree(job.pending);
+    ms3_cfree(job.responses);
+    return MS3_ERR_OOM;
+  }
+
+  memset(statuses, 0, count * sizeof(ms3_status_st));
+
+  for (key_it = 0; key_it < count; key_it++)
+  {
+    bool found;
+    struct head_response_st cached;
+
+    if (status_cache_get(&ms3->status_cache, bucket, keys[key_it], &found,
+                         &cached))
+    {
+      results[key_it] = found ? MS3_ERR_NONE : MS3_ERR_NOT_FOUND;
+
+      if (found)
+      {
+        statuses[key_it] = cached.status;
+      }
+
+      continue;
+    }
+
+    // Marks the keys which are never sent
+    results[key_it] = MS3_ERR_MAX;
+    job.pending[pending_count++] = key_it;
+  }
+
+  res = pending_count ? execute_parallel(ms3, pending_count, status_setup,
+                                         status_done, &job) : 0;
+
+  for (key_it = 0; key_it < count; key_it++)
+  {
+    if (results[key_it] == MS3_ERR_MAX)
+    {
+      results[key_it] = res;
+    }
+  }
+
+  ms3_cfree(job.pending);
+  ms3_cfree(job.responses);
+
+  return res;
+}
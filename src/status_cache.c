@@ -0,0 +1,381 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+#include <time.h>
+
+/* A chained hash table sized to a power of two at least max_entries, with
+ * every entry also on a doubly linked list in order of use for eviction.
+ * Entries are named "bucket/key", bucket names can't contain a '/'.
+ */
+
+struct status_cache_entry_st
+{
+  struct status_cache_entry_st *hash_next;
+  struct status_cache_entry_st *lru_prev;
+  struct status_cache_entry_st *lru_next;
+  uint32_t hash;
+  uint64_t expires_ms;
+  bool found;
+  struct head_response_st response;
+  char name[]; // bucket/key
+};
+
+static uint64_t now_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// FNV-1a over bucket/key without building the name
+static uint32_t name_hash(const char *bucket, const char *key)
+{
+  uint32_t hash = 2166136261u;
+  const char *pos;
+
+  for (pos = bucket; *pos; pos++)
+  {
+    hash = (hash ^ (uint8_t)*pos) * 16777619u;
+  }
+
+  hash = (hash ^ (uint8_t)'/') * 16777619u;
+
+  for (pos = key; *pos; pos++)
+  {
+    hash = (hash ^ (uint8_t)*pos) * 16777619u;
+  }
+
+  return hash;
+}
+
+static bool name_matches(const struct status_cache_entry_st *entry,
+                         const char *bucket, const char *key)
+{
+  size_t bucket_length = strlen(bucket);
+
+  return !strncmp(entry->name, bucket, bucket_length) &&
+         entry->name[bucket_length] == '/' &&
+         !strcmp(entry->name + bucket_length + 1, key);
+}
+
+static struct status_cache_entry_st **find_link(struct ms3_status_cache_st *cache,
+                                                uint32_t hash, const char *bucket, const char *key)
+{
+  struct status_cache_entry_st **link;
+
+  if (!cache->table_size)
+  {
+    return NULL;
+  }
+
+  link = &cache->table[hash & (cache->table_size - 1)];
+
+  while (*link)
+  {
+    if ((*link)->hash == hash && name_matches(*link, bucket, key))
+    {
+      return link;
+    }
+
+    link = &(*link)->hash_next;
+  }
+
+  return NULL;
+}
+
+static void lru_unlink(struct ms3_status_cache_st *cache,
+                       struct status_cache_entry_st *entry)
+{
+  if (entry->lru_prev)
+  {
+    entry->lru_prev->lru_next = entry->lru_next;
+  }
+  else
+  {
+    cache->lru_head = entry->lru_next;
+  }
+
+  if (entry->lru_next)
+  {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  }
+  else
+  {
+    cache->lru_tail = entry->lru_prev;
+  }
+}
+
+static void lru_push(struct ms3_status_cache_st *cache,
+                     struct status_cache_entry_st *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+
+  if (cache->lru_head)
+  {
+    cache->lru_head->lru_prev = entry;
+  }
+  else
+  {
+    cache->lru_tail = entry;
+  }
+
+  cache->lru_head = entry;
+}
+
+static void entry_remove(struct ms3_status_cache_st *cache,
+                         struct status_cache_entry_st **link)
+{
+  struct status_cache_entry_st *entry = *link;
+
+  *link = entry->hash_next;
+  lru_unlink(cache, entry);
+  cache->count--;
+  ms3_cfree(entry);
+}
+
+static void entry_evict(struct ms3_status_cache_st *cache,
+                                 struct status_cache_entry_st *entry)
+{
+  struct status_cache_entry_st **link =
+    &cache->table[entry->hash & (cache->table_size - 1)];
+
+  while (*link != entry)
+  {
+    link = &(*link)->hash_next;
+  }
+
+  entry_remove(cache, link);
+}
+
+/* The functions below take the cache lock and call these */
+
+static bool cache_get(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, bool *found, struct head_response_st *response)
+{
+  struct status_cache_entry_st **link;
+  struct status_cache_entry_st *entry;
+
+  if (!cache->max_entries)
+  {
+    return false;
+  }
+
+  link = find_link(cache, name_hash(bucket, key), bucket, key);
+
+  if (!link)
+  {
+    return false;
+  }
+
+  entry = *link;
+
+  if (entry->expires_ms <= now_ms())
+  {
+    entry_remove(cache, link);
+    return false;
+  }
+
+  lru_unlink(cache, entry);
+  lru_push(cache, entry);
+  *found = entry->found;
+
+  if (response && entry->found)
+  {
+    *response = entry->response;
+  }
+
+  return true;
+}
+
+static void cache_put(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, const struct head_response_st *response)
+{
+  uint32_t hash;
+  struct status_cache_entry_st **link;
+  struct status_cache_entry_st *entry;
+  size_t bucket_length;
+  size_t key_length;
+
+  if (!cache->max_entries)
+  {
+    return;
+  }
+
+  if (!cache->table_size)
+  {
+    size_t table_size = 1;
+
+    while (table_size < cache->max_entries)
+    {
+      table_size <<= 1;
+    }
+
+    cache->table = ms3_ccalloc(table_size, sizeof(struct status_cache_entry_st *));
+
+    // The cache is only an optimisation, carry on without it
+    if (!cache->table)
+    {
+      return;
+    }
+
+    cache->table_size = table_size;
+  }
+
+  hash = name_hash(bucket, key);
+  link = find_link(cache, hash, bucket, key);
+
+  if (link)
+  {
+    entry_remove(cache, link);
+  }
+
+  if (cache->count >= cache->max_entries)
+  {
+    entry_evict(cache, cache->lru_tail);
+  }
+
+  bucket_length = strlen(bucket);
+  key_length = strlen(key);
+  entry = ms3_cmalloc(sizeof(struct status_cache_entry_st) + bucket_length +
+                      key_length + 2);
+
+  if (!entry)
+  {
+    return;
+  }
+
+  entry->hash = hash;
+  entry->expires_ms = now_ms() + cache->ttl_ms;
+  entry->found = response != NULL;
+
+  if (response)
+  {
+    entry->response = *response;
+  }
+  else
+  {
+    memset(&entry->response, 0, sizeof(struct head_response_st));
+  }
+
+  memcpy(entry->name, bucket, bucket_length);
+  entry->name[bucket_length] = '/';
+  memcpy(entry->name + bucket_length + 1, key, key_length + 1);
+
+  link = &cache->table[hash & (cache->table_size - 1)];
+  entry->hash_next = *link;
+  *link = entry;
+  lru_push(cache, entry);
+  cache->count++;
+}
+
+static void cache_invalidate(struct ms3_status_cache_st *cache,
+                             const char *bucket, const char *key)
+{
+  struct status_cache_entry_st **link;
+
+  if (!cache->count || !bucket || !key)
+  {
+    return;
+  }
+
+  link = find_link(cache, name_hash(bucket, key), bucket, key);
+
+  if (link)
+  {
+    entry_remove(cache, link);
+  }
+}
+
+static void cache_clear(struct ms3_status_cache_st *cache)
+{
+  struct status_cache_entry_st *entry = cache->lru_head;
+
+  while (entry)
+  {
+    struct status_cache_entry_st *next = entry->lru_next;
+    ms3_cfree(entry);
+    entry = next;
+  }
+
+  ms3_cfree(cache->table);
+  cache->table = NULL;
+  cache->table_size = 0;
+  cache->lru_head = NULL;
+  cache->lru_tail = NULL;
+  cache->count = 0;
+}
+
+bool status_cache_get(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, bool *found, struct head_response_st *response)
+{
+  bool ret;
+
+  pthread_mutex_lock(&cache->lock);
+  ret = cache_get(cache, bucket, key, found, response);
+  pthread_mutex_unlock(&cache->lock);
+
+  return ret;
+}
+
+uint64_t status_cache_generation(struct ms3_status_cache_st *cache)
+{
+  uint64_t generation;
+
+  pthread_mutex_lock(&cache->lock);
+  generation = cache->generation;
+  pthread_mutex_unlock(&cache->lock);
+
+  return generation;
+}
+
+void status_cache_put(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, const struct head_response_st *response,
+                      uint64_t generation)
+{
+  pthread_mutex_lock(&cache->lock);
+
+  if (cache->generation == generation)
+  {
+    cache_put(cache, bucket, key, response);
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void status_cache_invalidate(struct ms3_status_cache_st *cache,
+                             const char *bucket, const char *key)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache->generation++;
+  cache_invalidate(cache, bucket, key);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void status_cache_clear(struct ms3_status_cache_st *cache)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache->generation++;
+  cache_clear(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
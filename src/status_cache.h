@@ -0,0 +1,80 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define STATUS_CACHE_TTL_DEFAULT_MS 60000
+
+struct status_cache_entry_st;
+
+/* Results of HEAD requests by bucket and key, including keys that were not
+ * found. Entries expire after ttl_ms and the least recently used entry is
+ * dropped once max_entries are held. Safe to use from several threads, the
+ * lock is set up by ms3_init().
+ */
+struct ms3_status_cache_st
+{
+  pthread_mutex_t lock;
+  struct status_cache_entry_st **table;
+  size_t table_size; // Power of two, 0 until the first entry is added
+  struct status_cache_entry_st *lru_head; // Most recently used
+  struct status_cache_entry_st *lru_tail;
+  size_t count;
+  size_t max_entries; // 0 means the cache is disabled
+  uint32_t ttl_ms;
+  uint64_t generation; // Changes whenever an entry is invalidated
+};
+
+/* What a HEAD request tells us about an object */
+struct head_response_st
+{
+  ms3_status_st status;
+  char etag[MAX_ETAG_LENGTH];
+  char content_type[128];
+};
+
+/* Returns true on a hit. found is false for a cached 404, response can be
+ * NULL if only found is wanted.
+ */
+bool status_cache_get(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, bool *found, struct head_response_st *response);
+
+/* To be taken before sending a HEAD and passed to status_cache_put(). A
+ * response which raced with a change to the objects is then not cached.
+ */
+uint64_t status_cache_generation(struct ms3_status_cache_st *cache);
+
+/* A NULL response caches the key as not found. Nothing is cached if anything
+ * was invalidated since generation was taken.
+ */
+void status_cache_put(struct ms3_status_cache_st *cache, const char *bucket,
+                      const char *key, const struct head_response_st *response,
+                      uint64_t generation);
+
+void status_cache_invalidate(struct ms3_status_cache_st *cache,
+                             const char *bucket, const char *key);
+
+void status_cache_clear(struct ms3_status_cache_st *cache);
@@ -0,0 +1,165 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+#include "common.h"
+
+
+static const char hex_digits[] = "0123456789abcdef";
+
+void string_builder_init(struct string_builder_st *builder, char *buffer,
+                         size_t size)
+{
+  builder->data = buffer;
+  builder->length = 0;
+  builder->alloced = size;
+  builder->on_heap = false;
+  builder->failed = false;
+  buffer[0] = '\0';
+}
+
+void string_builder_reset(struct string_builder_st *builder)
+{
+  builder->length = 0;
+
+  if (builder->data)
+  {
+    builder->data[0] = '\0';
+  }
+}
+
+// Makes room for length more bytes and the NUL terminator
+static bool string_builder_reserve(struct string_builder_st *builder,
+                                   size_t length)
+{
+  size_t needed = builder->length + length + 1;
+  size_t new_alloced;
+  char *data;
+
+  if (builder->failed)
+  {
+    return false;
+  }
+
+  if (needed <= builder->alloced)
+  {
+    return true;
+  }
+
+  new_alloced = builder->alloced * 2;
+
+  while (new_alloced < needed)
+  {
+    new_alloced *= 2;
+  }
+
+  if (builder->on_heap)
+  {
+    data = ms3_crealloc(builder->data, new_alloced);
+  }
+  else
+  {
+    data = ms3_cmalloc(new_alloced);
+
+    if (data)
+    {
+      memcpy(data, builder->data, builder->length + 1);
+    }
+  }
+
+  if (!data)
+  {
+    builder->failed = true;
+    return false;
+  }
+
+  builder->data = data;
+  builder->alloced = new_alloced;
+  builder->on_heap = true;
+
+  return true;
+}
+
+void string_builder_append(struct string_builder_st *builder,
+                           const char *data, size_t length)
+{
+  if (!string_builder_reserve(builder, length))
+  {
+    return;
+  }
+
+  memcpy(builder->data + builder->length, data, length);
+  builder->length += length;
+  builder->data[builder->length] = '\0';
+}
+
+void string_builder_append_str(struct string_builder_st *builder,
+                               const char *str)
+{
+  string_builder_append(builder, str, strlen(str));
+}
+
+void string_builder_append_char(struct string_builder_st *builder, char c)
+{
+  if (!string_builder_reserve(builder, 1))
+  {
+    return;
+  }
+
+  builder->data[builder->length++] = c;
+  builder->data[builder->length] = '\0';
+}
+
+void string_builder_append_hex(struct string_builder_st *builder,
+                               const uint8_t *data, size_t length)
+{
+  if (!string_builder_reserve(builder, length * 2))
+  {
+    return;
+  }
+
+  hex_encode(data, length, builder->data + builder->length);
+  builder->length += length * 2;
+}
+
+void string_builder_free(struct string_builder_st *builder)
+{
+  if (builder->on_heap)
+  {
+    ms3_cfree(builder->data);
+  }
+
+  builder->data = NULL;
+  builder->length = 0;
+  builder->alloced = 0;
+  builder->on_heap = false;
+}
+
+void hex_encode(const uint8_t *data, size_t length, char *out)
+{
+  size_t pos;
+
+  for (pos = 0; pos < length; pos++)
+  {
+    out[pos * 2] = hex_digits[data[pos] >> 4];
+    out[pos * 2 + 1] = hex_digits[data[pos] & 0x0f];
+  }
+
+  out[length * 2] = '\0';
+}
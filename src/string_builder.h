@@ -0,0 +1,66 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* A string which keeps track of its own length. It starts out in a buffer
+ * given by the caller, usually on the stack, and only moves to the heap if
+ * that is too small. After an allocation failure further appends are dropped
+ * and failed is set, so callers only need to check once at the end.
+ */
+struct string_builder_st
+{
+  char *data; // Always NUL terminated
+  size_t length;
+  size_t alloced;
+  bool on_heap;
+  bool failed;
+};
+
+void string_builder_init(struct string_builder_st *builder, char *buffer,
+                         size_t size);
+
+// Empties the builder, keeping whatever space it already has
+void string_builder_reset(struct string_builder_st *builder);
+
+void string_builder_append(struct string_builder_st *builder,
+                           const char *data, size_t length);
+
+void string_builder_append_str(struct string_builder_st *builder,
+                               const char *str);
+
+void string_builder_append_char(struct string_builder_st *builder, char c);
+
+// Appends length bytes of data as lower case hex
+void string_builder_append_hex(struct string_builder_st *builder,
+                               const uint8_t *data, size_t length);
+
+// Frees the heap copy if there is one
+void string_builder_free(struct string_builder_st *builder);
+
+/* Writes length bytes of data as lower case hex to out, which must hold
+ * length * 2 + 1 bytes. The result is NUL terminated.
+ */
+void hex_encode(const uint8_t *data, size_t length, char *out);
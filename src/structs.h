@@ -20,6 +20,7 @@
 #pragma once
 
 #include "config.h"
+#include <pthread.h>
 
 struct ms3_pool_alloc_list_st
 {
@@ -36,6 +37,36 @@ struct ms3_list_container_st
   size_t pool_free;
 };
 
+/* Why a request failed. Kept in fixed buffers so recording a failure
+ * doesn't allocate, anything longer is truncated. result is 0 until
+ * something has been recorded.
+ */
+struct request_error_st
+{
+  uint8_t result; // MS3_ERR_* code
+  long status; // HTTP status, 0 if there was no response
+  bool retryable;
+  char code[64]; // S3 error code such as NoSuchKey
+  char message[512];
+  char request_id[64];
+};
+
+/* The headers of a response which are parsed for every request */
+struct response_st
+{
+  long status;
+  uint64_t content_length;
+  time_t last_modified;
+  char etag[MAX_ETAG_LENGTH];
+  char content_type[128];
+  char content_range[128];
+  char request_id[64];
+  char *amz_headers; // x-amz-* headers as "name\0value\0" pairs
+  size_t amz_length;
+  size_t amz_alloced;
+  size_t amz_count;
+};
+
 struct ms3_st
 {
   char *s3key;
@@ -50,28 +81,66 @@ struct ms3_st
   char *sts_region;
   char *iam_endpoint;
   char *iam_role;
-  char *role_key;
-  char *role_secret;
-  char *role_session_token;
+  struct credentials_st *role_credentials; // NULL to use s3key / s3secret
   char *iam_role_arn;
   size_t role_session_duration;
+  credential_provider_fn credential_provider; // NULL for fixed credentials
+  ms3_credential_callback credential_callback;
+  void *credential_userdata;
+  time_t credential_expiration; // 0 if the credentials don't expire
+  time_t credential_refresh_window;
+  time_t refresh_failed; // When a refresh before expiry last failed, 0 if not
+  struct instance_credentials_st *instance_credentials; // Shared, not owned
 
   size_t buffer_chunk_size;
-  CURL *curl;
-  char *last_error;
   bool use_http;
   bool no_content_type;
+  const char *content_type_out;
+  const ms3_header_st *headers_out; // Signed and sent when creating objects
+  size_t header_out_count;
   bool disable_verification;
   uint8_t list_version;
   uint8_t protocol_version;
-  bool first_run;
-  char *path_buffer;
-  char *query_buffer;
   void *read_cb;
   void *user_data;
-  const char *content_type_out;
+  struct ms3_buffer_pool_st buffer_pool;
+  struct ms3_status_cache_st status_cache;
+  struct ms3_disk_cache_st disk_cache;
+  size_t part_size;
+  size_t max_parallel;
+  size_t copy_threshold; // Larger copies use multipart copy
+
+  // Everything below is what lets several threads use the handle at once
+  pthread_key_t context_key; // The calling thread's context
+  bool has_context_key; // False if the process ran out of keys
+  pthread_mutex_t credential_lock; // Protects role_credentials and credential_expiration
+  pthread_mutex_t refresh_lock; // Held by the thread refreshing credentials
+  CURLSH *curl_share; // DNS cache and TLS sessions of all the threads
+  pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+};
+
+/* The state of the calls made by one thread on a handle. Results such as the
+ * last error, ETag and list are kept here so threads don't see each other's.
+ */
+struct ms3_context_st
+{
+  ms3_st *ms3; // The handle this belongs to
+  pthread_t thread;
+  CURL *curl;
+  bool first_run;
+  struct request_error_st error; // Of the last call which failed
+  ms3_error_st last_error; // Filled in by ms3_last_error()
   char content_type_in[128]; // max length allowed for mime types
+  char etag_in[MAX_ETAG_LENGTH]; // ETag of the last GET
+  struct response_st response; // Of the last request to finish
+  ms3_response_st last_response; // Filled in by ms3_last_response()
+  ms3_header_st *amz_headers;
+  size_t amz_headers_alloced;
   struct ms3_list_container_st list_container;
+  CURLM *curl_multi; // Created on first parallel use
+  struct parallel_slot_st *parallel_slots;
+  size_t parallel_slot_count;
+  struct ms3_context_st *next; // In the list of every handle's contexts
 };
 
 struct memory_buffer_st
@@ -80,6 +149,18 @@ struct memory_buffer_st
   size_t length;
   size_t alloced;
   size_t buffer_chunk_size;
+  struct ms3_buffer_pool_st *pool; // NULL to use plain realloc
+  bool terminate; // Keep a NUL after the data, not done for caller's buffers
+};
+
+struct file_buffer_st
+{
+  int fd;
+  off_t base; // -1 if fd can't seek, data is then written sequentially
+  size_t length;
+  long status; // HTTP status of the response currently being received
+  int write_errno;
+  struct memory_buffer_st error; // Body of a non-2xx response
 };
 
 struct put_buffer_st
@@ -88,3 +169,56 @@ struct put_buffer_st
   size_t length;
   size_t offset;
 };
+
+/* A request body read from a file while it is being sent */
+struct upload_source_st
+{
+  int fd;
+  off_t offset; // Where the body starts in the file
+  size_t length;
+  size_t position; // How much curl has read so far
+  int read_errno;
+};
+
+/* Everything about a single request. Requests are set up one at a time on the
+ * handle but can then be in flight in parallel on their own curl handles.
+ */
+struct request_st
+{
+  command_t cmd;
+  const char *bucket;
+  const char *object;
+  const char *source_bucket;
+  const char *source_object;
+  const char *copy_range; // x-amz-copy-source-range of a part copy
+  const char *filter;
+  char *continuation;
+  const char *query; // Sub-resource query string, already in canonical order
+  const uint8_t *data;
+  size_t data_size;
+  struct upload_source_st *upload; // Body comes from a file instead of data
+  const char *payload_hash; // Hex SHA-256 of the body if already known
+  const char *content_type; // Sent instead of the handle's if not NULL
+  const ms3_header_st *extra_headers; // Sent instead of the handle's if set
+  size_t extra_header_count;
+  const char *if_none_match; // Conditions of a GET, NULL / 0 if not used
+  time_t if_modified_since;
+  void *ret_ptr;
+
+  // Internal state of the request while it runs
+  CURL *curl;
+  struct curl_slist *headers;
+  struct memory_buffer_st mem;
+  struct response_st response;
+  struct request_error_st error;
+  struct memory_buffer_st *get_buffer;
+  struct file_buffer_st *get_file;
+};
+
+struct parallel_slot_st
+{
+  CURL *curl;
+  struct request_st request;
+  size_t index;
+  bool busy;
+};
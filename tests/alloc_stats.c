@@ -0,0 +1,94 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+
+#include "tests/s3mock.h"
+
+/* Tests the allocation statistics, including that a handle frees
+ * everything it allocated
+ */
+
+int main(int argc, char *argv[])
+{
+  int res;
+  size_t site_count;
+  size_t site_it;
+  uint8_t *data = NULL;
+  size_t length = 0;
+  ms3_alloc_stats_st sites[256];
+  ms3_alloc_stats_st total;
+  ms3_list_st *list = NULL;
+  s3mock_st *mock;
+  ms3_st *ms3;
+
+  (void) argc;
+  (void) argv;
+
+  ASSERT_EQ(0, ms3_alloc_stats_enable());
+  ms3_library_init();
+  // Too late once the library has started allocating
+  ASSERT_EQ(MS3_ERR_PARAMETER, ms3_alloc_stats_enable());
+
+  mock = s3mock_start();
+  ASSERT_NOT_NULL(mock);
+  ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(ms3);
+
+  res = ms3_put(ms3, "stats", "test/alloc", (const uint8_t *)"stats", 5);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  ms3_alloc_stats_reset();
+  res = ms3_get(ms3, "stats", "test/alloc", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_alloc_stats(NULL, 0, &total);
+  ASSERT_TRUE(total.file == NULL);
+  ASSERT_TRUE(total.allocations > 0);
+  ASSERT_TRUE(total.bytes >= 5);
+  ASSERT_TRUE(total.peak_live_bytes >= total.live_bytes);
+  ms3_free(data);
+
+  res = ms3_list(ms3, "stats", "test/", &list);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_NOT_NULL(list);
+
+  site_count = ms3_alloc_stats(sites, 256, &total);
+  ASSERT_TRUE(site_count > 0 && site_count <= 256);
+
+  for (site_it = 0; site_it < site_count; site_it++)
+  {
+    ASSERT_NOT_NULL(sites[site_it].file);
+    ASSERT_TRUE(sites[site_it].line > 0);
+  }
+
+  res = ms3_delete(ms3, "stats", "test/alloc");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_deinit(ms3);
+  s3mock_stop(mock);
+
+  // Nothing is left allocated once the handle is gone
+  ms3_alloc_stats(sites, 256, &total);
+  ASSERT_EQ_(total.live_bytes, 0, "%zu bytes still allocated",
+             (size_t)total.live_bytes);
+
+  ms3_library_deinit();
+  return 0;
+}
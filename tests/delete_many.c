@@ -0,0 +1,133 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+
+/* Tests deleting many keys with DeleteObjects in parallel batches */
+
+#define KEY_COUNT 2100
+
+int main(int argc, char *argv[])
+{
+  int res;
+  size_t key_it;
+  size_t max_parallel = 3;
+  ms3_st *ms3;
+  ms3_list_st *list = NULL;
+  ms3_status_st status;
+  char **keys = calloc(KEY_COUNT + 1, sizeof(char *));
+  uint8_t *results = malloc(KEY_COUNT + 1);
+  char long_key[1100];
+  const uint8_t *test_string = (const uint8_t *)"Another one bites the dust";
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+
+  // Three batches, some keys need escaping in the XML body
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    keys[key_it] = malloc(64);
+    snprintf(keys[key_it], 64, "test/delete_many/%s%zu",
+             key_it % 100 ? "" : "a&b <c> ", key_it);
+    res = ms3_put(ms3, s3bucket, keys[key_it], test_string,
+                  strlen((const char *)test_string));
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+  }
+
+  res = ms3_delete_many(ms3, s3bucket, (const char **)keys, KEY_COUNT, results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    ASSERT_EQ_(results[key_it], 0, "Key %zu result: %u", key_it,
+               results[key_it]);
+  }
+
+  res = ms3_list(ms3, s3bucket, "test/delete_many/", &list);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_TRUE_(list == NULL, "Keys left after delete");
+
+  // A key S3 refuses only fails that key, deleting the rest is fine
+  res = ms3_put(ms3, s3bucket, keys[1], test_string,
+                strlen((const char *)test_string));
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  memset(long_key, 'x', sizeof(long_key) - 1);
+  long_key[sizeof(long_key) - 1] = '\0';
+  keys[0] = long_key;
+  res = ms3_delete_many(ms3, s3bucket, (const char **)keys, 2, results);
+  ASSERT_EQ_(res, MS3_ERR_SERVER, "Result: %u", res);
+  ASSERT_EQ(results[0], MS3_ERR_SERVER);
+  ASSERT_EQ(results[1], 0);
+  ASSERT_NOT_NULL(ms3_server_error(ms3));
+  printf("Error: %.60s\n", ms3_server_error(ms3));
+  res = ms3_status(ms3, s3bucket, keys[1], &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+
+  // No keys is not an error
+  res = ms3_delete_many(ms3, s3bucket, NULL, 0, NULL);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 1; key_it < KEY_COUNT; key_it++)
+  {
+    free(keys[key_it]);
+  }
+
+  free(keys);
+  free(results);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
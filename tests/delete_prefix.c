@@ -0,0 +1,135 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+#include <inttypes.h>
+
+/* Tests deleting everything under a prefix while it is being listed */
+
+#define KEY_COUNT 2345
+
+static void progress_callback(const ms3_delete_progress_st *progress,
+                              void *userdata)
+{
+  size_t *calls = (size_t *)userdata;
+
+  (*calls)++;
+  printf("Listed %" PRIu64 " deleted %" PRIu64 " failed %" PRIu64 "\n",
+         progress->listed, progress->deleted, progress->failed);
+}
+
+int main(int argc, char *argv[])
+{
+  int res;
+  size_t key_it;
+  size_t calls = 0;
+  size_t max_parallel = 3;
+  char key[64];
+  ms3_st *ms3;
+  ms3_list_st *list = NULL;
+  ms3_delete_progress_st progress;
+  const uint8_t *test_string = (const uint8_t *)"Another one bites the dust";
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+
+  // Several pages of keys, including a directory marker
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    snprintf(key, sizeof(key), "test/delete_prefix/%s%zu",
+             key_it % 2 ? "dir/" : "", key_it);
+    res = ms3_put(ms3, s3bucket, key, test_string,
+                  strlen((const char *)test_string));
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+  }
+
+  res = ms3_put(ms3, s3bucket, "test/delete_prefix/dir/", test_string, 1);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_put(ms3, s3bucket, "test/delete_prefix_keep", test_string,
+                strlen((const char *)test_string));
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  res = ms3_delete_prefix(ms3, s3bucket, "test/delete_prefix/",
+                          progress_callback, &calls, &progress);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(progress.listed, KEY_COUNT + 1);
+  ASSERT_EQ(progress.deleted, KEY_COUNT + 1);
+  ASSERT_EQ(progress.failed, 0);
+  ASSERT_TRUE(calls >= 3);
+
+  res = ms3_list(ms3, s3bucket, "test/delete_prefix/", &list);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_TRUE_(list == NULL, "Keys left after delete");
+
+  // Only the prefix is deleted
+  res = ms3_list(ms3, s3bucket, "test/delete_prefix", &list);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_NOT_NULL(list);
+  ASSERT_STREQ(list->key, "test/delete_prefix_keep");
+  ASSERT_TRUE(list->next == NULL);
+
+  // Nothing to delete is fine
+  res = ms3_delete_prefix(ms3, s3bucket, "test/delete_prefix/", NULL, NULL,
+                          &progress);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(progress.listed, 0);
+
+  res = ms3_delete(ms3, s3bucket, "test/delete_prefix_keep");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
@@ -0,0 +1,115 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+#include <time.h>
+
+/* Tests conditional GETs with If-None-Match and If-Modified-Since */
+
+int main(int argc, char *argv[])
+{
+  int res;
+  ms3_buffer_st get_buffer = {NULL, 0, 0};
+  char etag[128];
+  time_t after_put;
+  ms3_st *ms3;
+  const char *test_string = "Another one bites the dust";
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+
+  res = ms3_put(ms3, s3bucket, "test/get_if_changed.dat",
+                (const uint8_t *)test_string, strlen(test_string));
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  after_put = time(NULL);
+
+  // Without conditions it is a plain GET which reports the ETag
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed.dat", NULL, 0,
+                           &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, strlen(test_string));
+  ASSERT_NOT_NULL(ms3_get_etag(ms3));
+  snprintf(etag, sizeof(etag), "%s", ms3_get_etag(ms3));
+
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed.dat", etag, 0,
+                           &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_MODIFIED, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 0);
+  ASSERT_STREQ(ms3_get_etag(ms3), etag);
+
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed.dat",
+                           "\"00000000000000000000000000000000\"", 0, &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, strlen(test_string));
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_string, strlen(test_string)));
+
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed.dat", NULL,
+                           after_put, &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_MODIFIED, "Result: %u", res);
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed.dat", NULL,
+                           after_put - 86400, &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, strlen(test_string));
+
+  res = ms3_get_if_changed(ms3, s3bucket, "test/get_if_changed_missing.dat",
+                           etag, 0, &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+
+  ms3_buffer_free(ms3, &get_buffer);
+  res = ms3_delete(ms3, s3bucket, "test/get_if_changed.dat");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
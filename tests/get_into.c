@@ -0,0 +1,124 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+
+/* Tests GET into a reusable buffer with and without the buffer pool */
+
+int main(int argc, char *argv[])
+{
+  int res;
+  ms3_buffer_st get_buffer = {NULL, 0, 0};
+  uint8_t *first_data;
+  size_t pool_size = 1024 * 1024;
+  ms3_st *ms3;
+  char *test_string = malloc(64 * 1024);
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+  memset(test_string, 'a', 64 * 1024);
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+
+  res = ms3_put(ms3, s3bucket, "test/get_into.dat",
+                (const uint8_t *)test_string, 64 * 1024);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_put(ms3, s3bucket, "test/get_into_small.dat",
+                (const uint8_t *)test_string, 1024);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  res = ms3_get_into(ms3, s3bucket, "test/get_into.dat", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 64 * 1024);
+  ASSERT_TRUE(get_buffer.alloced >= get_buffer.length);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_string, 64 * 1024));
+  first_data = get_buffer.data;
+
+  // A smaller object fits in the same allocation
+  res = ms3_get_into(ms3, s3bucket, "test/get_into_small.dat", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 1024);
+  ASSERT_TRUE(get_buffer.data == first_data);
+
+  // Errors hand the buffer back empty
+  res = ms3_get_into(ms3, s3bucket, "test/get_into_missing.dat", &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 0);
+  ASSERT_TRUE(get_buffer.data == first_data);
+  ms3_buffer_free(ms3, &get_buffer);
+  ASSERT_NULL_(get_buffer.data, "Buffer not reset");
+
+  // With a pool a freed buffer is handed out again
+  res = ms3_set_option(ms3, MS3_OPT_BUFFER_POOL_SIZE, &pool_size);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, s3bucket, "test/get_into.dat", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 64 * 1024);
+  ASSERT_EQ(get_buffer.alloced, 64 * 1024);
+  first_data = get_buffer.data;
+  ms3_buffer_free(ms3, &get_buffer);
+  res = ms3_get_into(ms3, s3bucket, "test/get_into.dat", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_TRUE(get_buffer.data == first_data);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_string, 64 * 1024));
+  ms3_buffer_free(ms3, &get_buffer);
+
+  res = ms3_delete(ms3, s3bucket, "test/get_into.dat");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_delete(ms3, s3bucket, "test/get_into_small.dat");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  free(test_string);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Tests GET straight to a file and to a file descriptor */
+
+int main(int argc, char *argv[])
+{
+  int res;
+  int fd;
+  struct stat file_stat;
+  ms3_st *ms3;
+  char filename[] = "/tmp/ms3_get_to_file_XXXXXX";
+  char *test_string = malloc(1024 * 1024);
+  char *read_string = malloc(1024 * 1024 + 5);
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+  memset(test_string, 'f', 1024 * 1024);
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+
+  res = ms3_put(ms3, s3bucket, "test/get_to_file.dat",
+                (const uint8_t *)test_string, 1024 * 1024);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  fd = mkstemp(filename);
+  ASSERT_TRUE(fd >= 0);
+  close(fd);
+
+  res = ms3_get_to_file(ms3, s3bucket, "test/get_to_file.dat", filename);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(0, stat(filename, &file_stat));
+  ASSERT_EQ(file_stat.st_size, 1024 * 1024);
+
+  // Written after what is already there, the offset is left at the end
+  fd = open(filename, O_RDWR | O_TRUNC);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ(5, write(fd, "head:", 5));
+  res = ms3_get_to_fd(ms3, s3bucket, "test/get_to_file.dat", fd);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 1024 * 1024 + 5);
+  ASSERT_EQ(1024 * 1024 + 5, pread(fd, read_string, 1024 * 1024 + 5, 0));
+  ASSERT_EQ(0, memcmp(read_string, "head:", 5));
+  ASSERT_EQ(0, memcmp(read_string + 5, test_string, 1024 * 1024));
+  close(fd);
+
+  // A failed GET leaves the existing file as it was
+  res = ms3_get_to_file(ms3, s3bucket, "test/get_to_file_missing.dat",
+                        filename);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  ASSERT_EQ(0, stat(filename, &file_stat));
+  ASSERT_EQ(file_stat.st_size, 1024 * 1024 + 5);
+  ASSERT_EQ(0, unlink(filename));
+
+  res = ms3_delete(ms3, s3bucket, "test/get_to_file.dat");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  free(test_string);
+  free(read_string);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
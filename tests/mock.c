@@ -0,0 +1,1004 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "tests/s3mock.h"
+
+/* Tests against the mock S3 server: paging, multipart and the latency and
+ * error injection that can't be reproduced against a real service
+ */
+
+static size_t list_count(ms3_list_st *list)
+{
+  size_t count = 0;
+
+  for (; list; list = list->next)
+  {
+    count++;
+  }
+
+  return count;
+}
+
+struct provider_state_st
+{
+  s3mock_st *mock;
+  uint32_t calls;
+  time_t lifetime; // Seconds the credentials handed out are valid for
+  bool known; // Whether the server is told about the credentials
+  uint8_t fail; // Returned instead of credentials when set
+  uint32_t failures;
+  char key[32];
+  char secret[48];
+};
+
+static uint8_t mock_provider(ms3_st *ms3, ms3_credentials_st *credentials,
+                             void *userdata)
+{
+  struct provider_state_st *state = (struct provider_state_st *)userdata;
+
+  (void) ms3;
+
+  if (state->fail)
+  {
+    state->failures++;
+    return state->fail;
+  }
+
+  state->calls++;
+  snprintf(state->key, sizeof(state->key), "PROVIDERKEY%08" PRIu32,
+           state->calls);
+  snprintf(state->secret, sizeof(state->secret), "providersecret%08" PRIu32,
+           state->calls);
+
+  if (state->known)
+  {
+    s3mock_add_credentials(state->mock, state->key, state->secret);
+  }
+
+  credentials->key = state->key;
+  credentials->secret = state->secret;
+  credentials->token = "providertoken";
+  credentials->expiration = time(NULL) + state->lifetime;
+  return 0;
+}
+
+#define SHARED_THREADS 4
+
+/* One of several threads using the same handle. Each works on its own
+ * object of a different size so results mixed up between threads show.
+ */
+struct shared_thread_st
+{
+  pthread_t thread;
+  ms3_st *ms3;
+  size_t index;
+  const char *failed; // What went wrong, NULL if nothing
+};
+
+static void *shared_thread(void *arg)
+{
+  struct shared_thread_st *state = (struct shared_thread_st *)arg;
+  const ms3_response_st *last;
+  const ms3_error_st *thread_error;
+  uint8_t thread_data[1024];
+  uint8_t *got = NULL;
+  size_t got_length;
+  size_t thread_length = 100 + state->index;
+  ms3_status_st thread_status;
+  char thread_key[32];
+  int round;
+
+  memset(thread_data, (int)state->index, sizeof(thread_data));
+  snprintf(thread_key, sizeof(thread_key), "thread%zu", state->index);
+
+  for (round = 0; round < 20 && !state->failed; round++)
+  {
+    if (ms3_get(state->ms3, "mock", "thread_missing", &got, &got_length) !=
+        MS3_ERR_NOT_FOUND)
+    {
+      state->failed = "missing object found";
+    }
+    else if (!(last = ms3_last_response(state->ms3)) || last->status != 404)
+    {
+      state->failed = "missing object status";
+    }
+    else if (!(thread_error = ms3_last_error(state->ms3)) ||
+             thread_error->status != 404)
+    {
+      state->failed = "missing object error";
+    }
+    else if (ms3_put(state->ms3, "mock", thread_key, thread_data,
+                     thread_length))
+    {
+      state->failed = "put";
+    }
+    else if (ms3_status(state->ms3, "mock", thread_key, &thread_status) ||
+             thread_status.length != thread_length)
+    {
+      state->failed = "status";
+    }
+    else if (ms3_get(state->ms3, "mock", thread_key, &got, &got_length) ||
+             got_length != thread_length ||
+             memcmp(got, thread_data, thread_length))
+    {
+      state->failed = "get";
+    }
+    else if (!(last = ms3_last_response(state->ms3)) || last->status != 200 ||
+             last->content_length != thread_length || !ms3_get_etag(state->ms3))
+    {
+      state->failed = "get response";
+    }
+    else if (strcmp(ms3_get_content_type(state->ms3), "text/plain"))
+    {
+      state->failed = "content type set on the handle";
+    }
+
+    ms3_free(got);
+    got = NULL;
+  }
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int res;
+  int fd;
+  size_t key_it;
+  size_t part_size = 4096;
+  uint8_t *big_data;
+  size_t big_length = 2 * 5 * 1024 * 1024 + 20000;
+  uint8_t *chunked_data;
+  size_t chunked_length = 3 * 1024 * 1024 + 12345;
+  uint8_t list_version;
+  uint8_t *data = NULL;
+  size_t length = 0;
+  time_t last_modified;
+  char key[64];
+  char long_key[1001];
+  char *keys[11];
+  uint8_t results[11];
+  ms3_status_st statuses[11];
+  uint64_t post_count;
+  uint64_t head_count;
+  size_t max_parallel;
+  size_t cache_size;
+  float cache_ttl;
+  const char *cache_keys[] = { "cached", "missing" };
+  const ms3_header_st extra_headers[] =
+  {
+    { "X-Amz-Storage-Class", "STANDARD" },
+    { "x-amz-meta-colour", "  dark   blue " },
+    { "x-amz-meta-empty", "" }
+  };
+  const ms3_header_st reserved_header = { "x-amz-date", "20260101T000000Z" };
+  size_t copy_threshold;
+  ms3_delete_progress_st progress;
+  char filename[] = "/tmp/ms3_mock_XXXXXX";
+  char restore_file[] = "/tmp/ms3_restore_XXXXXX";
+  char restored[16];
+  char cache_dir[] = "/tmp/ms3_cache_XXXXXX";
+  char cache_file[300];
+  uint64_t get_count;
+  uint8_t flip;
+  ms3_buffer_st get_buffer = { NULL, 0, 0 };
+  DIR *dir;
+  struct dirent *dirent;
+  const ms3_response_st *response;
+  const ms3_error_st *error;
+  struct provider_state_st provider;
+  size_t refresh_window;
+  char sts_endpoint[64];
+  ms3_st *role_ms3;
+  ms3_st *second_ms3;
+  char ecs_uri[128];
+  int wait_it;
+  struct shared_thread_st shared[SHARED_THREADS];
+  size_t thread_it;
+  uint8_t test_data[20000];
+  ms3_list_st *list = NULL;
+  ms3_status_st status;
+  struct timespec start, end;
+  s3mock_st *mock;
+  ms3_st *ms3;
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  mock = s3mock_start();
+  ASSERT_NOT_NULL(mock);
+  ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(ms3);
+
+  memset(test_data, 'm', sizeof(test_data));
+
+  // Listing pages through a small page size with both list versions
+  s3mock_set_max_keys(mock, 3);
+
+  for (key_it = 0; key_it < 10; key_it++)
+  {
+    snprintf(key, sizeof(key), "list/%zu", key_it);
+    res = ms3_put(ms3, "mock", key, test_data, 10);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+  }
+
+  res = ms3_put(ms3, "mock", "list/dir/inner", test_data, 10);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (list_version = 1; list_version <= 2; list_version++)
+  {
+    ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_FORCE_LIST_VERSION,
+                                &list_version));
+    res = ms3_list(ms3, "mock", "list/", &list);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+    ASSERT_EQ(list_count(list), 11);
+  }
+
+  // The directory is a single common prefix entry, small pages make the
+  // delimiter go out with a marker or continuation token
+  s3mock_set_max_keys(mock, 4);
+
+  for (list_version = 1; list_version <= 2; list_version++)
+  {
+    ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_FORCE_LIST_VERSION,
+                                &list_version));
+    res = ms3_list_dir(ms3, "mock", "list/", &list);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+    ASSERT_EQ(list_count(list), 11);
+  }
+
+  s3mock_set_max_keys(mock, 1000);
+
+  // Keys which escape to more than the stack buffers move to the heap
+  memset(long_key, ' ', sizeof(long_key) - 1);
+  memcpy(long_key, "long/", 5);
+  long_key[sizeof(long_key) - 2] = 'x';
+  long_key[sizeof(long_key) - 1] = '\0';
+  res = ms3_put(ms3, "mock", long_key, test_data, 10);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get(ms3, "mock", long_key, &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, 10);
+  ms3_free(data);
+
+  for (list_version = 1; list_version <= 2; list_version++)
+  {
+    ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_FORCE_LIST_VERSION,
+                                &list_version));
+    res = ms3_list(ms3, "mock", long_key, &list);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+    ASSERT_EQ(list_count(list), 1);
+  }
+
+  res = ms3_delete(ms3, "mock", long_key);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  list_version = 1;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_FORCE_LIST_VERSION, &list_version));
+
+  // Parts smaller than S3 allows are refused, a multipart upload is created
+  // with the content type and headers set on the handle
+  ASSERT_EQ(MS3_ERR_PARAMETER,
+            ms3_set_option(ms3, MS3_OPT_PART_SIZE, &part_size));
+  part_size = 5 * 1024 * 1024;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_PART_SIZE, &part_size));
+  big_data = malloc(big_length);
+  ASSERT_NOT_NULL(big_data);
+
+  for (key_it = 0; key_it < big_length; key_it++)
+  {
+    big_data[key_it] = (uint8_t)(key_it * 7);
+  }
+
+  fd = mkstemp(filename);
+  ASSERT_TRUE(fd >= 0);
+  unlink(filename);
+  ASSERT_EQ((ssize_t)big_length, write(fd, big_data, big_length));
+  ms3_set_content_type(ms3, "text/plain");
+  ASSERT_EQ(0, ms3_set_headers(ms3, &extra_headers[1], 1));
+  res = ms3_put_file(ms3, "mock", "multipart", fd, 0, big_length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(0, ms3_set_headers(ms3, NULL, 0));
+  ms3_set_content_type(ms3, NULL);
+  close(fd);
+  // Create, three parts and complete
+  ASSERT_EQ(s3mock_method_count(mock, "POST"), 2);
+  ASSERT_EQ(s3mock_method_count(mock, "PUT"), 15);
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, big_length);
+  ASSERT_EQ(0, memcmp(data, big_data, big_length));
+  ASSERT_STREQ(ms3_get_content_type(ms3), "text/plain");
+  ms3_free(data);
+
+  res = ms3_status(ms3, "mock", "multipart", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(status.length, big_length);
+
+  // A failed download leaves the file which was there alone, a good one
+  // replaces it
+  fd = mkstemp(restore_file);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ(4, write(fd, "keep", 4));
+  close(fd);
+  res = ms3_get_to_file(ms3, "mock", "missing", restore_file);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  fd = open(restore_file, O_RDONLY);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ(4, read(fd, restored, sizeof(restored)));
+  ASSERT_EQ(0, memcmp(restored, "keep", 4));
+  close(fd);
+  res = ms3_get_to_file(ms3, "mock", "multipart", restore_file);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  fd = open(restore_file, O_RDONLY);
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ((off_t)big_length, lseek(fd, 0, SEEK_END));
+  close(fd);
+  ASSERT_EQ(0, unlink(restore_file));
+
+  // Copies above the threshold are multipart copies of parallel ranges,
+  // keeping the content type and metadata of the source. The server would
+  // refuse them as a single copy.
+  s3mock_set_max_copy_size(mock, 10000);
+  copy_threshold = 10000;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_COPY_THRESHOLD, &copy_threshold));
+  post_count = s3mock_method_count(mock, "POST");
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_move(ms3, "mock", "multipart", "mock", "multipart_moved");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  // Create and complete
+  ASSERT_EQ(s3mock_method_count(mock, "POST"), post_count + 2);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  res = ms3_get(ms3, "mock", "multipart_moved", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, big_length);
+  ASSERT_STREQ(ms3_get_content_type(ms3), "text/plain");
+  response = ms3_last_response(ms3);
+  ASSERT_EQ(response->amz_header_count, 2);
+  ASSERT_STREQ(response->amz_headers[1].name, "x-amz-meta-colour");
+  ASSERT_STREQ(response->amz_headers[1].value, "dark blue");
+  ms3_free(data);
+
+  post_count = s3mock_method_count(mock, "POST");
+  res = ms3_copy(ms3, "mock", "multipart_moved", "mock", "multipart");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "POST"), post_count + 2);
+  res = ms3_delete(ms3, "mock", "multipart_moved");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, big_length);
+  ASSERT_EQ(0, memcmp(data, big_data, big_length));
+  ms3_free(data);
+  free(big_data);
+  res = ms3_copy(ms3, "mock", "missing", "mock", "multipart_copy");
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+
+  // Injected errors map to the right error codes, the details of the last
+  // failure are kept
+  s3mock_inject_error(mock, 503, "SlowDown", 1);
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, MS3_ERR_SERVER, "Result: %u", res);
+  error = ms3_last_error(ms3);
+  ASSERT_NOT_NULL(error);
+  ASSERT_EQ(error->result, MS3_ERR_SERVER);
+  ASSERT_EQ(error->status, 503);
+  ASSERT_STREQ(error->code, "SlowDown");
+  ASSERT_NOT_NULL(error->message);
+  ASSERT_NOT_NULL(error->request_id);
+  ASSERT_TRUE(error->retryable);
+  s3mock_inject_error(mock, 403, "AccessDenied", 1);
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, MS3_ERR_AUTH, "Result: %u", res);
+  ASSERT_FALSE(ms3_last_error(ms3)->retryable);
+  res = ms3_get(ms3, "mock", "missing", &data, &length);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  error = ms3_last_error(ms3);
+  ASSERT_EQ(error->status, 404);
+  ASSERT_STREQ(error->code, "NoSuchKey");
+  ASSERT_STREQ(error->message, ms3_server_error(ms3));
+  ASSERT_FALSE(error->retryable);
+  // Success leaves the last failure in place
+  res = ms3_get(ms3, "mock", "multipart", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_free(data);
+  ASSERT_EQ(ms3_last_error(ms3)->result, MS3_ERR_NOT_FOUND);
+
+  // Latency is added to every response
+  s3mock_set_latency(mock, 50);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  res = ms3_status(ms3, "mock", "multipart", &status);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_TRUE((end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_nsec - start.tv_nsec) / 1000000 >= 50);
+  s3mock_set_latency(mock, 0);
+
+  res = ms3_delete(ms3, "mock", "multipart");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_object_count(mock), 11);
+
+  // A multi-object delete is one request, a failed request fails every key
+  for (key_it = 0; key_it < 10; key_it++)
+  {
+    keys[key_it] = malloc(16);
+    snprintf(keys[key_it], 16, "list/%zu", key_it);
+  }
+
+  keys[10] = strdup("list/dir/inner");
+  s3mock_inject_error(mock, 500, "InternalError", 1);
+  res = ms3_delete_many(ms3, "mock", (const char **)keys, 11, results);
+  ASSERT_EQ_(res, MS3_ERR_SERVER, "Result: %u", res);
+
+  for (key_it = 0; key_it < 11; key_it++)
+  {
+    ASSERT_EQ(results[key_it], MS3_ERR_SERVER);
+  }
+
+  ASSERT_EQ(s3mock_object_count(mock), 11);
+
+  // Batch HEADs report each key, an error stops the keys not yet sent
+  res = ms3_status_many(ms3, "mock", (const char **)keys, 11, statuses,
+                        results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 0; key_it < 11; key_it++)
+  {
+    ASSERT_EQ(results[key_it], 0);
+    ASSERT_EQ(statuses[key_it].length, 10);
+  }
+
+  max_parallel = 1;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+  head_count = s3mock_method_count(mock, "HEAD");
+  s3mock_inject_error(mock, 500, "InternalError", 1);
+  res = ms3_status_many(ms3, "mock", (const char **)keys, 11, statuses,
+                        results);
+  ASSERT_EQ_(res, MS3_ERR_SERVER, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+
+  for (key_it = 0; key_it < 11; key_it++)
+  {
+    ASSERT_EQ(results[key_it], MS3_ERR_SERVER);
+  }
+
+  max_parallel = 4;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+
+  post_count = s3mock_method_count(mock, "POST");
+  res = ms3_delete_many(ms3, "mock", (const char **)keys, 11, results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "POST"), post_count + 1);
+  ASSERT_EQ(s3mock_object_count(mock), 0);
+
+  for (key_it = 0; key_it < 11; key_it++)
+  {
+    ASSERT_EQ(results[key_it], 0);
+  }
+
+  // Missing keys are reported per key without failing the call
+  res = ms3_status_many(ms3, "mock", (const char **)keys, 11, statuses,
+                        results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 0; key_it < 11; key_it++)
+  {
+    ASSERT_EQ(results[key_it], MS3_ERR_NOT_FOUND);
+    free(keys[key_it]);
+  }
+
+  // Prefix deletes page through the listing, keys are unescaped from the XML
+  for (list_version = 1; list_version <= 2; list_version++)
+  {
+    ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_FORCE_LIST_VERSION,
+                                &list_version));
+
+    for (key_it = 0; key_it < 10; key_it++)
+    {
+      snprintf(key, sizeof(key), "prefix/%s%zu", key_it ? "" : "a&b<c>", key_it);
+      res = ms3_put(ms3, "mock", key, test_data, 10);
+      ASSERT_EQ_(res, 0, "Result: %u", res);
+    }
+
+    res = ms3_delete_prefix(ms3, "mock", "prefix/", NULL, NULL, &progress);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+    ASSERT_EQ(progress.deleted, 10);
+    ASSERT_EQ(s3mock_object_count(mock), 0);
+  }
+
+  // The status cache answers repeated HEADs, including for missing keys
+  cache_size = 2;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_STATUS_CACHE_SIZE, &cache_size));
+  res = ms3_put(ms3, "mock", "cached", test_data, 10);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_status(ms3, "mock", "cached", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_status(ms3, "mock", "cached", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(status.length, 10);
+  res = ms3_status(ms3, "mock", "missing", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  res = ms3_status(ms3, "mock", "missing", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 2);
+
+  res = ms3_status_many(ms3, "mock", cache_keys, 2, statuses, results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(results[0], 0);
+  ASSERT_EQ(statuses[0].length, 10);
+  ASSERT_EQ(results[1], MS3_ERR_NOT_FOUND);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 2);
+
+  // Writes through the handle drop the entry
+  res = ms3_put(ms3, "mock", "missing", test_data, 20);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_status(ms3, "mock", "missing", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(status.length, 20);
+  res = ms3_copy(ms3, "mock", "missing", "mock", "cached");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_status(ms3, "mock", "cached", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(status.length, 20);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+  res = ms3_delete_many(ms3, "mock", cache_keys, 2, NULL);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_status(ms3, "mock", "cached", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+
+  // Least recently used entries are evicted, and entries expire
+  res = ms3_status(ms3, "mock", "missing", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  res = ms3_status(ms3, "mock", "other", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_status(ms3, "mock", "cached", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+  cache_ttl = 0.05f;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_STATUS_CACHE_TTL, &cache_ttl));
+  res = ms3_status(ms3, "mock", "expires", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  usleep(100000);
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_status(ms3, "mock", "expires", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+  cache_size = 0;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_STATUS_CACHE_SIZE, &cache_size));
+
+  // The disk cache serves repeated GETs until the object is written again,
+  // without a status cache entry the server is asked if the copy is current
+  ASSERT_NOT_NULL(mkdtemp(cache_dir));
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_DISK_CACHE_DIR, cache_dir));
+  ms3_set_content_type(ms3, "text/plain");
+  res = ms3_put(ms3, "mock", "disk", test_data, 1000);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_set_content_type(ms3, NULL);
+  get_count = s3mock_method_count(mock, "GET");
+
+  for (key_it = 0; key_it < 3; key_it++)
+  {
+    res = ms3_get(ms3, "mock", "disk", &data, &length);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+    ASSERT_EQ(length, 1000);
+    ASSERT_EQ(0, memcmp(data, test_data, 1000));
+    ASSERT_STREQ(ms3_get_content_type(ms3), "text/plain");
+    ms3_free(data);
+  }
+
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 1000);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data, 1000));
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 4);
+
+  second_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(second_ms3);
+  res = ms3_put(second_ms3, "mock", "disk", test_data + 2, 998);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_deinit(second_ms3);
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 998);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data + 2, 998));
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 5);
+
+  res = ms3_put(ms3, "mock", "disk", test_data + 1, 999);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 999);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data + 1, 999));
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 6);
+
+  // A new handle finds the files, a damaged file is fetched again
+  ms3_deinit(ms3);
+  ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(ms3);
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_DISK_CACHE_DIR, cache_dir));
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 999);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data + 1, 999));
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 7);
+
+  dir = opendir(cache_dir);
+  ASSERT_NOT_NULL(dir);
+
+  while ((dirent = readdir(dir)))
+  {
+    if (dirent->d_name[0] != '.')
+    {
+      snprintf(cache_file, sizeof(cache_file), "%s/%s", cache_dir,
+               dirent->d_name);
+    }
+  }
+
+  closedir(dir);
+  fd = open(cache_file, O_WRONLY);
+  flip = test_data[999] ^ 0xff;
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ(1, pwrite(fd, &flip, 1, lseek(fd, 0, SEEK_END) - 1));
+  close(fd);
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 999);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data + 1, 999));
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 8);
+
+  // An ETag in the status cache is trusted without asking the server
+  cache_size = 2;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_STATUS_CACHE_SIZE, &cache_size));
+  res = ms3_status(ms3, "mock", "disk", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 999);
+  ASSERT_EQ(s3mock_method_count(mock, "GET"), get_count + 8);
+
+  // Shrinking the cache removes the files, deletes drop the entry
+  res = ms3_delete(ms3, "mock", "disk");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, "mock", "disk", &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  cache_size = 0;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_DISK_CACHE_SIZE, &cache_size));
+  ASSERT_EQ(0, rmdir(cache_dir));
+  ms3_buffer_free(ms3, &get_buffer);
+
+  // A pooled buffer for a power of two object stays in its size class
+  cache_size = 1024 * 1024;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_BUFFER_POOL_SIZE, &cache_size));
+  res = ms3_put(ms3, "mock", "pooled", test_data, 16384);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, "mock", "pooled", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 16384);
+  ASSERT_EQ(get_buffer.alloced, 16384);
+  ASSERT_EQ(0, memcmp(get_buffer.data, test_data, 16384));
+  ms3_buffer_free(ms3, &get_buffer);
+  res = ms3_delete(ms3, "mock", "pooled");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  // Without a Content-Length the buffer grows as the body arrives
+  chunked_data = malloc(chunked_length);
+  ASSERT_NOT_NULL(chunked_data);
+
+  for (key_it = 0; key_it < chunked_length; key_it++)
+  {
+    chunked_data[key_it] = (uint8_t)(key_it * 7);
+  }
+
+  res = ms3_put(ms3, "mock", "chunked", chunked_data, chunked_length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  s3mock_set_chunked(mock, true);
+  res = ms3_get(ms3, "mock", "chunked", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, chunked_length);
+  ASSERT_EQ(0, memcmp(data, chunked_data, chunked_length));
+  ASSERT_EQ(data[length], '\0');
+  ms3_free(data);
+  res = ms3_get_into(ms3, "mock", "chunked", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, chunked_length);
+  ASSERT_EQ(0, memcmp(get_buffer.data, chunked_data, chunked_length));
+  ms3_buffer_free(ms3, &get_buffer);
+  s3mock_set_chunked(mock, false);
+  res = ms3_delete(ms3, "mock", "chunked");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  free(chunked_data);
+
+  // The headers of the last response are kept on the handle
+  ms3_deinit(ms3);
+  ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(ms3);
+  res = ms3_put(ms3, "mock", "meta", test_data, 1000);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  response = ms3_last_response(ms3);
+  ASSERT_NOT_NULL(response);
+  ASSERT_EQ(response->status, 200);
+  ASSERT_NOT_NULL(response->etag);
+  res = ms3_get_into(ms3, "mock", "meta", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  // Without a pool too the buffer is sized to the object, with no terminator
+  ASSERT_EQ(get_buffer.alloced, 1000);
+  response = ms3_last_response(ms3);
+  ASSERT_EQ(response->status, 200);
+  ASSERT_EQ(response->content_length, 1000);
+  ASSERT_STREQ(response->etag, ms3_get_etag(ms3));
+  ASSERT_NOT_NULL(response->content_type);
+  ASSERT_TRUE(response->last_modified > 0);
+  ASSERT_FALSE(response->content_range);
+  ASSERT_EQ(response->amz_header_count, 2);
+  ASSERT_STREQ(response->amz_headers[0].name, "x-amz-request-id");
+  ASSERT_STREQ(response->amz_headers[1].name, "x-amz-meta-mock");
+  ASSERT_STREQ(response->amz_headers[1].value, "s3mock");
+  res = ms3_status(ms3, "mock", "meta", &status);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  response = ms3_last_response(ms3);
+  ASSERT_EQ(response->content_length, 1000);
+  res = ms3_status(ms3, "mock", "nometa", &status);
+  ASSERT_EQ_(res, MS3_ERR_NOT_FOUND, "Result: %u", res);
+  response = ms3_last_response(ms3);
+  ASSERT_EQ(response->status, 404);
+  ASSERT_FALSE(response->etag);
+  ASSERT_EQ(response->amz_header_count, 1);
+  res = ms3_delete(ms3, "mock", "meta");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_buffer_free(ms3, &get_buffer);
+
+  // Last-Modified is in GMT whatever the local time zone, so it can be passed
+  // back to ms3_get_if_changed()
+  setenv("TZ", "XYZ+5", 1);
+  tzset();
+  res = ms3_put(ms3, "mock", "modified", test_data, 100);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(ms3, "mock", "modified", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  last_modified = ms3_last_response(ms3)->last_modified;
+  ASSERT_TRUE(last_modified <= time(NULL) && last_modified + 60 > time(NULL));
+  res = ms3_get_if_changed(ms3, "mock", "modified", NULL, last_modified,
+                           &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_NOT_MODIFIED, "Result: %u", res);
+  sleep(1);
+  res = ms3_put(ms3, "mock", "modified", test_data, 200);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_if_changed(ms3, "mock", "modified", NULL, last_modified,
+                           &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(get_buffer.length, 200);
+  res = ms3_delete(ms3, "mock", "modified");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_buffer_free(ms3, &get_buffer);
+  unsetenv("TZ");
+  tzset();
+
+  // Extra headers are signed along with ours on the requests which create
+  // objects, the mock refuses any x-amz-* header which isn't signed
+  ASSERT_EQ(MS3_ERR_PARAMETER, ms3_set_headers(ms3, &reserved_header, 1));
+  ASSERT_EQ(0, ms3_set_headers(ms3, extra_headers, 3));
+  res = ms3_put(ms3, "mock", "meta", test_data, 1000);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  // A copy below the threshold is a HEAD and a single copy
+  head_count = s3mock_method_count(mock, "HEAD");
+  res = ms3_copy(ms3, "mock", "meta", "mock", "meta_copy");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_method_count(mock, "HEAD"), head_count + 1);
+  res = ms3_get_into(ms3, "mock", "meta_copy", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(0, ms3_set_headers(ms3, NULL, 0));
+  res = ms3_delete(ms3, "mock", "meta");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_delete(ms3, "mock", "meta_copy");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_buffer_free(ms3, &get_buffer);
+
+  // Provider credentials are used for signing and replaced before they expire
+  memset(&provider, 0, sizeof(provider));
+  provider.mock = mock;
+  provider.lifetime = 3600;
+  provider.known = false;
+  res = ms3_set_credential_provider(ms3, mock_provider, &provider);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 1);
+  res = ms3_put(ms3, "mock", "provider", test_data, 100);
+  ASSERT_EQ_(res, MS3_ERR_AUTH, "Result: %u", res);
+  provider.known = true;
+  refresh_window = 7200;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_CREDENTIAL_REFRESH_WINDOW,
+                              &refresh_window));
+  res = ms3_put(ms3, "mock", "provider", test_data, 100);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 2);
+  refresh_window = 300;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_CREDENTIAL_REFRESH_WINDOW,
+                              &refresh_window));
+  res = ms3_get_into(ms3, "mock", "provider", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 2);
+
+  // A failed refresh keeps credentials which have not expired yet
+  refresh_window = 7200;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_CREDENTIAL_REFRESH_WINDOW,
+                              &refresh_window));
+  provider.fail = MS3_ERR_REQUEST_ERROR;
+  res = ms3_get_into(ms3, "mock", "provider", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 2);
+  ASSERT_EQ(provider.failures, 1);
+
+  // and the refresh isn't tried again by the next request
+  res = ms3_get_into(ms3, "mock", "provider", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.failures, 1);
+
+  // Expired credentials have to be refreshed
+  provider.fail = 0;
+  provider.lifetime = -1;
+  res = ms3_set_credential_provider(ms3, mock_provider, &provider);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 3);
+  res = ms3_get_into(ms3, "mock", "provider", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(provider.calls, 4);
+  provider.fail = MS3_ERR_REQUEST_ERROR;
+  res = ms3_get_into(ms3, "mock", "provider", &get_buffer);
+  ASSERT_EQ_(res, MS3_ERR_REQUEST_ERROR, "Result: %u", res);
+
+  // Removing the provider goes back to the keys the handle was created with
+  ASSERT_EQ(0, ms3_set_credential_provider(ms3, NULL, NULL));
+  res = ms3_delete(ms3, "mock", "provider");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_buffer_free(ms3, &get_buffer);
+
+  // A role ARN given up front skips the IAM lookup, short lived credentials
+  // are renewed by assuming the role again
+  snprintf(sts_endpoint, sizeof(sts_endpoint), "%s:%d", S3MOCK_HOST,
+           s3mock_port(mock));
+  s3mock_set_credential_lifetime(mock, 60);
+  role_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(role_ms3);
+  ASSERT_EQ(0, ms3_set_option(role_ms3, MS3_OPT_IAM_ROLE_ARN,
+                              (void *)"arn:aws:iam::123456789012:role/mockrole"));
+  res = ms3_init_assume_role(role_ms3, "mockrole", sts_endpoint, S3MOCK_REGION);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_assume_role_count(mock), 1);
+  res = ms3_put(role_ms3, "mock", "role", test_data, 100);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_assume_role_count(mock), 2);
+  refresh_window = 30;
+  ASSERT_EQ(0, ms3_set_option(role_ms3, MS3_OPT_CREDENTIAL_REFRESH_WINDOW,
+                              &refresh_window));
+  res = ms3_get_into(role_ms3, "mock", "role", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_assume_role_count(mock), 2);
+  // The copy source and session token are both signed
+  res = ms3_copy(role_ms3, "mock", "role", "mock", "role_copy");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_delete(role_ms3, "mock", "role_copy");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ms3_deinit(role_ms3);
+
+  // Other handles find the ARN in the process wide cache, there is no IAM
+  // endpoint to look it up with
+  s3mock_set_credential_lifetime(mock, 3600);
+  role_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(role_ms3);
+  res = ms3_init_assume_role(role_ms3, "mockrole", sts_endpoint, S3MOCK_REGION);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_assume_role_count(mock), 3);
+  res = ms3_delete(role_ms3, "mock", "role");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_assume_role_count(mock), 3);
+  ms3_deinit(role_ms3);
+
+  // Instance role credentials are fetched once and shared between handles
+  role_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(role_ms3);
+  res = ms3_init_imds_credentials(role_ms3, sts_endpoint);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_metadata_count(mock), 1);
+  res = ms3_put(role_ms3, "mock", "instance", test_data, 100);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  second_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(second_ms3);
+  res = ms3_init_imds_credentials(second_ms3, sts_endpoint);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get_into(second_ms3, "mock", "instance", &get_buffer);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_metadata_count(mock), 1);
+  ms3_deinit(second_ms3);
+  ms3_deinit(role_ms3);
+
+  // Container credentials close to expiring are replaced in the background
+  // while the current ones are still used
+  snprintf(ecs_uri, sizeof(ecs_uri), "http://%s/v2/credentials/mock",
+           sts_endpoint);
+  s3mock_set_credential_lifetime(mock, 100);
+  role_ms3 = s3mock_connect(mock);
+  ASSERT_NOT_NULL(role_ms3);
+  res = ms3_init_ecs_credentials(role_ms3, ecs_uri, "wrongtoken");
+  ASSERT_EQ_(res, MS3_ERR_AUTH, "Result: %u", res);
+  res = ms3_init_ecs_credentials(role_ms3, ecs_uri, S3MOCK_ECS_TOKEN);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(s3mock_metadata_count(mock), 2);
+  res = ms3_delete(role_ms3, "mock", "instance");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (wait_it = 0; wait_it < 500 && s3mock_metadata_count(mock) < 3; wait_it++)
+  {
+    usleep(10000);
+  }
+
+  ASSERT_EQ(s3mock_metadata_count(mock), 3);
+
+  // Background refreshes are spaced out, even while still close to expiring
+  res = ms3_delete(role_ms3, "mock", "instance");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  usleep(100000);
+  ASSERT_EQ(s3mock_metadata_count(mock), 3);
+  ms3_deinit(role_ms3);
+  s3mock_set_credential_lifetime(mock, 3600);
+  ms3_buffer_free(ms3, &get_buffer);
+
+  // Several threads share one handle once its options are set, each seeing
+  // the results of its own calls
+  cache_size = 100;
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_STATUS_CACHE_SIZE, &cache_size));
+  ms3_set_content_type(ms3, "text/plain");
+
+  for (thread_it = 0; thread_it < SHARED_THREADS; thread_it++)
+  {
+    shared[thread_it].ms3 = ms3;
+    shared[thread_it].index = thread_it;
+    shared[thread_it].failed = NULL;
+    ASSERT_EQ(0, pthread_create(&shared[thread_it].thread, NULL, shared_thread,
+                                &shared[thread_it]));
+  }
+
+  for (thread_it = 0; thread_it < SHARED_THREADS; thread_it++)
+  {
+    pthread_join(shared[thread_it].thread, NULL);
+    ASSERT_NULL_(shared[thread_it].failed, "Thread %zu failed: %s", thread_it,
+                 shared[thread_it].failed);
+  }
+
+  ms3_set_content_type(ms3, NULL);
+
+  ms3_deinit(ms3);
+  s3mock_stop(mock);
+  ms3_library_deinit();
+  return 0;
+}
@@ -0,0 +1,126 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Tests PUT from a file descriptor, both as a single request and as a
+ * parallel multipart upload
+ */
+
+#define FILE_SIZE (12 * 1024 * 1024 + 123)
+
+int main(int argc, char *argv[])
+{
+  int res;
+  int fd;
+  size_t pos;
+  size_t part_size = 5 * 1024 * 1024;
+  size_t max_parallel = 2;
+  ms3_st *ms3;
+  uint8_t *data = NULL;
+  size_t length = 0;
+  char filename[] = "/tmp/ms3_put_file_XXXXXX";
+  uint8_t *test_data = malloc(FILE_SIZE);
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+
+  for (pos = 0; pos < FILE_SIZE; pos++)
+  {
+    test_data[pos] = (uint8_t)(pos % 251);
+  }
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+
+  fd = mkstemp(filename);
+  ASSERT_TRUE(fd >= 0);
+  unlink(filename);
+  ASSERT_EQ(FILE_SIZE, write(fd, test_data, FILE_SIZE));
+
+  // Three parts, the smallest size S3 allows for all but the last
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_PART_SIZE, &part_size));
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+
+  res = ms3_put_file(ms3, s3bucket, "test/put_file.dat", fd, 0, FILE_SIZE);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get(ms3, s3bucket, "test/put_file.dat", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, FILE_SIZE);
+  ASSERT_EQ(0, memcmp(data, test_data, FILE_SIZE));
+  ms3_free(data);
+
+  // A range that doesn't start on a page boundary in a single request
+  res = ms3_put_file(ms3, s3bucket, "test/put_file.dat", fd, 1001, 100000);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  res = ms3_get(ms3, s3bucket, "test/put_file.dat", &data, &length);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  ASSERT_EQ(length, 100000);
+  ASSERT_EQ(0, memcmp(data, test_data + 1001, 100000));
+  ms3_free(data);
+
+  // Past the end of the file
+  res = ms3_put_file(ms3, s3bucket, "test/put_file.dat", fd, FILE_SIZE - 10,
+                     100);
+  ASSERT_EQ_(res, MS3_ERR_PARAMETER, "Result: %u", res);
+
+  res = ms3_delete(ms3, s3bucket, "test/put_file.dat");
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+  close(fd);
+  free(test_data);
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}
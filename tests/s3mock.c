@@ -0,0 +1,3062 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "tests/s3mock.h"
+#include "src/sha256.h"
+#include "src/md5.h"
+
+#define S3MOCK_MAX_HEADERS 64
+#define S3MOCK_MAX_CREDENTIALS 16
+#define S3MOCK_MAX_CONNECTIONS 256
+#define S3MOCK_DEFAULT_PART_SIZE (5 * 1024 * 1024)
+#define S3MOCK_DEFAULT_MAX_COPY_SIZE ((uint64_t)5 * 1024 * 1024 * 1024)
+#define S3MOCK_CHUNK_SIZE 10000
+// Sent for objects stored without any x-amz-meta-* headers
+#define S3MOCK_DEFAULT_META "x-amz-meta-mock: s3mock\r\n"
+
+struct s3mock_object_st
+{
+  char *bucket;
+  char *key;
+  uint8_t *data;
+  size_t length;
+  char etag[48];
+  char content_type[128];
+  char meta[512]; // x-amz-meta-* header lines
+  time_t last_modified;
+};
+
+struct s3mock_part_st
+{
+  int number;
+  uint8_t *data;
+  size_t length;
+  char etag[48];
+  struct s3mock_part_st *next;
+};
+
+struct s3mock_upload_st
+{
+  char id[40];
+  char *bucket;
+  char *key;
+  char content_type[128]; // Empty if none was given
+  char meta[512];
+  struct s3mock_part_st *parts;
+  struct s3mock_upload_st *next;
+};
+
+struct s3mock_credentials_st
+{
+  char *key;
+  char *secret;
+};
+
+struct s3mock_st
+{
+  int listen_fd;
+  int port;
+  pthread_t accept_thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool stopping;
+  int connections[S3MOCK_MAX_CONNECTIONS];
+  size_t connection_count;
+  struct s3mock_object_st **objects;
+  size_t object_count;
+  size_t object_alloced;
+  struct s3mock_upload_st *uploads;
+  uint64_t upload_counter;
+  uint64_t request_counter;
+  uint64_t method_counters[8];
+  struct s3mock_credentials_st credentials[S3MOCK_MAX_CREDENTIALS];
+  size_t credential_count;
+  uint32_t latency_ms;
+  size_t throttle;
+  size_t max_keys;
+  size_t min_part_size;
+  uint64_t max_copy_size;
+  bool chunked;
+  int error_status;
+  char error_code[64];
+  uint32_t error_count;
+  uint64_t assume_role_counter;
+  uint64_t metadata_counter;
+  uint64_t credential_counter;
+  int64_t credential_lifetime;
+};
+
+struct s3mock_param_st
+{
+  char *name;
+  char *value;
+};
+
+struct s3mock_request_st
+{
+  char method[16];
+  char *path;
+  char *query;
+  size_t header_count;
+  char *header_names[S3MOCK_MAX_HEADERS];
+  char *header_values[S3MOCK_MAX_HEADERS];
+  size_t param_count;
+  struct s3mock_param_st *params;
+  uint8_t *body;
+  size_t body_length;
+  char *bucket;
+  char *key;
+};
+
+struct s3mock_connection_st
+{
+  s3mock_st *mock;
+  int fd;
+  char *buffer;
+  size_t length;
+  size_t alloced;
+};
+
+struct s3mock_string_st
+{
+  char *data;
+  size_t length;
+  size_t alloced;
+};
+
+static const char *method_names[] =
+{
+  "GET", "HEAD", "PUT", "POST", "DELETE", NULL
+};
+
+/* Growable string used to build XML responses */
+
+static void str_reserve(struct s3mock_string_st *str, size_t extra)
+{
+  if (str->length + extra + 1 > str->alloced)
+  {
+    size_t new_size = str->alloced ? str->alloced * 2 : 1024;
+
+    while (new_size < str->length + extra + 1)
+    {
+      new_size *= 2;
+    }
+
+    str->data = realloc(str->data, new_size);
+    str->alloced = new_size;
+  }
+}
+
+static void str_append_length(struct s3mock_string_st *str, const char *data,
+                              size_t length)
+{
+  str_reserve(str, length);
+  memcpy(str->data + str->length, data, length);
+  str->length += length;
+  str->data[str->length] = '\0';
+}
+
+static void str_append(struct s3mock_string_st *str, const char *data)
+{
+  str_append_length(str, data, strlen(data));
+}
+
+static void str_append_xml(struct s3mock_string_st *str, const char *data)
+{
+  for (; *data; data++)
+  {
+    switch (*data)
+    {
+      case '&':
+        str_append(str, "&amp;");
+        break;
+
+      case '<':
+        str_append(str, "&lt;");
+        break;
+
+      case '>':
+        str_append(str, "&gt;");
+        break;
+
+      case '"':
+        str_append(str, "&quot;");
+        break;
+
+      default:
+        str_append_length(str, data, 1);
+    }
+  }
+}
+
+static void str_append_element(struct s3mock_string_st *str, const char *name,
+                               const char *value)
+{
+  str_append(str, "<");
+  str_append(str, name);
+  str_append(str, ">");
+  str_append_xml(str, value);
+  str_append(str, "</");
+  str_append(str, name);
+  str_append(str, ">");
+}
+
+static void hex_encode(const uint8_t *data, size_t length, char *out)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  size_t pos;
+
+  for (pos = 0; pos < length; pos++)
+  {
+    out[pos * 2] = hex_digits[data[pos] >> 4];
+    out[pos * 2 + 1] = hex_digits[data[pos] & 0x0f];
+  }
+
+  out[length * 2] = '\0';
+}
+
+static int hex_value(char digit)
+{
+  if (digit >= '0' && digit <= '9')
+  {
+    return digit - '0';
+  }
+
+  if (digit >= 'a' && digit <= 'f')
+  {
+    return digit - 'a' + 10;
+  }
+
+  if (digit >= 'A' && digit <= 'F')
+  {
+    return digit - 'A' + 10;
+  }
+
+  return -1;
+}
+
+static char *url_decode(const char *data, size_t length)
+{
+  char *out = malloc(length + 1);
+  size_t in_pos;
+  size_t out_pos = 0;
+
+  for (in_pos = 0; in_pos < length; in_pos++)
+  {
+    if (data[in_pos] == '%' && in_pos + 2 < length + 1 &&
+        hex_value(data[in_pos + 1]) >= 0 && hex_value(data[in_pos + 2]) >= 0)
+    {
+      out[out_pos++] = (char)(hex_value(data[in_pos + 1]) * 16 +
+                              hex_value(data[in_pos + 2]));
+      in_pos += 2;
+    }
+    else if (data[in_pos] == '+')
+    {
+      out[out_pos++] = ' ';
+    }
+    else
+    {
+      out[out_pos++] = data[in_pos];
+    }
+  }
+
+  out[out_pos] = '\0';
+  return out;
+}
+
+static void format_etag(const uint8_t *data, size_t length, char *etag)
+{
+  uint8_t hash[32];
+
+  sha256(data, length, hash);
+  etag[0] = '"';
+  hex_encode(hash, 16, etag + 1);
+  etag[33] = '"';
+  etag[34] = '\0';
+}
+
+static void format_iso_date(time_t when, char *out, size_t length)
+{
+  struct tm tm_when;
+
+  gmtime_r(&when, &tm_when);
+  strftime(out, length, "%Y-%m-%dT%H:%M:%S.000Z", &tm_when);
+}
+
+static void format_http_date(time_t when, char *out, size_t length)
+{
+  struct tm tm_when;
+
+  gmtime_r(&when, &tm_when);
+  strftime(out, length, "%a, %d %b %Y %H:%M:%S GMT", &tm_when);
+}
+
+// Returns -1 if the date can't be parsed
+static time_t parse_http_date(const char *date)
+{
+  struct tm tm_when;
+
+  memset(&tm_when, 0, sizeof(tm_when));
+
+  if (!strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm_when))
+  {
+    return -1;
+  }
+
+  return timegm(&tm_when);
+}
+
+static void sleep_ms(uint32_t ms)
+{
+  struct timespec delay;
+
+  delay.tv_sec = ms / 1000;
+  delay.tv_nsec = (long)(ms % 1000) * 1000000L;
+
+  while (nanosleep(&delay, &delay) && errno == EINTR)
+  {
+  }
+}
+
+/* Request accessors */
+
+static const char *get_header(struct s3mock_request_st *req, const char *name)
+{
+  size_t pos;
+
+  for (pos = 0; pos < req->header_count; pos++)
+  {
+    if (!strcasecmp(req->header_names[pos], name))
+    {
+      return req->header_values[pos];
+    }
+  }
+
+  return NULL;
+}
+
+static const char *get_param(struct s3mock_request_st *req, const char *name)
+{
+  size_t pos;
+
+  for (pos = 0; pos < req->param_count; pos++)
+  {
+    if (!strcmp(req->params[pos].name, name))
+    {
+      return req->params[pos].value;
+    }
+  }
+
+  return NULL;
+}
+
+static void request_free(struct s3mock_request_st *req)
+{
+  size_t pos;
+
+  for (pos = 0; pos < req->header_count; pos++)
+  {
+    free(req->header_names[pos]);
+    free(req->header_values[pos]);
+  }
+
+  for (pos = 0; pos < req->param_count; pos++)
+  {
+    free(req->params[pos].name);
+    free(req->params[pos].value);
+  }
+
+  free(req->params);
+  free(req->path);
+  free(req->query);
+  free(req->body);
+  free(req->bucket);
+  free(req->key);
+  memset(req, 0, sizeof(*req));
+}
+
+/* Connection I/O */
+
+static bool conn_write(struct s3mock_connection_st *conn, const void *data,
+                       size_t length)
+{
+  const char *ptr = data;
+
+  while (length)
+  {
+    ssize_t written = send(conn->fd, ptr, length, MSG_NOSIGNAL);
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    ptr += written;
+    length -= (size_t)written;
+  }
+
+  return true;
+}
+
+static bool conn_fill(struct s3mock_connection_st *conn)
+{
+  ssize_t received;
+
+  if (conn->alloced - conn->length < 65536)
+  {
+    conn->alloced = conn->alloced ? conn->alloced * 2 : 131072;
+    conn->buffer = realloc(conn->buffer, conn->alloced);
+  }
+
+  do
+  {
+    received = recv(conn->fd, conn->buffer + conn->length,
+                    conn->alloced - conn->length, 0);
+  }
+  while (received < 0 && errno == EINTR);
+
+  if (received <= 0)
+  {
+    return false;
+  }
+
+  conn->length += (size_t)received;
+  return true;
+}
+
+static void conn_consume(struct s3mock_connection_st *conn, size_t length)
+{
+  memmove(conn->buffer, conn->buffer + length, conn->length - length);
+  conn->length -= length;
+}
+
+static char *find_line_end(char *start, char *end)
+{
+  char *pos;
+
+  for (pos = start; pos + 1 < end; pos++)
+  {
+    if (pos[0] == '\r' && pos[1] == '\n')
+    {
+      return pos;
+    }
+  }
+
+  return NULL;
+}
+
+static bool read_chunked_body(struct s3mock_connection_st *conn,
+                              struct s3mock_request_st *req)
+{
+  struct s3mock_string_st body = {NULL, 0, 0};
+
+  for (;;)
+  {
+    char *line_end;
+    size_t chunk_size;
+
+    while (!(line_end = find_line_end(conn->buffer,
+                                      conn->buffer + conn->length)))
+    {
+      if (!conn_fill(conn))
+      {
+        free(body.data);
+        return false;
+      }
+    }
+
+    chunk_size = strtoull(conn->buffer, NULL, 16);
+    conn_consume(conn, (size_t)(line_end - conn->buffer) + 2);
+
+    while (conn->length < chunk_size + 2)
+    {
+      if (!conn_fill(conn))
+      {
+        free(body.data);
+        return false;
+      }
+    }
+
+    if (chunk_size == 0)
+    {
+      // Skip any trailers up to the final empty line
+      while (conn->length < 2 || memcmp(conn->buffer, "\r\n", 2))
+      {
+        line_end = find_line_end(conn->buffer, conn->buffer + conn->length);
+
+        if (line_end)
+        {
+          conn_consume(conn, (size_t)(line_end - conn->buffer) + 2);
+        }
+        else if (!conn_fill(conn))
+        {
+          free(body.data);
+          return false;
+        }
+      }
+
+      conn_consume(conn, 2);
+      break;
+    }
+
+    str_append_length(&body, conn->buffer, chunk_size);
+    conn_consume(conn, chunk_size + 2);
+  }
+
+  req->body = (uint8_t *)body.data;
+  req->body_length = body.length;
+  return true;
+}
+
+static void parse_query(struct s3mock_request_st *req)
+{
+  char *pos = req->query;
+
+  while (pos && *pos)
+  {
+    char *amp = strchr(pos, '&');
+    size_t length = amp ? (size_t)(amp - pos) : strlen(pos);
+    char *equals = memchr(pos, '=', length);
+    struct s3mock_param_st *param;
+
+    req->params = realloc(req->params,
+                          sizeof(struct s3mock_param_st) * (req->param_count + 1));
+    param = &req->params[req->param_count++];
+
+    if (equals)
+    {
+      param->name = url_decode(pos, (size_t)(equals - pos));
+      param->value = url_decode(equals + 1, length - (size_t)(equals - pos) - 1);
+    }
+    else
+    {
+      param->name = url_decode(pos, length);
+      param->value = strdup("");
+    }
+
+    pos = amp ? amp + 1 : NULL;
+  }
+}
+
+static void parse_path(struct s3mock_request_st *req)
+{
+  const char *start = req->path + 1;
+  const char *slash = strchr(start, '/');
+
+  if (slash)
+  {
+    req->bucket = url_decode(start, (size_t)(slash - start));
+    req->key = url_decode(slash + 1, strlen(slash + 1));
+  }
+  else
+  {
+    req->bucket = url_decode(start, strlen(start));
+    req->key = strdup("");
+  }
+}
+
+static bool read_request(struct s3mock_connection_st *conn,
+                         struct s3mock_request_st *req)
+{
+  char *head_end = NULL;
+  char *line;
+  char *line_end;
+  char *target;
+  char *space;
+  const char *length_header;
+  const char *encoding_header;
+  const char *expect_header;
+  size_t head_length;
+
+  for (;;)
+  {
+    if (conn->length >= 4)
+    {
+      size_t pos;
+
+      for (pos = 0; pos + 3 < conn->length; pos++)
+      {
+        if (!memcmp(conn->buffer + pos, "\r\n\r\n", 4))
+        {
+          head_end = conn->buffer + pos;
+          break;
+        }
+      }
+    }
+
+    if (head_end)
+    {
+      break;
+    }
+
+    if (!conn_fill(conn))
+    {
+      return false;
+    }
+  }
+
+  head_length = (size_t)(head_end - conn->buffer) + 4;
+  *head_end = '\0';
+
+  // Request line
+  line = conn->buffer;
+  line_end = strstr(line, "\r\n");
+
+  if (line_end)
+  {
+    *line_end = '\0';
+  }
+
+  space = strchr(line, ' ');
+
+  if (!space || (size_t)(space - line) >= sizeof(req->method))
+  {
+    return false;
+  }
+
+  memcpy(req->method, line, (size_t)(space - line));
+  req->method[space - line] = '\0';
+  target = space + 1;
+  space = strchr(target, ' ');
+
+  if (space)
+  {
+    *space = '\0';
+  }
+
+  if (strchr(target, '?'))
+  {
+    char *question = strchr(target, '?');
+    req->path = strndup(target, (size_t)(question - target));
+    req->query = strdup(question + 1);
+  }
+  else
+  {
+    req->path = strdup(target);
+    req->query = NULL;
+  }
+
+  // Headers
+  while (line_end && line_end < head_end)
+  {
+    char *colon;
+    char *value;
+    char *value_end;
+
+    line = line_end + 2;
+    line_end = strstr(line, "\r\n");
+
+    if (line_end)
+    {
+      *line_end = '\0';
+    }
+
+    colon = strchr(line, ':');
+
+    if (!colon || req->header_count == S3MOCK_MAX_HEADERS)
+    {
+      continue;
+    }
+
+    value = colon + 1;
+
+    while (*value == ' ' || *value == '\t')
+    {
+      value++;
+    }
+
+    value_end = value + strlen(value);
+
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+    {
+      value_end--;
+    }
+
+    req->header_names[req->header_count] = strndup(line, (size_t)(colon - line));
+    req->header_values[req->header_count] = strndup(value,
+                                                    (size_t)(value_end - value));
+    req->header_count++;
+  }
+
+  conn_consume(conn, head_length);
+  parse_query(req);
+  parse_path(req);
+
+  expect_header = get_header(req, "Expect");
+
+  if (expect_header && !strcasecmp(expect_header, "100-continue"))
+  {
+    const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+
+    if (!conn_write(conn, cont, strlen(cont)))
+    {
+      return false;
+    }
+  }
+
+  encoding_header = get_header(req, "Transfer-Encoding");
+
+  if (encoding_header && !strcasecmp(encoding_header, "chunked"))
+  {
+    return read_chunked_body(conn, req);
+  }
+
+  length_header = get_header(req, "Content-Length");
+
+  if (length_header)
+  {
+    req->body_length = strtoull(length_header, NULL, 10);
+  }
+
+  while (conn->length < req->body_length)
+  {
+    if (!conn_fill(conn))
+    {
+      return false;
+    }
+  }
+
+  req->body = malloc(req->body_length + 1);
+  memcpy(req->body, conn->buffer, req->body_length);
+  req->body[req->body_length] = '\0';
+  conn_consume(conn, req->body_length);
+
+  return true;
+}
+
+/* Responses */
+
+static const char *status_reason(int status)
+{
+  switch (status)
+  {
+    case 100:
+      return "Continue";
+
+    case 200:
+      return "OK";
+
+    case 204:
+      return "No Content";
+
+    case 206:
+      return "Partial Content";
+
+    case 304:
+      return "Not Modified";
+
+    case 400:
+      return "Bad Request";
+
+    case 403:
+      return "Forbidden";
+
+    case 404:
+      return "Not Found";
+
+    case 405:
+      return "Method Not Allowed";
+
+    case 412:
+      return "Precondition Failed";
+
+    case 416:
+      return "Requested Range Not Satisfiable";
+
+    case 500:
+      return "Internal Server Error";
+
+    case 503:
+      return "Service Unavailable";
+
+    default:
+      return "Unknown";
+  }
+}
+
+static bool send_response(struct s3mock_connection_st *conn,
+                          struct s3mock_request_st *req, int status,
+                          const char *extra_headers, const void *body, size_t length)
+{
+  s3mock_st *mock = conn->mock;
+  char head[4096];
+  size_t throttle;
+  uint32_t latency;
+  int head_length;
+  const uint8_t *ptr = body;
+  bool head_only = !strcmp(req->method, "HEAD");
+
+  pthread_mutex_lock(&mock->lock);
+  throttle = mock->throttle;
+  latency = mock->latency_ms;
+  pthread_mutex_unlock(&mock->lock);
+
+  if (latency)
+  {
+    sleep_ms(latency);
+  }
+
+  head_length = snprintf(head, sizeof(head),
+                         "HTTP/1.1 %d %s\r\n"
+                         "x-amz-request-id: %016" PRIX64 "\r\n"
+                         "Content-Length: %zu\r\n"
+                         "%s\r\n", status, status_reason(status),
+                         mock->request_counter, length,
+                         extra_headers ? extra_headers : "");
+
+  if (!conn_write(conn, head, (size_t)head_length))
+  {
+    return false;
+  }
+
+  if (head_only || !length)
+  {
+    return true;
+  }
+
+  if (!throttle)
+  {
+    return conn_write(conn, body, length);
+  }
+
+  // Send in 100ms worth of data at a time
+  while (length)
+  {
+    size_t slice = throttle / 10 ? throttle / 10 : 1;
+
+    if (slice > length)
+    {
+      slice = length;
+    }
+
+    if (!conn_write(conn, ptr, slice))
+    {
+      return false;
+    }
+
+    ptr += slice;
+    length -= slice;
+    sleep_ms((uint32_t)(slice * 1000 / throttle));
+  }
+
+  return true;
+}
+
+/* Sends a body without a Content-Length, as a server which streams its
+ * responses does
+ */
+static bool send_chunked(struct s3mock_connection_st *conn, int status,
+                         const char *extra_headers, const void *body, size_t length)
+{
+  s3mock_st *mock = conn->mock;
+  char head[4096];
+  uint32_t latency;
+  int head_length;
+  const uint8_t *ptr = body;
+
+  pthread_mutex_lock(&mock->lock);
+  latency = mock->latency_ms;
+  pthread_mutex_unlock(&mock->lock);
+
+  if (latency)
+  {
+    sleep_ms(latency);
+  }
+
+  head_length = snprintf(head, sizeof(head),
+                         "HTTP/1.1 %d %s\r\n"
+                         "x-amz-request-id: %016" PRIX64 "\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "%s\r\n", status, status_reason(status),
+                         mock->request_counter,
+                         extra_headers ? extra_headers : "");
+
+  if (!conn_write(conn, head, (size_t)head_length))
+  {
+    return false;
+  }
+
+  while (length)
+  {
+    size_t chunk = length < S3MOCK_CHUNK_SIZE ? length : S3MOCK_CHUNK_SIZE;
+
+    head_length = snprintf(head, sizeof(head), "%zx\r\n", chunk);
+
+    if (!conn_write(conn, head, (size_t)head_length) ||
+        !conn_write(conn, ptr, chunk) || !conn_write(conn, "\r\n", 2))
+    {
+      return false;
+    }
+
+    ptr += chunk;
+    length -= chunk;
+  }
+
+  return conn_write(conn, "0\r\n\r\n", 5);
+}
+
+static bool send_xml(struct s3mock_connection_st *conn,
+                     struct s3mock_request_st *req, int status,
+                     const char *extra_headers, struct s3mock_string_st *xml)
+{
+  char headers[1024];
+  bool ret;
+
+  snprintf(headers, sizeof(headers), "Content-Type: application/xml\r\n%s",
+           extra_headers ? extra_headers : "");
+  ret = send_response(conn, req, status, headers, xml->data, xml->length);
+  free(xml->data);
+  return ret;
+}
+
+static bool send_error(struct s3mock_connection_st *conn,
+                       struct s3mock_request_st *req, int status, const char *code,
+                       const char *message)
+{
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  char request_id[32];
+
+  if (!strcmp(req->method, "HEAD"))
+  {
+    return send_response(conn, req, status, NULL, NULL, 0);
+  }
+
+  snprintf(request_id, sizeof(request_id), "%016" PRIX64,
+           conn->mock->request_counter);
+  str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Error>");
+  str_append_element(&xml, "Code", code);
+  str_append_element(&xml, "Message", message);
+
+  if (req->key && req->key[0])
+  {
+    str_append_element(&xml, "Key", req->key);
+  }
+
+  str_append_element(&xml, "RequestId", request_id);
+  str_append(&xml, "</Error>");
+  return send_xml(conn, req, status, NULL, &xml);
+}
+
+/* Signature V4 verification */
+
+static int compare_params(const void *a, const void *b)
+{
+  const char *param_a = *(const char * const *)a;
+  const char *param_b = *(const char * const *)b;
+  return strcmp(param_a, param_b);
+}
+
+static void canonical_query(struct s3mock_request_st *req,
+                            struct s3mock_string_st *out)
+{
+  char *query;
+  char *pos;
+  char **parts = NULL;
+  size_t count = 0;
+  size_t it;
+
+  if (!req->query || !req->query[0])
+  {
+    return;
+  }
+
+  query = strdup(req->query);
+  pos = query;
+
+  while (pos)
+  {
+    char *amp = strchr(pos, '&');
+
+    if (amp)
+    {
+      *amp = '\0';
+    }
+
+    parts = realloc(parts, sizeof(char *) * (count + 1));
+    parts[count++] = pos;
+    pos = amp ? amp + 1 : NULL;
+  }
+
+  // The library has to sort its query parameters, so we don't
+  qsort(parts, count, sizeof(char *), compare_params);
+
+  for (it = 0; it < count; it++)
+  {
+    if (it)
+    {
+      str_append(out, "&");
+    }
+
+    str_append(out, parts[it]);
+
+    if (!strchr(parts[it], '='))
+    {
+      str_append(out, "=");
+    }
+  }
+
+  free(parts);
+  free(query);
+}
+
+static const char *find_secret(s3mock_st *mock, const char *key,
+                               size_t key_length)
+{
+  size_t pos;
+
+  for (pos = 0; pos < mock->credential_count; pos++)
+  {
+    if (strlen(mock->credentials[pos].key) == key_length &&
+        !strncmp(mock->credentials[pos].key, key, key_length))
+    {
+      return mock->credentials[pos].secret;
+    }
+  }
+
+  return NULL;
+}
+
+// Whether name is one of the headers in a SignedHeaders list
+static bool header_listed(const char *signed_headers, size_t signed_length,
+                          const char *name)
+{
+  size_t name_length = strlen(name);
+  const char *pos = signed_headers;
+  const char *end = signed_headers + signed_length;
+
+  while (pos < end)
+  {
+    size_t length = strcspn(pos, ";, ");
+
+    if (length == name_length && !strncasecmp(pos, name, length))
+    {
+      return true;
+    }
+
+    pos += length;
+
+    if (*pos == ';')
+    {
+      pos++;
+    }
+  }
+
+  return false;
+}
+
+/* Returns NULL on success or an S3 error code */
+static const char *verify_signature(s3mock_st *mock,
+                                    struct s3mock_request_st *req)
+{
+  const char *auth = get_header(req, "Authorization");
+  const char *date = get_header(req, "x-amz-date");
+  const char *payload_hash = get_header(req, "x-amz-content-sha256");
+  const char *credential;
+  const char *signed_headers;
+  const char *signature;
+  const char *slash;
+  const char *secret;
+  const char *header_name;
+  char scope[128];
+  char scope_date[16];
+  char scope_region[64];
+  char scope_service[16];
+  char hex[65];
+  char secret_key[256];
+  uint8_t hash[32];
+  uint8_t key1[32];
+  uint8_t key2[32];
+  struct s3mock_string_st canonical = {NULL, 0, 0};
+  struct s3mock_string_st to_sign = {NULL, 0, 0};
+  size_t signed_length;
+  size_t header_it;
+  char previous[128];
+
+  if (!auth || !date || !payload_hash)
+  {
+    return "AccessDenied";
+  }
+
+  credential = strstr(auth, "Credential=");
+  signed_headers = strstr(auth, "SignedHeaders=");
+  signature = strstr(auth, "Signature=");
+
+  if (strncmp(auth, "AWS4-HMAC-SHA256 ", 17) || !credential ||
+      !signed_headers || !signature)
+  {
+    return "AuthorizationHeaderMalformed";
+  }
+
+  credential += 11;
+  signed_headers += 14;
+  signature += 10;
+  slash = strchr(credential, '/');
+
+  if (!slash)
+  {
+    return "AuthorizationHeaderMalformed";
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  secret = find_secret(mock, credential, (size_t)(slash - credential));
+  pthread_mutex_unlock(&mock->lock);
+
+  if (!secret)
+  {
+    return "InvalidAccessKeyId";
+  }
+
+  if (sscanf(slash + 1, "%15[^/]/%63[^/]/%15[^/]/aws4_request", scope_date,
+             scope_region, scope_service) != 3)
+  {
+    return "AuthorizationHeaderMalformed";
+  }
+
+  // Payload
+  if (strcmp(payload_hash, "UNSIGNED-PAYLOAD"))
+  {
+    sha256(req->body, req->body_length, hash);
+    hex_encode(hash, 32, hex);
+
+    if (strcmp(hex, payload_hash))
+    {
+      return "XAmzContentSHA256Mismatch";
+    }
+  }
+
+  // Canonical request
+  str_append(&canonical, req->method);
+  str_append(&canonical, "\n");
+  str_append(&canonical, req->path);
+  str_append(&canonical, "\n");
+  canonical_query(req, &canonical);
+  str_append(&canonical, "\n");
+
+  signed_length = strcspn(signed_headers, ", ");
+  header_name = signed_headers;
+
+  // S3 wants every x-amz-* header signed
+  for (header_it = 0; header_it < req->header_count; header_it++)
+  {
+    if (!strncasecmp(req->header_names[header_it], "x-amz-", 6) &&
+        !header_listed(signed_headers, signed_length,
+                       req->header_names[header_it]))
+    {
+      free(canonical.data);
+      return "AccessDenied";
+    }
+  }
+
+  previous[0] = '\0';
+
+  while (header_name < signed_headers + signed_length)
+  {
+    size_t name_length = strcspn(header_name, ";, ");
+    char name[128];
+    const char *value;
+
+    snprintf(name, sizeof(name), "%.*s", (int)name_length, header_name);
+    value = get_header(req, name);
+
+    // The list has to be sorted without repeats
+    if (!value || strcmp(previous, name) >= 0)
+    {
+      free(canonical.data);
+      return "SignatureDoesNotMatch";
+    }
+
+    memcpy(previous, name, sizeof(previous));
+
+    str_append(&canonical, name);
+    str_append(&canonical, ":");
+    str_append(&canonical, value);
+    str_append(&canonical, "\n");
+    header_name += name_length;
+
+    if (*header_name == ';')
+    {
+      header_name++;
+    }
+  }
+
+  str_append(&canonical, "\n");
+  str_append_length(&canonical, signed_headers, signed_length);
+  str_append(&canonical, "\n");
+  str_append(&canonical, payload_hash);
+
+  // String to sign
+  snprintf(scope, sizeof(scope), "%s/%s/%s/aws4_request", scope_date,
+           scope_region, scope_service);
+  sha256((uint8_t *)canonical.data, canonical.length, hash);
+  hex_encode(hash, 32, hex);
+  str_append(&to_sign, "AWS4-HMAC-SHA256\n");
+  str_append(&to_sign, date);
+  str_append(&to_sign, "\n");
+  str_append(&to_sign, scope);
+  str_append(&to_sign, "\n");
+  str_append(&to_sign, hex);
+
+  snprintf(secret_key, sizeof(secret_key), "AWS4%s", secret);
+  hmac_sha256((uint8_t *)secret_key, strlen(secret_key), (uint8_t *)scope_date,
+              strlen(scope_date), key1);
+  hmac_sha256(key1, 32, (uint8_t *)scope_region, strlen(scope_region), key2);
+  hmac_sha256(key2, 32, (uint8_t *)scope_service, strlen(scope_service), key1);
+  hmac_sha256(key1, 32, (const uint8_t *)"aws4_request", 12, key2);
+  hmac_sha256(key2, 32, (uint8_t *)to_sign.data, to_sign.length, key1);
+  hex_encode(key1, 32, hex);
+
+  free(canonical.data);
+  free(to_sign.data);
+
+  if (strncmp(hex, signature, 64))
+  {
+    return "SignatureDoesNotMatch";
+  }
+
+  return NULL;
+}
+
+/* Object store, kept sorted by bucket then key. Caller holds the lock. */
+
+static int object_compare(const char *bucket, const char *key,
+                          const struct s3mock_object_st *object)
+{
+  int ret = strcmp(bucket, object->bucket);
+
+  if (ret)
+  {
+    return ret;
+  }
+
+  return strcmp(key, object->key);
+}
+
+static size_t object_search(s3mock_st *mock, const char *bucket,
+                            const char *key, bool *found)
+{
+  size_t low = 0;
+  size_t high = mock->object_count;
+
+  *found = false;
+
+  while (low < high)
+  {
+    size_t mid = (low + high) / 2;
+    int cmp = object_compare(bucket, key, mock->objects[mid]);
+
+    if (!cmp)
+    {
+      *found = true;
+      return mid;
+    }
+
+    if (cmp < 0)
+    {
+      high = mid;
+    }
+    else
+    {
+      low = mid + 1;
+    }
+  }
+
+  return low;
+}
+
+static struct s3mock_object_st *object_find(s3mock_st *mock,
+                                            const char *bucket, const char *key)
+{
+  bool found;
+  size_t pos = object_search(mock, bucket, key, &found);
+
+  return found ? mock->objects[pos] : NULL;
+}
+
+static void object_free(struct s3mock_object_st *object)
+{
+  free(object->bucket);
+  free(object->key);
+  free(object->data);
+  free(object);
+}
+
+/* Takes ownership of data */
+/* The x-amz-meta-* headers of a request as header lines, the default
+ * metadata if there are none
+ */
+static void meta_collect(struct s3mock_request_st *req, char *meta,
+                         size_t size)
+{
+  size_t pos;
+  size_t length = 0;
+
+  meta[0] = '\0';
+
+  for (pos = 0; pos < req->header_count; pos++)
+  {
+    if (!strncasecmp(req->header_names[pos], "x-amz-meta-", 11) &&
+        length < size)
+    {
+      length += (size_t)snprintf(meta + length, size - length, "%s: %s\r\n",
+                                 req->header_names[pos],
+                                 req->header_values[pos]);
+    }
+  }
+
+  if (!meta[0])
+  {
+    snprintf(meta, size, "%s", S3MOCK_DEFAULT_META);
+  }
+}
+
+static struct s3mock_object_st *object_store(s3mock_st *mock,
+                                             const char *bucket, const char *key, uint8_t *data, size_t length,
+                                             const char *etag, const char *content_type, const char *meta)
+{
+  bool found;
+  size_t pos = object_search(mock, bucket, key, &found);
+  struct s3mock_object_st *object;
+
+  if (found)
+  {
+    object = mock->objects[pos];
+    free(object->data);
+  }
+  else
+  {
+    if (mock->object_count == mock->object_alloced)
+    {
+      mock->object_alloced = mock->object_alloced ? mock->object_alloced * 2 : 64;
+      mock->objects = realloc(mock->objects,
+                              sizeof(struct s3mock_object_st *) * mock->object_alloced);
+    }
+
+    memmove(&mock->objects[pos + 1], &mock->objects[pos],
+            sizeof(struct s3mock_object_st *) * (mock->object_count - pos));
+    object = calloc(1, sizeof(struct s3mock_object_st));
+    object->bucket = strdup(bucket);
+    object->key = strdup(key);
+    mock->objects[pos] = object;
+    mock->object_count++;
+  }
+
+  object->data = data;
+  object->length = length;
+  object->last_modified = time(NULL);
+
+  if (etag)
+  {
+    snprintf(object->etag, sizeof(object->etag), "%s", etag);
+  }
+  else
+  {
+    format_etag(data, length, object->etag);
+  }
+
+  snprintf(object->content_type, sizeof(object->content_type), "%s",
+           content_type ? content_type : "binary/octet-stream");
+  snprintf(object->meta, sizeof(object->meta), "%s",
+           meta ? meta : S3MOCK_DEFAULT_META);
+  return object;
+}
+
+static bool object_remove(s3mock_st *mock, const char *bucket,
+                          const char *key)
+{
+  bool found;
+  size_t pos = object_search(mock, bucket, key, &found);
+
+  if (!found)
+  {
+    return false;
+  }
+
+  object_free(mock->objects[pos]);
+  memmove(&mock->objects[pos], &mock->objects[pos + 1],
+          sizeof(struct s3mock_object_st *) * (mock->object_count - pos - 1));
+  mock->object_count--;
+  return true;
+}
+
+static uint8_t *copy_data(const uint8_t *data, size_t length)
+{
+  uint8_t *ret = malloc(length ? length : 1);
+
+  if (length)
+  {
+    memcpy(ret, data, length);
+  }
+
+  return ret;
+}
+
+/* Parses "bytes=a-b" against an object length. Returns false if the range
+ * cannot be satisfied.
+ */
+static bool parse_range(const char *range, size_t length, size_t *start,
+                        size_t *end)
+{
+  const char *dash;
+
+  if (strncmp(range, "bytes=", 6))
+  {
+    return false;
+  }
+
+  range += 6;
+  dash = strchr(range, '-');
+
+  if (!dash)
+  {
+    return false;
+  }
+
+  if (dash == range)
+  {
+    size_t suffix = strtoull(dash + 1, NULL, 10);
+
+    if (!suffix || !length)
+    {
+      return false;
+    }
+
+    *start = suffix >= length ? 0 : length - suffix;
+    *end = length - 1;
+    return true;
+  }
+
+  *start = strtoull(range, NULL, 10);
+  *end = dash[1] ? strtoull(dash + 1, NULL, 10) : length - 1;
+
+  if (*end >= length)
+  {
+    *end = length - 1;
+  }
+
+  return *start < length && *start <= *end;
+}
+
+/* Handlers */
+
+static bool handle_get(struct s3mock_connection_st *conn,
+                       struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_object_st *object;
+  const char *range = get_header(req, "Range");
+  const char *if_none_match = get_header(req, "If-None-Match");
+  const char *if_modified_since = get_header(req, "If-Modified-Since");
+  const char *if_match = get_header(req, "If-Match");
+  char headers[2048];
+  char modified[64];
+  uint8_t *data;
+  size_t start = 0;
+  size_t end = 0;
+  size_t length;
+  int status = 200;
+  bool chunked;
+  bool ret;
+
+  pthread_mutex_lock(&mock->lock);
+  object = object_find(mock, req->bucket, req->key);
+  chunked = mock->chunked;
+
+  if (!object)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 404, "NoSuchKey",
+                      "The specified key does not exist.");
+  }
+
+  format_http_date(object->last_modified, modified, sizeof(modified));
+
+  if (if_match && strcmp(if_match, object->etag))
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 412, "PreconditionFailed",
+                      "At least one of the pre-conditions you specified did not hold");
+  }
+
+  // If-Modified-Since is ignored when there is an If-None-Match
+  if ((if_none_match && !strcmp(if_none_match, object->etag)) ||
+      (!if_none_match && if_modified_since &&
+       parse_http_date(if_modified_since) >= object->last_modified))
+  {
+    snprintf(headers, sizeof(headers), "ETag: %s\r\nLast-Modified: %s\r\n",
+             object->etag, modified);
+    pthread_mutex_unlock(&mock->lock);
+    // 304 has no body, even though we are not a HEAD
+    return send_response(conn, req, 304, headers, NULL, 0);
+  }
+
+  length = object->length;
+
+  if (range)
+  {
+    if (!parse_range(range, object->length, &start, &end))
+    {
+      pthread_mutex_unlock(&mock->lock);
+      return send_error(conn, req, 416, "InvalidRange",
+                        "The requested range is not satisfiable");
+    }
+
+    status = 206;
+    length = end - start + 1;
+    snprintf(headers, sizeof(headers),
+             "Content-Type: %s\r\nETag: %s\r\nLast-Modified: %s\r\n"
+             "Accept-Ranges: bytes\r\nContent-Range: bytes %zu-%zu/%zu\r\n%s",
+             object->content_type, object->etag, modified, start, end,
+             object->length, object->meta);
+  }
+  else
+  {
+    snprintf(headers, sizeof(headers),
+             "Content-Type: %s\r\nETag: %s\r\nLast-Modified: %s\r\n"
+             "Accept-Ranges: bytes\r\n%s",
+             object->content_type, object->etag, modified, object->meta);
+  }
+
+  // Copy so the lock isn't held while sending
+  data = copy_data(object->data + start, length);
+  pthread_mutex_unlock(&mock->lock);
+
+  if (chunked)
+  {
+    ret = send_chunked(conn, status, headers, data, length);
+  }
+  else
+  {
+    ret = send_response(conn, req, status, headers, data, length);
+  }
+
+  free(data);
+  return ret;
+}
+
+static bool handle_head(struct s3mock_connection_st *conn,
+                        struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_object_st *object;
+  char headers[2048];
+  char modified[64];
+  size_t length;
+
+  pthread_mutex_lock(&mock->lock);
+  object = object_find(mock, req->bucket, req->key);
+
+  if (!object)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 404, "NoSuchKey", "Not Found");
+  }
+
+  format_http_date(object->last_modified, modified, sizeof(modified));
+  snprintf(headers, sizeof(headers),
+           "Content-Type: %s\r\nETag: %s\r\nLast-Modified: %s\r\n"
+           "Accept-Ranges: bytes\r\n%s",
+           object->content_type, object->etag, modified, object->meta);
+  length = object->length;
+  pthread_mutex_unlock(&mock->lock);
+
+  // Content-Length is the object length, HEAD never sends the body
+  return send_response(conn, req, 200, headers, NULL, length);
+}
+
+static bool handle_delete(struct s3mock_connection_st *conn,
+                          struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+
+  pthread_mutex_lock(&mock->lock);
+  object_remove(mock, req->bucket, req->key);
+  pthread_mutex_unlock(&mock->lock);
+
+  // S3 answers 204 even when the key did not exist
+  return send_response(conn, req, 204, NULL, NULL, 0);
+}
+
+static bool split_copy_source(const char *source, char **bucket, char **key)
+{
+  char *decoded = url_decode(source, strlen(source));
+  char *start = decoded[0] == '/' ? decoded + 1 : decoded;
+  char *slash = strchr(start, '/');
+
+  if (!slash)
+  {
+    free(decoded);
+    return false;
+  }
+
+  *bucket = strndup(start, (size_t)(slash - start));
+  *key = strdup(slash + 1);
+  free(decoded);
+  return true;
+}
+
+static bool handle_put(struct s3mock_connection_st *conn,
+                       struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_object_st *object;
+  const char *copy_source = get_header(req, "x-amz-copy-source");
+  char headers[256];
+  char meta[512];
+
+  if (copy_source)
+  {
+    struct s3mock_string_st xml = {NULL, 0, 0};
+    struct s3mock_object_st *source;
+    char *source_bucket;
+    char *source_key;
+    char modified[64];
+
+    if (!split_copy_source(copy_source, &source_bucket, &source_key))
+    {
+      return send_error(conn, req, 400, "InvalidArgument",
+                        "Copy Source must mention the source bucket and key");
+    }
+
+    pthread_mutex_lock(&mock->lock);
+    source = object_find(mock, source_bucket, source_key);
+
+    if (!source)
+    {
+      pthread_mutex_unlock(&mock->lock);
+      free(source_bucket);
+      free(source_key);
+      return send_error(conn, req, 404, "NoSuchKey",
+                        "The specified key does not exist.");
+    }
+
+    if (source->length > mock->max_copy_size)
+    {
+      snprintf(meta, sizeof(meta),
+               "The specified copy source is larger than the maximum allowable size for a copy source: %" PRIu64,
+               mock->max_copy_size);
+      pthread_mutex_unlock(&mock->lock);
+      free(source_bucket);
+      free(source_key);
+      return send_error(conn, req, 400, "InvalidRequest", meta);
+    }
+
+    // The metadata goes with the data, as with x-amz-metadata-directive: COPY
+    object = object_store(mock, req->bucket, req->key,
+                          copy_data(source->data, source->length), source->length, source->etag,
+                          source->content_type, source->meta);
+    format_iso_date(object->last_modified, modified, sizeof(modified));
+    str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<CopyObjectResult>");
+    str_append_element(&xml, "LastModified", modified);
+    str_append_element(&xml, "ETag", object->etag);
+    str_append(&xml, "</CopyObjectResult>");
+    pthread_mutex_unlock(&mock->lock);
+    free(source_bucket);
+    free(source_key);
+    return send_xml(conn, req, 200, NULL, &xml);
+  }
+
+  meta_collect(req, meta, sizeof(meta));
+  pthread_mutex_lock(&mock->lock);
+  object = object_store(mock, req->bucket, req->key, req->body,
+                        req->body_length, NULL, get_header(req, "Content-Type"),
+                        meta);
+  req->body = NULL;
+  snprintf(headers, sizeof(headers), "ETag: %s\r\n", object->etag);
+  pthread_mutex_unlock(&mock->lock);
+  return send_response(conn, req, 200, headers, NULL, 0);
+}
+
+static void token_encode(const char *key, char *out, size_t length)
+{
+  size_t key_length = strlen(key);
+
+  if (key_length * 2 + 1 > length)
+  {
+    key_length = (length - 1) / 2;
+  }
+
+  hex_encode((const uint8_t *)key, key_length, out);
+}
+
+static char *token_decode(const char *token)
+{
+  size_t length = strlen(token) / 2;
+  char *out = malloc(length + 1);
+  size_t pos;
+
+  for (pos = 0; pos < length; pos++)
+  {
+    out[pos] = (char)(hex_value(token[pos * 2]) * 16 + hex_value(token[pos * 2 +
+                                                                       1]));
+  }
+
+  out[length] = '\0';
+  return out;
+}
+
+static bool handle_list(struct s3mock_connection_st *conn,
+                        struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  const char *list_type = get_param(req, "list-type");
+  const char *prefix = get_param(req, "prefix");
+  const char *delimiter = get_param(req, "delimiter");
+  const char *max_keys_param = get_param(req, "max-keys");
+  const char *start_param;
+  char *start_after = NULL;
+  char *last_prefix = NULL;
+  const char *last_entry = NULL;
+  bool version2 = list_type && !strcmp(list_type, "2");
+  bool truncated = false;
+  size_t max_keys;
+  size_t count = 0;
+  size_t pos;
+  bool found;
+  char number[32];
+
+  if (!prefix)
+  {
+    prefix = "";
+  }
+
+  if (delimiter && !delimiter[0])
+  {
+    delimiter = NULL;
+  }
+
+  if (version2)
+  {
+    start_param = get_param(req, "continuation-token");
+
+    if (start_param)
+    {
+      start_after = token_decode(start_param);
+    }
+    else if ((start_param = get_param(req, "start-after")))
+    {
+      start_after = strdup(start_param);
+    }
+  }
+  else if ((start_param = get_param(req, "marker")))
+  {
+    start_after = strdup(start_param);
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  max_keys = mock->max_keys;
+
+  if (max_keys_param && strtoull(max_keys_param, NULL, 10) < max_keys)
+  {
+    max_keys = strtoull(max_keys_param, NULL, 10);
+  }
+
+  str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">");
+  str_append_element(&xml, "Name", req->bucket);
+  str_append_element(&xml, "Prefix", prefix);
+
+  if (start_after)
+  {
+    pos = object_search(mock, req->bucket, start_after, &found);
+
+    if (found)
+    {
+      pos++;
+    }
+  }
+  else
+  {
+    pos = object_search(mock, req->bucket, "", &found);
+  }
+
+  for (; pos < mock->object_count; pos++)
+  {
+    struct s3mock_object_st *object = mock->objects[pos];
+    const char *rest;
+    const char *delim_pos;
+
+    if (strcmp(object->bucket, req->bucket))
+    {
+      break;
+    }
+
+    if (strncmp(object->key, prefix, strlen(prefix)))
+    {
+      if (strcmp(object->key, prefix) > 0)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    rest = object->key + strlen(prefix);
+    delim_pos = delimiter ? strstr(rest, delimiter) : NULL;
+
+    if (delim_pos)
+    {
+      size_t prefix_length = (size_t)(delim_pos - object->key) + strlen(delimiter);
+
+      if (last_prefix && strlen(last_prefix) == prefix_length &&
+          !strncmp(last_prefix, object->key, prefix_length))
+      {
+        continue;
+      }
+
+      if (count == max_keys)
+      {
+        truncated = true;
+        break;
+      }
+
+      free(last_prefix);
+      last_prefix = strndup(object->key, prefix_length);
+      str_append(&xml, "<CommonPrefixes>");
+      str_append_element(&xml, "Prefix", last_prefix);
+      str_append(&xml, "</CommonPrefixes>");
+      last_entry = object->key;
+      count++;
+      continue;
+    }
+
+    if (count == max_keys)
+    {
+      truncated = true;
+      break;
+    }
+
+    {
+      char modified[64];
+      char size[32];
+
+      format_iso_date(object->last_modified, modified, sizeof(modified));
+      snprintf(size, sizeof(size), "%zu", object->length);
+      str_append(&xml, "<Contents>");
+      str_append_element(&xml, "Key", object->key);
+      str_append_element(&xml, "LastModified", modified);
+      str_append_element(&xml, "ETag", object->etag);
+      str_append_element(&xml, "Size", size);
+      str_append_element(&xml, "StorageClass", "STANDARD");
+      str_append(&xml, "</Contents>");
+    }
+
+    last_entry = object->key;
+    count++;
+  }
+
+  snprintf(number, sizeof(number), "%zu", max_keys);
+  str_append_element(&xml, "MaxKeys", number);
+
+  if (version2)
+  {
+    snprintf(number, sizeof(number), "%zu", count);
+    str_append_element(&xml, "KeyCount", number);
+  }
+
+  str_append_element(&xml, "IsTruncated", truncated ? "true" : "false");
+
+  if (truncated && last_entry)
+  {
+    if (version2)
+    {
+      char token[2048];
+      // Skip past a whole common prefix when that is the last entry
+      const char *resume = last_prefix && !strncmp(last_entry, last_prefix,
+                                                   strlen(last_prefix)) ? last_prefix : last_entry;
+      char *resume_key = strdup(resume);
+
+      if (resume == last_prefix)
+      {
+        // Anything after every key under the prefix
+        size_t length = strlen(resume_key);
+        resume_key = realloc(resume_key, length + 2);
+        resume_key[length] = '\xff';
+        resume_key[length + 1] = '\0';
+      }
+
+      token_encode(resume_key, token, sizeof(token));
+      str_append_element(&xml, "NextContinuationToken", token);
+      free(resume_key);
+    }
+    else if (delimiter)
+    {
+      str_append_element(&xml, "NextMarker", last_entry);
+    }
+  }
+
+  str_append(&xml, "</ListBucketResult>");
+  pthread_mutex_unlock(&mock->lock);
+  free(start_after);
+  free(last_prefix);
+  return send_xml(conn, req, 200, NULL, &xml);
+}
+
+/* Multipart uploads. Caller holds the lock. */
+
+static struct s3mock_upload_st *upload_find(s3mock_st *mock, const char *id)
+{
+  struct s3mock_upload_st *upload;
+
+  for (upload = mock->uploads; upload; upload = upload->next)
+  {
+    if (!strcmp(upload->id, id))
+    {
+      return upload;
+    }
+  }
+
+  return NULL;
+}
+
+static void upload_free(struct s3mock_upload_st *upload)
+{
+  struct s3mock_part_st *part = upload->parts;
+
+  while (part)
+  {
+    struct s3mock_part_st *next = part->next;
+    free(part->data);
+    free(part);
+    part = next;
+  }
+
+  free(upload->bucket);
+  free(upload->key);
+  free(upload);
+}
+
+static void upload_remove(s3mock_st *mock, struct s3mock_upload_st *upload)
+{
+  struct s3mock_upload_st **it;
+
+  for (it = &mock->uploads; *it; it = &(*it)->next)
+  {
+    if (*it == upload)
+    {
+      *it = upload->next;
+      upload_free(upload);
+      return;
+    }
+  }
+}
+
+static bool handle_initiate_upload(struct s3mock_connection_st *conn,
+                                   struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  struct s3mock_upload_st *upload = calloc(1, sizeof(struct s3mock_upload_st));
+
+  pthread_mutex_lock(&mock->lock);
+  snprintf(upload->id, sizeof(upload->id), "mock-upload-%" PRIu64,
+           ++mock->upload_counter);
+  upload->bucket = strdup(req->bucket);
+  upload->key = strdup(req->key);
+  snprintf(upload->content_type, sizeof(upload->content_type), "%s",
+           get_header(req, "Content-Type") ? get_header(req, "Content-Type") : "");
+  meta_collect(req, upload->meta, sizeof(upload->meta));
+  upload->next = mock->uploads;
+  mock->uploads = upload;
+  str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<InitiateMultipartUploadResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">");
+  str_append_element(&xml, "Bucket", upload->bucket);
+  str_append_element(&xml, "Key", upload->key);
+  str_append_element(&xml, "UploadId", upload->id);
+  str_append(&xml, "</InitiateMultipartUploadResult>");
+  pthread_mutex_unlock(&mock->lock);
+  return send_xml(conn, req, 200, NULL, &xml);
+}
+
+static bool handle_upload_part(struct s3mock_connection_st *conn,
+                               struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_upload_st *upload;
+  struct s3mock_part_st *part;
+  struct s3mock_part_st **it;
+  const char *copy_source = get_header(req, "x-amz-copy-source");
+  int number = atoi(get_param(req, "partNumber"));
+  char headers[256];
+  uint8_t *data;
+  size_t length;
+
+  if (number < 1 || number > 10000)
+  {
+    return send_error(conn, req, 400, "InvalidArgument",
+                      "Part number must be an integer between 1 and 10000, inclusive");
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  upload = upload_find(mock, get_param(req, "uploadId"));
+
+  if (!upload)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 404, "NoSuchUpload",
+                      "The specified upload does not exist.");
+  }
+
+  if (copy_source)
+  {
+    const char *range = get_header(req, "x-amz-copy-source-range");
+    struct s3mock_object_st *source;
+    char *source_bucket;
+    char *source_key;
+    size_t start = 0;
+    size_t end;
+
+    if (!split_copy_source(copy_source, &source_bucket, &source_key))
+    {
+      pthread_mutex_unlock(&mock->lock);
+      return send_error(conn, req, 400, "InvalidArgument",
+                        "Copy Source must mention the source bucket and key");
+    }
+
+    source = object_find(mock, source_bucket, source_key);
+    free(source_bucket);
+    free(source_key);
+
+    if (!source)
+    {
+      pthread_mutex_unlock(&mock->lock);
+      return send_error(conn, req, 404, "NoSuchKey",
+                        "The specified key does not exist.");
+    }
+
+    end = source->length ? source->length - 1 : 0;
+
+    if (range && !parse_range(range, source->length, &start, &end))
+    {
+      pthread_mutex_unlock(&mock->lock);
+      return send_error(conn, req, 416, "InvalidRange",
+                        "The requested range is not satisfiable");
+    }
+
+    length = source->length ? end - start + 1 : 0;
+    data = copy_data(source->data + start, length);
+  }
+  else
+  {
+    data = req->body;
+    length = req->body_length;
+    req->body = NULL;
+  }
+
+  // Replace any previous upload of the same part number
+  for (it = &upload->parts; *it; it = &(*it)->next)
+  {
+    if ((*it)->number == number)
+    {
+      part = *it;
+      *it = part->next;
+      free(part->data);
+      free(part);
+      break;
+    }
+  }
+
+  part = calloc(1, sizeof(struct s3mock_part_st));
+  part->number = number;
+  part->data = data;
+  part->length = length;
+  format_etag(data, length, part->etag);
+  part->next = upload->parts;
+  upload->parts = part;
+
+  if (copy_source)
+  {
+    struct s3mock_string_st xml = {NULL, 0, 0};
+    char modified[64];
+
+    format_iso_date(time(NULL), modified, sizeof(modified));
+    str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<CopyPartResult>");
+    str_append_element(&xml, "LastModified", modified);
+    str_append_element(&xml, "ETag", part->etag);
+    str_append(&xml, "</CopyPartResult>");
+    pthread_mutex_unlock(&mock->lock);
+    return send_xml(conn, req, 200, NULL, &xml);
+  }
+
+  snprintf(headers, sizeof(headers), "ETag: %s\r\n", part->etag);
+  pthread_mutex_unlock(&mock->lock);
+  return send_response(conn, req, 200, headers, NULL, 0);
+}
+
+/* Finds the text of the next <name>...</name> after *pos, advancing *pos */
+static char *xml_next_element(const char **pos, const char *name)
+{
+  char open[64];
+  char close[64];
+  const char *start;
+  const char *end;
+  char *raw;
+  char *out;
+  char *in_ptr;
+  char *out_ptr;
+
+  snprintf(open, sizeof(open), "<%s>", name);
+  snprintf(close, sizeof(close), "</%s>", name);
+  start = strstr(*pos, open);
+
+  if (!start)
+  {
+    return NULL;
+  }
+
+  start += strlen(open);
+  end = strstr(start, close);
+
+  if (!end)
+  {
+    return NULL;
+  }
+
+  *pos = end + strlen(close);
+  raw = strndup(start, (size_t)(end - start));
+  out = malloc(strlen(raw) + 1);
+
+  // Decode the basic entities
+  for (in_ptr = raw, out_ptr = out; *in_ptr;)
+  {
+    if (!strncmp(in_ptr, "&quot;", 6))
+    {
+      *out_ptr++ = '"';
+      in_ptr += 6;
+    }
+    else if (!strncmp(in_ptr, "&amp;", 5))
+    {
+      *out_ptr++ = '&';
+      in_ptr += 5;
+    }
+    else if (!strncmp(in_ptr, "&lt;", 4))
+    {
+      *out_ptr++ = '<';
+      in_ptr += 4;
+    }
+    else if (!strncmp(in_ptr, "&gt;", 4))
+    {
+      *out_ptr++ = '>';
+      in_ptr += 4;
+    }
+    else
+    {
+      *out_ptr++ = *in_ptr++;
+    }
+  }
+
+  *out_ptr = '\0';
+  free(raw);
+  return out;
+}
+
+static bool handle_complete_upload(struct s3mock_connection_st *conn,
+                                   struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_upload_st *upload;
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  struct s3mock_string_st data = {NULL, 0, 0};
+  struct s3mock_string_st etags = {NULL, 0, 0};
+  struct s3mock_object_st *object;
+  const char *pos = (const char *)req->body;
+  const char *error_code = NULL;
+  const char *error_message = NULL;
+  char *part_xml;
+  char etag[64];
+  uint8_t hash[32];
+  int last_number = 0;
+  size_t parts = 0;
+  size_t last_length = 0;
+
+  pthread_mutex_lock(&mock->lock);
+  upload = upload_find(mock, get_param(req, "uploadId"));
+
+  if (!upload)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 404, "NoSuchUpload",
+                      "The specified upload does not exist.");
+  }
+
+  while (pos && (part_xml = xml_next_element(&pos, "Part")))
+  {
+    const char *part_pos = part_xml;
+    char *number_str = xml_next_element(&part_pos, "PartNumber");
+    char *part_etag;
+    struct s3mock_part_st *part;
+    int number;
+
+    part_pos = part_xml;
+    part_etag = xml_next_element(&part_pos, "ETag");
+    number = number_str ? atoi(number_str) : 0;
+
+    for (part = upload->parts; part; part = part->next)
+    {
+      if (part->number == number)
+      {
+        break;
+      }
+    }
+
+    if (!part || !part_etag || strcmp(part->etag, part_etag))
+    {
+      error_code = "InvalidPart";
+      error_message = "One or more of the specified parts could not be found.";
+    }
+    else if (number <= last_number)
+    {
+      error_code = "InvalidPartOrder";
+      error_message = "The list of parts was not in ascending order.";
+    }
+    else if (parts && last_length < mock->min_part_size)
+    {
+      error_code = "EntityTooSmall";
+      error_message = "Your proposed upload is smaller than the minimum allowed size";
+    }
+    else
+    {
+      str_append_length(&data, (const char *)part->data, part->length);
+      str_append(&etags, part->etag);
+      last_length = part->length;
+      last_number = number;
+      parts++;
+    }
+
+    free(number_str);
+    free(part_etag);
+    free(part_xml);
+
+    if (error_code)
+    {
+      break;
+    }
+  }
+
+  if (!error_code && !parts)
+  {
+    error_code = "MalformedXML";
+    error_message = "The XML you provided was not well-formed";
+  }
+
+  if (error_code)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    free(data.data);
+    free(etags.data);
+    return send_error(conn, req, 400, error_code, error_message);
+  }
+
+  sha256((uint8_t *)etags.data, etags.length, hash);
+  etag[0] = '"';
+  hex_encode(hash, 16, etag + 1);
+  snprintf(etag + 33, sizeof(etag) - 33, "-%zu\"", parts);
+
+  object = object_store(mock, upload->bucket, upload->key,
+                        data.data ? (uint8_t *)data.data : copy_data(NULL, 0), data.length,
+                        etag, upload->content_type[0] ? upload->content_type : NULL,
+                        upload->meta);
+  str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<CompleteMultipartUploadResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">");
+  str_append_element(&xml, "Location", upload->key);
+  str_append_element(&xml, "Bucket", upload->bucket);
+  str_append_element(&xml, "Key", upload->key);
+  str_append_element(&xml, "ETag", object->etag);
+  str_append(&xml, "</CompleteMultipartUploadResult>");
+  upload_remove(mock, upload);
+  pthread_mutex_unlock(&mock->lock);
+  free(etags.data);
+  return send_xml(conn, req, 200, NULL, &xml);
+}
+
+static bool handle_abort_upload(struct s3mock_connection_st *conn,
+                                struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_upload_st *upload;
+
+  pthread_mutex_lock(&mock->lock);
+  upload = upload_find(mock, get_param(req, "uploadId"));
+
+  if (!upload)
+  {
+    pthread_mutex_unlock(&mock->lock);
+    return send_error(conn, req, 404, "NoSuchUpload",
+                      "The specified upload does not exist.");
+  }
+
+  upload_remove(mock, upload);
+  pthread_mutex_unlock(&mock->lock);
+  return send_response(conn, req, 204, NULL, NULL, 0);
+}
+
+static void base64_encode(const uint8_t *data, size_t length, char *out)
+{
+  static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t pos;
+
+  for (pos = 0; pos < length; pos += 3)
+  {
+    uint32_t block = (uint32_t)data[pos] << 16;
+
+    if (pos + 1 < length)
+    {
+      block |= (uint32_t)data[pos + 1] << 8;
+    }
+
+    if (pos + 2 < length)
+    {
+      block |= data[pos + 2];
+    }
+
+    *out++ = alphabet[(block >> 18) & 0x3f];
+    *out++ = alphabet[(block >> 12) & 0x3f];
+    *out++ = pos + 1 < length ? alphabet[(block >> 6) & 0x3f] : '=';
+    *out++ = pos + 2 < length ? alphabet[block & 0x3f] : '=';
+  }
+
+  *out = '\0';
+}
+
+/* DeleteObjects. Keys longer than S3 allows are reported as failed so the
+ * per key error path can be tested.
+ */
+static bool handle_delete_objects(struct s3mock_connection_st *conn,
+                                  struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  const char *content_md5 = get_header(req, "Content-MD5");
+  const char *pos = (const char *)req->body;
+  char *quiet;
+  char *object_xml;
+  uint8_t digest[MD5_MAC_LEN];
+  char expected_md5[32];
+  bool is_quiet;
+  size_t keys = 0;
+
+  if (!content_md5)
+  {
+    return send_error(conn, req, 400, "InvalidRequest",
+                      "Missing required header for this request: Content-MD5");
+  }
+
+  md5(req->body, req->body_length, digest);
+  base64_encode(digest, MD5_MAC_LEN, expected_md5);
+
+  if (strcmp(content_md5, expected_md5))
+  {
+    return send_error(conn, req, 400, "BadDigest",
+                      "The Content-MD5 you specified did not match what we received.");
+  }
+
+  quiet = pos ? xml_next_element(&pos, "Quiet") : NULL;
+  is_quiet = quiet && !strcmp(quiet, "true");
+  free(quiet);
+  pos = (const char *)req->body;
+
+  str_append(&xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<DeleteResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">");
+  pthread_mutex_lock(&mock->lock);
+
+  while (pos && (object_xml = xml_next_element(&pos, "Object")))
+  {
+    const char *object_pos = object_xml;
+    char *key = xml_next_element(&object_pos, "Key");
+
+    if (key && strlen(key) > 1024)
+    {
+      str_append(&xml, "<Error>");
+      str_append_element(&xml, "Key", key);
+      str_append_element(&xml, "Code", "KeyTooLongError");
+      str_append_element(&xml, "Message", "Your key is too long");
+      str_append(&xml, "</Error>");
+    }
+    else if (key)
+    {
+      object_remove(mock, req->bucket, key);
+
+      if (!is_quiet)
+      {
+        str_append(&xml, "<Deleted>");
+        str_append_element(&xml, "Key", key);
+        str_append(&xml, "</Deleted>");
+      }
+    }
+
+    keys++;
+    free(key);
+    free(object_xml);
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+
+  if (!keys || keys > 1000)
+  {
+    free(xml.data);
+    return send_error(conn, req, 400, "MalformedXML",
+                      "The XML you provided was not well-formed");
+  }
+
+  str_append(&xml, "</DeleteResult>");
+  return send_xml(conn, req, 200, NULL, &xml);
+}
+
+/* A new key pair which the server then accepts, for AssumeRole and the
+ * metadata endpoints
+ */
+static void issue_credentials(s3mock_st *mock, char *key, size_t key_length,
+                              char *secret, size_t secret_length,
+                              char *expiration, size_t expiration_length)
+{
+  uint64_t counter;
+  int64_t lifetime;
+
+  pthread_mutex_lock(&mock->lock);
+  counter = ++mock->credential_counter;
+  lifetime = mock->credential_lifetime;
+  pthread_mutex_unlock(&mock->lock);
+
+  snprintf(key, key_length, "ASIAMOCK%012" PRIu64, counter);
+  snprintf(secret, secret_length, "temporarysecret%025" PRIu64, counter);
+  s3mock_add_credentials(mock, key, secret);
+  format_iso_date(time(NULL) + (time_t)lifetime, expiration,
+                  expiration_length);
+}
+
+/* STS AssumeRole */
+static bool handle_assume_role(struct s3mock_connection_st *conn,
+                               struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  struct s3mock_string_st xml = {NULL, 0, 0};
+  const char *role_arn = get_param(req, "RoleArn");
+  char key[32];
+  char secret[48];
+  char expiration[32];
+
+  if (!role_arn || !role_arn[0])
+  {
+    return send_error(conn, req, 400, "ValidationError",
+                      "RoleArn is required.");
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  mock->assume_role_counter++;
+  pthread_mutex_unlock(&mock->lock);
+  issue_credentials(mock, key, sizeof(key), secret, sizeof(secret), expiration,
+                    sizeof(expiration));
+
+  str_append(&xml, "<AssumeRoleResponse xmlns=\"https://sts.amazonaws.com/doc/2011-06-15/\">"
+             "<AssumeRoleResult><Credentials>");
+  str_append_element(&xml, "AccessKeyId", key);
+  str_append_element(&xml, "SecretAccessKey", secret);
+  str_append_element(&xml, "SessionToken", "mocksessiontoken");
+  str_append_element(&xml, "Expiration", expiration);
+  str_append(&xml, "</Credentials><AssumedRoleUser>");
+  str_append_element(&xml, "Arn", role_arn);
+  str_append(&xml, "</AssumedRoleUser></AssumeRoleResult></AssumeRoleResponse>");
+  return send_xml(conn, req, 200, NULL, &xml);
+}
+
+/* Instance metadata, IMDSv2 under /latest/ and a container credentials
+ * endpoint under /v2/credentials/. These are not signed.
+ */
+static bool handle_metadata(struct s3mock_connection_st *conn,
+                            struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  const char *imds_prefix = "/latest/meta-data/iam/security-credentials/";
+  const char *token;
+  char key[32];
+  char secret[48];
+  char expiration[32];
+  char body[512];
+  int length;
+
+  if (!strcmp(req->path, "/latest/api/token"))
+  {
+    if (strcmp(req->method, "PUT") ||
+        !get_header(req, "X-aws-ec2-metadata-token-ttl-seconds"))
+    {
+      return send_response(conn, req, 400, NULL, NULL, 0);
+    }
+
+    return send_response(conn, req, 200, "Content-Type: text/plain\r\n",
+                         S3MOCK_IMDS_TOKEN, strlen(S3MOCK_IMDS_TOKEN));
+  }
+
+  if (!strncmp(req->path, imds_prefix, strlen(imds_prefix)))
+  {
+    const char *role = req->path + strlen(imds_prefix);
+
+    token = get_header(req, "X-aws-ec2-metadata-token");
+
+    if (!token || strcmp(token, S3MOCK_IMDS_TOKEN))
+    {
+      return send_response(conn, req, 401, NULL, NULL, 0);
+    }
+
+    if (!role[0])
+    {
+      return send_response(conn, req, 200, "Content-Type: text/plain\r\n",
+                           "mockrole", 8);
+    }
+
+    if (strcmp(role, "mockrole"))
+    {
+      return send_response(conn, req, 404, NULL, NULL, 0);
+    }
+  }
+  else
+  {
+    token = get_header(req, "Authorization");
+
+    if (!token || strcmp(token, S3MOCK_ECS_TOKEN))
+    {
+      return send_response(conn, req, 401, NULL, NULL, 0);
+    }
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  mock->metadata_counter++;
+  pthread_mutex_unlock(&mock->lock);
+  issue_credentials(mock, key, sizeof(key), secret, sizeof(secret), expiration,
+                    sizeof(expiration));
+  length = snprintf(body, sizeof(body),
+                    "{\n  \"Code\" : \"Success\",\n  \"Type\" : \"AWS-HMAC\",\n"
+                    "  \"AccessKeyId\" : \"%s\",\n  \"SecretAccessKey\" : \"%s\",\n"
+                    "  \"Token\" : \"mocksessiontoken\",\n  \"Expiration\" : \"%s\"\n}",
+                    key, secret, expiration);
+  return send_response(conn, req, 200, "Content-Type: application/json\r\n",
+                       body, (size_t)length);
+}
+
+static bool handle_request(struct s3mock_connection_st *conn,
+                           struct s3mock_request_st *req)
+{
+  s3mock_st *mock = conn->mock;
+  const char *error;
+  size_t method_it;
+  int error_status = 0;
+  char error_code[64];
+
+  pthread_mutex_lock(&mock->lock);
+  mock->request_counter++;
+
+  for (method_it = 0; method_names[method_it]; method_it++)
+  {
+    if (!strcmp(method_names[method_it], req->method))
+    {
+      mock->method_counters[method_it]++;
+    }
+  }
+
+  if (mock->error_count)
+  {
+    mock->error_count--;
+    error_status = mock->error_status;
+    snprintf(error_code, sizeof(error_code), "%s", mock->error_code);
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+
+  if (error_status)
+  {
+    return send_error(conn, req, error_status, error_code, "Injected error");
+  }
+
+  if (!strncmp(req->path, "/latest/", 8) ||
+      !strncmp(req->path, "/v2/credentials/", 16))
+  {
+    return handle_metadata(conn, req);
+  }
+
+  error = verify_signature(mock, req);
+
+  if (error)
+  {
+    return send_error(conn, req, 403, error,
+                      "The request signature we calculated does not match the signature you provided.");
+  }
+
+  if (!req->bucket[0] && get_param(req, "Action"))
+  {
+    if (!strcmp(get_param(req, "Action"), "AssumeRole"))
+    {
+      return handle_assume_role(conn, req);
+    }
+
+    return send_error(conn, req, 400, "InvalidAction",
+                      "The action is not supported.");
+  }
+
+  if (!req->bucket[0])
+  {
+    return send_error(conn, req, 400, "InvalidBucketName",
+                      "The specified bucket is not valid.");
+  }
+
+  if (!req->key[0])
+  {
+    if (!strcmp(req->method, "GET"))
+    {
+      return handle_list(conn, req);
+    }
+
+    if (!strcmp(req->method, "POST") && get_param(req, "delete"))
+    {
+      return handle_delete_objects(conn, req);
+    }
+
+    return send_error(conn, req, 405, "MethodNotAllowed",
+                      "The specified method is not allowed against this resource.");
+  }
+
+  if (!strcmp(req->method, "GET"))
+  {
+    return handle_get(conn, req);
+  }
+
+  if (!strcmp(req->method, "HEAD"))
+  {
+    return handle_head(conn, req);
+  }
+
+  if (!strcmp(req->method, "PUT"))
+  {
+    if (get_param(req, "uploadId") && get_param(req, "partNumber"))
+    {
+      return handle_upload_part(conn, req);
+    }
+
+    return handle_put(conn, req);
+  }
+
+  if (!strcmp(req->method, "POST"))
+  {
+    if (get_param(req, "uploads"))
+    {
+      return handle_initiate_upload(conn, req);
+    }
+
+    if (get_param(req, "uploadId"))
+    {
+      return handle_complete_upload(conn, req);
+    }
+  }
+
+  if (!strcmp(req->method, "DELETE"))
+  {
+    if (get_param(req, "uploadId"))
+    {
+      return handle_abort_upload(conn, req);
+    }
+
+    return handle_delete(conn, req);
+  }
+
+  return send_error(conn, req, 405, "MethodNotAllowed",
+                    "The specified method is not allowed against this resource.");
+}
+
+/* Threads */
+
+static void connection_remove(s3mock_st *mock, int fd)
+{
+  size_t pos;
+
+  pthread_mutex_lock(&mock->lock);
+
+  for (pos = 0; pos < mock->connection_count; pos++)
+  {
+    if (mock->connections[pos] == fd)
+    {
+      mock->connections[pos] = mock->connections[--mock->connection_count];
+      break;
+    }
+  }
+
+  pthread_cond_broadcast(&mock->cond);
+  pthread_mutex_unlock(&mock->lock);
+}
+
+static void *connection_thread(void *arg)
+{
+  struct s3mock_connection_st *conn = arg;
+  struct s3mock_request_st req;
+
+  memset(&req, 0, sizeof(req));
+
+  while (read_request(conn, &req))
+  {
+    bool keep_going = handle_request(conn, &req);
+    request_free(&req);
+
+    if (!keep_going)
+    {
+      break;
+    }
+  }
+
+  request_free(&req);
+  connection_remove(conn->mock, conn->fd);
+  close(conn->fd);
+  free(conn->buffer);
+  free(conn);
+  return NULL;
+}
+
+static void *accept_thread(void *arg)
+{
+  s3mock_st *mock = arg;
+
+  for (;;)
+  {
+    struct s3mock_connection_st *conn;
+    pthread_t thread;
+    int flag = 1;
+    int fd = accept(mock->listen_fd, NULL, NULL);
+
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    pthread_mutex_lock(&mock->lock);
+
+    if (mock->stopping || mock->connection_count == S3MOCK_MAX_CONNECTIONS)
+    {
+      pthread_mutex_unlock(&mock->lock);
+      close(fd);
+
+      if (mock->stopping)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    mock->connections[mock->connection_count++] = fd;
+    pthread_mutex_unlock(&mock->lock);
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    conn = calloc(1, sizeof(struct s3mock_connection_st));
+    conn->mock = mock;
+    conn->fd = fd;
+
+    if (pthread_create(&thread, NULL, connection_thread, conn))
+    {
+      connection_remove(mock, fd);
+      close(fd);
+      free(conn);
+      continue;
+    }
+
+    pthread_detach(thread);
+  }
+
+  return NULL;
+}
+
+s3mock_st *s3mock_start(void)
+{
+  s3mock_st *mock = calloc(1, sizeof(s3mock_st));
+  struct sockaddr_in addr;
+  socklen_t addr_length = sizeof(addr);
+  int flag = 1;
+
+  mock->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (mock->listen_fd < 0)
+  {
+    free(mock);
+    return NULL;
+  }
+
+  setsockopt(mock->listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  if (bind(mock->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(mock->listen_fd, 128) ||
+      getsockname(mock->listen_fd, (struct sockaddr *)&addr, &addr_length))
+  {
+    close(mock->listen_fd);
+    free(mock);
+    return NULL;
+  }
+
+  mock->port = ntohs(addr.sin_port);
+  mock->max_keys = 1000;
+  mock->min_part_size = S3MOCK_DEFAULT_PART_SIZE;
+  mock->max_copy_size = S3MOCK_DEFAULT_MAX_COPY_SIZE;
+  mock->credential_lifetime = 3600;
+  pthread_mutex_init(&mock->lock, NULL);
+  pthread_cond_init(&mock->cond, NULL);
+  s3mock_add_credentials(mock, S3MOCK_KEY, S3MOCK_SECRET);
+
+  if (pthread_create(&mock->accept_thread, NULL, accept_thread, mock))
+  {
+    close(mock->listen_fd);
+    free(mock);
+    return NULL;
+  }
+
+  return mock;
+}
+
+void s3mock_stop(s3mock_st *mock)
+{
+  size_t pos;
+  struct s3mock_upload_st *upload;
+
+  if (!mock)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&mock->lock);
+  mock->stopping = true;
+  shutdown(mock->listen_fd, SHUT_RDWR);
+
+  for (pos = 0; pos < mock->connection_count; pos++)
+  {
+    shutdown(mock->connections[pos], SHUT_RDWR);
+  }
+
+  while (mock->connection_count)
+  {
+    pthread_cond_wait(&mock->cond, &mock->lock);
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+  pthread_join(mock->accept_thread, NULL);
+  close(mock->listen_fd);
+
+  for (pos = 0; pos < mock->object_count; pos++)
+  {
+    object_free(mock->objects[pos]);
+  }
+
+  upload = mock->uploads;
+
+  while (upload)
+  {
+    struct s3mock_upload_st *next = upload->next;
+    upload_free(upload);
+    upload = next;
+  }
+
+  for (pos = 0; pos < mock->credential_count; pos++)
+  {
+    free(mock->credentials[pos].key);
+    free(mock->credentials[pos].secret);
+  }
+
+  free(mock->objects);
+  pthread_mutex_destroy(&mock->lock);
+  pthread_cond_destroy(&mock->cond);
+  free(mock);
+}
+
+int s3mock_port(s3mock_st *mock)
+{
+  return mock->port;
+}
+
+ms3_st *s3mock_connect(s3mock_st *mock)
+{
+  ms3_st *ms3 = ms3_init(S3MOCK_KEY, S3MOCK_SECRET, S3MOCK_REGION, S3MOCK_HOST);
+
+  if (ms3)
+  {
+    int port = mock->port;
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+  return ms3;
+}
+
+void s3mock_set_latency(s3mock_st *mock, uint32_t latency_ms)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->latency_ms = latency_ms;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_set_throttle(s3mock_st *mock, size_t bytes_per_second)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->throttle = bytes_per_second;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_set_max_keys(s3mock_st *mock, size_t max_keys)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->max_keys = max_keys;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_set_min_part_size(s3mock_st *mock, size_t min_part_size)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->min_part_size = min_part_size;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_set_max_copy_size(s3mock_st *mock, uint64_t max_copy_size)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->max_copy_size = max_copy_size;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_set_chunked(s3mock_st *mock, bool chunked)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->chunked = chunked;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_inject_error(s3mock_st *mock, int status, const char *code,
+                         uint32_t count)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->error_status = status;
+  snprintf(mock->error_code, sizeof(mock->error_code), "%s", code);
+  mock->error_count = count;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+void s3mock_add_credentials(s3mock_st *mock, const char *key,
+                            const char *secret)
+{
+  pthread_mutex_lock(&mock->lock);
+
+  if (mock->credential_count < S3MOCK_MAX_CREDENTIALS)
+  {
+    mock->credentials[mock->credential_count].key = strdup(key);
+    mock->credentials[mock->credential_count].secret = strdup(secret);
+    mock->credential_count++;
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+}
+
+uint64_t s3mock_request_count(s3mock_st *mock)
+{
+  uint64_t ret;
+
+  pthread_mutex_lock(&mock->lock);
+  ret = mock->request_counter;
+  pthread_mutex_unlock(&mock->lock);
+  return ret;
+}
+
+uint64_t s3mock_method_count(s3mock_st *mock, const char *method)
+{
+  uint64_t ret = 0;
+  size_t method_it;
+
+  pthread_mutex_lock(&mock->lock);
+
+  for (method_it = 0; method_names[method_it]; method_it++)
+  {
+    if (!strcmp(method_names[method_it], method))
+    {
+      ret = mock->method_counters[method_it];
+    }
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+  return ret;
+}
+
+size_t s3mock_object_count(s3mock_st *mock)
+{
+  size_t ret;
+
+  pthread_mutex_lock(&mock->lock);
+  ret = mock->object_count;
+  pthread_mutex_unlock(&mock->lock);
+  return ret;
+}
+
+uint64_t s3mock_assume_role_count(s3mock_st *mock)
+{
+  uint64_t ret;
+
+  pthread_mutex_lock(&mock->lock);
+  ret = mock->assume_role_counter;
+  pthread_mutex_unlock(&mock->lock);
+  return ret;
+}
+
+void s3mock_set_credential_lifetime(s3mock_st *mock, int64_t seconds)
+{
+  pthread_mutex_lock(&mock->lock);
+  mock->credential_lifetime = seconds;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+uint64_t s3mock_metadata_count(s3mock_st *mock)
+{
+  uint64_t ret;
+
+  pthread_mutex_lock(&mock->lock);
+  ret = mock->metadata_counter;
+  pthread_mutex_unlock(&mock->lock);
+  return ret;
+}
@@ -0,0 +1,109 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#pragma once
+
+/* A loopback S3 stand-in for the regression suite and benchmarks.
+ * The server runs on threads inside the test process, listens on an
+ * ephemeral port on 127.0.0.1 and keeps all objects in memory. Requests are
+ * path style and must be correctly signed with S3MOCK_KEY / S3MOCK_SECRET.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libmarias3/marias3.h>
+
+#define S3MOCK_KEY "s3mockaccesskey01234"
+#define S3MOCK_SECRET "s3mocksecretkey0123456789012345678901234"
+#define S3MOCK_REGION "us-east-1"
+#define S3MOCK_HOST "127.0.0.1"
+// Expected from the instance metadata and container credential clients
+#define S3MOCK_IMDS_TOKEN "mockimdstoken"
+#define S3MOCK_ECS_TOKEN "mockecstoken"
+
+struct s3mock_st;
+typedef struct s3mock_st s3mock_st;
+
+/* Starts the server, returns NULL if it could not listen */
+s3mock_st *s3mock_start(void);
+
+/* Stops the server and frees everything it stored */
+void s3mock_stop(s3mock_st *mock);
+
+int s3mock_port(s3mock_st *mock);
+
+/* Creates an ms3_st handle pointed at the server */
+ms3_st *s3mock_connect(s3mock_st *mock);
+
+/* Delay in milliseconds added before every response */
+void s3mock_set_latency(s3mock_st *mock, uint32_t latency_ms);
+
+/* Limits response bodies to this many bytes per second, 0 is unlimited */
+void s3mock_set_throttle(s3mock_st *mock, size_t bytes_per_second);
+
+/* Page size for ListObjects, default 1000 */
+void s3mock_set_max_keys(s3mock_st *mock, size_t max_keys);
+
+/* Minimum size of every multipart part apart from the last, default 5MB */
+void s3mock_set_min_part_size(s3mock_st *mock, size_t min_part_size);
+
+/* Largest object a single CopyObject copies, default 5GB */
+void s3mock_set_max_copy_size(s3mock_st *mock, uint64_t max_copy_size);
+
+/* Sends the bodies of GETs with Transfer-Encoding: chunked instead of a
+ * Content-Length, default off. Throttling doesn't apply to them.
+ */
+void s3mock_set_chunked(s3mock_st *mock, bool chunked);
+
+/* Answers the next count requests with the given HTTP status and S3 error
+ * code instead of executing them
+ */
+void s3mock_inject_error(s3mock_st *mock, int status, const char *code,
+                         uint32_t count);
+
+/* Adds another access key / secret pair the server will accept */
+void s3mock_add_credentials(s3mock_st *mock, const char *key,
+                            const char *secret);
+
+/* Total number of requests received */
+uint64_t s3mock_request_count(s3mock_st *mock);
+
+/* Number of requests received with a given method, such as "HEAD" */
+uint64_t s3mock_method_count(s3mock_st *mock, const char *method);
+
+/* Number of objects currently stored */
+size_t s3mock_object_count(s3mock_st *mock);
+
+/* Number of STS AssumeRole requests answered. Send them by using
+ * "127.0.0.1:<port>" as the STS endpoint.
+ */
+uint64_t s3mock_assume_role_count(s3mock_st *mock);
+
+/* Number of credentials handed out by the instance metadata stand-in. It
+ * answers IMDSv2 with the server address as the endpoint, and container
+ * credentials at http://<server>/v2/credentials/<anything>.
+ */
+uint64_t s3mock_metadata_count(s3mock_st *mock);
+
+/* Seconds the credentials from AssumeRole and the metadata endpoints are
+ * valid for, default 3600
+ */
+void s3mock_set_credential_lifetime(s3mock_st *mock, int64_t seconds);
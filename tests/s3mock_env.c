@@ -0,0 +1,111 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+
+/* Runs a test program against the mock S3 server. Used as the LOG_COMPILER
+ * for "make check" so that the tests which need S3KEY etc. are run against
+ * the mock instead of being skipped. If S3KEY is already set the test is run
+ * as it is against whatever service that points to.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "tests/s3mock.h"
+
+int main(int argc, char *argv[])
+{
+  s3mock_st *mock;
+  pid_t pid;
+  int status;
+  char port[16];
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s test [args]\n", argv[0]);
+    return 1;
+  }
+
+  if (getenv("S3KEY"))
+  {
+    execv(argv[1], argv + 1);
+    perror(argv[1]);
+    return 1;
+  }
+
+  mock = s3mock_start();
+
+  if (!mock)
+  {
+    fprintf(stderr, "Could not start the mock S3 server\n");
+    return 1;
+  }
+
+  snprintf(port, sizeof(port), "%d", s3mock_port(mock));
+  setenv("S3KEY", S3MOCK_KEY, 1);
+  setenv("S3SECRET", S3MOCK_SECRET, 1);
+  setenv("S3REGION", S3MOCK_REGION, 1);
+  setenv("S3BUCKET", "s3mock", 1);
+  setenv("S3HOST", S3MOCK_HOST, 1);
+  setenv("S3USEHTTP", "1", 1);
+  setenv("S3PORT", port, 1);
+
+  pid = fork();
+
+  if (pid < 0)
+  {
+    perror("fork");
+    s3mock_stop(mock);
+    return 1;
+  }
+
+  if (!pid)
+  {
+    execv(argv[1], argv + 1);
+    perror(argv[1]);
+    _exit(1);
+  }
+
+  while (waitpid(pid, &status, 0) < 0)
+  {
+    if (errno != EINTR)
+    {
+      perror("waitpid");
+      s3mock_stop(mock);
+      return 1;
+    }
+  }
+
+  s3mock_stop(mock);
+
+  if (WIFSIGNALED(status))
+  {
+    fprintf(stderr, "%s killed by signal %d\n", argv[1], WTERMSIG(status));
+    return 1;
+  }
+
+  // Skips (77) are passed through to the test driver
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,120 @@
+/* vim:expandtab:shiftwidth=2:tabstop=2:smarttab:
+ * Copyright 2026 MariaDB Corporation Ab. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+#include <yatl/lite.h>
+#include <libmarias3/marias3.h>
+
+/* Tests checking the status of many keys with parallel HEAD requests */
+
+#define KEY_COUNT 50
+
+int main(int argc, char *argv[])
+{
+  int res;
+  size_t key_it;
+  size_t max_parallel = 4;
+  ms3_st *ms3;
+  char *keys[KEY_COUNT + 1];
+  ms3_status_st statuses[KEY_COUNT + 1];
+  uint8_t results[KEY_COUNT + 1];
+  char missing_key[] = "test/status_many/missing";
+  const uint8_t *test_string = (const uint8_t *)"Another one bites the dust";
+  char *s3key = getenv("S3KEY");
+  char *s3secret = getenv("S3SECRET");
+  char *s3region = getenv("S3REGION");
+  char *s3bucket = getenv("S3BUCKET");
+  char *s3host = getenv("S3HOST");
+  char *s3noverify = getenv("S3NOVERIFY");
+  char *s3usehttp = getenv("S3USEHTTP");
+  char *s3port = getenv("S3PORT");
+
+  SKIP_IF_(!s3key, "Environemnt variable S3KEY missing");
+  SKIP_IF_(!s3secret, "Environemnt variable S3SECRET missing");
+  SKIP_IF_(!s3region, "Environemnt variable S3REGION missing");
+  SKIP_IF_(!s3bucket, "Environemnt variable S3BUCKET missing");
+
+  (void) argc;
+  (void) argv;
+
+  ms3_library_init();
+  ms3 = ms3_init(s3key, s3secret, s3region, s3host);
+
+  if (s3noverify && !strcmp(s3noverify, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_DISABLE_SSL_VERIFY, NULL);
+  }
+
+  if (s3usehttp && !strcmp(s3usehttp, "1"))
+  {
+    ms3_set_option(ms3, MS3_OPT_USE_HTTP, NULL);
+  }
+
+  if (s3port)
+  {
+    int port = atoi(s3port);
+    ms3_set_option(ms3, MS3_OPT_PORT_NUMBER, &port);
+  }
+
+//  ms3_debug(true);
+  ASSERT_NOT_NULL(ms3);
+  ASSERT_EQ(0, ms3_set_option(ms3, MS3_OPT_MAX_PARALLEL, &max_parallel));
+
+  // Each key has a different length so the statuses can't be mixed up
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    keys[key_it] = malloc(64);
+    snprintf(keys[key_it], 64, "test/status_many/%zu", key_it);
+    res = ms3_put(ms3, s3bucket, keys[key_it], test_string,
+                  key_it % strlen((const char *)test_string) + 1);
+    ASSERT_EQ_(res, 0, "Result: %u", res);
+  }
+
+  // A missing key only fails that key
+  keys[KEY_COUNT] = missing_key;
+  res = ms3_status_many(ms3, s3bucket, (const char **)keys, KEY_COUNT + 1,
+                        statuses, results);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    ASSERT_EQ_(results[key_it], 0, "Key %zu result: %u", key_it,
+               results[key_it]);
+    ASSERT_EQ(statuses[key_it].length,
+              key_it % strlen((const char *)test_string) + 1);
+    ASSERT_NEQ(statuses[key_it].created, 0);
+  }
+
+  ASSERT_EQ(results[KEY_COUNT], MS3_ERR_NOT_FOUND);
+  ASSERT_EQ(statuses[KEY_COUNT].length, 0);
+
+  // No keys is not an error
+  res = ms3_status_many(ms3, s3bucket, NULL, 0, NULL, NULL);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  res = ms3_delete_many(ms3, s3bucket, (const char **)keys, KEY_COUNT, NULL);
+  ASSERT_EQ_(res, 0, "Result: %u", res);
+
+  for (key_it = 0; key_it < KEY_COUNT; key_it++)
+  {
+    free(keys[key_it]);
+  }
+
+  ms3_deinit(ms3);
+  ms3_library_deinit();
+  return 0;
+}